@@ -16,6 +16,7 @@
 #define MARKER_DQT  0xFFDB  /* Define Quantization Table */
 #define MARKER_SOS  0xFFDA  /* Start of Scan */
 #define MARKER_APP0 0xFFE0  /* Application Segment 0 (JFIF) */
+#define MARKER_APP1 0xFFE1  /* Application Segment 1 (EXIF) */
 #define MARKER_DRI  0xFFDD  /* Define Restart Interval */
 #define MARKER_RST0 0xFFD0  /* Restart Marker 0 */
 #define MARKER_RST7 0xFFD7  /* Restart Marker 7 */
@@ -25,14 +26,26 @@
 #define MAX_COMPONENTS 3
 #define MAX_HUFFMAN_TABLES 4
 #define MAX_QUANT_TABLES 4
+#define MAX_DECODE_THREADS 64
 #define BLOCK_SIZE 64
 
 /* Quantization table (8x8 = 64 coefficients) */
 typedef struct {
     uint8_t table[BLOCK_SIZE];
+    /* Dequantization multipliers with the AAN IDCT scale factors folded in,
+     * filled in by parse_dqt (idct_prepare_quant_table) */
+    int16_t ifast_multipliers[BLOCK_SIZE];
+    float float_multipliers[BLOCK_SIZE];
     bool is_set;
 } quantization_table_t;
 
+/* Inverse DCT algorithm of the 8x8 blocks */
+typedef enum {
+    IDCT_ISLOW,     /* Accurate integer (LL&M, libjpeg's JDCT_ISLOW) */
+    IDCT_IFAST,     /* AAN with 8-bit fixed-point multipliers */
+    IDCT_FLOAT      /* AAN in single-precision float (SSE2 when available) */
+} idct_method_t;
+
 /* Fast Huffman lookup table entry */
 #define HUFF_LOOKAHEAD 8  /* Number of bits for fast lookup */
 
@@ -52,6 +65,7 @@ typedef struct {
     huffman_lookup_t lookup[1 << HUFF_LOOKAHEAD];  /* 256 entries */
 
     bool is_set;
+    bool codes_generated;       /* codes and lookup are built from bits/huffval */
 } huffman_table_t;
 
 /* Component information (Y, Cb, Cr) */
@@ -83,8 +97,44 @@ typedef struct {
     int bits_in_buffer;         /* Number of bits currently in buffer */
 } bit_reader_t;
 
-/* JPEG decoder state */
+/* Pixel layouts the color stage can write */
+typedef enum {
+    JPEG_PIXEL_GRAY8,           /* Luma only, 1 byte */
+    JPEG_PIXEL_RGB24,           /* R, G, B */
+    JPEG_PIXEL_RGBX32,          /* R, G, B, 255 (SDL_PIXELFORMAT_RGBA32) */
+    JPEG_PIXEL_BGRX32           /* B, G, R, 255 (SDL_PIXELFORMAT_BGRA32) */
+} jpeg_pixel_format_t;
+
+/* Timings of one decode, in microseconds. Stage times of threaded stages
+ * are summed over the threads that ran them. */
 typedef struct {
+    double huffman_time_us;     /* Entropy decoding */
+    double idct_time_us;        /* Dequantization, IDCT and block stores */
+    double upsample_time_us;    /* Chroma upsampling */
+    double color_time_us;       /* YCbCr to RGB (with upsampling when threaded) */
+    unsigned long blocks;       /* Blocks entropy-decoded with coefficients */
+    unsigned long dc_only_blocks; /* ... of which the first AC symbol was EOB */
+    /* Huffman tables installed for the decode, counted when installed (by
+     * the parser or the decode): taken ready-built (the compiled-in Annex K
+     * tables, or a DHT repeating the previous frame's) or built from BITS
+     * and HUFFVAL */
+    unsigned long huffman_tables_reused;
+    unsigned long huffman_tables_built;
+} jpeg_decode_stats_t;
+
+/* Hardware performance counters of one thread, attributed to decode stages
+ * (see src/perf.h) */
+typedef struct perf_profile perf_profile_t;
+
+/* Called by jpeg_decode after each MCU row with the range of image rows
+ * [first_row, first_row + num_rows) whose component samples are now final.
+ * A non-zero return aborts the decode. */
+struct jpeg_decoder;
+typedef int (*jpeg_row_callback_t)(struct jpeg_decoder *decoder,
+                                   int first_row, int num_rows, void *user_data);
+
+/* JPEG decoder state */
+typedef struct jpeg_decoder {
     /* File data */
     uint8_t *data;              /* Raw JPEG file data */
     size_t data_size;           /* Size of file data */
@@ -126,31 +176,58 @@ typedef struct {
 
     /* Restart interval */
     uint16_t restart_interval;  /* Number of MCUs between restart markers */
+
+    /* Embedded EXIF thumbnail (a complete JPEG stream inside data) */
+    size_t exif_thumbnail_offset;
+    size_t exif_thumbnail_size;     /* 0 if the file has none */
+
+    /* Replicate chroma samples instead of triangle-filtering them */
+    bool fast_upsampling;
+
+    /* Decode h2v1/h2v2 chroma with 16x8/16x16 scaled IDCTs straight into
+     * full-resolution planes. Cleared by jpeg_decode for other layouts, so
+     * afterwards it tells whether the chroma planes are already upsampled. */
+    bool idct_upsampling;
+
+    /* Grayscale output of color images: chroma blocks are entropy-decoded
+     * only to advance the bit stream (no dequantization, IDCT or storage)
+     * and the Y plane is emitted as-is */
+    bool luma_only;
+
+    /* 8x8 IDCT; the scaled chroma IDCTs of idct_upsampling are always accurate */
+    idct_method_t idct_method;
+
+    /* Above 1: entropy-decode on the calling thread and run IDCT (and, with
+     * no row_callback, RGB conversion) of finished MCU rows on
+     * decode_threads - 1 workers */
+    int decode_threads;
+
+    /* Caller-provided destination of the color stage (jpeg_decode_into);
+     * NULL means ycbcr_to_rgb allocates image_data */
+    uint8_t *output_pixels;
+    size_t output_stride;
+    jpeg_pixel_format_t output_format;
+    bool output_converted;      /* The decode pipeline already filled output_pixels */
+
+    /* Timings of the last jpeg_decode / ycbcr_to_rgb */
+    jpeg_decode_stats_t stats;
+
+    /* Counter profile of the calling thread (NULL = off). While set, the
+     * decode runs single-threaded and stage by stage per MCU row. */
+    perf_profile_t *perf;
+
+    /* Optional streaming consumer of decoded rows */
+    jpeg_row_callback_t row_callback;
+    void *row_callback_data;
+
+    /* Set by jpeg_decode_cancel from another thread; read between MCU rows */
+    int cancel_requested;
 } jpeg_decoder_t;
 
-/* Zigzag scan order for 8x8 blocks */
 /* Zigzag scan order - maps zigzag position to natural (row-major) position */
-static const int jpeg_natural_order[BLOCK_SIZE] = {
-     0,  1,  8, 16,  9,  2,  3, 10,
-    17, 24, 32, 25, 18, 11,  4,  5,
-    12, 19, 26, 33, 40, 48, 41, 34,
-    27, 20, 13,  6,  7, 14, 21, 28,
-    35, 42, 49, 56, 57, 50, 43, 36,
-    29, 22, 15, 23, 30, 37, 44, 51,
-    58, 59, 52, 45, 38, 31, 39, 46,
-    53, 60, 61, 54, 47, 55, 62, 63
-};
+extern const int jpeg_natural_order[BLOCK_SIZE];
 
 /* Inverse zigzag - maps natural position to zigzag position */
-static const int zigzag[BLOCK_SIZE] = {
-     0,  1,  5,  6, 14, 15, 27, 28,
-     2,  4,  7, 13, 16, 26, 29, 42,
-     3,  8, 12, 17, 25, 30, 41, 43,
-     9, 11, 18, 24, 31, 40, 44, 53,
-    10, 19, 23, 32, 39, 45, 52, 54,
-    20, 22, 33, 38, 46, 51, 55, 60,
-    21, 34, 37, 47, 50, 56, 59, 61,
-    35, 36, 48, 49, 57, 58, 62, 63
-};
+extern const int jpeg_zigzag_order[BLOCK_SIZE];
 
 #endif /* JPEG_TYPES_H */
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L  /* strdup, strcasecmp, dirent */
+#include "browser.h"
+#include "image_cache.h"
+#include "display.h"
+#include "utils.h"
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char **paths;
+    int count;
+    int current;
+    image_cache_t *cache;
+} browser_t;
+
+/* Case-insensitive check for a JPEG file extension */
+static int has_jpeg_extension(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) {
+        return 0;
+    }
+    return strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0 ||
+           strcasecmp(dot, ".jpe") == 0 || strcasecmp(dot, ".jfif") == 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Append a path to a growable list */
+static void append_path(char ***paths, int *count, int *capacity, const char *path) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        char **grown = (char**)jpeg_malloc(*capacity * sizeof(char*));
+        if (*paths) {
+            memcpy(grown, *paths, *count * sizeof(char*));
+            jpeg_free(*paths);
+        }
+        *paths = grown;
+    }
+    (*paths)[(*count)++] = strdup(path);
+}
+
+/* Add the JPEG files of one directory, sorted by name */
+static void collect_directory(const char *dir_path, char ***paths, int *count, int *capacity) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "Cannot open directory: %s\n", dir_path);
+        return;
+    }
+
+    int first = *count;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.' || !has_jpeg_extension(ent->d_name)) {
+            continue;
+        }
+
+        size_t len = strlen(dir_path) + strlen(ent->d_name) + 2;
+        char *full = (char*)jpeg_malloc(len);
+        snprintf(full, len, "%s/%s", dir_path, ent->d_name);
+
+        struct stat st;
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode)) {
+            append_path(paths, count, capacity, full);
+        }
+        jpeg_free(full);
+    }
+    closedir(dir);
+
+    qsort(*paths + first, *count - first, sizeof(char*), compare_paths);
+}
+
+/* Expand inputs into a list of JPEG files */
+int collect_image_paths(char **inputs, int num_inputs, char ***paths_out) {
+    char **paths = NULL;
+    int count = 0;
+    int capacity = 0;
+
+    for (int i = 0; i < num_inputs; i++) {
+        struct stat st;
+        if (stat(inputs[i], &st) != 0) {
+            fprintf(stderr, "Cannot open file: %s\n", inputs[i]);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            collect_directory(inputs[i], &paths, &count, &capacity);
+        } else {
+            append_path(&paths, &count, &capacity, inputs[i]);
+        }
+    }
+
+    *paths_out = paths;
+    return count;
+}
+
+void free_image_paths(char **paths, int count) {
+    for (int i = 0; i < count; i++) {
+        free(paths[i]);  /* Allocated by strdup */
+    }
+    jpeg_free(paths);
+}
+
+/* Put an acquired image on screen with a descriptive window title */
+static int apply_image(browser_t *browser, display_t *display, int index,
+                       const decoded_image_t *image) {
+    const char *name = strrchr(browser->paths[index], '/');
+    name = name ? name + 1 : browser->paths[index];
+
+    char title[512];
+    snprintf(title, sizeof(title), "JPEG Viewer - %s (%d/%d) - %dx%d",
+             name, index + 1, browser->count, image->width, image->height);
+
+    return display_set_image(display, image->pixels, image->width, image->height,
+                             image->channels, title);
+}
+
+/* Show image at index; on failure the current image stays up */
+static int show_image(browser_t *browser, display_t *display, int index) {
+    const decoded_image_t *image = image_cache_acquire(browser->cache, index);
+    if (!image) {
+        fprintf(stderr, "Failed to decode %s\n", browser->paths[index]);
+        return -1;
+    }
+
+    if (apply_image(browser, display, index, image) != 0) {
+        image_cache_release(browser->cache, index);
+        return -1;
+    }
+
+    /* The display now references the new image; the old one may be evicted */
+    image_cache_release(browser->cache, browser->current);
+    browser->current = index;
+
+    image_cache_prefetch(browser->cache, index);
+    return 0;
+}
+
+/* Navigation key handler; undecodable files are skipped in the direction of travel */
+static void on_key(display_t *display, display_key_t key, void *user_data) {
+    browser_t *browser = (browser_t*)user_data;
+    int target = browser->current;
+    int step = 1;
+
+    switch (key) {
+        case DISPLAY_KEY_NEXT:  target = browser->current + 1; step = 1; break;
+        case DISPLAY_KEY_PREV:  target = browser->current - 1; step = -1; break;
+        case DISPLAY_KEY_FIRST: target = 0; step = 1; break;
+        case DISPLAY_KEY_LAST:  target = browser->count - 1; step = -1; break;
+    }
+
+    while (target >= 0 && target < browser->count && target != browser->current) {
+        if (show_image(browser, display, target) == 0) {
+            return;
+        }
+        target += step;
+    }
+}
+
+/* Browse a list of images */
+int browse_images(char **paths, int count, const browse_options_t *options) {
+    browser_t browser;
+    browser.paths = paths;
+    browser.count = count;
+    browser.cache = image_cache_create(paths, count, options->cache_budget_bytes,
+                                       options->prefetch_threads, options->prefetch_radius);
+
+    JPEG_LOG("Browsing %d images (cache %zu MB, %d prefetch thread(s), radius %d)\n",
+             count, options->cache_budget_bytes >> 20,
+             options->prefetch_threads, options->prefetch_radius);
+
+    /* Find the first image that decodes */
+    const decoded_image_t *image = NULL;
+    for (browser.current = 0; browser.current < count; browser.current++) {
+        image = image_cache_acquire(browser.cache, browser.current);
+        if (image) {
+            break;
+        }
+        fprintf(stderr, "Failed to decode %s\n", paths[browser.current]);
+    }
+
+    if (!image) {
+        fprintf(stderr, "No decodable images\n");
+        image_cache_destroy(browser.cache);
+        return -1;
+    }
+
+    image_cache_prefetch(browser.cache, browser.current);
+
+    display_t *display = display_create(image->pixels, image->width,
+                                        image->height, image->channels);
+    if (!display) {
+        image_cache_destroy(browser.cache);
+        return -1;
+    }
+
+    apply_image(&browser, display, browser.current, image);
+
+    display_set_key_handler(display, on_key, &browser);
+    JPEG_LOG("Use Left/Right (or Page Up/Down, Home/End) to step through images\n");
+
+    int result = display_run(display);
+
+    JPEG_LOG("Cache held %zu MB at exit\n", image_cache_bytes(browser.cache) >> 20);
+
+    display_destroy(display);
+    image_cache_release(browser.cache, browser.current);
+    image_cache_destroy(browser.cache);
+    return result;
+}
@@ -0,0 +1,23 @@
+#ifndef BROWSER_H
+#define BROWSER_H
+
+#include <stddef.h>
+
+/* Multi-image browsing options */
+typedef struct {
+    size_t cache_budget_bytes;  /* Decoded pixel memory kept in the LRU cache */
+    int prefetch_threads;       /* Background decode threads (0 = no prefetch) */
+    int prefetch_radius;        /* Neighbors decoded ahead on each side */
+} browse_options_t;
+
+/* Expand files and directories into a sorted list of JPEG file paths.
+ * Returns the number of paths (0 if none); free with free_image_paths. */
+int collect_image_paths(char **inputs, int num_inputs, char ***paths_out);
+
+/* Free a list returned by collect_image_paths */
+void free_image_paths(char **paths, int count);
+
+/* Open a window and step through the images with the arrow keys */
+int browse_images(char **paths, int count, const browse_options_t *options);
+
+#endif /* BROWSER_H */
@@ -0,0 +1,246 @@
+#include "coef_store.h"
+#include "decoder.h"
+#include "dct.h"
+#include "color.h"
+#include "utils.h"
+
+/* Entry header: zero run before the coefficient, and whether its value
+ * takes two bytes (otherwise one, signed) */
+#define ENTRY_RUN_MASK 0x3F
+#define ENTRY_LONG 0x40
+
+/* One component's blocks, coded in scan order: MCU row by MCU row, within
+ * a row MCU by MCU, within an MCU rows of blocks top to bottom */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    size_t *row_starts;         /* Offset of each MCU row in data */
+    int h_sampling;
+    int v_sampling;
+} coef_component_t;
+
+struct coef_store {
+    frame_header_t frame;
+    quantization_table_t quant_tables[MAX_QUANT_TABLES];
+    int mcu_width;
+    int mcu_height;
+    int max_h_sampling;
+    int max_v_sampling;
+    size_t blocks;
+    coef_component_t components[MAX_COMPONENTS];
+};
+
+static void ensure_capacity(coef_component_t *comp, size_t extra) {
+    if (comp->size + extra <= comp->capacity) {
+        return;
+    }
+
+    size_t capacity = comp->capacity ? comp->capacity : 4096;
+    while (capacity < comp->size + extra) {
+        capacity *= 2;
+    }
+
+    uint8_t *grown = (uint8_t*)jpeg_malloc(capacity);
+    if (comp->size > 0) {
+        memcpy(grown, comp->data, comp->size);
+    }
+    jpeg_free(comp->data);
+    comp->data = grown;
+    comp->capacity = capacity;
+}
+
+/* jpeg_for_each_block callback: append one block */
+static int append_block(int component, int block_x, int block_y,
+                        const int16_t *block, void *user_data) {
+    coef_store_t *store = (coef_store_t*)user_data;
+    coef_component_t *comp = &store->components[component];
+
+    if (block_x == 0 && block_y % comp->v_sampling == 0) {
+        comp->row_starts[block_y / comp->v_sampling] = comp->size;
+    }
+
+    /* Count byte, then at most 3 bytes per coefficient */
+    ensure_capacity(comp, 1 + 3 * BLOCK_SIZE);
+    uint8_t *count = comp->data + comp->size;
+    uint8_t *out = count + 1;
+    *count = 0;
+
+    int run = 0;
+    for (int k = 0; k < BLOCK_SIZE; k++) {
+        int value = block[jpeg_natural_order[k]];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+        if (value >= -128 && value <= 127) {
+            *out++ = (uint8_t)run;
+            *out++ = (uint8_t)(int8_t)value;
+        } else {
+            *out++ = (uint8_t)(run | ENTRY_LONG);
+            *out++ = (uint8_t)(value & 0xFF);
+            *out++ = (uint8_t)((value >> 8) & 0xFF);
+        }
+        (*count)++;
+        run = 0;
+    }
+
+    comp->size = out - comp->data;
+    store->blocks++;
+    return 0;
+}
+
+/* Expand the block at data into a zeroed natural-order block; returns the
+ * bytes consumed */
+static size_t expand_block(const uint8_t *data, int16_t *block) {
+    const uint8_t *in = data;
+    int count = *in++;
+    int k = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint8_t entry = *in++;
+        k += entry & ENTRY_RUN_MASK;
+        int value;
+        if (entry & ENTRY_LONG) {
+            value = (int16_t)(in[0] | (in[1] << 8));
+            in += 2;
+        } else {
+            value = (int8_t)in[0];
+            in++;
+        }
+        block[jpeg_natural_order[k++]] = (int16_t)value;
+    }
+    return in - data;
+}
+
+coef_store_t* coef_store_read(jpeg_decoder_t *decoder) {
+    coef_store_t *store = (coef_store_t*)jpeg_malloc(sizeof(coef_store_t));
+    memset(store, 0, sizeof(coef_store_t));
+    store->frame = decoder->frame;
+    memcpy(store->quant_tables, decoder->quant_tables, sizeof(store->quant_tables));
+    store->mcu_width = decoder->mcu_width;
+    store->mcu_height = decoder->mcu_height;
+    store->max_h_sampling = decoder->max_h_sampling;
+    store->max_v_sampling = decoder->max_v_sampling;
+
+    for (int c = 0; c < decoder->frame.num_components; c++) {
+        coef_component_t *comp = &store->components[c];
+        comp->h_sampling = decoder->frame.components[c].h_sampling;
+        comp->v_sampling = decoder->frame.components[c].v_sampling;
+        comp->row_starts = (size_t*)jpeg_malloc(decoder->mcu_height * sizeof(size_t));
+    }
+
+    jpeg_reset_stats(decoder);
+    if (jpeg_for_each_block(decoder, append_block, store) != 0) {
+        coef_store_destroy(store);
+        return NULL;
+    }
+    return store;
+}
+
+void coef_store_scaled_size(const coef_store_t *store, int scale, int *width, int *height) {
+    *width = (store->frame.width + scale - 1) / scale;
+    *height = (store->frame.height + scale - 1) / scale;
+}
+
+int coef_store_render(const coef_store_t *store, int scale, idct_method_t idct_method,
+                      bool fast_upsampling, decoded_image_t *image) {
+    idct_fn idct;
+    switch (scale) {
+        case 1:  idct = idct_select(idct_method); break;
+        case 2:  idct = idct_4x4; break;
+        case 4:  idct = idct_2x2; break;
+        case 8:  idct = idct_1x1; break;
+        default:
+            fprintf(stderr, "Unsupported scale: 1/%d (expected 1, 2, 4 or 8)\n", scale);
+            return -1;
+    }
+    int size = 8 / scale;       /* Samples per block side */
+
+    /* A decoder that only describes the scaled planes, for the color stage */
+    jpeg_decoder_t *view = (jpeg_decoder_t*)jpeg_malloc(sizeof(jpeg_decoder_t));
+    memset(view, 0, sizeof(jpeg_decoder_t));
+    view->frame = store->frame;
+    coef_store_scaled_size(store, scale, &image->width, &image->height);
+    view->frame.width = (uint16_t)image->width;
+    view->frame.height = (uint16_t)image->height;
+    view->mcu_width = store->mcu_width;
+    view->mcu_height = store->mcu_height;
+    view->mcu_size_x = store->max_h_sampling * size;
+    view->mcu_size_y = store->max_v_sampling * size;
+    view->max_h_sampling = store->max_h_sampling;
+    view->max_v_sampling = store->max_v_sampling;
+    view->fast_upsampling = fast_upsampling;
+    view->decode_threads = 1;
+
+    for (int c = 0; c < store->frame.num_components; c++) {
+        const coef_component_t *comp = &store->components[c];
+        const quantization_table_t *quant =
+            &store->quant_tables[store->frame.components[c].quant_table_id];
+        int width = store->mcu_width * comp->h_sampling * size;
+        int height = store->mcu_height * comp->v_sampling * size;
+        uint8_t *plane = (uint8_t*)jpeg_malloc((size_t)width * height);
+        view->component_buffers[c] = plane;
+        view->component_width[c] = width;
+        view->component_height[c] = height;
+
+        for (int mcu_row = 0; mcu_row < store->mcu_height; mcu_row++) {
+            const uint8_t *in = comp->data + comp->row_starts[mcu_row];
+            for (int mcu_col = 0; mcu_col < store->mcu_width; mcu_col++) {
+                for (int v = 0; v < comp->v_sampling; v++) {
+                    for (int h = 0; h < comp->h_sampling; h++) {
+                        int16_t block[BLOCK_SIZE];
+                        uint8_t samples[BLOCK_SIZE];
+                        memset(block, 0, sizeof(block));
+                        in += expand_block(in, block);
+                        idct(block, quant, samples);
+
+                        int x = (mcu_col * comp->h_sampling + h) * size;
+                        int y = (mcu_row * comp->v_sampling + v) * size;
+                        for (int row = 0; row < size; row++) {
+                            memcpy(plane + (size_t)(y + row) * width + x,
+                                   samples + row * size, size);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    int result = ycbcr_to_rgb(view);
+    if (result == 0) {
+        image->pixels = view->image_data;
+        image->channels = view->channels;
+        view->image_data = NULL;
+    }
+
+    for (int c = 0; c < store->frame.num_components; c++) {
+        jpeg_free(view->component_buffers[c]);
+    }
+    jpeg_free(view->image_data);
+    jpeg_free(view);
+    return result;
+}
+
+size_t coef_store_bytes(const coef_store_t *store) {
+    size_t bytes = 0;
+    for (int c = 0; c < store->frame.num_components; c++) {
+        bytes += store->components[c].size;
+    }
+    return bytes;
+}
+
+size_t coef_store_blocks(const coef_store_t *store) {
+    return store->blocks;
+}
+
+void coef_store_destroy(coef_store_t *store) {
+    if (!store) {
+        return;
+    }
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        jpeg_free(store->components[c].data);
+        jpeg_free(store->components[c].row_starts);
+    }
+    jpeg_free(store);
+}
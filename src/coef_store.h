@@ -0,0 +1,37 @@
+#ifndef COEF_STORE_H
+#define COEF_STORE_H
+
+#include "../include/jpeg_types.h"
+#include "image_cache.h"
+
+/* Quantized coefficients of a whole image, kept after a single entropy
+ * decode so the image can be reconstructed again (at another scale, with
+ * another IDCT) without touching the bit stream. Blocks are run-length
+ * coded: a count of nonzero coefficients, then per coefficient its zero run
+ * in zigzag order and a 1- or 2-byte value, so a flat block costs a few
+ * bytes instead of 128. The store holds copies of the frame header and
+ * quantization tables and outlives the decoder it was read from. */
+typedef struct coef_store coef_store_t;
+
+/* Entropy-decode a parsed decoder's scan into a new store. Returns NULL if
+ * the scan fails to decode. */
+coef_store_t* coef_store_read(jpeg_decoder_t *decoder);
+
+/* Reconstruct the image at 1/scale of its size (scale 1, 2, 4 or 8; the
+ * reduced IDCTs produce 4x4, 2x2 or 1x1 blocks) into image->pixels,
+ * tightly packed RGB or grayscale, freed with jpeg_free. idct_method
+ * applies at full size. Returns -1 for an unsupported scale or component
+ * count. */
+int coef_store_render(const coef_store_t *store, int scale, idct_method_t idct_method,
+                      bool fast_upsampling, decoded_image_t *image);
+
+/* Image size at 1/scale: each side rounded up */
+void coef_store_scaled_size(const coef_store_t *store, int scale, int *width, int *height);
+
+/* Bytes of coded coefficients held, and the number of blocks they code */
+size_t coef_store_bytes(const coef_store_t *store);
+size_t coef_store_blocks(const coef_store_t *store);
+
+void coef_store_destroy(coef_store_t *store);
+
+#endif /* COEF_STORE_H */
@@ -1,245 +1,435 @@
 #include "color.h"
+#include "perf.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "upsample.h"
 #include "utils.h"
 #include <string.h>
 #include <sys/time.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static double get_time_us(void) {
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000000.0 + tv.tv_usec;
 }
 
-/* Convert YCbCr to RGB */
-int ycbcr_to_rgb(jpeg_decoder_t *decoder) {
-    printf("\nConverting YCbCr to RGB...\n");
+/* Fixed-point coefficients (scaled by 2^16) from libjpeg */
+#define SCALEBITS 16
+#define ONE_HALF  (1 << (SCALEBITS-1))
+#define FIX(x)  ((int)((x) * (1L << SCALEBITS) + 0.5))
+
+/* Convert one row of full-resolution Y, Cb, Cr samples to pixels of
+ * pixel_size bytes with R, G, B at the given offsets (and 255 at filler,
+ * unless it is negative). Inlined per pixel format by convert_row, so the
+ * offsets are constants in each copy. */
+static inline void convert_row_layout(const uint8_t *y_row, const uint8_t *cb_row,
+                                      const uint8_t *cr_row, uint8_t *out, int width,
+                                      int pixel_size, int r_pos, int g_pos, int b_pos,
+                                      int filler) {
+    const int cr_r = FIX(1.40200);    /* 91881 */
+    const int cb_g = FIX(0.34414);    /* 22554 */
+    const int cr_g = FIX(0.71414);    /* 46802 */
+    const int cb_b = FIX(1.77200);    /* 116130 */
 
-    double t_start, t_end;
-    double upsample_time = 0.0, convert_time = 0.0;
+    for (int x = 0; x < width; x++, out += pixel_size) {
+        int y_val = y_row[x];
+        int cb_val = cb_row[x] - 128;
+        int cr_val = cr_row[x] - 128;
+
+        /* YCbCr to RGB conversion using fixed-point arithmetic */
+        int r = y_val + ((cr_r * cr_val + ONE_HALF) >> SCALEBITS);
+        int g = y_val - ((cb_g * cb_val + cr_g * cr_val + ONE_HALF) >> SCALEBITS);
+        int b = y_val + ((cb_b * cb_val + ONE_HALF) >> SCALEBITS);
+
+        /* Clamp to [0, 255] and store */
+        out[r_pos] = clamp(r, 0, 255);
+        out[g_pos] = clamp(g, 0, 255);
+        out[b_pos] = clamp(b, 0, 255);
+        if (filler >= 0) {
+            out[filler] = 255;
+        }
+    }
+}
 
-    decoder->width = decoder->frame.width;
-    decoder->height = decoder->frame.height;
-    decoder->channels = decoder->frame.num_components;
-
-    /* Handle grayscale (1 component) */
-    if (decoder->frame.num_components == 1) {
-        printf("Grayscale image detected\n");
-        size_t size = decoder->width * decoder->height;
-        decoder->image_data = (uint8_t*)jpeg_malloc(size);
-
-        /* Copy Y component directly */
-        for (int y = 0; y < decoder->height; y++) {
-            for (int x = 0; x < decoder->width; x++) {
-                decoder->image_data[y * decoder->width + x] =
-                    decoder->component_buffers[0][y * decoder->component_width[0] + x];
-            }
+static void convert_row(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row,
+                        uint8_t *out, int width, jpeg_pixel_format_t format) {
+    switch (format) {
+        case JPEG_PIXEL_RGBX32:
+            convert_row_layout(y_row, cb_row, cr_row, out, width, 4, 0, 1, 2, 3);
+            break;
+        case JPEG_PIXEL_BGRX32:
+            convert_row_layout(y_row, cb_row, cr_row, out, width, 4, 2, 1, 0, 3);
+            break;
+        default:
+            convert_row_layout(y_row, cb_row, cr_row, out, width, 3, 0, 1, 2, -1);
+            break;
+    }
+}
+
+/* Write one row of luma as gray pixels of the given format */
+static void gray_row(const uint8_t *y_row, uint8_t *out, int width, jpeg_pixel_format_t format) {
+    int pixel_size = jpeg_pixel_size(format);
+
+    if (pixel_size == 1) {
+        memcpy(out, y_row, width);
+        return;
+    }
+    for (int x = 0; x < width; x++, out += pixel_size) {
+        out[0] = out[1] = out[2] = y_row[x];
+        if (pixel_size == 4) {
+            out[3] = 255;
         }
+    }
+}
+
+int jpeg_pixel_size(jpeg_pixel_format_t format) {
+    switch (format) {
+        case JPEG_PIXEL_GRAY8:  return 1;
+        case JPEG_PIXEL_RGB24:  return 3;
+        case JPEG_PIXEL_RGBX32:
+        case JPEG_PIXEL_BGRX32: return 4;
+    }
+    return 0;
+}
+
+/* GRAY8 for grayscale images and luma-only decodes, RGB24 otherwise */
+static jpeg_pixel_format_t native_format(const jpeg_decoder_t *decoder) {
+    return (decoder->frame.num_components == 1 || decoder->luma_only)
+        ? JPEG_PIXEL_GRAY8 : JPEG_PIXEL_RGB24;
+}
+
+/* Convert output rows [y_start, y_end) into dst. With upsample_us set, the
+ * time spent upsampling chroma is added to it. */
+static int convert_rows(jpeg_decoder_t *decoder, int y_start, int y_end,
+                        uint8_t *dst, size_t dst_stride, jpeg_pixel_format_t format,
+                        double *upsample_us) {
+    int width = decoder->frame.width;
 
-        printf("Grayscale conversion complete\n");
+    if (y_end > decoder->frame.height) {
+        y_end = decoder->frame.height;
+    }
+    trace_begin_arg("color rows", "y", y_start);
+
+    /* Gray sources, and gray output of color sources, need only luma */
+    if (native_format(decoder) == JPEG_PIXEL_GRAY8 || format == JPEG_PIXEL_GRAY8) {
+        perf_profile_enter(decoder->perf, PERF_STAGE_COLOR);
+        for (int y = y_start; y < y_end; y++) {
+            gray_row(decoder->component_buffers[0] + (size_t)y * decoder->component_width[0],
+                     dst + (size_t)(y - y_start) * dst_stride, width, format);
+        }
+        perf_profile_enter(decoder->perf, PERF_STAGE_NONE);
+        trace_end();
         return 0;
     }
 
-    /* Handle RGB (3 components - YCbCr) */
     if (decoder->frame.num_components != 3) {
         fprintf(stderr, "Unsupported number of components: %d\n",
                 decoder->frame.num_components);
+        trace_end();
         return -1;
     }
 
-    printf("Color image detected (YCbCr)\n");
+    /* Chroma is upsampled a row at a time just ahead of conversion */
+    upsampler_t cb_upsampler, cr_upsampler;
+    upsampler_init(&cb_upsampler, decoder, 1, decoder->fast_upsampling);
+    upsampler_init(&cr_upsampler, decoder, 2, decoder->fast_upsampling);
+
+    for (int y = y_start; y < y_end; y++) {
+        double t_start = upsample_us ? get_time_us() : 0.0;
+        perf_profile_enter(decoder->perf, PERF_STAGE_UPSAMPLE);
+        const uint8_t *cb_row = upsampler_row(&cb_upsampler, y);
+        const uint8_t *cr_row = upsampler_row(&cr_upsampler, y);
+        if (upsample_us) {
+            *upsample_us += get_time_us() - t_start;
+        }
 
-    /* Allocate RGB output buffer */
-    size_t rgb_size = decoder->width * decoder->height * 3;
-    decoder->image_data = (uint8_t*)jpeg_malloc(rgb_size);
+        perf_profile_enter(decoder->perf, PERF_STAGE_COLOR);
+        convert_row(decoder->component_buffers[0] + (size_t)y * decoder->component_width[0],
+                    cb_row, cr_row, dst + (size_t)(y - y_start) * dst_stride, width, format);
+    }
 
-    /* Check if chroma upsampling is needed */
-    component_info_t *y_comp = &decoder->frame.components[0];
-    component_info_t *cb_comp = &decoder->frame.components[1];
+    perf_profile_enter(decoder->perf, PERF_STAGE_NONE);
 
-    uint8_t *cb_upsampled = NULL;
-    uint8_t *cr_upsampled = NULL;
+    upsampler_free(&cb_upsampler);
+    upsampler_free(&cr_upsampler);
+    trace_end();
+    return 0;
+}
 
-    /* Upsample Cb and Cr if needed */
-    if (cb_comp->h_sampling != y_comp->h_sampling ||
-        cb_comp->v_sampling != y_comp->v_sampling) {
-        printf("Upsampling chroma components...\n");
+/* Below about a megapixel per thread, starting the threads costs more
+ * than the conversion they would share */
+#define MIN_PIXELS_PER_THREAD (1 << 20)
+
+/* One horizontal band of the output for a color conversion worker */
+typedef struct {
+    jpeg_decoder_t *decoder;
+    uint8_t *dst;               /* First row of the band */
+    size_t dst_stride;
+    jpeg_pixel_format_t format;
+    int y_start;
+    int y_end;
+    int result;
+} color_band_t;
+
+static void convert_band(void *arg) {
+    color_band_t *band = (color_band_t*)arg;
+
+    band->result = convert_rows(band->decoder, band->y_start, band->y_end,
+                                band->dst, band->dst_stride, band->format, NULL);
+}
 
-        t_start = get_time_us();
+/* Threads worth using for the color conversion of this image */
+static int color_thread_count(const jpeg_decoder_t *decoder) {
+    size_t pixels = (size_t)decoder->frame.width * decoder->frame.height;
+    size_t by_size = pixels / MIN_PIXELS_PER_THREAD;
+    int threads = decoder->decode_threads;
 
-        cb_upsampled = (uint8_t*)jpeg_malloc(decoder->width * decoder->height);
-        cr_upsampled = (uint8_t*)jpeg_malloc(decoder->width * decoder->height);
+    /* Counters only follow the profiled thread */
+    if (decoder->perf) {
+        return 1;
+    }
+
+    if ((size_t)threads > by_size) {
+        threads = (int)by_size;
+    }
+    /* Bands of at least one MCU row */
+    if (threads > decoder->mcu_height) {
+        threads = decoder->mcu_height;
+    }
+    return threads < 1 ? 1 : threads;
+}
 
-        upsample_component(decoder->component_buffers[1], cb_upsampled,
-                          decoder->component_width[1], decoder->component_height[1],
-                          decoder->width, decoder->height);
+/* Upsample and convert bands of MCU rows on a thread pool; each band sets
+ * up its own upsamplers, which read the chroma rows just outside it */
+static int convert_parallel(jpeg_decoder_t *decoder, uint8_t *dst, size_t dst_stride,
+                            jpeg_pixel_format_t format, int num_threads) {
+    color_band_t bands[MAX_DECODE_THREADS];
+    int mcu_rows_per_band = (decoder->mcu_height + num_threads - 1) / num_threads;
+    int num_bands = 0;
+
+    for (int row = 0; row < decoder->mcu_height; row += mcu_rows_per_band) {
+        color_band_t *band = &bands[num_bands++];
+        band->decoder = decoder;
+        band->y_start = row * decoder->mcu_size_y;
+        band->y_end = (row + mcu_rows_per_band) * decoder->mcu_size_y;
+        band->dst = dst + (size_t)band->y_start * dst_stride;
+        band->dst_stride = dst_stride;
+        band->format = format;
+        band->result = -1;
+    }
 
-        upsample_component(decoder->component_buffers[2], cr_upsampled,
-                          decoder->component_width[2], decoder->component_height[2],
-                          decoder->width, decoder->height);
+    /* The calling thread takes the last band itself */
+    threadpool_t *pool = threadpool_create(num_bands - 1, 0);
+    if (!pool) {
+        fprintf(stderr, "Failed to create color conversion threads\n");
+        return -1;
+    }
+    for (int i = 0; i < num_bands - 1; i++) {
+        if (threadpool_submit(pool, convert_band, &bands[i]) != 0) {
+            convert_band(&bands[i]);
+        }
+    }
+    convert_band(&bands[num_bands - 1]);
+    threadpool_wait(pool);
+    threadpool_destroy(pool);
 
-        t_end = get_time_us();
-        upsample_time = (t_end - t_start) / 1000.0;  /* Convert to ms */
-    } else {
-        /* No upsampling needed (4:4:4) */
-        cb_upsampled = decoder->component_buffers[1];
-        cr_upsampled = decoder->component_buffers[2];
+    for (int i = 0; i < num_bands; i++) {
+        if (bands[i].result != 0) {
+            return -1;
+        }
     }
+    JPEG_LOG("Converted in %d bands of %d MCU rows\n", num_bands, mcu_rows_per_band);
+    return 0;
+}
 
-    /* Convert YCbCr to RGB using fixed-point integer arithmetic (like libjpeg) */
-    printf("Converting color space...\n");
-    t_start = get_time_us();
+/* Convert the whole frame into dst */
+int ycbcr_to_pixels(jpeg_decoder_t *decoder, uint8_t *dst, size_t dst_stride,
+                    jpeg_pixel_format_t format) {
+    decoder->width = decoder->frame.width;
+    decoder->height = decoder->frame.height;
 
-    /* Fixed-point coefficients (scaled by 2^16) from libjpeg */
-    #define SCALEBITS 16
-    #define ONE_HALF  (1 << (SCALEBITS-1))
-    #define FIX(x)  ((int)((x) * (1L << SCALEBITS) + 0.5))
+    /* Handle grayscale (1 component, or only the Y plane was decoded) */
+    if (native_format(decoder) == JPEG_PIXEL_GRAY8 || format == JPEG_PIXEL_GRAY8) {
+        JPEG_LOG(decoder->frame.num_components == 1 ? "Grayscale image detected\n"
+                                                    : "Luma-only output: copying Y plane\n");
+        if (convert_rows(decoder, 0, decoder->height, dst, dst_stride, format, NULL) != 0) {
+            return -1;
+        }
+        JPEG_LOG("Grayscale conversion complete\n");
+        return 0;
+    }
 
-    const int cr_r = FIX(1.40200);    /* 91881 */
-    const int cb_g = FIX(0.34414);    /* 22554 */
-    const int cr_g = FIX(0.71414);    /* 46802 */
-    const int cb_b = FIX(1.77200);    /* 116130 */
+    /* Handle RGB (3 components - YCbCr) */
+    if (decoder->frame.num_components != 3) {
+        fprintf(stderr, "Unsupported number of components: %d\n",
+                decoder->frame.num_components);
+        return -1;
+    }
 
-    for (int y = 0; y < decoder->height; y++) {
-        for (int x = 0; x < decoder->width; x++) {
-            int y_val = decoder->component_buffers[0][y * decoder->component_width[0] + x];
-            int cb_val = cb_upsampled[y * decoder->width + x] - 128;
-            int cr_val = cr_upsampled[y * decoder->width + x] - 128;
-
-            /* YCbCr to RGB conversion using fixed-point arithmetic */
-            int r = y_val + ((cr_r * cr_val + ONE_HALF) >> SCALEBITS);
-            int g = y_val - ((cb_g * cb_val + cr_g * cr_val + ONE_HALF) >> SCALEBITS);
-            int b = y_val + ((cb_b * cb_val + ONE_HALF) >> SCALEBITS);
-
-            /* Clamp to [0, 255] */
-            r = clamp(r, 0, 255);
-            g = clamp(g, 0, 255);
-            b = clamp(b, 0, 255);
-
-            /* Store RGB */
-            int idx = (y * decoder->width + x) * 3;
-            decoder->image_data[idx + 0] = r;
-            decoder->image_data[idx + 1] = g;
-            decoder->image_data[idx + 2] = b;
+    JPEG_LOG("Color image detected (YCbCr)\n");
+
+    double t_start = get_time_us();
+    int num_threads = color_thread_count(decoder);
+    if (num_threads > 1) {
+        if (convert_parallel(decoder, dst, dst_stride, format, num_threads) != 0) {
+            return -1;
         }
+        decoder->stats.upsample_time_us = 0.0;
+        decoder->stats.color_time_us = get_time_us() - t_start;
+        JPEG_LOG("Color conversion complete\n");
+        JPEG_LOG("  Upsample + YCbCr->RGB: %.2f ms (%d threads)\n",
+                 decoder->stats.color_time_us / 1000.0, num_threads);
+        return 0;
     }
 
-    t_end = get_time_us();
-    convert_time = (t_end - t_start) / 1000.0;  /* Convert to ms */
+    int needs_upsample = !decoder->idct_upsampling &&
+                         (decoder->frame.components[1].h_sampling != decoder->max_h_sampling ||
+                          decoder->frame.components[1].v_sampling != decoder->max_v_sampling);
+    if (needs_upsample) {
+        JPEG_LOG("Upsampling chroma components (%s)...\n",
+                 decoder->fast_upsampling ? "fast" : "fancy");
+    }
 
-    #undef SCALEBITS
-    #undef ONE_HALF
-    #undef FIX
+    /* Convert YCbCr to RGB using fixed-point integer arithmetic (like libjpeg) */
+    JPEG_LOG("Converting color space...\n");
 
-    /* Free upsampled buffers if they were allocated */
-    if (cb_upsampled != decoder->component_buffers[1]) {
-        jpeg_free(cb_upsampled);
+    double upsample_time = 0.0;
+    if (convert_rows(decoder, 0, decoder->height, dst, dst_stride, format,
+                     &upsample_time) != 0) {
+        return -1;
     }
-    if (cr_upsampled != decoder->component_buffers[2]) {
-        jpeg_free(cr_upsampled);
+    decoder->stats.upsample_time_us = upsample_time;
+    decoder->stats.color_time_us = get_time_us() - t_start - upsample_time;
+
+    JPEG_LOG("Color conversion complete\n");
+    if (needs_upsample) {
+        JPEG_LOG("  Chroma upsample:  %.2f ms\n", decoder->stats.upsample_time_us / 1000.0);
     }
+    JPEG_LOG("  YCbCr->RGB:       %.2f ms\n", decoder->stats.color_time_us / 1000.0);
+    return 0;
+}
+
+/* Convert YCbCr to RGB */
+int ycbcr_to_rgb(jpeg_decoder_t *decoder) {
+    JPEG_LOG("\nConverting YCbCr to RGB...\n");
 
-    printf("Color conversion complete\n");
-    if (upsample_time > 0.0) {
-        printf("  Chroma upsample:  %.2f ms\n", upsample_time);
+    /* The decode pipeline converts rows as they are reconstructed */
+    if (decoder->output_converted && decoder->output_pixels == decoder->image_data) {
+        JPEG_LOG("Already converted during decode\n");
+        return 0;
+    }
+
+    jpeg_pixel_format_t format = native_format(decoder);
+    decoder->channels = jpeg_pixel_size(format);
+    size_t stride = (size_t)decoder->frame.width * decoder->channels;
+    decoder->image_data = (uint8_t*)jpeg_malloc(stride * decoder->frame.height);
+
+    if (ycbcr_to_pixels(decoder, decoder->image_data, stride, format) != 0) {
+        jpeg_free(decoder->image_data);
+        decoder->image_data = NULL;
+        return -1;
     }
-    printf("  YCbCr->RGB:       %.2f ms\n", convert_time);
     return 0;
 }
 
-/* Helper to safely get chroma sample with boundary handling */
-static inline uint8_t get_chroma_sample(const uint8_t *src, int x, int y,
-                                        int width, int height) {
-    if (x < 0) x = 0;
-    if (x >= width) x = width - 1;
-    if (y < 0) y = 0;
-    if (y >= height) y = height - 1;
-    return src[y * width + x];
+/* Convert output rows [y_start, y_end) to pixels of the given format */
+int ycbcr_to_pixels_rows(jpeg_decoder_t *decoder, int y_start, int y_end,
+                         uint8_t *dst, size_t dst_stride, jpeg_pixel_format_t format) {
+    return convert_rows(decoder, y_start, y_end, dst, dst_stride, format, NULL);
 }
 
-/* Upsample component using libjpeg h2v2 fancy upsampling (9:3:3:1 weighting) */
-void upsample_component(const uint8_t *src, uint8_t *dst,
-                        int src_width, int src_height,
-                        int dst_width, int dst_height) {
-
-    /* Check if this is h2v2 subsampling (2x in both directions) */
-    if (dst_width == src_width * 2 && dst_height == src_height * 2) {
-        /* libjpeg h2v2 fancy upsampling using 9:3:3:1 weights */
-        for (int src_y = 0; src_y < src_height; src_y++) {
-            for (int src_x = 0; src_x < src_width; src_x++) {
-                /* Each chroma sample maps to a 2x2 block of output pixels */
-                int dst_x = src_x * 2;
-                int dst_y = src_y * 2;
-
-                /* Get the four neighboring chroma samples for 9:3:3:1 weighting */
-                uint8_t c00 = get_chroma_sample(src, src_x,     src_y,     src_width, src_height);
-                uint8_t c10 = get_chroma_sample(src, src_x + 1, src_y,     src_width, src_height);
-                uint8_t c01 = get_chroma_sample(src, src_x,     src_y + 1, src_width, src_height);
-                uint8_t c11 = get_chroma_sample(src, src_x + 1, src_y + 1, src_width, src_height);
-
-                /* Compute 2x2 output block using 9:3:3:1 weights (total = 16)
-                 * Top-left: weight 9 to c00
-                 * Top-right: weight 9 to c10
-                 * Bottom-left: weight 9 to c01
-                 * Bottom-right: weight 9 to c11
-                 */
-
-                /* Top-left output pixel (closest to c00) */
-                if (dst_y < dst_height && dst_x < dst_width) {
-                    int val = (9 * c00 + 3 * c10 + 3 * c01 + 1 * c11 + 8) >> 4;
-                    dst[dst_y * dst_width + dst_x] = val;
-                }
-
-                /* Top-right output pixel (closest to c10) */
-                if (dst_y < dst_height && dst_x + 1 < dst_width) {
-                    int val = (3 * c00 + 9 * c10 + 1 * c01 + 3 * c11 + 8) >> 4;
-                    dst[dst_y * dst_width + dst_x + 1] = val;
-                }
-
-                /* Bottom-left output pixel (closest to c01) */
-                if (dst_y + 1 < dst_height && dst_x < dst_width) {
-                    int val = (3 * c00 + 1 * c10 + 9 * c01 + 3 * c11 + 8) >> 4;
-                    dst[(dst_y + 1) * dst_width + dst_x] = val;
-                }
-
-                /* Bottom-right output pixel (closest to c11) */
-                if (dst_y + 1 < dst_height && dst_x + 1 < dst_width) {
-                    int val = (1 * c00 + 3 * c10 + 3 * c01 + 9 * c11 + 8) >> 4;
-                    dst[(dst_y + 1) * dst_width + dst_x + 1] = val;
-                }
-            }
-        }
-    } else {
-        /* Fallback to simple bilinear for non-h2v2 cases */
-        float x_ratio = (float)(src_width) / (float)dst_width;
-        float y_ratio = (float)(src_height) / (float)dst_height;
-
-        for (int y = 0; y < dst_height; y++) {
-            for (int x = 0; x < dst_width; x++) {
-                float src_x_f = (x + 0.5f) * x_ratio - 0.5f;
-                float src_y_f = (y + 0.5f) * y_ratio - 0.5f;
-
-                if (src_x_f < 0.0f) src_x_f = 0.0f;
-                if (src_y_f < 0.0f) src_y_f = 0.0f;
-
-                int x0 = (int)src_x_f;
-                int y0 = (int)src_y_f;
-                float dx = src_x_f - x0;
-                float dy = src_y_f - y0;
-
-                int x1 = (x0 + 1 < src_width) ? x0 + 1 : x0;
-                int y1 = (y0 + 1 < src_height) ? y0 + 1 : y0;
-
-                uint8_t p00 = src[y0 * src_width + x0];
-                uint8_t p10 = src[y0 * src_width + x1];
-                uint8_t p01 = src[y1 * src_width + x0];
-                uint8_t p11 = src[y1 * src_width + x1];
-
-                float val = p00 * (1.0f - dx) * (1.0f - dy) +
-                           p10 * dx * (1.0f - dy) +
-                           p01 * (1.0f - dx) * dy +
-                           p11 * dx * dy;
-
-                dst[y * dst_width + x] = (uint8_t)(val + 0.5f);
-            }
+/* Convert output rows [y_start, y_end) to interleaved RGB (or gray) */
+int ycbcr_to_rgb_rows(jpeg_decoder_t *decoder, int y_start, int y_end,
+                      uint8_t *dst, size_t dst_stride) {
+    return convert_rows(decoder, y_start, y_end, dst, dst_stride, native_format(decoder), NULL);
+}
+
+/* Forward conversion coefficients (scaled by 2^15 so they fit SSE2 16-bit
+ * multiplies); each row of three sums to 2^15 or 0 */
+#define FWD_BITS 15
+#define FWD_Y_R   9798      /* 0.29900 */
+#define FWD_Y_G   19235     /* 0.58700 */
+#define FWD_Y_B   3735      /* 0.11400 */
+#define FWD_CB_R  (-5529)   /* -0.16874 */
+#define FWD_CB_G  (-10855)  /* -0.33126 */
+#define FWD_CB_B  16384     /* 0.50000 */
+#define FWD_CR_R  16384     /* 0.50000 */
+#define FWD_CR_G  (-13720)  /* -0.41869 */
+#define FWD_CR_B  (-2664)   /* -0.08131 */
+#define FWD_ROUND    (1 << (FWD_BITS - 1))
+#define FWD_CENTER   ((128 << FWD_BITS) + FWD_ROUND)
+
+/* Convert one row of interleaved RGB to Y, Cb and Cr rows */
+void rgb_to_ycbcr_row(const uint8_t *rgb_row, uint8_t *y_row, uint8_t *cb_row,
+                      uint8_t *cr_row, int width) {
+    int x = 0;
+
+#ifdef __SSE2__
+    /* 8 pixels per step: deinterleave, then pair (R,G) and (B,1) so each
+     * output needs two madd instructions per 4 pixels */
+    const __m128i y_rg = _mm_set_epi16(FWD_Y_G, FWD_Y_R, FWD_Y_G, FWD_Y_R,
+                                       FWD_Y_G, FWD_Y_R, FWD_Y_G, FWD_Y_R);
+    const __m128i cb_rg = _mm_set_epi16(FWD_CB_G, FWD_CB_R, FWD_CB_G, FWD_CB_R,
+                                        FWD_CB_G, FWD_CB_R, FWD_CB_G, FWD_CB_R);
+    const __m128i cr_rg = _mm_set_epi16(FWD_CR_G, FWD_CR_R, FWD_CR_G, FWD_CR_R,
+                                        FWD_CR_G, FWD_CR_R, FWD_CR_G, FWD_CR_R);
+    const __m128i y_b = _mm_set_epi16(0, FWD_Y_B, 0, FWD_Y_B, 0, FWD_Y_B, 0, FWD_Y_B);
+    const __m128i cb_b = _mm_set_epi16(0, FWD_CB_B, 0, FWD_CB_B, 0, FWD_CB_B, 0, FWD_CB_B);
+    const __m128i cr_b = _mm_set_epi16(0, FWD_CR_B, 0, FWD_CR_B, 0, FWD_CR_B, 0, FWD_CR_B);
+    const __m128i y_bias = _mm_set1_epi32(FWD_ROUND);
+    const __m128i c_bias = _mm_set1_epi32(FWD_CENTER);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; x + 8 <= width; x += 8) {
+        int16_t r[8], g[8], b[8];
+        const uint8_t *p = rgb_row + x * 3;
+        for (int i = 0; i < 8; i++) {
+            r[i] = p[i * 3 + 0];
+            g[i] = p[i * 3 + 1];
+            b[i] = p[i * 3 + 2];
         }
+
+        __m128i rv = _mm_loadu_si128((const __m128i*)r);
+        __m128i gv = _mm_loadu_si128((const __m128i*)g);
+        __m128i bv = _mm_loadu_si128((const __m128i*)b);
+        __m128i rg_lo = _mm_unpacklo_epi16(rv, gv);
+        __m128i rg_hi = _mm_unpackhi_epi16(rv, gv);
+        __m128i b_lo = _mm_unpacklo_epi16(bv, zero);
+        __m128i b_hi = _mm_unpackhi_epi16(bv, zero);
+
+#define FWD_CONVERT(rg_coef, b_coef, bias, out)                                     \
+        do {                                                                        \
+            __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg_lo, rg_coef), \
+                                                     _mm_madd_epi16(b_lo, b_coef)), bias); \
+            __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg_hi, rg_coef), \
+                                                     _mm_madd_epi16(b_hi, b_coef)), bias); \
+            lo = _mm_srai_epi32(lo, FWD_BITS);                                      \
+            hi = _mm_srai_epi32(hi, FWD_BITS);                                      \
+            __m128i packed = _mm_packs_epi32(lo, hi);                               \
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(packed, packed)); \
+        } while (0)
+
+        FWD_CONVERT(y_rg, y_b, y_bias, y_row);
+        FWD_CONVERT(cb_rg, cb_b, c_bias, cb_row);
+        FWD_CONVERT(cr_rg, cr_b, c_bias, cr_row);
+#undef FWD_CONVERT
+    }
+#endif
+
+    /* Scalar path (and SSE2 tail) with identical arithmetic */
+    for (; x < width; x++) {
+        int r = rgb_row[x * 3 + 0];
+        int g = rgb_row[x * 3 + 1];
+        int b = rgb_row[x * 3 + 2];
+
+        y_row[x] = (uint8_t)((FWD_Y_R * r + FWD_Y_G * g + FWD_Y_B * b + FWD_ROUND) >> FWD_BITS);
+        cb_row[x] = (uint8_t)clamp((FWD_CB_R * r + FWD_CB_G * g + FWD_CB_B * b + FWD_CENTER) >> FWD_BITS,
+                                   0, 255);
+        cr_row[x] = (uint8_t)clamp((FWD_CR_R * r + FWD_CR_G * g + FWD_CR_B * b + FWD_CENTER) >> FWD_BITS,
+                                   0, 255);
     }
 }
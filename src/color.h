@@ -6,9 +6,28 @@
 /* Convert YCbCr component buffers to RGB image */
 int ycbcr_to_rgb(jpeg_decoder_t *decoder);
 
-/* Upsample chroma component (for 4:2:0 and 4:2:2 subsampling) */
-void upsample_component(const uint8_t *src, uint8_t *dst,
-                        int src_width, int src_height,
-                        int dst_width, int dst_height);
+/* Convert the whole frame into a caller-provided buffer: dst_stride bytes
+ * per row, pixels laid out as format. Gray formats take only the luma;
+ * grayscale images are replicated into the color formats. */
+int ycbcr_to_pixels(jpeg_decoder_t *decoder, uint8_t *dst, size_t dst_stride,
+                    jpeg_pixel_format_t format);
+
+/* Bytes per pixel of a pixel format */
+int jpeg_pixel_size(jpeg_pixel_format_t format);
+
+/* Convert output rows [y_start, y_end) into dst (dst_stride bytes per row).
+ * Only reads component rows needed for those output rows plus one row of
+ * chroma context below, so it can run as soon as that data is decoded. */
+int ycbcr_to_rgb_rows(jpeg_decoder_t *decoder, int y_start, int y_end,
+                      uint8_t *dst, size_t dst_stride);
+
+/* ycbcr_to_rgb_rows writing pixels of the given format */
+int ycbcr_to_pixels_rows(jpeg_decoder_t *decoder, int y_start, int y_end,
+                         uint8_t *dst, size_t dst_stride, jpeg_pixel_format_t format);
+
+/* Convert one row of interleaved RGB to separate Y, Cb and Cr rows
+ * (JFIF full-range BT.601; SSE2 when available) */
+void rgb_to_ycbcr_row(const uint8_t *rgb_row, uint8_t *y_row, uint8_t *cb_row,
+                      uint8_t *cr_row, int width);
 
 #endif /* COLOR_H */
@@ -1,5 +1,17 @@
 #include "dct.h"
 #include "utils.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* The float IDCT has an AVX2/FMA kernel, picked at run time */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define IDCT_FLOAT_AVX2
+#include <immintrin.h>
+#endif
 
 /*
  * Accurate integer IDCT implementation based on the Loeffler-Ligtenberg-Moschytz
@@ -33,35 +45,29 @@
 /* Descale with proper rounding */
 #define RIGHT_SHIFT(x, n) (((x) + (1L << ((n)-1))) >> (n))
 
-/* Range limiting - create lookup table for clamping to 0-255 */
-static uint8_t range_limit_table[1024];
-static int range_limit_initialized = 0;
-
-static void init_range_limit_table(void) {
-    if (range_limit_initialized) return;
-
-    int i;
-    /* Negative values map to 0 */
-    for (i = 0; i < 384; i++) {
-        range_limit_table[i] = 0;
-    }
-    /* Valid range 0-255 */
-    for (i = 0; i < 256; i++) {
-        range_limit_table[i + 384] = i;
-    }
-    /* Values > 255 map to 255 */
-    for (i = 0; i < 384; i++) {
-        range_limit_table[i + 640] = 255;
-    }
+/* Range limiting - lookup table for clamping to 0-255, indexed by value + 384.
+ * Constant-initialized so concurrent decoders share it without setup. */
+#define RL_REP4(x)    x, x, x, x
+#define RL_REP16(x)   RL_REP4(x), RL_REP4(x), RL_REP4(x), RL_REP4(x)
+#define RL_REP128(x)  RL_REP16(x), RL_REP16(x), RL_REP16(x), RL_REP16(x), \
+                      RL_REP16(x), RL_REP16(x), RL_REP16(x), RL_REP16(x)
+#define RL_REP384(x)  RL_REP128(x), RL_REP128(x), RL_REP128(x)
+#define RL_RAMP4(n)   (n), (n) + 1, (n) + 2, (n) + 3
+#define RL_RAMP16(n)  RL_RAMP4(n), RL_RAMP4((n) + 4), RL_RAMP4((n) + 8), RL_RAMP4((n) + 12)
+#define RL_RAMP64(n)  RL_RAMP16(n), RL_RAMP16((n) + 16), RL_RAMP16((n) + 32), RL_RAMP16((n) + 48)
+#define RL_RAMP256    RL_RAMP64(0), RL_RAMP64(64), RL_RAMP64(128), RL_RAMP64(192)
 
-    range_limit_initialized = 1;
-}
+static const uint8_t range_limit_table[1024] = {
+    RL_REP384(0),       /* Negative values map to 0 */
+    RL_RAMP256,         /* Valid range 0-255 */
+    RL_REP384(255)      /* Values > 255 map to 255 */
+};
 
 /* Dequantize macro */
 #define DEQUANTIZE(coef, quantval) ((coef) * (quantval))
 
 /* 2D IDCT with integrated dequantization */
-void idct_2d(int16_t *input_block, const uint8_t *quant_table, uint8_t *output_block) {
+void idct_2d(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
     int32_t workspace[DCTSIZE2];
     int32_t *wsptr;
     int16_t *inptr;
@@ -72,11 +78,9 @@ void idct_2d(int16_t *input_block, const uint8_t *quant_table, uint8_t *output_b
     int32_t z1, z2, z3;
     int ctr;
 
-    init_range_limit_table();
-
     /* Pass 1: process columns, dequantize and store into workspace */
     inptr = input_block;
-    quantptr = quant_table;
+    quantptr = quant->table;
     wsptr = workspace;
 
     for (ctr = DCTSIZE; ctr > 0; ctr--) {
@@ -251,3 +255,933 @@ void idct_2d(int16_t *input_block, const uint8_t *quant_table, uint8_t *output_b
         wsptr += DCTSIZE;
     }
 }
+
+/*
+ * Batched accurate IDCT: IDCT_BATCH blocks at once, one block per vector
+ * lane, so every step of idct_2d becomes one vector operation. Coefficients
+ * are moved into lanes, and samples out of them, with 8x8 transposes of
+ * 16-bit values (one row of each of the 8 blocks at a time). The DC-only
+ * column shortcut of idct_2d is a per-lane select, which keeps the output
+ * bit-exact with it. Written with GCC vector extensions and compiled for
+ * AVX2 (8 x 32-bit lanes per register, native 32-bit multiplies), which is
+ * checked for at run time; with SSE2 alone the multiplies are emulated and
+ * idct_2d per block is faster, so that is what runs there.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9 && defined(__x86_64__)
+#define IDCT_BATCH_LANES
+
+typedef int32_t idct_vec_t __attribute__((vector_size(IDCT_BATCH * sizeof(int32_t))));
+typedef int16_t idct_vec16_t __attribute__((vector_size(IDCT_BATCH * sizeof(int16_t))));
+typedef uint8_t idct_vec8_t __attribute__((vector_size(IDCT_BATCH)));
+
+/* Transpose 8 vectors of 8 16-bit values in place (interleave pairs, then
+ * quads, then halves) */
+static inline void transpose_8x8_16(idct_vec16_t v[8]) {
+    const idct_vec16_t lo16 = { 0, 8, 1, 9, 2, 10, 3, 11 };
+    const idct_vec16_t hi16 = { 4, 12, 5, 13, 6, 14, 7, 15 };
+    const idct_vec16_t lo32 = { 0, 1, 8, 9, 2, 3, 10, 11 };
+    const idct_vec16_t hi32 = { 4, 5, 12, 13, 6, 7, 14, 15 };
+    const idct_vec16_t lo64 = { 0, 1, 2, 3, 8, 9, 10, 11 };
+    const idct_vec16_t hi64 = { 4, 5, 6, 7, 12, 13, 14, 15 };
+    idct_vec16_t t[8], u[8];
+
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = __builtin_shuffle(v[i], v[i + 1], lo16);
+        t[i + 1] = __builtin_shuffle(v[i], v[i + 1], hi16);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = __builtin_shuffle(t[i], t[i + 2], lo32);
+        u[i + 1] = __builtin_shuffle(t[i], t[i + 2], hi32);
+        u[i + 2] = __builtin_shuffle(t[i + 1], t[i + 3], lo32);
+        u[i + 3] = __builtin_shuffle(t[i + 1], t[i + 3], hi32);
+    }
+    for (int i = 0; i < 4; i++) {
+        v[2 * i] = __builtin_shuffle(u[i], u[i + 4], lo64);
+        v[2 * i + 1] = __builtin_shuffle(u[i], u[i + 4], hi64);
+    }
+}
+
+/* One 1-D LL&M pass over vectors v[0..7] as in idct_2d, with dc in place
+ * of v[0] and bias added to the scaled even part; the outputs are not yet
+ * descaled */
+#define IDCT_VEC_1D(v, out, dc, bias)                                       \
+    do {                                                                    \
+        idct_vec_t z1_, z2_, z3_, t0_, t1_, t2_, t3_, t10_, t11_, t12_, t13_; \
+        z2_ = (dc);                                                         \
+        z3_ = (v)[4];                                                       \
+        t0_ = ((z2_ + z3_) << CONST_BITS) + (bias);                         \
+        t1_ = ((z2_ - z3_) << CONST_BITS) + (bias);                         \
+        z2_ = (v)[2];                                                       \
+        z3_ = (v)[6];                                                       \
+        z1_ = (z2_ + z3_) * FIX_0_541196100;                                \
+        t2_ = z1_ + z2_ * FIX_0_765366865;                                  \
+        t3_ = z1_ - z3_ * FIX_1_847759065;                                  \
+        t10_ = t0_ + t2_;                                                   \
+        t13_ = t0_ - t2_;                                                   \
+        t11_ = t1_ + t3_;                                                   \
+        t12_ = t1_ - t3_;                                                   \
+        t0_ = (v)[7];                                                       \
+        t1_ = (v)[5];                                                       \
+        t2_ = (v)[3];                                                       \
+        t3_ = (v)[1];                                                       \
+        z2_ = t0_ + t2_;                                                    \
+        z3_ = t1_ + t3_;                                                    \
+        z1_ = (z2_ + z3_) * FIX_1_175875602;                                \
+        z2_ = z2_ * -FIX_1_961570560 + z1_;                                 \
+        z3_ = z3_ * -FIX_0_390180644 + z1_;                                 \
+        z1_ = (t0_ + t3_) * -FIX_0_899976223;                               \
+        t0_ = t0_ * FIX_0_298631336 + z1_ + z2_;                            \
+        t3_ = t3_ * FIX_1_501321110 + z1_ + z3_;                            \
+        z1_ = (t1_ + t2_) * -FIX_2_562915447;                               \
+        t1_ = t1_ * FIX_2_053119869 + z1_ + z3_;                            \
+        t2_ = t2_ * FIX_3_072711026 + z1_ + z2_;                            \
+        (out)[0] = t10_ + t3_;                                              \
+        (out)[7] = t10_ - t3_;                                              \
+        (out)[1] = t11_ + t2_;                                              \
+        (out)[6] = t11_ - t2_;                                              \
+        (out)[2] = t12_ + t1_;                                              \
+        (out)[5] = t12_ - t1_;                                              \
+        (out)[3] = t13_ + t0_;                                              \
+        (out)[4] = t13_ - t0_;                                              \
+    } while (0)
+
+/* IDCT_BATCH consecutive blocks; lane b holds block b throughout */
+__attribute__((target("avx2")))
+static void idct_2d_lanes(const int16_t *blocks, const uint8_t *quantval,
+                          uint8_t *outputs, size_t output_step) {
+    idct_vec_t coef[DCTSIZE2];
+    idct_vec_t workspace[DCTSIZE2];
+
+    /* Row r of every block -> vectors of coefficient r * 8 + c */
+    for (int row = 0; row < DCTSIZE; row++) {
+        idct_vec16_t v[IDCT_BATCH];
+        for (int b = 0; b < IDCT_BATCH; b++) {
+            memcpy(&v[b], blocks + b * DCTSIZE2 + row * DCTSIZE, sizeof(v[b]));
+        }
+        transpose_8x8_16(v);
+        for (int col = 0; col < DCTSIZE; col++) {
+            coef[row * DCTSIZE + col] = __builtin_convertvector(v[col], idct_vec_t);
+        }
+    }
+
+    /* Pass 1: columns, dequantized */
+    for (int col = 0; col < DCTSIZE; col++) {
+        idct_vec_t in[DCTSIZE];
+        idct_vec_t ac = { 0 };
+        for (int row = 0; row < DCTSIZE; row++) {
+            in[row] = coef[row * DCTSIZE + col];
+            if (row > 0) {
+                ac |= in[row];
+            }
+            in[row] *= (int32_t)quantval[row * DCTSIZE + col];
+        }
+
+        /* Lanes whose column has no AC terms take the DC-only value */
+        idct_vec_t dc_only = ac == 0;
+        idct_vec_t dc = in[0] << PASS1_BITS;
+
+        idct_vec_t out[DCTSIZE];
+        IDCT_VEC_1D(in, out, in[0], 1 << (CONST_BITS - PASS1_BITS - 1));
+        for (int row = 0; row < DCTSIZE; row++) {
+            idct_vec_t value = (out[row] + (1 << (CONST_BITS - PASS1_BITS - 1))) >>
+                               (CONST_BITS - PASS1_BITS);
+            workspace[row * DCTSIZE + col] = (dc_only & dc) | (~dc_only & value);
+        }
+    }
+
+    /* Pass 2: rows, range limited, then back out of the lanes */
+    for (int row = 0; row < DCTSIZE; row++) {
+        idct_vec_t *ws = &workspace[row * DCTSIZE];
+        idct_vec_t out[DCTSIZE];
+        IDCT_VEC_1D(ws, out, ws[0] + ((CENTERJSAMPLE << (PASS1_BITS + 3)) +
+                                      (1 << (PASS1_BITS + 2))), 0);
+
+        idct_vec16_t samples[DCTSIZE];
+        for (int col = 0; col < DCTSIZE; col++) {
+            idct_vec_t value = (out[col] + (1 << (CONST_BITS + PASS1_BITS + 2))) >>
+                               (CONST_BITS + PASS1_BITS + 3);
+            value &= ~(value < 0);
+            idct_vec_t high = value > 255;
+            value = (value & ~high) | (255 & high);
+            samples[col] = __builtin_convertvector(value, idct_vec16_t);
+        }
+        transpose_8x8_16(samples);
+        for (int b = 0; b < IDCT_BATCH; b++) {
+            idct_vec8_t bytes = __builtin_convertvector(samples[b], idct_vec8_t);
+            memcpy(outputs + b * output_step + row * DCTSIZE, &bytes, sizeof(bytes));
+        }
+    }
+}
+
+#endif /* IDCT_BATCH_LANES */
+
+void idct_2d_batch(int16_t *blocks, const quantization_table_t *quant, uint8_t *outputs,
+                   size_t output_step, int count) {
+    int done = 0;
+#ifdef IDCT_BATCH_LANES
+    if (jpeg_simd_limit >= JPEG_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+        for (; done + IDCT_BATCH <= count; done += IDCT_BATCH) {
+            idct_2d_lanes(blocks + (size_t)done * DCTSIZE2, quant->table,
+                          outputs + done * output_step, output_step);
+        }
+    }
+#endif
+    for (; done < count; done++) {
+        idct_2d(blocks + (size_t)done * DCTSIZE2, quant, outputs + done * output_step);
+    }
+}
+
+/*
+ * Scaled IDCTs for chroma upsampling. The 8x8 coefficients are treated as the
+ * low frequencies of a 16-point DCT, which reconstructs the same signal at
+ * twice the sample density: x[n] = 1/2 sum C(k) X[k] cos((2n+1) k pi / 2N).
+ * Reduced sizes work the other way round: the lowest N coefficients of an
+ * N-point DCT give the signal at 8/N times lower density (1/2, 1/4 and 1/8
+ * scale decoding). Each 1-D pass uses the symmetry x[N-1-n] = even(n) -
+ * odd(n), so only the first N/2 rows of the basis are stored. Basis entries
+ * are C(k)/2 * cos(..) scaled by 2^CONST_BITS.
+ */
+static const int32_t idct2_basis[1][8] = {
+    {   2896,   2896,      0,      0,      0,      0,      0,      0 }
+};
+
+static const int32_t idct4_basis[2][8] = {
+    {   2896,   3784,   2896,   1567,      0,      0,      0,      0 },
+    {   2896,   1567,  -2896,  -3784,      0,      0,      0,      0 }
+};
+
+static const int32_t idct8_basis[4][8] = {
+    {   2896,   4017,   3784,   3406,   2896,   2276,   1567,    799 },
+    {   2896,   3406,   1567,   -799,  -2896,  -4017,  -3784,  -2276 },
+    {   2896,   2276,  -1567,  -4017,  -2896,    799,   3784,   3406 },
+    {   2896,    799,  -3784,  -2276,   2896,   3406,  -1567,  -4017 }
+};
+
+static const int32_t idct16_basis[8][8] = {
+    {   2896,   4076,   4017,   3920,   3784,   3612,   3406,   3166 },
+    {   2896,   3920,   3406,   2598,   1567,    401,   -799,  -1931 },
+    {   2896,   3612,   2276,    401,  -1567,  -3166,  -4017,  -3920 },
+    {   2896,   3166,    799,  -1931,  -3784,  -3920,  -2276,    401 },
+    {   2896,   2598,   -799,  -3612,  -3784,  -1189,   2276,   4076 },
+    {   2896,   1931,  -2276,  -4076,  -1567,   2598,   4017,   1189 },
+    {   2896,   1189,  -3406,  -3166,   1567,   4076,    799,  -3612 },
+    {   2896,    401,  -4017,  -1189,   3784,   1931,  -3406,  -2598 }
+};
+
+/* One 1-D pass: the first min(n, 8) coefficients in[k * in_stride] to n
+ * outputs out[i * out_stride], descaled by shift after adding bias */
+static void idct_1d_scaled(const int32_t *in, int in_stride, int32_t *out, int out_stride,
+                           const int32_t (*basis)[8], int n, int32_t bias, int shift) {
+    int taps = n < DCTSIZE ? n : DCTSIZE;
+
+    /* DC only: every output is the same */
+    bool ac_zero = true;
+    for (int k = 1; k < taps && ac_zero; k++) {
+        ac_zero = in[k * in_stride] == 0;
+    }
+    if (ac_zero) {
+        int32_t value = (bias + basis[0][0] * in[0]) >> shift;
+        for (int i = 0; i < n; i++) {
+            out[i * out_stride] = value;
+        }
+        return;
+    }
+
+    for (int i = 0; i < n / 2; i++) {
+        int32_t even = bias;
+        int32_t odd = 0;
+        for (int k = 0; k < taps; k += 2) {
+            even += basis[i][k] * in[k * in_stride];
+            odd += basis[i][k + 1] * in[(k + 1) * in_stride];
+        }
+        out[i * out_stride] = (even + odd) >> shift;
+        out[(n - 1 - i) * out_stride] = (even - odd) >> shift;
+    }
+}
+
+static inline uint8_t clamp_sample(int32_t value) {
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/* Basis of an n-point pass (n = 1 needs none: DC only) */
+static const int32_t (*scaled_basis(int n))[8] {
+    switch (n) {
+        case 16: return idct16_basis;
+        case 8:  return idct8_basis;
+        case 4:  return idct4_basis;
+        default: return idct2_basis;
+    }
+}
+
+/* Shared body of the scaled IDCTs: width x height output, row stride width */
+static void idct_scaled(const int16_t *input_block, const uint8_t *quant_table,
+                        uint8_t *output_block, int width, int height) {
+    int32_t coef[DCTSIZE2];
+    int32_t workspace[16 * DCTSIZE];
+    int32_t row_out[16];
+
+    const int32_t (*col_basis)[8] = scaled_basis(height);
+    const int32_t (*row_basis)[8] = scaled_basis(width);
+
+    for (int i = 0; i < DCTSIZE2; i++) {
+        coef[i] = DEQUANTIZE(input_block[i], quant_table[i]);
+    }
+
+    /* Pass 1: columns, 8 coefficients -> height rows, keep PASS1_BITS of
+     * fraction (only the columns the row pass reads) */
+    int columns = width < DCTSIZE ? width : DCTSIZE;
+    for (int col = 0; col < columns; col++) {
+        idct_1d_scaled(coef + col, DCTSIZE, workspace + col, DCTSIZE, col_basis, height,
+                       1 << (CONST_BITS - PASS1_BITS - 1), CONST_BITS - PASS1_BITS);
+    }
+
+    /* Pass 2: rows, 8 -> width samples, recentered around 128 */
+    int32_t bias = (CENTERJSAMPLE << (CONST_BITS + PASS1_BITS)) +
+                   (1 << (CONST_BITS + PASS1_BITS - 1));
+    for (int row = 0; row < height; row++) {
+        idct_1d_scaled(workspace + row * DCTSIZE, 1, row_out, 1, row_basis, width,
+                       bias, CONST_BITS + PASS1_BITS);
+
+        uint8_t *outptr = output_block + row * width;
+        for (int x = 0; x < width; x++) {
+            outptr[x] = clamp_sample(row_out[x]);
+        }
+    }
+}
+
+void idct_16x16(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
+    idct_scaled(input_block, quant->table, output_block, 16, 16);
+}
+
+void idct_16x8(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
+    idct_scaled(input_block, quant->table, output_block, 16, 8);
+}
+
+void idct_4x4(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
+    idct_scaled(input_block, quant->table, output_block, 4, 4);
+}
+
+void idct_2x2(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
+    idct_scaled(input_block, quant->table, output_block, 2, 2);
+}
+
+/* Just the block average */
+void idct_1x1(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block) {
+    int32_t dc = DEQUANTIZE(input_block[0], quant->table[0]);
+    output_block[0] = clamp_sample((dc + (CENTERJSAMPLE << 3) + 4) >> 3);
+}
+
+/*
+ * Fast IDCTs from the Arai-Agui-Nakajima (AAN) factorization, as in libjpeg's
+ * jidctfst and jidctflt: 5 multiplies per 1-D pass instead of 12. The AAN
+ * output scale factors are folded into each table's dequantization
+ * multipliers once, by idct_prepare_quant_table, so the transforms never
+ * touch the uint8_t quantization values.
+ */
+
+/* AAN scale factors: 1 for k = 0, cos(k * pi / 16) * sqrt(2) otherwise */
+static const double aan_scale_factor[DCTSIZE] = {
+    1.0, 1.387039845, 1.306562965, 1.175875602,
+    1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+/* aan_scale_factor[row] * aan_scale_factor[col], scaled by 2^14 */
+static const int16_t aan_scales[DCTSIZE2] = {
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+    21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+    19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+     8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+     4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+};
+
+#define AAN_SCALE_BITS 14
+#define IFAST_SCALE_BITS PASS1_BITS     /* Fraction bits of the ifast multipliers */
+#define IFAST_CONST_BITS 8
+#define IFAST_FIX_1_082392200  ((int32_t)  277)
+#define IFAST_FIX_1_414213562  ((int32_t)  362)
+#define IFAST_FIX_1_847759065  ((int32_t)  473)
+#define IFAST_FIX_2_613125930  ((int32_t)  669)
+#define IFAST_MULTIPLY(var, const) (((var) * (const)) >> IFAST_CONST_BITS)
+
+void idct_prepare_quant_table(quantization_table_t *table) {
+    for (int i = 0; i < DCTSIZE2; i++) {
+        int row = i / DCTSIZE;
+        int col = i % DCTSIZE;
+
+        table->ifast_multipliers[i] = (int16_t)RIGHT_SHIFT(
+            (int32_t)table->table[i] * aan_scales[i], AAN_SCALE_BITS - IFAST_SCALE_BITS);
+
+        /* The float IDCT's final division by 8 is folded in as well */
+        table->float_multipliers[i] = (float)(table->table[i] * aan_scale_factor[row] *
+                                              aan_scale_factor[col] * 0.125);
+    }
+}
+
+/* AAN fast integer IDCT (libjpeg's JDCT_IFAST): 8-bit multipliers, so less
+ * accurate than idct_2d, especially for high-quality images */
+void idct_ifast(int16_t *input_block, const quantization_table_t *quant,
+                uint8_t *output_block) {
+    int32_t workspace[DCTSIZE2];
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z5, z10, z11, z12, z13;
+
+    /* Pass 1: process columns, dequantize and store into workspace */
+    for (int col = 0; col < DCTSIZE; col++) {
+        const int16_t *in = input_block + col;
+        const int16_t *q = quant->ifast_multipliers + col;
+        int32_t *ws = workspace + col;
+
+        if (in[DCTSIZE*1] == 0 && in[DCTSIZE*2] == 0 && in[DCTSIZE*3] == 0 &&
+            in[DCTSIZE*4] == 0 && in[DCTSIZE*5] == 0 && in[DCTSIZE*6] == 0 &&
+            in[DCTSIZE*7] == 0) {
+            /* AC terms all zero - DC only */
+            int32_t dcval = DEQUANTIZE(in[0], q[0]);
+            for (int row = 0; row < DCTSIZE; row++) {
+                ws[DCTSIZE*row] = dcval;
+            }
+            continue;
+        }
+
+        /* Even part */
+        tmp0 = DEQUANTIZE(in[DCTSIZE*0], q[DCTSIZE*0]);
+        tmp1 = DEQUANTIZE(in[DCTSIZE*2], q[DCTSIZE*2]);
+        tmp2 = DEQUANTIZE(in[DCTSIZE*4], q[DCTSIZE*4]);
+        tmp3 = DEQUANTIZE(in[DCTSIZE*6], q[DCTSIZE*6]);
+
+        tmp10 = tmp0 + tmp2;
+        tmp11 = tmp0 - tmp2;
+        tmp13 = tmp1 + tmp3;
+        tmp12 = IFAST_MULTIPLY(tmp1 - tmp3, IFAST_FIX_1_414213562) - tmp13;
+
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+
+        /* Odd part */
+        tmp4 = DEQUANTIZE(in[DCTSIZE*1], q[DCTSIZE*1]);
+        tmp5 = DEQUANTIZE(in[DCTSIZE*3], q[DCTSIZE*3]);
+        tmp6 = DEQUANTIZE(in[DCTSIZE*5], q[DCTSIZE*5]);
+        tmp7 = DEQUANTIZE(in[DCTSIZE*7], q[DCTSIZE*7]);
+
+        z13 = tmp6 + tmp5;
+        z10 = tmp6 - tmp5;
+        z11 = tmp4 + tmp7;
+        z12 = tmp4 - tmp7;
+
+        tmp7 = z11 + z13;
+        tmp11 = IFAST_MULTIPLY(z11 - z13, IFAST_FIX_1_414213562);
+        z5 = IFAST_MULTIPLY(z10 + z12, IFAST_FIX_1_847759065);
+        tmp10 = IFAST_MULTIPLY(z12, IFAST_FIX_1_082392200) - z5;
+        tmp12 = IFAST_MULTIPLY(z10, -IFAST_FIX_2_613125930) + z5;
+
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 + tmp5;
+
+        ws[DCTSIZE*0] = tmp0 + tmp7;
+        ws[DCTSIZE*7] = tmp0 - tmp7;
+        ws[DCTSIZE*1] = tmp1 + tmp6;
+        ws[DCTSIZE*6] = tmp1 - tmp6;
+        ws[DCTSIZE*2] = tmp2 + tmp5;
+        ws[DCTSIZE*5] = tmp2 - tmp5;
+        ws[DCTSIZE*4] = tmp3 + tmp4;
+        ws[DCTSIZE*3] = tmp3 - tmp4;
+    }
+
+    /* Pass 2: process rows, remove the multiplier and 1-D pass scaling */
+    for (int row = 0; row < DCTSIZE; row++) {
+        const int32_t *ws = workspace + row * DCTSIZE;
+        uint8_t *outptr = output_block + row * DCTSIZE;
+
+        /* Range center and rounding bias ride along with the DC term */
+        int32_t dc = ws[0] + (CENTERJSAMPLE << (IFAST_SCALE_BITS + 3)) +
+                     (1 << (IFAST_SCALE_BITS + 2));
+
+        if (ws[1] == 0 && ws[2] == 0 && ws[3] == 0 && ws[4] == 0 &&
+            ws[5] == 0 && ws[6] == 0 && ws[7] == 0) {
+            uint8_t dcval = clamp_sample(dc >> (IFAST_SCALE_BITS + 3));
+            memset(outptr, dcval, DCTSIZE);
+            continue;
+        }
+
+        /* Even part */
+        tmp10 = dc + ws[4];
+        tmp11 = dc - ws[4];
+        tmp13 = ws[2] + ws[6];
+        tmp12 = IFAST_MULTIPLY(ws[2] - ws[6], IFAST_FIX_1_414213562) - tmp13;
+
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+
+        /* Odd part */
+        z13 = ws[5] + ws[3];
+        z10 = ws[5] - ws[3];
+        z11 = ws[1] + ws[7];
+        z12 = ws[1] - ws[7];
+
+        tmp7 = z11 + z13;
+        tmp11 = IFAST_MULTIPLY(z11 - z13, IFAST_FIX_1_414213562);
+        z5 = IFAST_MULTIPLY(z10 + z12, IFAST_FIX_1_847759065);
+        tmp10 = IFAST_MULTIPLY(z12, IFAST_FIX_1_082392200) - z5;
+        tmp12 = IFAST_MULTIPLY(z10, -IFAST_FIX_2_613125930) + z5;
+
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 + tmp5;
+
+        outptr[0] = clamp_sample((tmp0 + tmp7) >> (IFAST_SCALE_BITS + 3));
+        outptr[7] = clamp_sample((tmp0 - tmp7) >> (IFAST_SCALE_BITS + 3));
+        outptr[1] = clamp_sample((tmp1 + tmp6) >> (IFAST_SCALE_BITS + 3));
+        outptr[6] = clamp_sample((tmp1 - tmp6) >> (IFAST_SCALE_BITS + 3));
+        outptr[2] = clamp_sample((tmp2 + tmp5) >> (IFAST_SCALE_BITS + 3));
+        outptr[5] = clamp_sample((tmp2 - tmp5) >> (IFAST_SCALE_BITS + 3));
+        outptr[4] = clamp_sample((tmp3 + tmp4) >> (IFAST_SCALE_BITS + 3));
+        outptr[3] = clamp_sample((tmp3 - tmp4) >> (IFAST_SCALE_BITS + 3));
+    }
+}
+
+#ifdef __SSE2__
+
+/* One 1-D AAN pass over 8 vectors (inputs 0-7 in, outputs 0-7 out); each
+ * lane is an independent column (or row) */
+static inline void idct_float_1d_sse2(__m128 v[DCTSIZE]) {
+    const __m128 c1_414 = _mm_set1_ps(1.414213562f);
+    const __m128 c1_847 = _mm_set1_ps(1.847759065f);
+    const __m128 c1_082 = _mm_set1_ps(1.082392200f);
+    const __m128 c2_613 = _mm_set1_ps(-2.613125930f);
+
+    /* Even part */
+    __m128 tmp10 = _mm_add_ps(v[0], v[4]);
+    __m128 tmp11 = _mm_sub_ps(v[0], v[4]);
+    __m128 tmp13 = _mm_add_ps(v[2], v[6]);
+    __m128 tmp12 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(v[2], v[6]), c1_414), tmp13);
+
+    __m128 tmp0 = _mm_add_ps(tmp10, tmp13);
+    __m128 tmp3 = _mm_sub_ps(tmp10, tmp13);
+    __m128 tmp1 = _mm_add_ps(tmp11, tmp12);
+    __m128 tmp2 = _mm_sub_ps(tmp11, tmp12);
+
+    /* Odd part */
+    __m128 z13 = _mm_add_ps(v[5], v[3]);
+    __m128 z10 = _mm_sub_ps(v[5], v[3]);
+    __m128 z11 = _mm_add_ps(v[1], v[7]);
+    __m128 z12 = _mm_sub_ps(v[1], v[7]);
+
+    __m128 tmp7 = _mm_add_ps(z11, z13);
+    tmp11 = _mm_mul_ps(_mm_sub_ps(z11, z13), c1_414);
+    __m128 z5 = _mm_mul_ps(_mm_add_ps(z10, z12), c1_847);
+    tmp10 = _mm_sub_ps(_mm_mul_ps(z12, c1_082), z5);
+    tmp12 = _mm_add_ps(_mm_mul_ps(z10, c2_613), z5);
+
+    __m128 tmp6 = _mm_sub_ps(tmp12, tmp7);
+    __m128 tmp5 = _mm_sub_ps(tmp11, tmp6);
+    __m128 tmp4 = _mm_add_ps(tmp10, tmp5);
+
+    v[0] = _mm_add_ps(tmp0, tmp7);
+    v[7] = _mm_sub_ps(tmp0, tmp7);
+    v[1] = _mm_add_ps(tmp1, tmp6);
+    v[6] = _mm_sub_ps(tmp1, tmp6);
+    v[2] = _mm_add_ps(tmp2, tmp5);
+    v[5] = _mm_sub_ps(tmp2, tmp5);
+    v[4] = _mm_add_ps(tmp3, tmp4);
+    v[3] = _mm_sub_ps(tmp3, tmp4);
+}
+
+/* Float AAN IDCT, four columns (then rows) per SSE2 vector: the 8x8 block
+ * is handled as left and right halves, transposed in 4x4 quadrants
+ * between the passes */
+static void idct_float_sse2(int16_t *input_block, const quantization_table_t *quant,
+                            uint8_t *output_block) {
+    __m128 left[DCTSIZE], right[DCTSIZE];
+    const __m128i zero = _mm_setzero_si128();
+
+    /* Dequantize: vector r holds columns 0-3 (left) or 4-7 (right) of row r */
+    for (int row = 0; row < DCTSIZE; row++) {
+        __m128i coef = _mm_loadu_si128((const __m128i*)(input_block + row * DCTSIZE));
+        __m128i sign = _mm_cmpgt_epi16(zero, coef);
+        const float *q = quant->float_multipliers + row * DCTSIZE;
+        left[row] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(coef, sign)),
+                               _mm_loadu_ps(q));
+        right[row] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(coef, sign)),
+                                _mm_loadu_ps(q + 4));
+    }
+
+    /* Pass 1: columns */
+    idct_float_1d_sse2(left);
+    idct_float_1d_sse2(right);
+
+    /* Transpose so that vector k holds column k of rows 0-3 (top) or 4-7 (bottom) */
+    _MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+    _MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+    _MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+    _MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+
+    __m128 top[DCTSIZE], bottom[DCTSIZE];
+    for (int k = 0; k < 4; k++) {
+        top[k] = left[k];
+        top[k + 4] = right[k];
+        bottom[k] = left[k + 4];
+        bottom[k + 4] = right[k + 4];
+    }
+
+    /* Pass 2: rows */
+    idct_float_1d_sse2(top);
+    idct_float_1d_sse2(bottom);
+
+    /* Back to row-major, then round, recenter and saturate two rows at a time */
+    _MM_TRANSPOSE4_PS(top[0], top[1], top[2], top[3]);
+    _MM_TRANSPOSE4_PS(top[4], top[5], top[6], top[7]);
+    _MM_TRANSPOSE4_PS(bottom[0], bottom[1], bottom[2], bottom[3]);
+    _MM_TRANSPOSE4_PS(bottom[4], bottom[5], bottom[6], bottom[7]);
+
+    const __m128 center = _mm_set1_ps((float)CENTERJSAMPLE);
+    __m128i rows16[DCTSIZE];
+    for (int row = 0; row < 4; row++) {
+        rows16[row] = _mm_packs_epi32(_mm_cvtps_epi32(_mm_add_ps(top[row], center)),
+                                      _mm_cvtps_epi32(_mm_add_ps(top[row + 4], center)));
+        rows16[row + 4] = _mm_packs_epi32(_mm_cvtps_epi32(_mm_add_ps(bottom[row], center)),
+                                          _mm_cvtps_epi32(_mm_add_ps(bottom[row + 4], center)));
+    }
+    for (int row = 0; row < DCTSIZE; row += 2) {
+        _mm_storeu_si128((__m128i*)(output_block + row * DCTSIZE),
+                         _mm_packus_epi16(rows16[row], rows16[row + 1]));
+    }
+}
+
+#endif /* __SSE2__ */
+
+/* Float AAN IDCT (libjpeg's JDCT_FLOAT) */
+static void idct_float_c(int16_t *input_block, const quantization_table_t *quant,
+                         uint8_t *output_block) {
+    float workspace[DCTSIZE2];
+    float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    float tmp10, tmp11, tmp12, tmp13;
+    float z5, z10, z11, z12, z13;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < DCTSIZE; i++) {
+            /* Pass 0 runs down column i of the coefficients, pass 1 along row i */
+            int step = pass == 0 ? DCTSIZE : 1;
+            float *ws = pass == 0 ? workspace + i : workspace + i * DCTSIZE;
+            float v[DCTSIZE];
+
+            for (int k = 0; k < DCTSIZE; k++) {
+                v[k] = pass == 0
+                    ? input_block[i + k * DCTSIZE] * quant->float_multipliers[i + k * DCTSIZE]
+                    : ws[k];
+            }
+
+            /* Even part */
+            tmp10 = v[0] + v[4];
+            tmp11 = v[0] - v[4];
+            tmp13 = v[2] + v[6];
+            tmp12 = (v[2] - v[6]) * 1.414213562f - tmp13;
+
+            tmp0 = tmp10 + tmp13;
+            tmp3 = tmp10 - tmp13;
+            tmp1 = tmp11 + tmp12;
+            tmp2 = tmp11 - tmp12;
+
+            /* Odd part */
+            z13 = v[5] + v[3];
+            z10 = v[5] - v[3];
+            z11 = v[1] + v[7];
+            z12 = v[1] - v[7];
+
+            tmp7 = z11 + z13;
+            tmp11 = (z11 - z13) * 1.414213562f;
+            z5 = (z10 + z12) * 1.847759065f;
+            tmp10 = z12 * 1.082392200f - z5;
+            tmp12 = z10 * -2.613125930f + z5;
+
+            tmp6 = tmp12 - tmp7;
+            tmp5 = tmp11 - tmp6;
+            tmp4 = tmp10 + tmp5;
+
+            ws[step * 0] = tmp0 + tmp7;
+            ws[step * 7] = tmp0 - tmp7;
+            ws[step * 1] = tmp1 + tmp6;
+            ws[step * 6] = tmp1 - tmp6;
+            ws[step * 2] = tmp2 + tmp5;
+            ws[step * 5] = tmp2 - tmp5;
+            ws[step * 4] = tmp3 + tmp4;
+            ws[step * 3] = tmp3 - tmp4;
+        }
+    }
+
+    for (int i = 0; i < DCTSIZE2; i++) {
+        output_block[i] = clamp_sample((int32_t)lrintf(workspace[i] + CENTERJSAMPLE));
+    }
+}
+
+#ifdef IDCT_FLOAT_AVX2
+
+/* Transpose 8 vectors of 8 floats in place */
+__attribute__((target("avx2,fma")))
+static inline void transpose_8x8_ps(__m256 v[DCTSIZE]) {
+    __m256 t[DCTSIZE], u[DCTSIZE];
+
+    for (int i = 0; i < DCTSIZE; i += 2) {
+        t[i] = _mm256_unpacklo_ps(v[i], v[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(v[i], v[i + 1]);
+    }
+    for (int i = 0; i < DCTSIZE; i += 4) {
+        u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 4; i++) {
+        v[i] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x20);
+        v[i + 4] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x31);
+    }
+}
+
+/* idct_float_1d_sse2 over 8 lanes, with the multiply-adds fused */
+__attribute__((target("avx2,fma")))
+static inline void idct_float_1d_avx2(__m256 v[DCTSIZE]) {
+    const __m256 c1_414 = _mm256_set1_ps(1.414213562f);
+    const __m256 c1_847 = _mm256_set1_ps(1.847759065f);
+    const __m256 c1_082 = _mm256_set1_ps(1.082392200f);
+    const __m256 c2_613 = _mm256_set1_ps(-2.613125930f);
+
+    /* Even part */
+    __m256 tmp10 = _mm256_add_ps(v[0], v[4]);
+    __m256 tmp11 = _mm256_sub_ps(v[0], v[4]);
+    __m256 tmp13 = _mm256_add_ps(v[2], v[6]);
+    __m256 tmp12 = _mm256_fmsub_ps(_mm256_sub_ps(v[2], v[6]), c1_414, tmp13);
+
+    __m256 tmp0 = _mm256_add_ps(tmp10, tmp13);
+    __m256 tmp3 = _mm256_sub_ps(tmp10, tmp13);
+    __m256 tmp1 = _mm256_add_ps(tmp11, tmp12);
+    __m256 tmp2 = _mm256_sub_ps(tmp11, tmp12);
+
+    /* Odd part */
+    __m256 z13 = _mm256_add_ps(v[5], v[3]);
+    __m256 z10 = _mm256_sub_ps(v[5], v[3]);
+    __m256 z11 = _mm256_add_ps(v[1], v[7]);
+    __m256 z12 = _mm256_sub_ps(v[1], v[7]);
+
+    __m256 tmp7 = _mm256_add_ps(z11, z13);
+    tmp11 = _mm256_mul_ps(_mm256_sub_ps(z11, z13), c1_414);
+    __m256 z5 = _mm256_mul_ps(_mm256_add_ps(z10, z12), c1_847);
+    tmp10 = _mm256_fmsub_ps(z12, c1_082, z5);
+    tmp12 = _mm256_fmadd_ps(z10, c2_613, z5);
+
+    __m256 tmp6 = _mm256_sub_ps(tmp12, tmp7);
+    __m256 tmp5 = _mm256_sub_ps(tmp11, tmp6);
+    __m256 tmp4 = _mm256_add_ps(tmp10, tmp5);
+
+    v[0] = _mm256_add_ps(tmp0, tmp7);
+    v[7] = _mm256_sub_ps(tmp0, tmp7);
+    v[1] = _mm256_add_ps(tmp1, tmp6);
+    v[6] = _mm256_sub_ps(tmp1, tmp6);
+    v[2] = _mm256_add_ps(tmp2, tmp5);
+    v[5] = _mm256_sub_ps(tmp2, tmp5);
+    v[4] = _mm256_add_ps(tmp3, tmp4);
+    v[3] = _mm256_sub_ps(tmp3, tmp4);
+}
+
+/* Float AAN IDCT, a whole row of the block per AVX2 vector: no halves or
+ * quadrants, one 8x8 transpose between the passes and one after */
+__attribute__((target("avx2,fma")))
+static void idct_float_avx2(int16_t *input_block, const quantization_table_t *quant,
+                            uint8_t *output_block) {
+    __m256 v[DCTSIZE];
+
+    for (int row = 0; row < DCTSIZE; row++) {
+        __m128i coef = _mm_loadu_si128((const __m128i*)(input_block + row * DCTSIZE));
+        v[row] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(coef)),
+                               _mm256_loadu_ps(quant->float_multipliers + row * DCTSIZE));
+    }
+
+    /* Pass 1: columns; pass 2: rows */
+    idct_float_1d_avx2(v);
+    transpose_8x8_ps(v);
+    idct_float_1d_avx2(v);
+    transpose_8x8_ps(v);
+
+    /* Round, recenter and saturate two rows at a time */
+    const __m256 center = _mm256_set1_ps((float)CENTERJSAMPLE);
+    for (int row = 0; row < DCTSIZE; row += 2) {
+        __m256i even = _mm256_cvtps_epi32(_mm256_add_ps(v[row], center));
+        __m256i odd = _mm256_cvtps_epi32(_mm256_add_ps(v[row + 1], center));
+        __m128i even16 = _mm_packs_epi32(_mm256_castsi256_si128(even),
+                                         _mm256_extracti128_si256(even, 1));
+        __m128i odd16 = _mm_packs_epi32(_mm256_castsi256_si128(odd),
+                                        _mm256_extracti128_si256(odd, 1));
+        _mm_storeu_si128((__m128i*)(output_block + row * DCTSIZE),
+                         _mm_packus_epi16(even16, odd16));
+    }
+}
+
+#endif /* IDCT_FLOAT_AVX2 */
+
+/* The float kernel for this CPU */
+static idct_fn idct_float_kernel(void) {
+#ifdef IDCT_FLOAT_AVX2
+    if (jpeg_simd_limit >= JPEG_SIMD_AVX2 && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma")) {
+        return idct_float_avx2;
+    }
+#endif
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        return idct_float_sse2;
+    }
+#endif
+    return idct_float_c;
+}
+
+void idct_float(int16_t *input_block, const quantization_table_t *quant,
+                uint8_t *output_block) {
+    idct_float_kernel()(input_block, quant, output_block);
+}
+
+idct_fn idct_select(idct_method_t method) {
+    switch (method) {
+        case IDCT_IFAST: return idct_ifast;
+        case IDCT_FLOAT: return idct_float_kernel();
+        default:         return idct_2d;
+    }
+}
+
+const char* idct_method_name(idct_method_t method) {
+    switch (method) {
+        case IDCT_IFAST: return "ifast";
+        case IDCT_FLOAT: return "float";
+        default:         return "islow";
+    }
+}
+
+/*
+ * Forward DCT: the same LL&M factorization run in reverse (as libjpeg's
+ * jfdctint). Outputs are scaled up by 8 relative to a true DCT; the
+ * quantizer divides that out.
+ */
+void fdct_islow(const uint8_t *input, size_t stride, int32_t *output) {
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+    int32_t *dataptr;
+    int ctr;
+
+    /* Pass 1: process rows, removing the sample offset */
+    dataptr = output;
+    for (ctr = 0; ctr < DCTSIZE; ctr++) {
+        const uint8_t *row = input + ctr * stride;
+        int32_t d0 = row[0] - CENTERJSAMPLE, d1 = row[1] - CENTERJSAMPLE;
+        int32_t d2 = row[2] - CENTERJSAMPLE, d3 = row[3] - CENTERJSAMPLE;
+        int32_t d4 = row[4] - CENTERJSAMPLE, d5 = row[5] - CENTERJSAMPLE;
+        int32_t d6 = row[6] - CENTERJSAMPLE, d7 = row[7] - CENTERJSAMPLE;
+
+        tmp0 = d0 + d7;
+        tmp7 = d0 - d7;
+        tmp1 = d1 + d6;
+        tmp6 = d1 - d6;
+        tmp2 = d2 + d5;
+        tmp5 = d2 - d5;
+        tmp3 = d3 + d4;
+        tmp4 = d3 - d4;
+
+        /* Even part */
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        dataptr[0] = (tmp10 + tmp11) * (1 << PASS1_BITS);
+        dataptr[4] = (tmp10 - tmp11) * (1 << PASS1_BITS);
+
+        z1 = MULTIPLY(tmp12 + tmp13, FIX_0_541196100);
+        dataptr[2] = RIGHT_SHIFT(z1 + MULTIPLY(tmp13, FIX_0_765366865), CONST_BITS - PASS1_BITS);
+        dataptr[6] = RIGHT_SHIFT(z1 + MULTIPLY(tmp12, -FIX_1_847759065), CONST_BITS - PASS1_BITS);
+
+        /* Odd part */
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = MULTIPLY(z3 + z4, FIX_1_175875602);
+
+        tmp4 = MULTIPLY(tmp4, FIX_0_298631336);
+        tmp5 = MULTIPLY(tmp5, FIX_2_053119869);
+        tmp6 = MULTIPLY(tmp6, FIX_3_072711026);
+        tmp7 = MULTIPLY(tmp7, FIX_1_501321110);
+        z1 = MULTIPLY(z1, -FIX_0_899976223);
+        z2 = MULTIPLY(z2, -FIX_2_562915447);
+        z3 = MULTIPLY(z3, -FIX_1_961570560);
+        z4 = MULTIPLY(z4, -FIX_0_390180644);
+
+        z3 += z5;
+        z4 += z5;
+
+        dataptr[7] = RIGHT_SHIFT(tmp4 + z1 + z3, CONST_BITS - PASS1_BITS);
+        dataptr[5] = RIGHT_SHIFT(tmp5 + z2 + z4, CONST_BITS - PASS1_BITS);
+        dataptr[3] = RIGHT_SHIFT(tmp6 + z2 + z3, CONST_BITS - PASS1_BITS);
+        dataptr[1] = RIGHT_SHIFT(tmp7 + z1 + z4, CONST_BITS - PASS1_BITS);
+
+        dataptr += DCTSIZE;
+    }
+
+    /* Pass 2: process columns, removing the pass 1 scaling */
+    dataptr = output;
+    for (ctr = 0; ctr < DCTSIZE; ctr++) {
+        tmp0 = dataptr[DCTSIZE*0] + dataptr[DCTSIZE*7];
+        tmp7 = dataptr[DCTSIZE*0] - dataptr[DCTSIZE*7];
+        tmp1 = dataptr[DCTSIZE*1] + dataptr[DCTSIZE*6];
+        tmp6 = dataptr[DCTSIZE*1] - dataptr[DCTSIZE*6];
+        tmp2 = dataptr[DCTSIZE*2] + dataptr[DCTSIZE*5];
+        tmp5 = dataptr[DCTSIZE*2] - dataptr[DCTSIZE*5];
+        tmp3 = dataptr[DCTSIZE*3] + dataptr[DCTSIZE*4];
+        tmp4 = dataptr[DCTSIZE*3] - dataptr[DCTSIZE*4];
+
+        /* Even part */
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        dataptr[DCTSIZE*0] = RIGHT_SHIFT(tmp10 + tmp11, PASS1_BITS);
+        dataptr[DCTSIZE*4] = RIGHT_SHIFT(tmp10 - tmp11, PASS1_BITS);
+
+        z1 = MULTIPLY(tmp12 + tmp13, FIX_0_541196100);
+        dataptr[DCTSIZE*2] = RIGHT_SHIFT(z1 + MULTIPLY(tmp13, FIX_0_765366865),
+                                         CONST_BITS + PASS1_BITS);
+        dataptr[DCTSIZE*6] = RIGHT_SHIFT(z1 + MULTIPLY(tmp12, -FIX_1_847759065),
+                                         CONST_BITS + PASS1_BITS);
+
+        /* Odd part */
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = MULTIPLY(z3 + z4, FIX_1_175875602);
+
+        tmp4 = MULTIPLY(tmp4, FIX_0_298631336);
+        tmp5 = MULTIPLY(tmp5, FIX_2_053119869);
+        tmp6 = MULTIPLY(tmp6, FIX_3_072711026);
+        tmp7 = MULTIPLY(tmp7, FIX_1_501321110);
+        z1 = MULTIPLY(z1, -FIX_0_899976223);
+        z2 = MULTIPLY(z2, -FIX_2_562915447);
+        z3 = MULTIPLY(z3, -FIX_1_961570560);
+        z4 = MULTIPLY(z4, -FIX_0_390180644);
+
+        z3 += z5;
+        z4 += z5;
+
+        dataptr[DCTSIZE*7] = RIGHT_SHIFT(tmp4 + z1 + z3, CONST_BITS + PASS1_BITS);
+        dataptr[DCTSIZE*5] = RIGHT_SHIFT(tmp5 + z2 + z4, CONST_BITS + PASS1_BITS);
+        dataptr[DCTSIZE*3] = RIGHT_SHIFT(tmp6 + z2 + z3, CONST_BITS + PASS1_BITS);
+        dataptr[DCTSIZE*1] = RIGHT_SHIFT(tmp7 + z1 + z4, CONST_BITS + PASS1_BITS);
+
+        dataptr++;
+    }
+}
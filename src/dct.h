@@ -1,9 +1,53 @@
 #ifndef DCT_H
 #define DCT_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "../include/jpeg_types.h"
+
+/* An 8x8 (or scaled) IDCT with integrated dequantization */
+typedef void (*idct_fn)(int16_t *input_block, const quantization_table_t *quant,
+                        uint8_t *output_block);
 
 /* Apply 2D inverse DCT to an 8x8 block with integrated dequantization */
-void idct_2d(int16_t *input_block, const uint8_t *quant_table, uint8_t *output_block);
+void idct_2d(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+
+/* Blocks per call of the batched IDCT kernel (one per vector lane) */
+#define IDCT_BATCH 8
+
+/* idct_2d over count consecutive blocks with the same quantization table,
+ * bit-exact with it: full groups of IDCT_BATCH go through a kernel that
+ * transforms one block per vector lane. Block i's 8x8 output starts at
+ * outputs + i * output_step. */
+void idct_2d_batch(int16_t *blocks, const quantization_table_t *quant, uint8_t *outputs,
+                   size_t output_step, int count);
+
+/* AAN fast integer and float IDCTs; they dequantize with the prescaled
+ * multipliers from idct_prepare_quant_table */
+void idct_ifast(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+void idct_float(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+
+/* Fill in a table's ifast/float multipliers from its (natural order) values */
+void idct_prepare_quant_table(quantization_table_t *table);
+
+/* 8x8 IDCT implementing method, and its command-line name */
+idct_fn idct_select(idct_method_t method);
+const char* idct_method_name(idct_method_t method);
+
+/* Scaled IDCTs that emit a 16x16 or 16x8 (wide x tall) block from one
+ * 8x8 coefficient block: the same image content at twice the resolution,
+ * used to upsample h2v2 and h2v1 chroma inside the transform */
+void idct_16x16(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+void idct_16x8(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+
+/* Reduced IDCTs for 1/2, 1/4 and 1/8 scale decoding: a 4x4, 2x2 or 1x1
+ * block of the same content from the low frequencies of an 8x8 block */
+void idct_4x4(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+void idct_2x2(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+void idct_1x1(int16_t *input_block, const quantization_table_t *quant, uint8_t *output_block);
+
+/* Forward DCT of an 8x8 block of samples (stride bytes per row). Output is
+ * in natural order and scaled up by 8. */
+void fdct_islow(const uint8_t *input, size_t stride, int32_t *output);
 
 #endif /* DCT_H */
@@ -1,44 +1,772 @@
 #include "decoder.h"
 #include "huffman.h"
 #include "dct.h"
+#include "color.h"
+#include "perf.h"
+#include "threadpool.h"
+#include "trace.h"
 #include "utils.h"
+#include <pthread.h>
 #include <string.h>
 #include <sys/time.h>
 
-/* Profiling timers (in microseconds) */
-static double huffman_time_us = 0.0;
-static double idct_time_us = 0.0;
-
 static double get_time_us(void) {
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000000.0 + tv.tv_usec;
 }
 
-/* Main JPEG decoding function */
-int jpeg_decode(jpeg_decoder_t *decoder) {
-    printf("\nStarting JPEG decode...\n");
-
-    /* Reset profiling timers */
-    huffman_time_us = 0.0;
-    idct_time_us = 0.0;
-
-    /* Generate Huffman codes from tables */
+/* Generate Huffman codes of tables that were set without them; parse_dht
+ * builds them already, and tables carried over from a previous frame of a
+ * stream keep theirs */
+static void prepare_huffman_tables(jpeg_decoder_t *decoder) {
     for (int i = 0; i < MAX_HUFFMAN_TABLES; i++) {
-        if (decoder->dc_tables[i].is_set) {
+        if (decoder->dc_tables[i].is_set && !decoder->dc_tables[i].codes_generated) {
             generate_huffman_codes(&decoder->dc_tables[i]);
-            printf("Generated DC Huffman codes for table %d\n", i);
+            decoder->stats.huffman_tables_built++;
+            JPEG_LOG("Generated DC Huffman codes for table %d\n", i);
         }
-        if (decoder->ac_tables[i].is_set) {
+        if (decoder->ac_tables[i].is_set && !decoder->ac_tables[i].codes_generated) {
             generate_huffman_codes(&decoder->ac_tables[i]);
-            printf("Generated AC Huffman codes for table %d\n", i);
+            decoder->stats.huffman_tables_built++;
+            JPEG_LOG("Generated AC Huffman codes for table %d\n", i);
+        }
+    }
+}
+
+/* Reset before each decode */
+void jpeg_reset_stats(jpeg_decoder_t *decoder) {
+    jpeg_decode_stats_t *stats = &decoder->stats;
+    unsigned long reused = stats->huffman_tables_reused;
+    unsigned long built = stats->huffman_tables_built;
+
+    memset(stats, 0, sizeof(jpeg_decode_stats_t));
+    stats->huffman_tables_reused = reused;
+    stats->huffman_tables_built = built;
+}
+
+void jpeg_decode_cancel(jpeg_decoder_t *decoder) {
+    __atomic_store_n(&decoder->cancel_requested, 1, __ATOMIC_RELAXED);
+}
+
+/* Polled once per MCU row: a row is the unit a cancel waits for */
+static bool decode_cancelled(jpeg_decoder_t *decoder, int mcu_row) {
+    if (!__atomic_load_n(&decoder->cancel_requested, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    JPEG_LOG("Decode cancelled at MCU row %d\n", mcu_row);
+    return true;
+}
+
+/* At a restart interval boundary: reset predictors and skip the RST marker */
+static void process_restart(jpeg_decoder_t *decoder, bit_reader_t *reader, int mcu_count) {
+    if (decoder->restart_interval == 0 || mcu_count == 0 ||
+        mcu_count % decoder->restart_interval != 0) {
+        return;
+    }
+
+    /* Reset DC predictors */
+    for (int i = 0; i < MAX_COMPONENTS; i++) {
+        decoder->dc_predictors[i] = 0;
+    }
+
+    /* Align to byte boundary */
+    reader->bits_in_buffer = 0;
+    reader->bit_buffer = 0;
+
+    /* Skip restart marker (RST0-RST7) */
+    if (reader->byte_pos < reader->data_size - 1) {
+        if (reader->data[reader->byte_pos] == 0xFF) {
+            uint8_t marker = reader->data[reader->byte_pos + 1];
+            if (marker >= 0xD0 && marker <= 0xD7) {
+                reader->byte_pos += 2;  /* Skip RST marker */
+            }
+        }
+    }
+}
+
+/* Per-component state for the specialized MCU decoders, resolved once per
+ * scan instead of through component_info_t on every block */
+typedef struct {
+    huffman_table_t *dc_table;
+    huffman_table_t *ac_table;
+    const quantization_table_t *quant;
+    int16_t *dc_predictor;
+    uint8_t *buffer;
+    int width;                  /* Buffer stride */
+    int height;
+    idct_fn idct;
+    int block_width;            /* Samples per block from idct: 8 or 16 */
+    int block_height;
+    size_t row_queue;           /* First block of the component in an MCU row's coefficients */
+} mcu_component_t;
+
+/* Entropy-decode one MCU into the block queues of an MCU row's coefficients
+ * (see decode_row_coefficients) */
+typedef int (*mcu_decode_fn)(const mcu_component_t *comps, bit_reader_t *reader,
+                             int mcu_col, int16_t *coefficients, jpeg_decode_stats_t *stats);
+
+/* Copy a decoded block into a component buffer, clipping at its edges */
+static void put_block(const mcu_component_t *comp, int x, int y, const uint8_t *block) {
+    if (x >= comp->width || y >= comp->height) {
+        return;
+    }
+
+    int bw = comp->block_width;
+    int cols = comp->width - x < bw ? comp->width - x : bw;
+    int rows = comp->height - y < comp->block_height ? comp->height - y : comp->block_height;
+    uint8_t *dest = comp->buffer + (size_t)y * comp->width + x;
+    for (int row = 0; row < rows; row++) {
+        memcpy(dest, block + row * bw, cols);
+        dest += comp->width;
+    }
+}
+
+/* Consume one block's Huffman codes and magnitude bits without storing
+ * coefficients (luma-only decoding of chroma) */
+static int skip_block(bit_reader_t *reader, huffman_table_t *dc_table,
+                      huffman_table_t *ac_table) {
+    int dc_symbol = decode_huffman_symbol(reader, dc_table);
+    if (dc_symbol < 0) {
+        fprintf(stderr, "Failed to decode DC symbol\n");
+        return -1;
+    }
+    read_bits(reader, dc_symbol);
+
+    for (int k = 1; k < 64; k++) {
+        int ac_symbol = decode_huffman_symbol(reader, ac_table);
+        if (ac_symbol < 0) {
+            fprintf(stderr, "Failed to decode AC symbol\n");
+            return -1;
+        }
+        if (ac_symbol == 0x00) {
+            break;
+        }
+        k += ac_symbol >> 4;
+        if (k >= 64) {
+            break;
+        }
+        read_bits(reader, ac_symbol & 0x0F);
+    }
+
+    return 0;
+}
+
+/* Entropy-decode one block into a zeroed queue entry; components without
+ * an IDCT are skipped */
+static inline int queue_block(const mcu_component_t *comp, bit_reader_t *reader,
+                              int16_t *block, jpeg_decode_stats_t *stats) {
+    if (!comp->idct) {
+        return skip_block(reader, comp->dc_table, comp->ac_table);
+    }
+    return decode_block(stats, reader, comp->dc_table, comp->ac_table,
+                        comp->dc_predictor, block);
+}
+
+/* Define an MCU decoder for a fixed layout: luma H x V blocks followed by
+ * one block each of the remaining components. The block counts and queue
+ * strides are compile-time constants in each generated function; how the
+ * blocks are reconstructed (8 x 8, or chroma over the whole MCU with scaled
+ * IDCTs) is up to idct_row and store_row. */
+#define DEFINE_MCU_DECODER(name, NUM_COMPONENTS, H, V)                              \
+static int name(const mcu_component_t *comps, bit_reader_t *reader,                \
+                int mcu_col, int16_t *coefficients, jpeg_decode_stats_t *stats) {   \
+    int16_t *block = coefficients + (size_t)mcu_col * (H) * (V) * BLOCK_SIZE;       \
+    for (int b = 0; b < (H) * (V); b++, block += BLOCK_SIZE) {                      \
+        if (queue_block(&comps[0], reader, block, stats) != 0) {                    \
+            return -1;                                                              \
+        }                                                                           \
+    }                                                                               \
+    for (int c = 1; c < (NUM_COMPONENTS); c++) {                                    \
+        block = coefficients + (comps[c].row_queue + mcu_col) * BLOCK_SIZE;         \
+        if (queue_block(&comps[c], reader, block, stats) != 0) {                    \
+            return -1;                                                              \
+        }                                                                           \
+    }                                                                               \
+    return 0;                                                                       \
+}
+
+DEFINE_MCU_DECODER(decode_mcu_gray, 1, 1, 1)
+DEFINE_MCU_DECODER(decode_mcu_h1v1, 3, 1, 1)
+DEFINE_MCU_DECODER(decode_mcu_h2v1, 3, 2, 1)
+DEFINE_MCU_DECODER(decode_mcu_h2v2, 3, 2, 2)
+DEFINE_MCU_DECODER(decode_mcu_h1v2, 3, 1, 2)
+
+/* Any layout: the same queues, with the block counts read per MCU */
+static int decode_mcu_queued(const jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                             bit_reader_t *reader, int mcu_col, int16_t *coefficients,
+                             jpeg_decode_stats_t *stats) {
+    const frame_header_t *frame = &decoder->frame;
+
+    for (int c = 0; c < frame->num_components; c++) {
+        int blocks = frame->components[c].h_sampling * frame->components[c].v_sampling;
+        int16_t *block = coefficients + (comps[c].row_queue + (size_t)mcu_col * blocks) * BLOCK_SIZE;
+        for (int b = 0; b < blocks; b++, block += BLOCK_SIZE) {
+            if (queue_block(&comps[c], reader, block, stats) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Scaled-IDCT upsampling covers 4:2:2 (h2v1) and 4:2:0 (h2v2) with 1x1 chroma */
+static bool idct_upsampling_layout(const jpeg_decoder_t *decoder) {
+    const frame_header_t *frame = &decoder->frame;
+    if (frame->num_components != 3 || frame->components[0].h_sampling != 2 ||
+        (frame->components[0].v_sampling != 1 && frame->components[0].v_sampling != 2)) {
+        return false;
+    }
+    for (int i = 1; i < 3; i++) {
+        if (frame->components[i].h_sampling != 1 || frame->components[i].v_sampling != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Pick a specialized MCU decoder for the frame's sampling layout and resolve
+ * its per-component state. Returns NULL for layouts that need
+ * decode_mcu_queued. */
+static mcu_decode_fn select_mcu_decoder(jpeg_decoder_t *decoder, mcu_component_t *comps) {
+    const frame_header_t *frame = &decoder->frame;
+    const component_info_t *luma = &frame->components[0];
+
+    for (int i = 0; i < frame->num_components; i++) {
+        const component_info_t *info = &frame->components[i];
+        comps[i].dc_table = &decoder->dc_tables[info->dc_table_id];
+        comps[i].ac_table = &decoder->ac_tables[info->ac_table_id];
+        comps[i].quant = &decoder->quant_tables[info->quant_table_id];
+        comps[i].dc_predictor = &decoder->dc_predictors[i];
+        comps[i].buffer = decoder->component_buffers[i];
+        comps[i].width = decoder->component_width[i];
+        comps[i].height = decoder->component_height[i];
+        comps[i].idct = (i > 0 && decoder->luma_only) ? NULL : idct_select(decoder->idct_method);
+        comps[i].block_width = 8;
+        comps[i].block_height = 8;
+        comps[i].row_queue = i == 0 ? 0
+            : comps[i - 1].row_queue + (size_t)decoder->mcu_width *
+              frame->components[i - 1].h_sampling * frame->components[i - 1].v_sampling;
+    }
+
+    /* Chroma blocks expand to the full MCU (see idct_upsampling_layout) */
+    if (decoder->idct_upsampling) {
+        for (int i = 1; i < 3; i++) {
+            comps[i].idct = luma->v_sampling == 2 ? idct_16x16 : idct_16x8;
+            comps[i].block_width = 16;
+            comps[i].block_height = luma->v_sampling * 8;
+        }
+        return luma->v_sampling == 2 ? decode_mcu_h2v2 : decode_mcu_h2v1;
+    }
+
+    if (frame->num_components == 1) {
+        return luma->h_sampling == 1 && luma->v_sampling == 1 ? decode_mcu_gray : NULL;
+    }
+
+    /* Color layouts: full-MCU chroma blocks only */
+    if (frame->num_components != 3) {
+        return NULL;
+    }
+    for (int i = 1; i < 3; i++) {
+        if (frame->components[i].h_sampling != 1 || frame->components[i].v_sampling != 1) {
+            return NULL;
+        }
+    }
+
+    switch ((luma->h_sampling << 4) | luma->v_sampling) {
+        case 0x11: return decode_mcu_h1v1;
+        case 0x21: return decode_mcu_h2v1;
+        case 0x22: return decode_mcu_h2v2;
+        case 0x12: return decode_mcu_h1v2;
+        default:   return NULL;
+    }
+}
+
+/* Hand the image rows of a finished MCU row to the streaming consumer */
+static int emit_mcu_row(jpeg_decoder_t *decoder, int mcu_row) {
+    int first_row = mcu_row * decoder->mcu_size_y;
+    int num_rows = decoder->mcu_size_y;
+    if (first_row + num_rows > decoder->frame.height) {
+        num_rows = decoder->frame.height - first_row;
+    }
+    if (decoder->row_callback(decoder, first_row, num_rows, decoder->row_callback_data) != 0) {
+        fprintf(stderr, "Row consumer failed at MCU row %d\n", mcu_row);
+        return -1;
+    }
+    return 0;
+}
+
+/* Blocks in one MCU row, over all components */
+static size_t row_block_count(const jpeg_decoder_t *decoder) {
+    size_t blocks = 0;
+    for (int c = 0; c < decoder->frame.num_components; c++) {
+        blocks += (size_t)decoder->mcu_width * decoder->frame.components[c].h_sampling *
+                  decoder->frame.components[c].v_sampling;
+    }
+    return blocks;
+}
+
+/* Entropy-decode one MCU row into a zeroed coefficient buffer. Each
+ * component's blocks are queued together (from row_queue, MCU by MCU,
+ * rows of blocks top to bottom) so the IDCT can run over them in batches. */
+static int decode_row_coefficients(jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                                   mcu_decode_fn decode_fn, bit_reader_t *reader,
+                                   int mcu_row, int16_t *coefficients) {
+    for (int mcu_col = 0; mcu_col < decoder->mcu_width; mcu_col++) {
+        process_restart(decoder, reader, mcu_row * decoder->mcu_width + mcu_col);
+
+        int result = decode_fn
+            ? decode_fn(comps, reader, mcu_col, coefficients, &decoder->stats)
+            : decode_mcu_queued(decoder, comps, reader, mcu_col, coefficients, &decoder->stats);
+        if (result != 0) {
+            fprintf(stderr, "Failed to decode MCU at (%d, %d)\n", mcu_col, mcu_row);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Run the IDCTs of MCU columns [first_col, end_col) of a row's coefficient
+ * queues into 16 x 16 sample slots (one per block, same order), then zero
+ * those coefficients for the next use. The accurate IDCT runs over whole
+ * queues in vector batches. */
+static void idct_row(const jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                     int16_t *coefficients, uint8_t *spatial, int first_col, int end_col) {
+    const frame_header_t *frame = &decoder->frame;
+
+    for (int c = 0; c < frame->num_components; c++) {
+        const mcu_component_t *comp = &comps[c];
+        int mcu_blocks = frame->components[c].h_sampling * frame->components[c].v_sampling;
+        int blocks = (end_col - first_col) * mcu_blocks;
+        size_t first = comp->row_queue + (size_t)first_col * mcu_blocks;
+        int16_t *block = coefficients + first * BLOCK_SIZE;
+        uint8_t *spatial_block = spatial + first * 16 * 16;
+
+        if (!comp->idct) {
+            continue;
+        }
+        if (comp->idct == idct_2d) {
+            idct_2d_batch(block, comp->quant, spatial_block, 16 * 16, blocks);
+        } else {
+            for (int b = 0; b < blocks; b++, block += BLOCK_SIZE, spatial_block += 16 * 16) {
+                comp->idct(block, comp->quant, spatial_block);
+            }
+        }
+        memset(coefficients + first * BLOCK_SIZE, 0, (size_t)blocks * BLOCK_SIZE * sizeof(int16_t));
+    }
+}
+
+/* Scatter the sample slots of idct_row into the component buffers */
+static void store_row(const jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                      const uint8_t *spatial, int mcu_row, int first_col, int end_col) {
+    const frame_header_t *frame = &decoder->frame;
+
+    for (int c = 0; c < frame->num_components; c++) {
+        const mcu_component_t *comp = &comps[c];
+        int h_blocks = frame->components[c].h_sampling;
+        int v_blocks = frame->components[c].v_sampling;
+        const uint8_t *spatial_block = spatial +
+            (comp->row_queue + (size_t)first_col * h_blocks * v_blocks) * 16 * 16;
+
+        if (!comp->idct) {
+            continue;
+        }
+        for (int mcu_col = first_col; mcu_col < end_col; mcu_col++) {
+            for (int v = 0; v < v_blocks; v++) {
+                for (int h = 0; h < h_blocks; h++, spatial_block += 16 * 16) {
+                    put_block(comp, (mcu_col * h_blocks + h) * comp->block_width,
+                              (mcu_row * v_blocks + v) * comp->block_height, spatial_block);
+                }
+            }
+        }
+    }
+}
+
+/* Pipelined decode: the calling thread entropy-decodes MCU rows into a ring
+ * of coefficient buffers and hands each finished row to a worker, which
+ * runs the IDCTs and stores the samples. Without a row consumer the workers
+ * also convert every MCU row to RGB as soon as it and its neighbors (the
+ * chroma context of the upsamplers) are reconstructed. */
+typedef struct decode_pipeline decode_pipeline_t;
+
+typedef struct {
+    decode_pipeline_t *pipe;
+    int mcu_row;
+    int16_t *coefficients;      /* One MCU row, see decode_row_coefficients */
+    uint8_t *spatial;           /* Its samples, see idct_row */
+} pipeline_slot_t;
+
+struct decode_pipeline {
+    jpeg_decoder_t *decoder;
+    const mcu_component_t *comps;
+    bool convert;               /* Workers write RGB into decoder->image_data */
+
+    pthread_mutex_t lock;
+    pthread_cond_t row_finished;
+    bool *row_done;             /* IDCT finished, per MCU row */
+    bool *row_converted;        /* RGB conversion claimed, per MCU row */
+    int next_delivered;         /* Next MCU row for the row callback */
+    bool failed;
+    double idct_time_us;
+    double convert_time_us;
+};
+
+/* An MCU row can be converted once it and the rows on either side are done */
+static bool pipeline_can_convert(const decode_pipeline_t *pipe, int mcu_row) {
+    int last = pipe->decoder->mcu_height - 1;
+    if (mcu_row < 0 || mcu_row > last || pipe->row_converted[mcu_row]) {
+        return false;
+    }
+    return pipe->row_done[mcu_row] &&
+           (mcu_row == 0 || pipe->row_done[mcu_row - 1]) &&
+           (mcu_row == last || pipe->row_done[mcu_row + 1]);
+}
+
+static int pipeline_convert_row(decode_pipeline_t *pipe, int mcu_row) {
+    jpeg_decoder_t *decoder = pipe->decoder;
+    int y_start = mcu_row * decoder->mcu_size_y;
+    int y_end = y_start + decoder->mcu_size_y;
+
+    return ycbcr_to_pixels_rows(decoder, y_start, y_end,
+                                decoder->output_pixels + (size_t)y_start * decoder->output_stride,
+                                decoder->output_stride, decoder->output_format);
+}
+
+/* Worker job: IDCT and store one MCU row, then convert whatever became ready */
+static void pipeline_reconstruct_row(void *arg) {
+    pipeline_slot_t *slot = (pipeline_slot_t*)arg;
+    decode_pipeline_t *pipe = slot->pipe;
+    int mcu_row = slot->mcu_row;
+
+    trace_begin_arg("idct row", "row", mcu_row);
+    double t_start = get_time_us();
+    idct_row(pipe->decoder, pipe->comps, slot->coefficients, slot->spatial,
+             0, pipe->decoder->mcu_width);
+    store_row(pipe->decoder, pipe->comps, slot->spatial, mcu_row, 0, pipe->decoder->mcu_width);
+    double t_idct = get_time_us() - t_start;
+    trace_end();
+
+    /* Claim the rows this one completes (itself and its neighbors) */
+    int claimed[3];
+    int num_claimed = 0;
+    pthread_mutex_lock(&pipe->lock);
+    pipe->idct_time_us += t_idct;
+    pipe->row_done[mcu_row] = true;
+    for (int r = mcu_row - 1; pipe->convert && r <= mcu_row + 1; r++) {
+        if (pipeline_can_convert(pipe, r)) {
+            pipe->row_converted[r] = true;
+            claimed[num_claimed++] = r;
+        }
+    }
+    pthread_cond_broadcast(&pipe->row_finished);
+    pthread_mutex_unlock(&pipe->lock);
+
+    if (num_claimed == 0) {
+        return;
+    }
+
+    t_start = get_time_us();
+    int result = 0;
+    for (int i = 0; i < num_claimed; i++) {
+        if (pipeline_convert_row(pipe, claimed[i]) != 0) {
+            result = -1;
+        }
+    }
+    double t_convert = get_time_us() - t_start;
+
+    pthread_mutex_lock(&pipe->lock);
+    pipe->convert_time_us += t_convert;
+    if (result != 0) {
+        pipe->failed = true;
+    }
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+/* Wait until MCU rows up to wait_row are reconstructed, passing every
+ * finished row (in order) to the row callback */
+static int pipeline_deliver(decode_pipeline_t *pipe, int wait_row) {
+    jpeg_decoder_t *decoder = pipe->decoder;
+
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->next_delivered < decoder->mcu_height) {
+        int mcu_row = pipe->next_delivered;
+        if (!pipe->row_done[mcu_row]) {
+            if (mcu_row > wait_row) {
+                break;
+            }
+            trace_begin_arg("wait for row", "row", mcu_row);
+            pthread_cond_wait(&pipe->row_finished, &pipe->lock);
+            trace_end();
+            continue;
+        }
+        pipe->next_delivered++;
+
+        if (decoder->row_callback) {
+            pthread_mutex_unlock(&pipe->lock);
+            if (emit_mcu_row(decoder, mcu_row) != 0) {
+                return -1;
+            }
+            pthread_mutex_lock(&pipe->lock);
         }
     }
+    pthread_mutex_unlock(&pipe->lock);
+    return 0;
+}
+
+static int decode_pipelined(jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                            mcu_decode_fn decode_fn, bit_reader_t *reader) {
+    int num_components = decoder->frame.num_components;
+    int workers = decoder->decode_threads - 1;
+
+    decode_pipeline_t pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.decoder = decoder;
+    pipe.comps = comps;
+    pipe.convert = !decoder->row_callback && (num_components == 1 || num_components == 3);
+    pipe.row_done = (bool*)jpeg_malloc(decoder->mcu_height * sizeof(bool));
+    pipe.row_converted = (bool*)jpeg_malloc(decoder->mcu_height * sizeof(bool));
+    memset(pipe.row_done, 0, decoder->mcu_height * sizeof(bool));
+    memset(pipe.row_converted, 0, decoder->mcu_height * sizeof(bool));
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.row_finished, NULL);
+
+    /* Convert into the caller's buffer, or a new image_data */
+    bool own_output = pipe.convert && !decoder->output_pixels;
+    if (pipe.convert) {
+        decoder->width = decoder->frame.width;
+        decoder->height = decoder->frame.height;
+    }
+    if (own_output) {
+        decoder->output_format = (num_components == 1 || decoder->luma_only)
+            ? JPEG_PIXEL_GRAY8 : JPEG_PIXEL_RGB24;
+        decoder->channels = jpeg_pixel_size(decoder->output_format);
+        decoder->output_stride = (size_t)decoder->width * decoder->channels;
+        decoder->image_data = (uint8_t*)jpeg_malloc(decoder->output_stride * decoder->height);
+        decoder->output_pixels = decoder->image_data;
+    }
+
+    /* Enough slots to keep every worker busy while the next rows decode */
+    int ring_size = 2 * workers + 2;
+    if (ring_size > decoder->mcu_height) {
+        ring_size = decoder->mcu_height;
+    }
+    size_t row_blocks = row_block_count(decoder);
+    pipeline_slot_t *slots = (pipeline_slot_t*)jpeg_malloc(ring_size * sizeof(pipeline_slot_t));
+    for (int i = 0; i < ring_size; i++) {
+        slots[i].pipe = &pipe;
+        slots[i].coefficients = (int16_t*)jpeg_malloc(row_blocks * BLOCK_SIZE * sizeof(int16_t));
+        slots[i].spatial = (uint8_t*)jpeg_malloc(row_blocks * 16 * 16);
+        memset(slots[i].coefficients, 0, row_blocks * BLOCK_SIZE * sizeof(int16_t));
+    }
+
+    JPEG_LOG("Decoding %d x %d MCUs (pipelined: entropy thread + %d worker%s, %d row buffers%s)...\n",
+             decoder->mcu_width, decoder->mcu_height, workers, workers == 1 ? "" : "s",
+             ring_size, pipe.convert ? ", RGB conversion in workers" : "");
+
+    threadpool_t *pool = threadpool_create(workers, 0);
+    if (!pool) {
+        fprintf(stderr, "Failed to create decode workers\n");
+    }
+
+    int result = pool ? 0 : -1;
+    for (int mcu_row = 0; result == 0 && mcu_row < decoder->mcu_height; mcu_row++) {
+        pipeline_slot_t *slot = &slots[mcu_row % ring_size];
+
+        if (decode_cancelled(decoder, mcu_row)) {
+            result = JPEG_DECODE_CANCELLED;
+            break;
+        }
+
+        /* The slot is free once the row that last used it is reconstructed */
+        if (pipeline_deliver(&pipe, mcu_row - ring_size) != 0) {
+            result = -1;
+            break;
+        }
+
+        double t_start = get_time_us();
+        trace_begin_arg("entropy row", "row", mcu_row);
+        result = decode_row_coefficients(decoder, comps, decode_fn, reader, mcu_row,
+                                         slot->coefficients);
+        trace_end();
+        if (result != 0) {
+            break;
+        }
+        decoder->stats.huffman_time_us += get_time_us() - t_start;
+
+        slot->mcu_row = mcu_row;
+        if (threadpool_submit(pool, pipeline_reconstruct_row, slot) != 0) {
+            fprintf(stderr, "Failed to queue MCU row %d\n", mcu_row);
+            result = -1;
+            break;
+        }
+
+        if ((mcu_row + 1) % 10 == 0) {
+            JPEG_LOG("  Decoded %d / %d rows\n", mcu_row + 1, decoder->mcu_height);
+        }
+    }
+
+    if (pool) {
+        threadpool_wait(pool);
+        threadpool_destroy(pool);
+    }
+    if (result == 0) {
+        result = pipeline_deliver(&pipe, decoder->mcu_height - 1);
+    }
+    if (result == 0 && pipe.failed) {
+        fprintf(stderr, "Color conversion failed\n");
+        result = -1;
+    }
+
+    decoder->stats.idct_time_us = pipe.idct_time_us;
+    decoder->stats.color_time_us = pipe.convert_time_us;
+    if (result != 0 && own_output) {
+        jpeg_free(decoder->image_data);
+        decoder->image_data = NULL;
+        decoder->output_pixels = NULL;
+    }
+    decoder->output_converted = result == 0 && pipe.convert;
+
+    for (int i = 0; i < ring_size; i++) {
+        jpeg_free(slots[i].coefficients);
+        jpeg_free(slots[i].spatial);
+    }
+    jpeg_free(slots);
+    jpeg_free(pipe.row_done);
+    jpeg_free(pipe.row_converted);
+    pthread_mutex_destroy(&pipe.lock);
+    pthread_cond_destroy(&pipe.row_finished);
+
+    if (result != 0) {
+        return result == JPEG_DECODE_CANCELLED ? result : -1;
+    }
 
-    /* Allocate component buffers */
-    for (int i = 0; i < decoder->frame.num_components; i++) {
+    JPEG_LOG("Decoding complete!\n");
+    JPEG_LOG("  Huffman decoding: %.2f ms\n", decoder->stats.huffman_time_us / 1000.0);
+    JPEG_LOG("  IDCT:             %.2f ms (sum over workers)\n",
+             decoder->stats.idct_time_us / 1000.0);
+    if (pipe.convert) {
+        JPEG_LOG("  YCbCr->RGB:       %.2f ms (sum over workers)\n", pipe.convert_time_us / 1000.0);
+    }
+    return 0;
+}
+
+/* Single-threaded decode, one MCU row at a time: entropy decoding, then
+ * the IDCT over the row's block queues, then the block stores. With a
+ * counter profile the hardware counters are charged to each stage with a
+ * few reads per row (per block they would cost more than the work
+ * measured); the counters follow the calling thread. */
+static int decode_rows(jpeg_decoder_t *decoder, const mcu_component_t *comps,
+                       mcu_decode_fn decode_fn, bit_reader_t *reader) {
+    perf_profile_t *perf = decoder->perf;
+
+    size_t row_blocks = row_block_count(decoder);
+    int16_t *coefficients = (int16_t*)jpeg_malloc(row_blocks * BLOCK_SIZE * sizeof(int16_t));
+    uint8_t *spatial = (uint8_t*)jpeg_malloc(row_blocks * 16 * 16);
+    memset(coefficients, 0, row_blocks * BLOCK_SIZE * sizeof(int16_t));
+
+    JPEG_LOG("Decoding %d x %d MCUs (row-batched%s)...\n", decoder->mcu_width,
+             decoder->mcu_height, perf ? ", staged for counter profiling" : "");
+
+    int result = 0;
+    for (int mcu_row = 0; mcu_row < decoder->mcu_height; mcu_row++) {
+        if (decode_cancelled(decoder, mcu_row)) {
+            result = JPEG_DECODE_CANCELLED;
+            break;
+        }
+
+        double t_start = get_time_us();
+        perf_profile_enter(perf, PERF_STAGE_HUFFMAN);
+        trace_begin_arg("entropy row", "row", mcu_row);
+        result = decode_row_coefficients(decoder, comps, decode_fn, reader, mcu_row, coefficients);
+        trace_end();
+        if (result != 0) {
+            break;
+        }
+
+        double t_idct = get_time_us();
+        perf_profile_enter(perf, PERF_STAGE_IDCT);
+        trace_begin_arg("idct row", "row", mcu_row);
+        idct_row(decoder, comps, coefficients, spatial, 0, decoder->mcu_width);
+        trace_end();
+
+        perf_profile_enter(perf, PERF_STAGE_STORE);
+        trace_begin_arg("store row", "row", mcu_row);
+        store_row(decoder, comps, spatial, mcu_row, 0, decoder->mcu_width);
+        trace_end();
+        perf_profile_enter(perf, PERF_STAGE_NONE);
+        decoder->stats.huffman_time_us += t_idct - t_start;
+        decoder->stats.idct_time_us += get_time_us() - t_idct;
+
+        /* Hand the finished rows to a streaming consumer */
+        if (decoder->row_callback && emit_mcu_row(decoder, mcu_row) != 0) {
+            result = -1;
+            break;
+        }
+
+        if ((mcu_row + 1) % 10 == 0) {
+            JPEG_LOG("  Decoded %d / %d rows\n", mcu_row + 1, decoder->mcu_height);
+        }
+    }
+    perf_profile_enter(perf, PERF_STAGE_NONE);
+
+    jpeg_free(coefficients);
+    jpeg_free(spatial);
+    if (result != 0) {
+        return result == JPEG_DECODE_CANCELLED ? result : -1;
+    }
+
+    JPEG_LOG("Decoding complete!\n");
+    JPEG_LOG("  Huffman decoding: %.2f ms\n", decoder->stats.huffman_time_us / 1000.0);
+    JPEG_LOG("  IDCT:             %.2f ms\n", decoder->stats.idct_time_us / 1000.0);
+    return 0;
+}
+
+/* Drop decode options that do not apply to the frame */
+static void resolve_decode_options(jpeg_decoder_t *decoder) {
+    if (decoder->luma_only && decoder->frame.num_components == 1) {
+        decoder->luma_only = false;
+    }
+    if (decoder->idct_upsampling && (decoder->luma_only || !idct_upsampling_layout(decoder))) {
+        decoder->idct_upsampling = false;
+    }
+}
+
+/* Main JPEG decoding function */
+int jpeg_decode(jpeg_decoder_t *decoder) {
+    JPEG_LOG("\nStarting JPEG decode...\n");
+
+    /* Reset profiling timers */
+    jpeg_reset_stats(decoder);
+    decoder->output_converted = false;
+
+    prepare_huffman_tables(decoder);
+    resolve_decode_options(decoder);
+
+    /* Allocate component buffers (only luma when chroma is discarded),
+     * replacing those of an earlier decode */
+    for (int i = 0; i < MAX_COMPONENTS; i++) {
+        jpeg_free(decoder->component_buffers[i]);
+        decoder->component_buffers[i] = NULL;
+    }
+    int num_buffers = decoder->luma_only ? 1 : decoder->frame.num_components;
+    if (decoder->luma_only) {
+        JPEG_LOG("Luma-only decode: chroma blocks are skipped\n");
+    }
+    for (int i = 0; i < num_buffers; i++) {
         component_info_t *comp = &decoder->frame.components[i];
 
+        /* Chroma decoded by scaled IDCTs is as large as luma */
+        if (i > 0 && decoder->idct_upsampling) {
+            decoder->component_width[i] = decoder->component_width[0];
+            decoder->component_height[i] = decoder->component_height[0];
+            size_t buffer_size = (size_t)decoder->component_width[i] * decoder->component_height[i];
+            decoder->component_buffers[i] = (uint8_t*)jpeg_malloc(buffer_size);
+            memset(decoder->component_buffers[i], 0, buffer_size);
+            JPEG_LOG("Component %d buffer: %dx%d (upsampled by scaled IDCT)\n",
+                     i, decoder->component_width[i], decoder->component_height[i]);
+            continue;
+        }
+
         /* Calculate component dimensions based on sampling factors */
         decoder->component_width[i] = (decoder->frame.width * comp->h_sampling +
                                       decoder->max_h_sampling - 1) / decoder->max_h_sampling;
@@ -53,8 +781,8 @@ int jpeg_decode(jpeg_decoder_t *decoder) {
         decoder->component_buffers[i] = (uint8_t*)jpeg_malloc(buffer_size);
         memset(decoder->component_buffers[i], 0, buffer_size);
 
-        printf("Component %d buffer: %dx%d\n",
-               i, decoder->component_width[i], decoder->component_height[i]);
+        JPEG_LOG("Component %d buffer: %dx%d\n",
+                 i, decoder->component_width[i], decoder->component_height[i]);
     }
 
     /* Initialize bit reader for scan data */
@@ -66,100 +794,210 @@ int jpeg_decode(jpeg_decoder_t *decoder) {
         decoder->dc_predictors[i] = 0;
     }
 
-    /* Decode all MCUs */
-    printf("Decoding %d x %d MCUs...\n", decoder->mcu_width, decoder->mcu_height);
+    /* Entropy-decode with the layout's specialized MCU decoder, if any */
+    mcu_component_t mcu_components[MAX_COMPONENTS];
+    mcu_decode_fn decode_fn = select_mcu_decoder(decoder, mcu_components);
+
+    if (decoder->decode_threads > 1 && decoder->mcu_height > 1 && !decoder->perf) {
+        return decode_pipelined(decoder, mcu_components, decode_fn, &reader);
+    }
+    return decode_rows(decoder, mcu_components, decode_fn, &reader);
+}
+
+/* Decode selected restart intervals over the previous frame's planes */
+int jpeg_decode_restart_segments(jpeg_decoder_t *decoder, const size_t *segment_offsets,
+                                 const bool *decode_segment, int num_segments) {
+    jpeg_reset_stats(decoder);
+    decoder->output_converted = false;
+
+    prepare_huffman_tables(decoder);
+    resolve_decode_options(decoder);
+
+    int total_mcus = decoder->mcu_width * decoder->mcu_height;
+    int interval = decoder->restart_interval;
+    if (interval == 0 || num_segments != (total_mcus + interval - 1) / interval) {
+        fprintf(stderr, "Restart segments do not match the frame\n");
+        return -1;
+    }
+
+    mcu_component_t mcu_components[MAX_COMPONENTS];
+    mcu_decode_fn decode_fn = select_mcu_decoder(decoder, mcu_components);
+
+    /* An interval's MCUs are queued as in a whole row (at their columns) and
+     * reconstructed at the end of each row and of the interval */
+    size_t row_blocks = row_block_count(decoder);
+    int16_t *coefficients = (int16_t*)jpeg_malloc(row_blocks * BLOCK_SIZE * sizeof(int16_t));
+    uint8_t *spatial = (uint8_t*)jpeg_malloc(row_blocks * 16 * 16);
+    memset(coefficients, 0, row_blocks * BLOCK_SIZE * sizeof(int16_t));
+
+    int result = 0;
+    for (int segment = 0; result == 0 && segment < num_segments; segment++) {
+        if (!decode_segment[segment]) {
+            continue;
+        }
+
+        /* Each interval starts byte-aligned with fresh DC predictors */
+        bit_reader_t reader;
+        bit_reader_init(&reader, decoder->scan_data + segment_offsets[segment],
+                        decoder->scan_data_size - segment_offsets[segment]);
+        for (int i = 0; i < MAX_COMPONENTS; i++) {
+            decoder->dc_predictors[i] = 0;
+        }
+
+        int first = segment * interval;
+        int last = first + interval < total_mcus ? first + interval : total_mcus;
+        int first_col = first % decoder->mcu_width;
+        double t_start = get_time_us();
+        for (int mcu = first; mcu < last; mcu++) {
+            int mcu_row = mcu / decoder->mcu_width;
+            int mcu_col = mcu % decoder->mcu_width;
+            result = decode_fn
+                ? decode_fn(mcu_components, &reader, mcu_col, coefficients, &decoder->stats)
+                : decode_mcu_queued(decoder, mcu_components, &reader, mcu_col, coefficients,
+                                    &decoder->stats);
+            if (result != 0) {
+                fprintf(stderr, "Failed to decode MCU at (%d, %d)\n", mcu_col, mcu_row);
+                break;
+            }
+
+            if (mcu_col == decoder->mcu_width - 1 || mcu == last - 1) {
+                double t_idct = get_time_us();
+                idct_row(decoder, mcu_components, coefficients, spatial, first_col, mcu_col + 1);
+                store_row(decoder, mcu_components, spatial, mcu_row, first_col, mcu_col + 1);
+                decoder->stats.huffman_time_us += t_idct - t_start;
+                t_start = get_time_us();
+                decoder->stats.idct_time_us += t_start - t_idct;
+                first_col = 0;
+            }
+        }
+    }
+
+    jpeg_free(coefficients);
+    jpeg_free(spatial);
+    return result == 0 ? 0 : -1;
+}
+
+/* Decode, then convert into the caller's buffer unless the pipeline did */
+int jpeg_decode_into(jpeg_decoder_t *decoder, uint8_t *dst, size_t dst_stride,
+                     jpeg_pixel_format_t format) {
+    decoder->output_pixels = dst;
+    decoder->output_stride = dst_stride;
+    decoder->output_format = format;
+
+    /* GRAY8 makes only this decode luma-only; resolve_decode_options may
+     * also drop idct_upsampling for it, so both are restored afterwards */
+    bool luma_only = decoder->luma_only;
+    bool idct_upsampling = decoder->idct_upsampling;
+    if (format == JPEG_PIXEL_GRAY8) {
+        decoder->luma_only = true;
+    }
+
+    int result = jpeg_decode(decoder);
+    if (result == 0 && !decoder->output_converted) {
+        JPEG_LOG("\nConverting YCbCr into caller buffer...\n");
+        result = ycbcr_to_pixels(decoder, dst, dst_stride, format);
+    }
+
+    /* The buffer belongs to the caller */
+    decoder->output_pixels = NULL;
+    decoder->output_converted = false;
+    decoder->luma_only = luma_only;
+    decoder->idct_upsampling = idct_upsampling;
+    return result;
+}
+
+/* Entropy-decode the scan block by block, without IDCT */
+int jpeg_for_each_block(jpeg_decoder_t *decoder, jpeg_block_fn block_fn, void *user_data) {
+    int num_components = decoder->frame.num_components;
+
+    prepare_huffman_tables(decoder);
+
+    bit_reader_t reader;
+    bit_reader_init(&reader, decoder->scan_data, decoder->scan_data_size);
+
+    for (int i = 0; i < MAX_COMPONENTS; i++) {
+        decoder->dc_predictors[i] = 0;
+    }
 
     int mcu_count = 0;
     for (int mcu_row = 0; mcu_row < decoder->mcu_height; mcu_row++) {
         for (int mcu_col = 0; mcu_col < decoder->mcu_width; mcu_col++) {
-            /* Check for restart marker if restart interval is set */
-            if (decoder->restart_interval > 0 && mcu_count > 0 &&
-                mcu_count % decoder->restart_interval == 0) {
-                /* Reset DC predictors */
-                for (int i = 0; i < MAX_COMPONENTS; i++) {
-                    decoder->dc_predictors[i] = 0;
-                }
+            process_restart(decoder, &reader, mcu_count);
+
+            for (int c = 0; c < num_components; c++) {
+                component_info_t *comp = &decoder->frame.components[c];
 
-                /* Align to byte boundary */
-                reader.bits_in_buffer = 0;
-                reader.bit_buffer = 0;
+                for (int v = 0; v < comp->v_sampling; v++) {
+                    for (int h = 0; h < comp->h_sampling; h++) {
+                        int16_t block[BLOCK_SIZE];
+                        memset(block, 0, sizeof(block));
 
-                /* Skip restart marker (RST0-RST7) */
-                if (reader.byte_pos < reader.data_size - 1) {
-                    if (reader.data[reader.byte_pos] == 0xFF) {
-                        uint8_t marker = reader.data[reader.byte_pos + 1];
-                        if (marker >= 0xD0 && marker <= 0xD7) {
-                            reader.byte_pos += 2;  /* Skip RST marker */
+                        if (decode_block(&decoder->stats, &reader,
+                                         &decoder->dc_tables[comp->dc_table_id],
+                                         &decoder->ac_tables[comp->ac_table_id],
+                                         &decoder->dc_predictors[c], block) != 0) {
+                            fprintf(stderr, "Failed to decode MCU at (%d, %d)\n", mcu_col, mcu_row);
+                            return -1;
+                        }
+                        if (block_fn(c, mcu_col * comp->h_sampling + h,
+                                     mcu_row * comp->v_sampling + v, block, user_data) != 0) {
+                            return -1;
                         }
                     }
                 }
             }
-
-            if (decode_mcu(decoder, &reader, mcu_row, mcu_col) != 0) {
-                fprintf(stderr, "Failed to decode MCU at (%d, %d)\n", mcu_col, mcu_row);
-                return -1;
-            }
             mcu_count++;
         }
-
-        if ((mcu_row + 1) % 10 == 0) {
-            printf("  Decoded %d / %d rows\n", mcu_row + 1, decoder->mcu_height);
-        }
     }
 
-    printf("Decoding complete!\n");
-    printf("  Huffman decoding: %.2f ms\n", huffman_time_us / 1000.0);
-    printf("  IDCT:             %.2f ms\n", idct_time_us / 1000.0);
     return 0;
 }
 
-/* Decode a single MCU */
-int decode_mcu(jpeg_decoder_t *decoder, bit_reader_t *reader, int mcu_row, int mcu_col) {
-    double t_start, t_end;
+typedef struct {
+    jpeg_decoder_t *decoder;
+    int16_t **coefficients;
+} coefficient_planes_t;
 
-    /* Decode each component in the MCU */
-    for (int comp = 0; comp < decoder->frame.num_components; comp++) {
-        component_info_t *component = &decoder->frame.components[comp];
+static int store_coefficients(int component, int block_x, int block_y,
+                              const int16_t *block, void *user_data) {
+    coefficient_planes_t *planes = (coefficient_planes_t*)user_data;
+    const jpeg_decoder_t *decoder = planes->decoder;
+    int blocks_w = decoder->mcu_width * decoder->frame.components[component].h_sampling;
 
-        /* Decode all blocks for this component in the MCU */
-        for (int v = 0; v < component->v_sampling; v++) {
-            for (int h = 0; h < component->h_sampling; h++) {
-                int16_t block[64];
-                memset(block, 0, sizeof(block));
+    memcpy(planes->coefficients[component] + ((size_t)block_y * blocks_w + block_x) * BLOCK_SIZE,
+           block, BLOCK_SIZE * sizeof(int16_t));
+    return 0;
+}
 
-                /* Decode block (Huffman decoding) */
-                t_start = get_time_us();
-                if (decode_block(decoder, reader,
-                               &decoder->dc_tables[component->dc_table_id],
-                               &decoder->ac_tables[component->ac_table_id],
-                               &decoder->dc_predictors[comp],
-                               block) != 0) {
-                    return -1;
-                }
-                t_end = get_time_us();
-                huffman_time_us += (t_end - t_start);
+/* Entropy-decode the scan into quantized coefficient planes */
+int jpeg_read_coefficients(jpeg_decoder_t *decoder, int16_t *coefficients[MAX_COMPONENTS]) {
+    int num_components = decoder->frame.num_components;
 
-                /* Apply IDCT with integrated dequantization */
-                t_start = get_time_us();
-                uint8_t spatial_block[64];
-                idct_2d(block, decoder->quant_tables[component->quant_table_id].table, spatial_block);
-                t_end = get_time_us();
-                idct_time_us += (t_end - t_start);
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        coefficients[c] = NULL;
+    }
+    for (int c = 0; c < num_components; c++) {
+        component_info_t *comp = &decoder->frame.components[c];
+        size_t num_blocks = (size_t)decoder->mcu_width * comp->h_sampling *
+                            decoder->mcu_height * comp->v_sampling;
+        coefficients[c] = (int16_t*)jpeg_malloc(num_blocks * BLOCK_SIZE * sizeof(int16_t));
+    }
 
-                /* Store in component buffer */
-                store_block(decoder, comp, mcu_row, mcu_col, h, v, spatial_block);
-            }
+    coefficient_planes_t planes = { decoder, coefficients };
+    if (jpeg_for_each_block(decoder, store_coefficients, &planes) != 0) {
+        for (int c = 0; c < num_components; c++) {
+            jpeg_free(coefficients[c]);
+            coefficients[c] = NULL;
         }
+        return -1;
     }
-
     return 0;
 }
 
 /* Decode a single 8x8 block */
-int decode_block(jpeg_decoder_t *decoder, bit_reader_t *reader,
+int decode_block(jpeg_decode_stats_t *stats, bit_reader_t *reader,
                  huffman_table_t *dc_table, huffman_table_t *ac_table,
                  int16_t *dc_predictor, int16_t *block) {
-    (void)decoder;  /* Unused parameter */
 
     /* Decode DC coefficient */
     int dc_symbol = decode_huffman_symbol(reader, dc_table);
@@ -205,41 +1043,15 @@ int decode_block(jpeg_decoder_t *decoder, bit_reader_t *reader,
 
         /* Decode coefficient value and store in natural order */
         int value = receive_and_extend(reader, size);
-        extern const int jpeg_natural_order[64];
         block[jpeg_natural_order[k]] = value;
 
         k++;
     }
 
-    return 0;
-}
-
-/* Store 8x8 block into component buffer */
-void store_block(jpeg_decoder_t *decoder, int component,
-                 int mcu_row, int mcu_col, int block_h, int block_v,
-                 const uint8_t *block_data) {
-    component_info_t *comp = &decoder->frame.components[component];
-    uint8_t *buffer = decoder->component_buffers[component];
-    int width = decoder->component_width[component];
-
-    /* Calculate block position in component buffer */
-    int block_x = mcu_col * comp->h_sampling * 8 + block_h * 8;
-    int block_y = mcu_row * comp->v_sampling * 8 + block_v * 8;
-
-    /* Copy 8x8 block into buffer */
-    for (int y = 0; y < 8; y++) {
-        int dest_y = block_y + y;
-        if (dest_y >= decoder->component_height[component]) {
-            break;
-        }
-
-        for (int x = 0; x < 8; x++) {
-            int dest_x = block_x + x;
-            if (dest_x >= decoder->component_width[component]) {
-                break;
-            }
-
-            buffer[dest_y * width + dest_x] = block_data[y * 8 + x];
-        }
+    /* k is still 1 when the first AC symbol was EOB */
+    if (stats) {
+        stats->blocks++;
+        stats->dc_only_blocks += (k == 1);
     }
+    return 0;
 }
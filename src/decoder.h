@@ -6,17 +6,54 @@
 /* Main decoding function */
 int jpeg_decode(jpeg_decoder_t *decoder);
 
-/* Decode a single MCU (Minimum Coded Unit) */
-int decode_mcu(jpeg_decoder_t *decoder, bit_reader_t *reader, int mcu_row, int mcu_col);
+/* jpeg_decode's result when jpeg_decode_cancel stopped it (nothing is
+ * printed; errors are -1) */
+#define JPEG_DECODE_CANCELLED 1
 
-/* Decode a single 8x8 block */
-int decode_block(jpeg_decoder_t *decoder, bit_reader_t *reader,
+/* Make a running or not yet started jpeg_decode on another thread stop at
+ * the next MCU row and return JPEG_DECODE_CANCELLED. The request stays set
+ * for the decoder's lifetime. */
+void jpeg_decode_cancel(jpeg_decoder_t *decoder);
+
+/* Decode and color-convert straight into a caller-provided buffer (a
+ * locked streaming texture, shared memory, an mmap'ed file): dst_stride
+ * bytes per row, pixels laid out as format. No image_data is allocated.
+ * JPEG_PIXEL_GRAY8 skips the chroma entirely (luma_only for this call). */
+int jpeg_decode_into(jpeg_decoder_t *decoder, uint8_t *dst, size_t dst_stride,
+                     jpeg_pixel_format_t format);
+
+/* Called by jpeg_for_each_block with each entropy-decoded block: 64
+ * quantized coefficients in natural order, of the given component at block
+ * column block_x and row block_y of its plane. A non-zero return stops the
+ * scan. */
+typedef int (*jpeg_block_fn)(int component, int block_x, int block_y,
+                             const int16_t *block, void *user_data);
+
+/* Entropy-decode the whole scan without IDCT, handing every block (MCU
+ * padding blocks included) to block_fn in scan order */
+int jpeg_for_each_block(jpeg_decoder_t *decoder, jpeg_block_fn block_fn, void *user_data);
+
+/* Entropy-decode the whole scan without IDCT. coefficients[c] receives
+ * (mcu_width * h) x (mcu_height * v) blocks of 64 quantized coefficients in
+ * natural order, row-major by block, including MCU padding blocks.
+ * Free each plane with jpeg_free. */
+int jpeg_read_coefficients(jpeg_decoder_t *decoder, int16_t *coefficients[MAX_COMPONENTS]);
+
+/* Decode only the restart intervals with decode_segment[i] set, into
+ * component buffers the caller attached that still hold the previous frame
+ * of a stream with the same layout, tables and restart interval (sized as
+ * jpeg_decode sized them). segment_offsets[i] is where interval i starts in
+ * scan_data; num_segments must cover every MCU. */
+int jpeg_decode_restart_segments(jpeg_decoder_t *decoder, const size_t *segment_offsets,
+                                 const bool *decode_segment, int num_segments);
+
+/* Zero decoder->stats before a decode, keeping the Huffman table counts of
+ * the parse that installed its tables */
+void jpeg_reset_stats(jpeg_decoder_t *decoder);
+
+/* Decode a single 8x8 block, counting it in stats (may be NULL) */
+int decode_block(jpeg_decode_stats_t *stats, bit_reader_t *reader,
                  huffman_table_t *dc_table, huffman_table_t *ac_table,
                  int16_t *dc_predictor, int16_t *block);
 
-/* Store decoded 8x8 block into component buffer */
-void store_block(jpeg_decoder_t *decoder, int component,
-                 int mcu_row, int mcu_col, int block_h, int block_v,
-                 const uint8_t *block_data);
-
 #endif /* DECODER_H */
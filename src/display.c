@@ -1,18 +1,380 @@
 #include "display.h"
+#include "trace.h"
+#include "utils.h"
 #include <SDL.h>
 #include <stdio.h>
 #include <string.h>
 
-/* Display image using SDL2 */
-int display_image(const uint8_t *image_data, int width, int height, int channels) {
-    printf("\nInitializing SDL2...\n");
+/* Minimum time between presents while updates are streaming in (~60 FPS) */
+#define MIN_FRAME_INTERVAL_MS 16
+
+struct display {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    int streaming;              /* BGRA32 streaming texture filled by the caller */
+
+    /* Source image (not owned); NULL while the texture itself holds the
+     * image (display_create_locked) */
+    const uint8_t *image_data;
+    int width;
+    int height;
+    int channels;
+
+    /* Scratch buffer for expanding grayscale regions to RGB */
+    uint8_t *rgb_scratch;
+    size_t rgb_scratch_size;
+
+    /* Regions marked dirty by other threads, merged on the render thread */
+    SDL_mutex *pending_lock;
+    SDL_Rect pending_rect;
+    int has_pending;
+    Uint32 wake_event;
+
+    /* Image handed over by another thread, swapped in on the render thread */
+    const uint8_t *posted_data;
+    int posted_width;
+    int posted_height;
+    int posted_channels;
+    char posted_title[256];
+    int has_posted;
+
+    /* Render-thread dirty state */
+    SDL_Rect dirty_rect;        /* Texture region that needs uploading */
+    int texture_dirty;
+    int needs_redraw;           /* Window contents need to be presented */
+    Uint64 last_present;
+
+    /* Navigation callback */
+    display_key_fn key_handler;
+    void *key_user_data;
+
+    display_stats_t stats;
+    perf_profile_t *perf;       /* Counter profile of the render thread, or NULL */
+};
+
+static double ticks_to_ms(Uint64 ticks) {
+    return (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+/* Grow rect a to also cover rect b */
+static void union_rect(SDL_Rect *a, int *a_valid, const SDL_Rect *b) {
+    if (!*a_valid) {
+        *a = *b;
+        *a_valid = 1;
+        return;
+    }
+    SDL_UnionRect(a, b, a);
+}
+
+/* Clip a region to the image bounds; returns 0 if nothing is left */
+static int clip_rect(const display_t *display, SDL_Rect *rect) {
+    int x0 = rect->x < 0 ? 0 : rect->x;
+    int y0 = rect->y < 0 ? 0 : rect->y;
+    int x1 = rect->x + rect->w;
+    int y1 = rect->y + rect->h;
+    if (x1 > display->width) x1 = display->width;
+    if (y1 > display->height) y1 = display->height;
+    if (x1 <= x0 || y1 <= y0) {
+        return 0;
+    }
+    rect->x = x0;
+    rect->y = y0;
+    rect->w = x1 - x0;
+    rect->h = y1 - y0;
+    return 1;
+}
+
+/* Copy the dirty region of the source image into the texture */
+static int upload_dirty_region(display_t *display) {
+    SDL_Rect *rect = &display->dirty_rect;
+    int result;
+
+    /* Written in place through display_create_locked: nothing to upload */
+    if (!display->image_data) {
+        display->texture_dirty = 0;
+        return 0;
+    }
+
+    if (display->channels == 3) {
+        const uint8_t *src = display->image_data +
+                             ((size_t)rect->y * display->width + rect->x) * 3;
+        result = SDL_UpdateTexture(display->texture, rect, src, display->width * 3);
+    } else {
+        /* Grayscale - expand only the dirty region to RGB */
+        size_t needed = (size_t)rect->w * rect->h * 3;
+        if (needed > display->rgb_scratch_size) {
+            uint8_t *scratch = (uint8_t*)realloc(display->rgb_scratch, needed);
+            if (!scratch) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return -1;
+            }
+            display->rgb_scratch = scratch;
+            display->rgb_scratch_size = needed;
+        }
+
+        for (int y = 0; y < rect->h; y++) {
+            const uint8_t *src = display->image_data +
+                                 (size_t)(rect->y + y) * display->width + rect->x;
+            uint8_t *dst = display->rgb_scratch + (size_t)y * rect->w * 3;
+            for (int x = 0; x < rect->w; x++) {
+                dst[x * 3 + 0] = src[x];
+                dst[x * 3 + 1] = src[x];
+                dst[x * 3 + 2] = src[x];
+            }
+        }
+
+        result = SDL_UpdateTexture(display->texture, rect, display->rgb_scratch, rect->w * 3);
+    }
+
+    if (result != 0) {
+        fprintf(stderr, "SDL_UpdateTexture Error: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    display->stats.uploads++;
+    display->stats.pixels_uploaded += (unsigned long)rect->w * rect->h;
+    display->texture_dirty = 0;
+    return 0;
+}
+
+/* Move regions queued by display_mark_dirty into the render-thread state */
+static void merge_pending(display_t *display) {
+    SDL_LockMutex(display->pending_lock);
+    if (display->has_pending) {
+        union_rect(&display->dirty_rect, &display->texture_dirty, &display->pending_rect);
+        display->has_pending = 0;
+        display->needs_redraw = 1;
+    }
+    SDL_UnlockMutex(display->pending_lock);
+}
+
+/* Upload anything dirty and present one frame */
+static void render_frame(display_t *display) {
+    Uint64 t_start = SDL_GetPerformanceCounter();
+
+    if (display->texture_dirty) {
+        perf_profile_enter(display->perf, PERF_STAGE_UPLOAD);
+        trace_begin("upload");
+        upload_dirty_region(display);
+        trace_end();
+        perf_profile_enter(display->perf, PERF_STAGE_NONE);
+    }
+
+    SDL_RenderClear(display->renderer);
+    SDL_RenderCopy(display->renderer, display->texture, NULL, NULL);
+    SDL_RenderPresent(display->renderer);
+
+    Uint64 t_end = SDL_GetPerformanceCounter();
+    double frame_ms = ticks_to_ms(t_end - t_start);
+
+    display->stats.frames++;
+    display->stats.total_frame_ms += frame_ms;
+    if (display->stats.frames == 1 || frame_ms < display->stats.min_frame_ms) {
+        display->stats.min_frame_ms = frame_ms;
+    }
+    if (frame_ms > display->stats.max_frame_ms) {
+        display->stats.max_frame_ms = frame_ms;
+    }
+
+    display->needs_redraw = 0;
+    display->last_present = t_end;
+}
+
+/* Translate navigation keys and forward them to the key handler */
+static void dispatch_key(display_t *display, SDL_Keycode sym) {
+    if (!display->key_handler) {
+        return;
+    }
+
+    switch (sym) {
+        case SDLK_RIGHT:
+        case SDLK_DOWN:
+        case SDLK_PAGEDOWN:
+        case SDLK_SPACE:
+            display->key_handler(display, DISPLAY_KEY_NEXT, display->key_user_data);
+            break;
+        case SDLK_LEFT:
+        case SDLK_UP:
+        case SDLK_PAGEUP:
+        case SDLK_BACKSPACE:
+            display->key_handler(display, DISPLAY_KEY_PREV, display->key_user_data);
+            break;
+        case SDLK_HOME:
+            display->key_handler(display, DISPLAY_KEY_FIRST, display->key_user_data);
+            break;
+        case SDLK_END:
+            display->key_handler(display, DISPLAY_KEY_LAST, display->key_user_data);
+            break;
+        default:
+            break;
+    }
+}
+
+/* (Re)create the texture for the current image size */
+static int create_texture(display_t *display) {
+    if (display->texture) {
+        SDL_DestroyTexture(display->texture);
+    }
+
+    /* Grayscale is expanded to RGB on upload. Caller-filled textures use a
+     * 32-bit format that renderers take without conversion. */
+    display->texture = SDL_CreateTexture(display->renderer,
+                                         display->streaming ? SDL_PIXELFORMAT_BGRA32
+                                                            : SDL_PIXELFORMAT_RGB24,
+                                         display->streaming ? SDL_TEXTUREACCESS_STREAMING
+                                                            : SDL_TEXTUREACCESS_STATIC,
+                                         display->width, display->height);
+    if (!display->texture) {
+        fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    /* Set logical size to image dimensions for proper scaling */
+    SDL_RenderSetLogicalSize(display->renderer, display->width, display->height);
+    return 0;
+}
+
+/* Mark the whole image for upload */
+static void mark_all_dirty(display_t *display) {
+    display->dirty_rect.x = 0;
+    display->dirty_rect.y = 0;
+    display->dirty_rect.w = display->width;
+    display->dirty_rect.h = display->height;
+    display->texture_dirty = 1;
+    display->needs_redraw = 1;
+}
+
+/* Swap in an image queued by display_post_image */
+static void apply_posted_image(display_t *display) {
+    /* Copy the request under the lock: another post may replace it */
+    SDL_LockMutex(display->pending_lock);
+    int has_posted = display->has_posted;
+    const uint8_t *data = display->posted_data;
+    int width = display->posted_width;
+    int height = display->posted_height;
+    int channels = display->posted_channels;
+    char title[sizeof(display->posted_title)];
+    memcpy(title, display->posted_title, sizeof(title));
+    display->has_posted = 0;
+    SDL_UnlockMutex(display->pending_lock);
+
+    if (has_posted) {
+        display_set_image(display, data, width, height, channels, title[0] ? title : NULL);
+    }
+}
+
+/* Handle one event; returns 0 when the window should close */
+static int handle_event(display_t *display, const SDL_Event *event) {
+    if (event->type == SDL_QUIT) {
+        return 0;
+    }
+
+    if (event->type == display->wake_event) {
+        apply_posted_image(display);
+        merge_pending(display);
+        return 1;
+    }
+
+    switch (event->type) {
+        case SDL_KEYDOWN:
+            if (event->key.keysym.sym == SDLK_ESCAPE) {
+                return 0;
+            }
+            dispatch_key(display, event->key.keysym.sym);
+            break;
+
+        case SDL_WINDOWEVENT:
+            switch (event->window.event) {
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_EXPOSED:
+                case SDL_WINDOWEVENT_RESIZED:
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                case SDL_WINDOWEVENT_MAXIMIZED:
+                case SDL_WINDOWEVENT_RESTORED:
+                    display->needs_redraw = 1;
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return 1;
+}
+
+static display_t* display_open(const uint8_t *image_data, int width, int height, int channels,
+                               int full_width, int full_height, int streaming);
+
+/* Create window, renderer and texture for the image */
+display_t* display_create(const uint8_t *image_data, int width, int height, int channels) {
+    return display_open(image_data, width, height, channels, width, height, 0);
+}
+
+/* Window sized for full_width x full_height, texture for the (smaller) image */
+display_t* display_create_preview(const uint8_t *image_data, int width, int height, int channels,
+                                  int full_width, int full_height) {
+    return display_open(image_data, width, height, channels, full_width, full_height, 0);
+}
+
+/* Window with a streaming texture, locked for the caller to fill */
+display_t* display_create_locked(int width, int height, uint8_t **pixels, int *pitch) {
+    display_t *display = display_open(NULL, width, height, 3, width, height, 1);
+    if (!display) {
+        return NULL;
+    }
+
+    void *texture_pixels;
+    if (SDL_LockTexture(display->texture, NULL, &texture_pixels, pitch) != 0) {
+        fprintf(stderr, "SDL_LockTexture Error: %s\n", SDL_GetError());
+        display_destroy(display);
+        return NULL;
+    }
+    *pixels = (uint8_t*)texture_pixels;
+    return display;
+}
+
+int display_unlock_texture(display_t *display) {
+    perf_profile_enter(display->perf, PERF_STAGE_UPLOAD);
+    trace_begin("upload");
+    SDL_UnlockTexture(display->texture);
+    trace_end();
+    perf_profile_enter(display->perf, PERF_STAGE_NONE);
+    display->needs_redraw = 1;
+    return 0;
+}
+
+static display_t* display_open(const uint8_t *image_data, int width, int height, int channels,
+                               int full_width, int full_height, int streaming) {
+    JPEG_LOG("\nInitializing SDL2...\n");
+
+    if (channels != 1 && channels != 3) {
+        fprintf(stderr, "Unsupported number of channels: %d\n", channels);
+        return NULL;
+    }
 
     /* Initialize SDL */
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         fprintf(stderr, "SDL_Init Error: %s\n", SDL_GetError());
-        return -1;
+        return NULL;
+    }
+
+    display_t *display = (display_t*)calloc(1, sizeof(display_t));
+    if (!display) {
+        fprintf(stderr, "Memory allocation failed\n");
+        SDL_Quit();
+        return NULL;
     }
 
+    display->image_data = image_data;
+    display->width = width;
+    display->height = height;
+    display->channels = channels;
+    display->streaming = streaming;
+
     /* Use best quality filtering for smooth scaling */
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "2");  /* 2 = best quality (anisotropic) */
 
@@ -20,8 +382,8 @@ int display_image(const uint8_t *image_data, int width, int height, int channels
     SDL_DisplayMode display_mode;
     SDL_GetCurrentDisplayMode(0, &display_mode);
 
-    int window_width = width;
-    int window_height = height;
+    int window_width = full_width;
+    int window_height = full_height;
     float display_scale = 1.0f;
 
     /* Scale down large images to fit screen (with padding) */
@@ -36,144 +398,243 @@ int display_image(const uint8_t *image_data, int width, int height, int channels
         window_width = (int)(window_width * display_scale);
         window_height = (int)(window_height * display_scale);
 
-        printf("Window scaled to fit screen: %dx%d -> %dx%d (%.1f%%)\n",
-               width, height, window_width, window_height, display_scale * 100);
+        JPEG_LOG("Window scaled to fit screen: %dx%d -> %dx%d (%.1f%%)\n",
+                 full_width, full_height, window_width, window_height, display_scale * 100);
     }
 
     /* Create window title with image info */
     char window_title[256];
     snprintf(window_title, sizeof(window_title),
-             "JPEG Viewer - %dx%d", width, height);
+             "JPEG Viewer - %dx%d", full_width, full_height);
 
     /* Create window */
-    SDL_Window *window = SDL_CreateWindow(window_title,
-                                          SDL_WINDOWPOS_CENTERED,
-                                          SDL_WINDOWPOS_CENTERED,
-                                          window_width, window_height,
-                                          SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
-    if (!window) {
+    display->window = SDL_CreateWindow(window_title,
+                                       SDL_WINDOWPOS_CENTERED,
+                                       SDL_WINDOWPOS_CENTERED,
+                                       window_width, window_height,
+                                       SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
+    if (!display->window) {
         fprintf(stderr, "SDL_CreateWindow Error: %s\n", SDL_GetError());
-        SDL_Quit();
-        return -1;
+        display_destroy(display);
+        return NULL;
     }
 
     /* Create renderer */
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
-                                                SDL_RENDERER_ACCELERATED |
-                                                SDL_RENDERER_PRESENTVSYNC);
-    if (!renderer) {
+    display->renderer = SDL_CreateRenderer(display->window, -1,
+                                           SDL_RENDERER_ACCELERATED |
+                                           SDL_RENDERER_PRESENTVSYNC);
+    if (!display->renderer) {
         fprintf(stderr, "SDL_CreateRenderer Error: %s\n", SDL_GetError());
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return -1;
+        display_destroy(display);
+        return NULL;
     }
 
-    /* Set logical size to original image dimensions for proper scaling */
-    SDL_RenderSetLogicalSize(renderer, width, height);
-
     /* Create texture */
-    SDL_Texture *texture = NULL;
-
-    if (channels == 3) {
-        /* RGB image */
-        texture = SDL_CreateTexture(renderer,
-                                   SDL_PIXELFORMAT_RGB24,
-                                   SDL_TEXTUREACCESS_STATIC,
-                                   width, height);
-    } else if (channels == 1) {
-        /* Grayscale - need to convert to RGB */
-        uint8_t *rgb_data = (uint8_t*)malloc(width * height * 3);
-        if (!rgb_data) {
-            fprintf(stderr, "Memory allocation failed\n");
-            SDL_DestroyRenderer(renderer);
-            SDL_DestroyWindow(window);
-            SDL_Quit();
-            return -1;
-        }
-
-        /* Convert grayscale to RGB */
-        for (int i = 0; i < width * height; i++) {
-            rgb_data[i * 3 + 0] = image_data[i];
-            rgb_data[i * 3 + 1] = image_data[i];
-            rgb_data[i * 3 + 2] = image_data[i];
-        }
+    if (create_texture(display) != 0) {
+        display_destroy(display);
+        return NULL;
+    }
 
-        texture = SDL_CreateTexture(renderer,
-                                   SDL_PIXELFORMAT_RGB24,
-                                   SDL_TEXTUREACCESS_STATIC,
-                                   width, height);
+    /* Cross-thread dirty notifications */
+    display->pending_lock = SDL_CreateMutex();
+    display->wake_event = SDL_RegisterEvents(1);
+    if (!display->pending_lock || display->wake_event == (Uint32)-1) {
+        fprintf(stderr, "SDL event setup Error: %s\n", SDL_GetError());
+        display_destroy(display);
+        return NULL;
+    }
 
-        if (texture) {
-            SDL_UpdateTexture(texture, NULL, rgb_data, width * 3);
-        }
+    /* First frame uploads the whole image (a locked texture is filled in place) */
+    if (streaming) {
+        display->needs_redraw = 1;
+    } else {
+        mark_all_dirty(display);
+    }
 
-        free(rgb_data);
+    JPEG_LOG("Display initialized successfully\n");
+    JPEG_LOG("Image resolution: %dx%d pixels\n", full_width, full_height);
+    if (display_scale < 1.0f) {
+        JPEG_LOG("Window size: %dx%d (scaled to %.0f%% to fit screen)\n",
+                 window_width, window_height, display_scale * 100);
+        JPEG_LOG("Note: Window is resizable - resize to see more detail!\n");
     } else {
+        JPEG_LOG("Window size: %dx%d (native resolution)\n", window_width, window_height);
+    }
+
+    return display;
+}
+
+/* Switch to a different image */
+int display_set_image(display_t *display, const uint8_t *image_data,
+                      int width, int height, int channels, const char *title) {
+    if (channels != 1 && channels != 3) {
         fprintf(stderr, "Unsupported number of channels: %d\n", channels);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
         return -1;
     }
 
-    if (!texture) {
-        fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+    /* Back to uploads from image_data after a caller-filled texture */
+    int resized = (width != display->width || height != display->height ||
+                   display->streaming);
+
+    display->streaming = 0;
+    display->image_data = image_data;
+    display->channels = channels;
+
+    /* The size is read by display_mark_dirty on other threads; updates
+     * queued for the previous image no longer apply */
+    SDL_LockMutex(display->pending_lock);
+    display->width = width;
+    display->height = height;
+    display->has_pending = 0;
+    SDL_UnlockMutex(display->pending_lock);
+
+    if (resized && create_texture(display) != 0) {
         return -1;
     }
 
-    /* Update texture with image data (for RGB) */
-    if (channels == 3) {
-        SDL_UpdateTexture(texture, NULL, image_data, width * 3);
+    if (title) {
+        SDL_SetWindowTitle(display->window, title);
     }
 
-    printf("Display initialized successfully\n");
-    printf("Image resolution: %dx%d pixels\n", width, height);
-    if (display_scale < 1.0f) {
-        printf("Window size: %dx%d (scaled to %.0f%% to fit screen)\n",
-               window_width, window_height, display_scale * 100);
-        printf("Note: Window is resizable - resize to see more detail!\n");
-    } else {
-        printf("Window size: %dx%d (native resolution)\n", window_width, window_height);
+    mark_all_dirty(display);
+    return 0;
+}
+
+void display_set_perf(display_t *display, perf_profile_t *perf) {
+    display->perf = perf;
+}
+
+void display_set_key_handler(display_t *display, display_key_fn handler, void *user_data) {
+    display->key_handler = handler;
+    display->key_user_data = user_data;
+}
+
+/* Queue an image swap and wake the render loop */
+void display_post_image(display_t *display, const uint8_t *image_data,
+                        int width, int height, int channels, const char *title) {
+    SDL_LockMutex(display->pending_lock);
+    display->posted_data = image_data;
+    display->posted_width = width;
+    display->posted_height = height;
+    display->posted_channels = channels;
+    snprintf(display->posted_title, sizeof(display->posted_title), "%s", title ? title : "");
+    display->has_posted = 1;
+    SDL_UnlockMutex(display->pending_lock);
+
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = display->wake_event;
+    SDL_PushEvent(&event);
+}
+
+/* Mark a region as changed and wake the render loop */
+void display_mark_dirty(display_t *display, int x, int y, int w, int h) {
+    SDL_Rect rect = { x, y, w, h };
+
+    /* Clip against the size the render thread set, under its lock */
+    SDL_LockMutex(display->pending_lock);
+    if (!clip_rect(display, &rect)) {
+        SDL_UnlockMutex(display->pending_lock);
+        return;
+    }
+    int was_pending = display->has_pending;
+    union_rect(&display->pending_rect, &display->has_pending, &rect);
+    SDL_UnlockMutex(display->pending_lock);
+
+    /* One wake event per batch of updates is enough */
+    if (!was_pending) {
+        SDL_Event event;
+        memset(&event, 0, sizeof(event));
+        event.type = display->wake_event;
+        SDL_PushEvent(&event);
     }
-    printf("Press ESC or close window to exit\n\n");
+}
+
+/* Event-driven render loop */
+int display_run(display_t *display) {
+    JPEG_LOG("Press ESC or close window to exit\n\n");
 
-    /* Event loop */
     int running = 1;
     SDL_Event event;
 
     while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                running = 0;
-            } else if (event.type == SDL_KEYDOWN) {
-                if (event.key.keysym.sym == SDLK_ESCAPE) {
-                    running = 0;
-                }
+        int timeout_ms = -1;  /* Nothing to draw: block until something happens */
+
+        if (display->needs_redraw) {
+            /* Pace redraws so streaming updates are coalesced, not drawn per row */
+            double since_ms = ticks_to_ms(SDL_GetPerformanceCounter() - display->last_present);
+            if (display->last_present == 0 || since_ms >= MIN_FRAME_INTERVAL_MS) {
+                render_frame(display);
+                continue;
             }
+            timeout_ms = MIN_FRAME_INTERVAL_MS - (int)since_ms;
+        }
+
+        int got_event = (timeout_ms < 0) ? SDL_WaitEvent(&event)
+                                         : SDL_WaitEventTimeout(&event, timeout_ms);
+        display->stats.wakeups++;
+
+        if (!got_event) {
+            continue;  /* Timed out: a paced redraw is now due */
         }
 
-        /* Clear screen */
-        SDL_RenderClear(renderer);
+        running = handle_event(display, &event);
 
-        /* Render texture */
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        /* Drain everything already queued before drawing */
+        while (running && SDL_PollEvent(&event)) {
+            running = handle_event(display, &event);
+        }
+    }
 
-        /* Present */
-        SDL_RenderPresent(renderer);
+    const display_stats_t *stats = &display->stats;
+    JPEG_LOG("Render stats: %lu frames, %lu wakeups, %lu uploads (%lu pixels)\n",
+             stats->frames, stats->wakeups, stats->uploads, stats->pixels_uploaded);
+    if (stats->frames > 0) {
+        JPEG_LOG("  Frame time: avg %.2f ms, min %.2f ms, max %.2f ms\n",
+                 stats->total_frame_ms / stats->frames,
+                 stats->min_frame_ms, stats->max_frame_ms);
+    }
 
-        /* Small delay to reduce CPU usage */
-        SDL_Delay(16);  /* ~60 FPS */
+    return 0;
+}
+
+const display_stats_t* display_get_stats(const display_t *display) {
+    return &display->stats;
+}
+
+/* Destroy window and shut down SDL */
+void display_destroy(display_t *display) {
+    if (!display) {
+        return;
     }
 
-    /* Cleanup */
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (display->texture) {
+        SDL_DestroyTexture(display->texture);
+    }
+    if (display->renderer) {
+        SDL_DestroyRenderer(display->renderer);
+    }
+    if (display->window) {
+        SDL_DestroyWindow(display->window);
+    }
+    if (display->pending_lock) {
+        SDL_DestroyMutex(display->pending_lock);
+    }
+    free(display->rgb_scratch);
+    free(display);
     SDL_Quit();
 
-    printf("Display closed\n");
-    return 0;
+    JPEG_LOG("Display closed\n");
+}
+
+/* Display image using SDL2 */
+int display_image(const uint8_t *image_data, int width, int height, int channels) {
+    display_t *display = display_create(image_data, width, height, channels);
+    if (!display) {
+        return -1;
+    }
+
+    int result = display_run(display);
+    display_destroy(display);
+    return result;
 }
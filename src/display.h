@@ -2,6 +2,83 @@
 #define DISPLAY_H
 
 #include <stdint.h>
+#include "perf.h"
+
+/* Frame-time statistics collected by the render loop */
+typedef struct {
+    unsigned long wakeups;          /* Times the loop returned from waiting */
+    unsigned long frames;           /* Frames actually rendered and presented */
+    unsigned long uploads;          /* Dirty-region texture uploads */
+    unsigned long pixels_uploaded;  /* Pixels copied into the texture */
+    double total_frame_ms;          /* Sum of render times */
+    double min_frame_ms;            /* Fastest frame */
+    double max_frame_ms;            /* Slowest frame */
+} display_stats_t;
+
+/* Opaque display context (window, renderer, texture and dirty state) */
+typedef struct display display_t;
+
+/* Navigation keys forwarded to the key handler */
+typedef enum {
+    DISPLAY_KEY_NEXT,               /* Right, Down, Page Down, Space */
+    DISPLAY_KEY_PREV,               /* Left, Up, Page Up, Backspace */
+    DISPLAY_KEY_FIRST,              /* Home */
+    DISPLAY_KEY_LAST                /* End */
+} display_key_t;
+
+/* Called on the render thread for navigation keys */
+typedef void (*display_key_fn)(display_t *display, display_key_t key, void *user_data);
+
+/* Create a window sized for a width x height image with 1 or 3 channels.
+ * image_data is not copied; it must stay valid until display_destroy. */
+display_t* display_create(const uint8_t *image_data, int width, int height, int channels);
+
+/* Like display_create, but size the window for a full_width x full_height
+ * image while showing a smaller stand-in (e.g. an EXIF thumbnail) scaled up */
+display_t* display_create_preview(const uint8_t *image_data, int width, int height, int channels,
+                                  int full_width, int full_height);
+
+/* Create a window and a streaming texture for a width x height image and
+ * lock the texture: *pixels receives its memory, BGRX32 rows
+ * (JPEG_PIXEL_BGRX32) *pitch bytes apart, for the caller to fill in place,
+ * e.g. with jpeg_decode_into. Call display_unlock_texture before
+ * display_run. */
+display_t* display_create_locked(int width, int height, uint8_t **pixels, int *pitch);
+
+/* Unlock a texture locked by display_create_locked and schedule a redraw */
+int display_unlock_texture(display_t *display);
+
+/* Replace the displayed image (recreating the texture if the size changed)
+ * and set the window title. image_data must stay valid until replaced. */
+int display_set_image(display_t *display, const uint8_t *image_data,
+                      int width, int height, int channels, const char *title);
+
+/* Charge texture uploads to PERF_STAGE_UPLOAD of a counter profile opened
+ * on the render thread (NULL to stop) */
+void display_set_perf(display_t *display, perf_profile_t *perf);
+
+/* Install a handler for navigation keys (ESC always closes the window) */
+void display_set_key_handler(display_t *display, display_key_fn handler, void *user_data);
+
+/* Mark a region of the image as changed. Safe to call from any thread:
+ * the region is queued and the render loop is woken to upload and redraw it. */
+void display_mark_dirty(display_t *display, int x, int y, int w, int h);
+
+/* Hand over a new image from another thread. It replaces the current one on
+ * the render thread as if passed to display_set_image; image_data must stay
+ * valid until replaced. */
+void display_post_image(display_t *display, const uint8_t *image_data,
+                        int width, int height, int channels, const char *title);
+
+/* Run the event loop until the window is closed. Blocks on SDL events and
+ * only redraws on expose, resize, input or new image data. */
+int display_run(display_t *display);
+
+/* Statistics gathered so far */
+const display_stats_t* display_get_stats(const display_t *display);
+
+/* Destroy window and shut down SDL */
+void display_destroy(display_t *display);
 
 /* Display image in SDL2 window */
 int display_image(const uint8_t *image_data, int width, int height, int channels);
@@ -0,0 +1,421 @@
+#include "encoder.h"
+#include "huffman.h"
+#include "dct.h"
+#include "color.h"
+#include "utils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Quantization tables from the JPEG standard (Annex K.1), natural order */
+static const uint8_t std_luminance_quant[BLOCK_SIZE] = {
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99
+};
+
+static const uint8_t std_chrominance_quant[BLOCK_SIZE] = {
+    17,  18,  24,  47,  99,  99,  99,  99,
+    18,  21,  26,  66,  99,  99,  99,  99,
+    24,  26,  56,  99,  99,  99,  99,  99,
+    47,  66,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99
+};
+
+/* Encoder state for one image */
+typedef struct {
+    jpeg_writer_t *writer;
+    frame_header_t frame;
+    quantization_table_t quant_tables[MAX_QUANT_TABLES];
+    uint16_t divisors[2][BLOCK_SIZE];   /* Quantizer step * 8 (FDCT scaling) */
+    huffman_table_t dc_tables[MAX_HUFFMAN_TABLES];
+    huffman_table_t ac_tables[MAX_HUFFMAN_TABLES];
+
+    int mcu_width;              /* MCUs horizontally */
+    int mcu_height;             /* MCUs vertically */
+    int mcu_size_x;             /* MCU width in pixels */
+    int mcu_size_y;             /* MCU height in pixels */
+
+    /* One MCU row of each component, padded to whole blocks */
+    uint8_t *strips[MAX_COMPONENTS];
+    int strip_width[MAX_COMPONENTS];
+
+    int16_t predictors[MAX_COMPONENTS];
+
+    /* Huffman optimization keeps every quantized block until the end */
+    bool optimize;
+    int16_t *blocks;
+    size_t num_blocks;
+} encoder_t;
+
+void encoder_default_options(encoder_options_t *options) {
+    options->quality = 85;
+    options->subsampling = CHROMA_420;
+    options->optimize_huffman = false;
+}
+
+/* IJG quality scaling: 50 uses the Annex K tables as-is */
+static void scale_quant_table(const uint8_t *base, int quality,
+                              quantization_table_t *table, uint16_t *divisors) {
+    quality = clamp(quality, 1, 100);
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        int value = clamp((base[i] * scale + 50) / 100, 1, 255);  /* Baseline: 8-bit */
+        table->table[i] = (uint8_t)value;
+        divisors[i] = (uint16_t)(value * 8);
+    }
+    table->is_set = true;
+}
+
+static void encoder_setup(encoder_t *enc, jpeg_writer_t *writer, int width, int height,
+                          int num_components, const encoder_options_t *options) {
+    memset(enc, 0, sizeof(encoder_t));
+    enc->writer = writer;
+    enc->optimize = options->optimize_huffman;
+
+    frame_header_t *frame = &enc->frame;
+    frame->precision = 8;
+    frame->width = (uint16_t)width;
+    frame->height = (uint16_t)height;
+    frame->num_components = (uint8_t)num_components;
+
+    for (int c = 0; c < num_components; c++) {
+        component_info_t *comp = &frame->components[c];
+        comp->id = (uint8_t)(c + 1);
+        comp->h_sampling = 1;
+        comp->v_sampling = 1;
+        if (c == 0 && num_components > 1) {
+            comp->h_sampling = options->subsampling == CHROMA_444 ? 1 : 2;
+            comp->v_sampling = options->subsampling == CHROMA_420 ? 2 : 1;
+        }
+        comp->quant_table_id = (c == 0) ? 0 : 1;
+        comp->dc_table_id = (c == 0) ? 0 : 1;
+        comp->ac_table_id = (c == 0) ? 0 : 1;
+    }
+
+    scale_quant_table(std_luminance_quant, options->quality,
+                      &enc->quant_tables[0], enc->divisors[0]);
+    scale_quant_table(std_chrominance_quant, options->quality,
+                      &enc->quant_tables[1], enc->divisors[1]);
+
+    int num_tables = num_components > 1 ? 2 : 1;
+    if (!enc->optimize) {
+        for (int i = 0; i < num_tables; i++) {
+            load_standard_huffman_table(&enc->dc_tables[i], 0, i);
+            load_standard_huffman_table(&enc->ac_tables[i], 1, i);
+        }
+    }
+
+    int max_h = frame->components[0].h_sampling;
+    int max_v = frame->components[0].v_sampling;
+    enc->mcu_size_x = max_h * 8;
+    enc->mcu_size_y = max_v * 8;
+    enc->mcu_width = (width + enc->mcu_size_x - 1) / enc->mcu_size_x;
+    enc->mcu_height = (height + enc->mcu_size_y - 1) / enc->mcu_size_y;
+
+    size_t blocks_per_mcu = 0;
+    for (int c = 0; c < num_components; c++) {
+        component_info_t *comp = &frame->components[c];
+        enc->strip_width[c] = enc->mcu_width * comp->h_sampling * 8;
+        enc->strips[c] = (uint8_t*)jpeg_malloc((size_t)enc->strip_width[c] *
+                                               comp->v_sampling * 8);
+        blocks_per_mcu += comp->h_sampling * comp->v_sampling;
+    }
+
+    if (enc->optimize) {
+        size_t total = blocks_per_mcu * enc->mcu_width * enc->mcu_height;
+        enc->blocks = (int16_t*)jpeg_malloc(total * BLOCK_SIZE * sizeof(int16_t));
+    } else {
+        jpeg_write_headers(writer, frame, enc->quant_tables, enc->dc_tables, enc->ac_tables);
+    }
+
+    JPEG_LOG("Encoding %dx%d, %d component(s), quality %d, %dx%d MCUs%s\n",
+             width, height, num_components, clamp(options->quality, 1, 100),
+             enc->mcu_width, enc->mcu_height, enc->optimize ? ", optimized Huffman" : "");
+}
+
+/* Divide by the quantizer step, rounding to nearest */
+static void quantize_block(const int32_t *coefs, const uint16_t *divisors, int16_t *block) {
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        int32_t value = coefs[i];
+        int32_t q = divisors[i];
+        if (value < 0) {
+            block[i] = (int16_t)-((-value + (q >> 1)) / q);
+        } else {
+            block[i] = (int16_t)((value + (q >> 1)) / q);
+        }
+    }
+}
+
+/* Transform, quantize and code the MCU row held in the strips */
+static void encode_strip(encoder_t *enc) {
+    int32_t workspace[BLOCK_SIZE];
+    int16_t local_block[BLOCK_SIZE];
+
+    for (int mcu_col = 0; mcu_col < enc->mcu_width; mcu_col++) {
+        for (int c = 0; c < enc->frame.num_components; c++) {
+            const component_info_t *comp = &enc->frame.components[c];
+            const uint16_t *divisors = enc->divisors[comp->quant_table_id];
+            int stride = enc->strip_width[c];
+
+            for (int v = 0; v < comp->v_sampling; v++) {
+                for (int h = 0; h < comp->h_sampling; h++) {
+                    const uint8_t *src = enc->strips[c] + (size_t)v * 8 * stride +
+                                         (mcu_col * comp->h_sampling + h) * 8;
+                    fdct_islow(src, stride, workspace);
+
+                    if (enc->optimize) {
+                        int16_t *block = enc->blocks + enc->num_blocks++ * BLOCK_SIZE;
+                        quantize_block(workspace, divisors, block);
+                    } else {
+                        quantize_block(workspace, divisors, local_block);
+                        jpeg_encode_block(enc->writer, local_block, &enc->predictors[c],
+                                          &enc->dc_tables[comp->dc_table_id],
+                                          &enc->ac_tables[comp->ac_table_id]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Visit stored blocks in coding order: count symbols or emit them */
+static void replay_blocks(encoder_t *enc, huffman_freq_t *freqs) {
+    const int16_t *block = enc->blocks;
+    int16_t predictors[MAX_COMPONENTS] = { 0 };
+    size_t num_mcus = (size_t)enc->mcu_width * enc->mcu_height;
+
+    for (size_t m = 0; m < num_mcus; m++) {
+        for (int c = 0; c < enc->frame.num_components; c++) {
+            const component_info_t *comp = &enc->frame.components[c];
+            int count = comp->h_sampling * comp->v_sampling;
+
+            for (int b = 0; b < count; b++, block += BLOCK_SIZE) {
+                if (freqs) {
+                    jpeg_count_block(block, &predictors[c], freqs[comp->dc_table_id].dc,
+                                     freqs[comp->ac_table_id].ac);
+                } else {
+                    jpeg_encode_block(enc->writer, block, &predictors[c],
+                                      &enc->dc_tables[comp->dc_table_id],
+                                      &enc->ac_tables[comp->ac_table_id]);
+                }
+            }
+        }
+    }
+}
+
+static void encoder_finish(encoder_t *enc) {
+    if (enc->optimize) {
+        huffman_freq_t freqs[MAX_HUFFMAN_TABLES];
+        memset(freqs, 0, sizeof(freqs));
+        replay_blocks(enc, freqs);
+
+        int num_tables = enc->frame.num_components > 1 ? 2 : 1;
+        for (int i = 0; i < num_tables; i++) {
+            jpeg_build_optimal_table(freqs[i].dc, &enc->dc_tables[i]);
+            jpeg_build_optimal_table(freqs[i].ac, &enc->ac_tables[i]);
+        }
+
+        jpeg_write_headers(enc->writer, &enc->frame, enc->quant_tables,
+                           enc->dc_tables, enc->ac_tables);
+        replay_blocks(enc, NULL);
+        jpeg_free(enc->blocks);
+        enc->blocks = NULL;
+    }
+
+    jpeg_write_trailer(enc->writer);
+
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        if (enc->strips[c]) {
+            jpeg_free(enc->strips[c]);
+            enc->strips[c] = NULL;
+        }
+    }
+}
+
+/* Copy width samples and replicate the last one out to padded_width */
+static void pad_row(const uint8_t *src, int width, uint8_t *dst, int padded_width) {
+    memcpy(dst, src, width);
+    memset(dst + width, src[width - 1], padded_width - width);
+}
+
+/* Encode planes that are already at the output sampling */
+int jpeg_encode_planes(jpeg_writer_t *writer, const uint8_t *const planes[],
+                       const size_t strides[], int width, int height, int num_components,
+                       const encoder_options_t *options) {
+    if (num_components != 1 && num_components != 3) {
+        fprintf(stderr, "Unsupported number of components: %d\n", num_components);
+        return -1;
+    }
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) {
+        fprintf(stderr, "Invalid image size for JPEG: %dx%d\n", width, height);
+        return -1;
+    }
+
+    double t_start = jpeg_time_us();
+    encoder_t enc;
+    encoder_setup(&enc, writer, width, height, num_components, options);
+
+    int max_h = enc.frame.components[0].h_sampling;
+    int max_v = enc.frame.components[0].v_sampling;
+    int plane_width[MAX_COMPONENTS], plane_height[MAX_COMPONENTS];
+    for (int c = 0; c < num_components; c++) {
+        const component_info_t *comp = &enc.frame.components[c];
+        plane_width[c] = (width * comp->h_sampling + max_h - 1) / max_h;
+        plane_height[c] = (height * comp->v_sampling + max_v - 1) / max_v;
+    }
+
+    for (int mcu_row = 0; mcu_row < enc.mcu_height; mcu_row++) {
+        for (int c = 0; c < num_components; c++) {
+            int rows = enc.frame.components[c].v_sampling * 8;
+            for (int r = 0; r < rows; r++) {
+                int sy = mcu_row * rows + r;
+                if (sy >= plane_height[c]) {
+                    sy = plane_height[c] - 1;  /* Replicate the bottom row */
+                }
+                pad_row(planes[c] + (size_t)sy * strides[c], plane_width[c],
+                        enc.strips[c] + (size_t)r * enc.strip_width[c], enc.strip_width[c]);
+            }
+        }
+        encode_strip(&enc);
+    }
+
+    encoder_finish(&enc);
+    JPEG_LOG("Encoded %zu bytes in %.2f ms\n", writer->size, (jpeg_time_us() - t_start) / 1000.0);
+    return 0;
+}
+
+/* 2:1 horizontal and vertical box filter with libjpeg's alternating bias */
+static void downsample_h2v2(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int out_width) {
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i bias = _mm_set_epi16(2, 1, 2, 1, 2, 1, 2, 1);
+    for (; x + 8 <= out_width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + 2 * x));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)),
+                                    _mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, bias), 2);
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for (; x < out_width; x++) {
+        int bias = (x & 1) ? 2 : 1;
+        out[x] = (uint8_t)((row0[2 * x] + row0[2 * x + 1] +
+                            row1[2 * x] + row1[2 * x + 1] + bias) >> 2);
+    }
+}
+
+/* 2:1 horizontal box filter with alternating bias */
+static void downsample_h2v1(const uint8_t *row, uint8_t *out, int out_width) {
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i bias = _mm_set_epi16(1, 0, 1, 0, 1, 0, 1, 0);
+    for (; x + 8 <= out_width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row + 2 * x));
+        __m128i sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, bias), 1);
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for (; x < out_width; x++) {
+        int bias = x & 1;
+        out[x] = (uint8_t)((row[2 * x] + row[2 * x + 1] + bias) >> 1);
+    }
+}
+
+/* Encode RGB or grayscale pixels: convert and subsample one MCU row at a time */
+int jpeg_encode_pixels(jpeg_writer_t *writer, const uint8_t *pixels, int width, int height,
+                       int channels, size_t stride, const encoder_options_t *options) {
+    if (channels == 1) {
+        const uint8_t *planes[1] = { pixels };
+        size_t strides[1] = { stride };
+        return jpeg_encode_planes(writer, planes, strides, width, height, 1, options);
+    }
+    if (channels != 3) {
+        fprintf(stderr, "Unsupported number of channels: %d\n", channels);
+        return -1;
+    }
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) {
+        fprintf(stderr, "Invalid image size for JPEG: %dx%d\n", width, height);
+        return -1;
+    }
+
+    double t_start = jpeg_time_us();
+    encoder_t enc;
+    encoder_setup(&enc, writer, width, height, 3, options);
+
+    /* Full-resolution chroma rows for one MCU row (unless 4:4:4) */
+    int padded_width = enc.mcu_width * enc.mcu_size_x;
+    bool subsampled = options->subsampling != CHROMA_444;
+    uint8_t *cb_full = NULL;
+    uint8_t *cr_full = NULL;
+    if (subsampled) {
+        cb_full = (uint8_t*)jpeg_malloc((size_t)padded_width * enc.mcu_size_y);
+        cr_full = (uint8_t*)jpeg_malloc((size_t)padded_width * enc.mcu_size_y);
+    }
+
+    for (int mcu_row = 0; mcu_row < enc.mcu_height; mcu_row++) {
+        for (int r = 0; r < enc.mcu_size_y; r++) {
+            int sy = mcu_row * enc.mcu_size_y + r;
+            if (sy >= height) {
+                sy = height - 1;
+            }
+
+            uint8_t *y_row = enc.strips[0] + (size_t)r * enc.strip_width[0];
+            uint8_t *cb_row = subsampled ? cb_full + (size_t)r * padded_width
+                                         : enc.strips[1] + (size_t)r * enc.strip_width[1];
+            uint8_t *cr_row = subsampled ? cr_full + (size_t)r * padded_width
+                                         : enc.strips[2] + (size_t)r * enc.strip_width[2];
+
+            rgb_to_ycbcr_row(pixels + (size_t)sy * stride, y_row, cb_row, cr_row, width);
+
+            /* Replicate the right edge out to the MCU boundary */
+            memset(y_row + width, y_row[width - 1], padded_width - width);
+            memset(cb_row + width, cb_row[width - 1], padded_width - width);
+            memset(cr_row + width, cr_row[width - 1], padded_width - width);
+        }
+
+        if (options->subsampling == CHROMA_420) {
+            for (int r = 0; r < 8; r++) {
+                size_t in0 = (size_t)(2 * r) * padded_width;
+                size_t in1 = in0 + padded_width;
+                size_t out = (size_t)r * enc.strip_width[1];
+                downsample_h2v2(cb_full + in0, cb_full + in1, enc.strips[1] + out, enc.strip_width[1]);
+                downsample_h2v2(cr_full + in0, cr_full + in1, enc.strips[2] + out, enc.strip_width[2]);
+            }
+        } else if (options->subsampling == CHROMA_422) {
+            for (int r = 0; r < 8; r++) {
+                size_t in = (size_t)r * padded_width;
+                size_t out = (size_t)r * enc.strip_width[1];
+                downsample_h2v1(cb_full + in, enc.strips[1] + out, enc.strip_width[1]);
+                downsample_h2v1(cr_full + in, enc.strips[2] + out, enc.strip_width[2]);
+            }
+        }
+
+        encode_strip(&enc);
+    }
+
+    if (cb_full) jpeg_free(cb_full);
+    if (cr_full) jpeg_free(cr_full);
+
+    encoder_finish(&enc);
+    JPEG_LOG("Encoded %zu bytes in %.2f ms\n", writer->size, (jpeg_time_us() - t_start) / 1000.0);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include "../include/jpeg_types.h"
+#include "jpeg_writer.h"
+
+/* Chroma sampling of the encoded image */
+typedef enum {
+    CHROMA_444,                 /* Full resolution chroma */
+    CHROMA_422,                 /* Half horizontal chroma resolution */
+    CHROMA_420                  /* Half horizontal and vertical chroma resolution */
+} chroma_subsampling_t;
+
+/* Encoder settings */
+typedef struct {
+    int quality;                        /* 1-100, IJG scaling of the Annex K tables */
+    chroma_subsampling_t subsampling;
+    bool optimize_huffman;              /* Two passes with optimal tables instead of Annex K */
+} encoder_options_t;
+
+/* Quality 85, 4:2:0, standard Huffman tables */
+void encoder_default_options(encoder_options_t *options);
+
+/* Encode interleaved RGB (channels = 3) or grayscale (channels = 1) pixels,
+ * stride bytes per row, as a baseline JPEG */
+int jpeg_encode_pixels(jpeg_writer_t *writer, const uint8_t *pixels, int width, int height,
+                       int channels, size_t stride, const encoder_options_t *options);
+
+/* Encode planar Y (and Cb, Cr) samples that are already at the sampled
+ * sizes implied by options->subsampling: plane 0 is width x height, chroma
+ * planes are ceil(width / 2) wide for 4:2:2 and 4:2:0 and ceil(height / 2)
+ * tall for 4:2:0. num_components is 1 or 3. */
+int jpeg_encode_planes(jpeg_writer_t *writer, const uint8_t *const planes[],
+                       const size_t strides[], int width, int height, int num_components,
+                       const encoder_options_t *options);
+
+#endif /* ENCODER_H */
@@ -0,0 +1,154 @@
+#include "exif.h"
+#include <string.h>
+
+#define EXIF_HEADER_SIZE 6      /* "Exif\0\0" */
+#define IFD_ENTRY_SIZE   12
+
+/* TIFF tags */
+#define TAG_ORIENTATION         0x0112
+#define TAG_JPEG_OFFSET         0x0201  /* JPEGInterchangeFormat */
+#define TAG_JPEG_LENGTH         0x0202  /* JPEGInterchangeFormatLength */
+
+/* TIFF field types */
+#define TYPE_SHORT 3
+#define TYPE_LONG  4
+
+/* TIFF structure inside an APP1 payload; offsets are relative to tiff */
+typedef struct {
+    const uint8_t *tiff;
+    size_t size;
+    bool little_endian;
+} tiff_reader_t;
+
+/* TIFF data is either little-endian ("II") or big-endian ("MM") */
+static uint16_t tiff_get16(const tiff_reader_t *t, size_t offset) {
+    const uint8_t *p = t->tiff + offset;
+    return t->little_endian ? (uint16_t)(p[0] | (p[1] << 8))
+                            : (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t tiff_get32(const tiff_reader_t *t, size_t offset) {
+    const uint8_t *p = t->tiff + offset;
+    return t->little_endian
+        ? (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)
+        : ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/* Integer value of a SHORT or LONG entry with a count of 1 */
+static uint32_t tiff_entry_value(const tiff_reader_t *t, size_t entry) {
+    uint16_t type = tiff_get16(t, entry + 2);
+    return type == TYPE_SHORT ? tiff_get16(t, entry + 8) : tiff_get32(t, entry + 8);
+}
+
+/* Check the "Exif\0\0" and TIFF headers. Returns 0 with the offset of IFD0,
+ * 1 if more data is needed, -1 if this is not EXIF. */
+static int tiff_open(tiff_reader_t *t, const uint8_t *data, size_t size, uint32_t *ifd0) {
+    if (size < EXIF_HEADER_SIZE + 8) {
+        size_t n = size < EXIF_HEADER_SIZE ? size : EXIF_HEADER_SIZE;
+        return memcmp(data, "Exif\0\0", n) == 0 ? 1 : -1;
+    }
+    if (memcmp(data, "Exif\0\0", EXIF_HEADER_SIZE) != 0) {
+        return -1;
+    }
+
+    t->tiff = data + EXIF_HEADER_SIZE;
+    t->size = size - EXIF_HEADER_SIZE;
+
+    if (t->tiff[0] == 'I' && t->tiff[1] == 'I') {
+        t->little_endian = true;
+    } else if (t->tiff[0] == 'M' && t->tiff[1] == 'M') {
+        t->little_endian = false;
+    } else {
+        return -1;
+    }
+    if (tiff_get16(t, 2) != 42) {
+        return -1;
+    }
+
+    *ifd0 = tiff_get32(t, 4);
+    return 0;
+}
+
+int exif_read_orientation(const uint8_t *data, size_t size, int *orientation) {
+    *orientation = EXIF_ORIENTATION_NORMAL;
+
+    tiff_reader_t t;
+    uint32_t ifd;
+    int result = tiff_open(&t, data, size, &ifd);
+    if (result != 0) {
+        return result;
+    }
+
+    /* IFD0: entry count, then 12-byte entries */
+    if ((size_t)ifd + 2 > t.size) {
+        return 1;
+    }
+
+    uint16_t num_entries = tiff_get16(&t, ifd);
+    for (uint16_t i = 0; i < num_entries; i++) {
+        size_t entry = (size_t)ifd + 2 + (size_t)i * IFD_ENTRY_SIZE;
+        if (entry + IFD_ENTRY_SIZE > t.size) {
+            return 1;
+        }
+        if (tiff_get16(&t, entry) != TAG_ORIENTATION) {
+            continue;
+        }
+
+        uint32_t value = tiff_entry_value(&t, entry);
+        if (tiff_get16(&t, entry + 2) == TYPE_SHORT && value >= 1 && value <= 8) {
+            *orientation = (int)value;
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
+int exif_find_thumbnail(const uint8_t *data, size_t size, size_t *offset, size_t *length) {
+    tiff_reader_t t;
+    uint32_t ifd;
+    if (tiff_open(&t, data, size, &ifd) != 0) {
+        return -1;
+    }
+
+    /* IFD1 follows IFD0 through its next-IFD link */
+    if ((size_t)ifd + 2 > t.size) {
+        return -1;
+    }
+    size_t next_link = (size_t)ifd + 2 + (size_t)tiff_get16(&t, ifd) * IFD_ENTRY_SIZE;
+    if (next_link + 4 > t.size) {
+        return -1;
+    }
+    ifd = tiff_get32(&t, next_link);
+    if (ifd == 0 || (size_t)ifd + 2 > t.size) {
+        return -1;
+    }
+
+    uint32_t jpeg_offset = 0;
+    uint32_t jpeg_length = 0;
+    uint16_t num_entries = tiff_get16(&t, ifd);
+    for (uint16_t i = 0; i < num_entries; i++) {
+        size_t entry = (size_t)ifd + 2 + (size_t)i * IFD_ENTRY_SIZE;
+        if (entry + IFD_ENTRY_SIZE > t.size) {
+            return -1;
+        }
+
+        uint16_t tag = tiff_get16(&t, entry);
+        if (tag == TAG_JPEG_OFFSET) {
+            jpeg_offset = tiff_entry_value(&t, entry);
+        } else if (tag == TAG_JPEG_LENGTH) {
+            jpeg_length = tiff_entry_value(&t, entry);
+        }
+    }
+
+    /* The thumbnail must lie inside the segment and start with SOI */
+    if (jpeg_offset == 0 || jpeg_length < 4 ||
+        (size_t)jpeg_offset + jpeg_length > t.size ||
+        t.tiff[jpeg_offset] != 0xFF || t.tiff[jpeg_offset + 1] != 0xD8) {
+        return -1;
+    }
+
+    *offset = EXIF_HEADER_SIZE + (size_t)jpeg_offset;
+    *length = jpeg_length;
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef EXIF_H
+#define EXIF_H
+
+#include "../include/jpeg_types.h"
+
+/* EXIF orientation values (TIFF tag 0x0112) */
+#define EXIF_ORIENTATION_NORMAL 1
+
+/* Read the orientation from an APP1 payload (the bytes after the length
+ * field, starting with "Exif\0\0"). Sets *orientation to 1-8, or 1 when the
+ * tag is absent. Returns 0 on success, 1 if the payload was cut short before
+ * the tag could be found (retry with more of the segment), -1 if the data
+ * is not valid EXIF. */
+int exif_read_orientation(const uint8_t *data, size_t size, int *orientation);
+
+/* Locate the JPEG thumbnail referenced by IFD1 of an APP1 payload. On
+ * success *offset is relative to the start of data (the "Exif" tag) and the
+ * thumbnail bytes are known to lie within size. Returns -1 if there is none. */
+int exif_find_thumbnail(const uint8_t *data, size_t size, size_t *offset, size_t *length);
+
+#endif /* EXIF_H */
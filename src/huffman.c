@@ -2,51 +2,9 @@
 #include "utils.h"
 #include <string.h>
 
-/* Generate Huffman codes from BITS and HUFFVAL arrays per JPEG Annex C */
-void generate_huffman_codes(huffman_table_t *table) {
-    /* Initialize all code lengths to 0 */
-    memset(table->code_lengths, 0, sizeof(table->code_lengths));
-    memset(table->codes, 0, sizeof(table->codes));
-    memset(table->lookup, 0, sizeof(table->lookup));
-
-    int code = 0;
-    int k = 0;
-
-    /* Generate codes for each bit length (1-16) */
-    for (int len = 1; len <= 16; len++) {
-        for (int i = 0; i < table->bits[len]; i++) {
-            if (k >= 256) {
-                fprintf(stderr, "Huffman table overflow\n");
-                return;
-            }
-
-            uint8_t symbol = table->huffval[k];
-            table->codes[symbol] = code;
-            table->code_lengths[symbol] = len;
-
-            /* Build fast lookup table for codes <= HUFF_LOOKAHEAD bits */
-            if (len <= HUFF_LOOKAHEAD) {
-                /* For codes shorter than HUFF_LOOKAHEAD bits, replicate the entry
-                 * for all possible bit patterns that start with this code.
-                 * E.g., if code is "10" (2 bits), fill entries for:
-                 * 10000000, 10000001, ..., 10111111 (all 64 combinations) */
-                int lookahead_base = code << (HUFF_LOOKAHEAD - len);
-                int replicate_count = 1 << (HUFF_LOOKAHEAD - len);
-
-                for (int j = 0; j < replicate_count; j++) {
-                    int lookup_index = lookahead_base + j;
-                    table->lookup[lookup_index].symbol = symbol;
-                    table->lookup[lookup_index].bits = len;
-                }
-            }
-
-            code++;
-            k++;
-        }
-
-        code <<= 1;  /* Shift for next code length */
-    }
-}
+/* The Annex K tables with codes and lookup built: [class][id], generated
+ * at build time by tools/gen_huffman_tables.c */
+#include "huffman_std_tables.h"
 
 /* Decode a Huffman symbol from bit stream - FAST version with lookup table */
 int decode_huffman_symbol(bit_reader_t *reader, huffman_table_t *table) {
@@ -87,3 +45,30 @@ int decode_huffman_symbol(bit_reader_t *reader, huffman_table_t *table) {
     fprintf(stderr, "Invalid Huffman code: 0x%04X\n", code);
     return -1;
 }
+
+/* Take the compiled-in build of an Annex K table with the same BITS and
+ * HUFFVAL, which is what most encoders write */
+bool load_standard_build(huffman_table_t *table) {
+    for (int table_class = 0; table_class < 2; table_class++) {
+        for (int id = 0; id < 2; id++) {
+            const huffman_table_t *std = &std_tables[table_class][id];
+            if (memcmp(std->bits, table->bits, sizeof(table->bits)) != 0) {
+                continue;
+            }
+            int num_symbols = 0;
+            for (int len = 1; len <= 16; len++) {
+                num_symbols += std->bits[len];
+            }
+            if (memcmp(std->huffval, table->huffval, num_symbols) == 0) {
+                *table = *std;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Load an Annex K table: class 0 = DC, 1 = AC; id 0 = luminance, 1 = chrominance */
+void load_standard_huffman_table(huffman_table_t *table, int table_class, int table_id) {
+    *table = std_tables[table_class][table_id];
+}
@@ -3,9 +3,22 @@
 
 #include "../include/jpeg_types.h"
 
-/* Generate Huffman codes from BITS and HUFFVAL arrays */
+/* Generate Huffman codes and the lookup table from BITS and HUFFVAL
+ * (huffman_tables.c, which the build-time table generator shares) */
 void generate_huffman_codes(huffman_table_t *table);
 
+/* Fill BITS and HUFFVAL of a standard Annex K.3 table, without codes */
+void huffman_standard_contents(huffman_table_t *table, int table_class, int table_id);
+
+/* If BITS and HUFFVAL are those of an Annex K.3 table, take its
+ * compiled-in codes and lookup table and return true */
+bool load_standard_build(huffman_table_t *table);
+
+/* Load a standard Annex K.3 table (class 0 = DC, 1 = AC;
+ * id 0 = luminance, 1 = chrominance) with codes generated. The built
+ * tables are compiled in, so this is a copy. */
+void load_standard_huffman_table(huffman_table_t *table, int table_class, int table_id);
+
 /* Decode a symbol from the bit stream */
 int decode_huffman_symbol(bit_reader_t *reader, huffman_table_t *table);
 
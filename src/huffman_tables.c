@@ -0,0 +1,135 @@
+#include "huffman.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Build codes and lookup table from BITS and HUFFVAL per JPEG Annex C */
+void generate_huffman_codes(huffman_table_t *table) {
+    table->codes_generated = false;
+
+    /* Initialize all code lengths to 0 */
+    memset(table->code_lengths, 0, sizeof(table->code_lengths));
+    memset(table->codes, 0, sizeof(table->codes));
+    memset(table->lookup, 0, sizeof(table->lookup));
+
+    int code = 0;
+    int k = 0;
+
+    /* Generate codes for each bit length (1-16) */
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < table->bits[len]; i++) {
+            if (k >= 256) {
+                fprintf(stderr, "Huffman table overflow\n");
+                return;
+            }
+
+            uint8_t symbol = table->huffval[k];
+            table->codes[symbol] = code;
+            table->code_lengths[symbol] = len;
+
+            /* Build fast lookup table for codes <= HUFF_LOOKAHEAD bits */
+            if (len <= HUFF_LOOKAHEAD) {
+                /* For codes shorter than HUFF_LOOKAHEAD bits, replicate the entry
+                 * for all possible bit patterns that start with this code.
+                 * E.g., if code is "10" (2 bits), fill entries for:
+                 * 10000000, 10000001, ..., 10111111 (all 64 combinations) */
+                int lookahead_base = code << (HUFF_LOOKAHEAD - len);
+                int replicate_count = 1 << (HUFF_LOOKAHEAD - len);
+
+                for (int j = 0; j < replicate_count; j++) {
+                    int lookup_index = lookahead_base + j;
+                    table->lookup[lookup_index].symbol = symbol;
+                    table->lookup[lookup_index].bits = len;
+                }
+            }
+
+            code++;
+            k++;
+        }
+
+        code <<= 1;  /* Shift for next code length */
+    }
+    table->codes_generated = true;
+}
+
+/* Typical Huffman tables from the JPEG standard (Annex K.3) */
+static const uint8_t std_dc_luminance_bits[17] =
+    { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_chrominance_bits[17] =
+    { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_values[12] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t std_ac_luminance_bits[17] =
+    { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t std_ac_luminance_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+    0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t std_ac_chrominance_bits[17] =
+    { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t std_ac_chrominance_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+    0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+    0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+/* Fill BITS and HUFFVAL of an Annex K table */
+void huffman_standard_contents(huffman_table_t *table, int table_class, int table_id) {
+    const uint8_t *bits;
+    const uint8_t *values;
+
+    if (table_class == 0) {
+        bits = table_id == 0 ? std_dc_luminance_bits : std_dc_chrominance_bits;
+        values = std_dc_values;
+    } else {
+        bits = table_id == 0 ? std_ac_luminance_bits : std_ac_chrominance_bits;
+        values = table_id == 0 ? std_ac_luminance_values : std_ac_chrominance_values;
+    }
+
+    memset(table, 0, sizeof(huffman_table_t));
+    int total_symbols = 0;
+    for (int i = 1; i <= 16; i++) {
+        table->bits[i] = bits[i];
+        total_symbols += bits[i];
+    }
+    memcpy(table->huffval, values, total_symbols);
+    table->is_set = true;
+}
@@ -0,0 +1,364 @@
+#include "image_cache.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "color.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "utils.h"
+#include <pthread.h>
+
+/* Nice level for prefetch workers: visible-image decodes run at normal priority */
+#define PREFETCH_NICE_LEVEL 10
+
+/* The decodes of one entry: a prefetch worker's, and the foreground's,
+ * which does not wait on the low-priority worker but races it */
+enum {
+    RACER_PREFETCH,
+    RACER_FOREGROUND,
+    NUM_RACERS
+};
+
+typedef enum {
+    CACHE_EMPTY,        /* Not decoded */
+    CACHE_LOADING,      /* Being decoded by a worker or the foreground thread */
+    CACHE_READY,        /* Decoded pixels available */
+    CACHE_FAILED        /* Decode failed; not retried */
+} cache_state_t;
+
+typedef struct {
+    cache_state_t state;
+    decoded_image_t image;
+    size_t bytes;
+    int pins;                   /* Outstanding image_cache_acquire references */
+    unsigned long last_used;    /* LRU clock value of last access */
+    unsigned long load;         /* Bumped each time the entry starts LOADING */
+    jpeg_decoder_t *decoders[NUM_RACERS];   /* Decodes in flight for this load */
+} cache_entry_t;
+
+struct image_cache {
+    char **paths;
+    int count;
+    cache_entry_t *entries;
+
+    size_t budget_bytes;
+    size_t used_bytes;
+    unsigned long clock;        /* Monotonic LRU clock */
+
+    threadpool_t *workers;
+    int prefetch_radius;
+    unsigned long generation;   /* Bumped on navigation; stale prefetch jobs are dropped */
+    int shutdown;
+
+    pthread_mutex_t lock;
+    pthread_cond_t entry_done;  /* Signalled when a LOADING entry settles */
+};
+
+typedef struct {
+    image_cache_t *cache;
+    int index;
+    unsigned long generation;
+} prefetch_job_t;
+
+int decode_parsed_image(jpeg_decoder_t *decoder, decoded_image_t *image) {
+    if (jpeg_decode(decoder) != 0 || ycbcr_to_rgb(decoder) != 0) {
+        return -1;
+    }
+
+    /* Take ownership of the output buffer */
+    image->pixels = decoder->image_data;
+    image->width = decoder->width;
+    image->height = decoder->height;
+    image->channels = decoder->channels;
+    decoder->image_data = NULL;
+    return 0;
+}
+
+/* Evict least recently used unpinned images until within budget.
+ * Must be called with the lock held. */
+static void evict_to_budget(image_cache_t *cache, int keep_index) {
+    while (cache->used_bytes > cache->budget_bytes) {
+        int victim = -1;
+        for (int i = 0; i < cache->count; i++) {
+            cache_entry_t *entry = &cache->entries[i];
+            if (i == keep_index || entry->state != CACHE_READY || entry->pins > 0) {
+                continue;
+            }
+            if (victim < 0 || entry->last_used < cache->entries[victim].last_used) {
+                victim = i;
+            }
+        }
+
+        if (victim < 0) {
+            return;  /* Everything left is pinned or in flight */
+        }
+
+        cache_entry_t *entry = &cache->entries[victim];
+        jpeg_free(entry->image.pixels);
+        entry->image.pixels = NULL;
+        cache->used_bytes -= entry->bytes;
+        entry->bytes = 0;
+        entry->state = CACHE_EMPTY;
+    }
+}
+
+/* Record the result of a decode. Must be called with the lock held. */
+static void finish_entry(image_cache_t *cache, int index, int result,
+                         const decoded_image_t *image) {
+    cache_entry_t *entry = &cache->entries[index];
+
+    if (result == 0) {
+        entry->image = *image;
+        entry->bytes = (size_t)image->width * image->height * image->channels;
+        entry->state = CACHE_READY;
+        entry->last_used = ++cache->clock;
+        cache->used_bytes += entry->bytes;
+        evict_to_budget(cache, index);
+    } else {
+        entry->state = CACHE_FAILED;
+    }
+
+    pthread_cond_broadcast(&cache->entry_done);
+}
+
+/* Mark an EMPTY entry LOADING. Must be called with the lock held. */
+static void start_loading(cache_entry_t *entry) {
+    entry->state = CACHE_LOADING;
+    entry->load++;
+    for (int i = 0; i < NUM_RACERS; i++) {
+        entry->decoders[i] = NULL;
+    }
+}
+
+/* Decode a LOADING entry as one of its racers; the first decode to finish
+ * settles the entry and cancels the other, whose result is dropped. Must
+ * be called with the lock held; takes ownership of decoder. */
+static void race_entry(image_cache_t *cache, int index, int racer, jpeg_decoder_t *decoder) {
+    cache_entry_t *entry = &cache->entries[index];
+    unsigned long load = entry->load;
+
+    entry->decoders[racer] = decoder;
+    pthread_mutex_unlock(&cache->lock);
+
+    decoded_image_t image;
+    trace_begin_arg(racer == RACER_PREFETCH ? "prefetch image" : "decode image", "index", index);
+    int result = decode_parsed_image(decoder, &image);
+    trace_end();
+
+    pthread_mutex_lock(&cache->lock);
+    bool current = entry->load == load;
+    if (current) {
+        entry->decoders[racer] = NULL;
+    }
+    if (current && entry->state == CACHE_LOADING) {
+        finish_entry(cache, index, result, &image);
+        for (int i = 0; i < NUM_RACERS; i++) {
+            if (entry->decoders[i]) {
+                jpeg_decode_cancel(entry->decoders[i]);
+            }
+        }
+    } else if (result == 0) {
+        jpeg_free(image.pixels);
+    }
+
+    /* Unregistered above, so no one can cancel it any more */
+    pthread_mutex_unlock(&cache->lock);
+    jpeg_parser_destroy(decoder);
+    pthread_mutex_lock(&cache->lock);
+}
+
+/* Worker: decode one neighbor unless the request has gone stale */
+static void prefetch_worker(void *arg) {
+    prefetch_job_t *job = (prefetch_job_t*)arg;
+    image_cache_t *cache = job->cache;
+    int index = job->index;
+
+    cache_entry_t *entry = &cache->entries[index];
+    pthread_mutex_lock(&cache->lock);
+    int stale = cache->shutdown || job->generation != cache->generation ||
+                entry->state != CACHE_EMPTY;
+    if (!stale) {
+        start_loading(entry);
+    }
+    unsigned long load = entry->load;
+    pthread_mutex_unlock(&cache->lock);
+    jpeg_free(job);
+
+    if (stale) {
+        return;
+    }
+
+    jpeg_decoder_t *decoder = jpeg_parser_init(cache->paths[index]);
+
+    pthread_mutex_lock(&cache->lock);
+    if (entry->load != load || entry->state != CACHE_LOADING) {
+        /* The foreground got there first */
+        pthread_mutex_unlock(&cache->lock);
+        jpeg_parser_destroy(decoder);
+        return;
+    }
+    if (!decoder) {
+        finish_entry(cache, index, -1, NULL);
+    } else {
+        race_entry(cache, index, RACER_PREFETCH, decoder);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Create cache */
+image_cache_t* image_cache_create(char **paths, int count, size_t budget_bytes,
+                                  int prefetch_threads, int prefetch_radius) {
+    image_cache_t *cache = (image_cache_t*)jpeg_malloc(sizeof(image_cache_t));
+    memset(cache, 0, sizeof(image_cache_t));
+
+    cache->paths = paths;
+    cache->count = count;
+    cache->budget_bytes = budget_bytes;
+    cache->prefetch_radius = prefetch_radius;
+
+    cache->entries = (cache_entry_t*)jpeg_malloc(count * sizeof(cache_entry_t));
+    memset(cache->entries, 0, count * sizeof(cache_entry_t));
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->entry_done, NULL);
+
+    if (prefetch_threads > 0 && prefetch_radius > 0) {
+        cache->workers = threadpool_create(prefetch_threads, PREFETCH_NICE_LEVEL);
+        if (!cache->workers) {
+            fprintf(stderr, "Warning: prefetch disabled (no worker threads)\n");
+        }
+    }
+
+    return cache;
+}
+
+/* Get (and pin) an image, decoding it in the foreground if necessary */
+const decoded_image_t* image_cache_acquire(image_cache_t *cache, int index) {
+    if (index < 0 || index >= cache->count) {
+        return NULL;
+    }
+
+    cache_entry_t *entry = &cache->entries[index];
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Queued prefetch work for the previous position is now stale */
+    cache->generation++;
+
+    /* Not cached: decode it here at normal priority. A prefetch worker that
+     * already started on it runs niced and could be starved for as long as
+     * the foreground is busy, so it is raced rather than waited for; if it
+     * was nearly done it wins and cancels this decode. */
+    if (entry->state == CACHE_EMPTY || entry->state == CACHE_LOADING) {
+        pthread_mutex_unlock(&cache->lock);
+        jpeg_decoder_t *decoder = jpeg_parser_init(cache->paths[index]);
+        pthread_mutex_lock(&cache->lock);
+
+        for (;;) {
+            if (entry->state == CACHE_EMPTY) {
+                start_loading(entry);
+                if (!decoder) {
+                    finish_entry(cache, index, -1, NULL);
+                    break;
+                }
+            }
+            if (entry->state != CACHE_LOADING) {
+                jpeg_parser_destroy(decoder);
+                break;
+            }
+            if (decoder && !entry->decoders[RACER_FOREGROUND]) {
+                race_entry(cache, index, RACER_FOREGROUND, decoder);
+                break;
+            }
+
+            /* Another foreground caller is racing it, or the file does not parse */
+            trace_begin_arg("wait for decode", "index", index);
+            pthread_cond_wait(&cache->entry_done, &cache->lock);
+            trace_end();
+        }
+    }
+
+    const decoded_image_t *image = NULL;
+    if (entry->state == CACHE_READY) {
+        entry->pins++;
+        entry->last_used = ++cache->clock;
+        image = &entry->image;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return image;
+}
+
+/* Unpin an image */
+void image_cache_release(image_cache_t *cache, int index) {
+    if (index < 0 || index >= cache->count) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->entries[index].pins > 0) {
+        cache->entries[index].pins--;
+    }
+    evict_to_budget(cache, -1);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Queue neighbors of index: +1, -1, +2, -2, ... */
+void image_cache_prefetch(image_cache_t *cache, int index) {
+    if (!cache->workers) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    unsigned long generation = ++cache->generation;
+    pthread_mutex_unlock(&cache->lock);
+
+    for (int distance = 1; distance <= cache->prefetch_radius; distance++) {
+        int neighbors[2] = { index + distance, index - distance };
+
+        for (int n = 0; n < 2; n++) {
+            int target = neighbors[n];
+            if (target < 0 || target >= cache->count) {
+                continue;
+            }
+
+            prefetch_job_t *job = (prefetch_job_t*)jpeg_malloc(sizeof(prefetch_job_t));
+            job->cache = cache;
+            job->index = target;
+            job->generation = generation;
+
+            if (threadpool_submit(cache->workers, prefetch_worker, job) != 0) {
+                jpeg_free(job);
+            }
+        }
+    }
+}
+
+/* Bytes of decoded pixels currently held */
+size_t image_cache_bytes(image_cache_t *cache) {
+    pthread_mutex_lock(&cache->lock);
+    size_t bytes = cache->used_bytes;
+    pthread_mutex_unlock(&cache->lock);
+    return bytes;
+}
+
+/* Destroy cache */
+void image_cache_destroy(image_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+
+    /* Make any queued jobs no-ops, then wait for in-flight decodes */
+    pthread_mutex_lock(&cache->lock);
+    cache->shutdown = 1;
+    pthread_mutex_unlock(&cache->lock);
+    threadpool_destroy(cache->workers);
+
+    for (int i = 0; i < cache->count; i++) {
+        jpeg_free(cache->entries[i].image.pixels);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->entry_done);
+    jpeg_free(cache->entries);
+    jpeg_free(cache);
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "../include/jpeg_types.h"
+
+/* Fully decoded image (tightly packed RGB or grayscale) */
+typedef struct {
+    uint8_t *pixels;
+    int width;
+    int height;
+    int channels;
+} decoded_image_t;
+
+/* Decode and color-convert a parsed file into image, taking the pixels
+ * (freed with jpeg_free) out of the decoder */
+int decode_parsed_image(jpeg_decoder_t *decoder, decoded_image_t *image);
+
+/* Opaque LRU cache of decoded images with background prefetch */
+typedef struct image_cache image_cache_t;
+
+/* Create a cache over a list of file paths (not copied; must outlive the cache).
+ * budget_bytes bounds the decoded pixel memory kept around; prefetch_threads
+ * low-priority workers decode up to prefetch_radius neighbors ahead. */
+image_cache_t* image_cache_create(char **paths, int count, size_t budget_bytes,
+                                  int prefetch_threads, int prefetch_radius);
+
+/* Get image at index, decoding it on the calling thread if it is not cached
+ * (also when a prefetch worker is already on it: whichever decode finishes
+ * first is kept and the other cancelled). Supersedes any queued prefetch
+ * work. The image stays pinned (never evicted) until released. Returns NULL
+ * if the file cannot be decoded. */
+const decoded_image_t* image_cache_acquire(image_cache_t *cache, int index);
+
+/* Unpin an image returned by image_cache_acquire */
+void image_cache_release(image_cache_t *cache, int index);
+
+/* Queue background decodes for the neighbors of index, nearest first */
+void image_cache_prefetch(image_cache_t *cache, int index);
+
+/* Bytes of decoded pixels currently held */
+size_t image_cache_bytes(image_cache_t *cache);
+
+/* Stop workers and free all cached images */
+void image_cache_destroy(image_cache_t *cache);
+
+#endif /* IMAGE_CACHE_H */
@@ -1,28 +1,35 @@
 #include "jpeg_parser.h"
+#include "dct.h"
+#include "exif.h"
+#include "huffman.h"
+#include "trace.h"
 #include "utils.h"
 #include <string.h>
 
-/* Initialize decoder and load file */
-jpeg_decoder_t* jpeg_parser_init(const char *filename) {
+/* Take ownership of data and parse the markers, starting from the tables
+ * of a previous frame if given */
+static jpeg_decoder_t* parser_init_data(uint8_t *data, size_t data_size,
+                                        const jpeg_tables_t *tables) {
     jpeg_decoder_t *decoder = (jpeg_decoder_t*)jpeg_malloc(sizeof(jpeg_decoder_t));
     memset(decoder, 0, sizeof(jpeg_decoder_t));
 
-    /* Load file into memory */
-    decoder->data = load_file(filename, &decoder->data_size);
-    if (!decoder->data) {
-        jpeg_free(decoder);
-        return NULL;
-    }
-
+    decoder->data = data;
+    decoder->data_size = data_size;
     decoder->current_pos = 0;
 
-    /* Initialize tables as not set */
-    for (int i = 0; i < MAX_QUANT_TABLES; i++) {
-        decoder->quant_tables[i].is_set = false;
-    }
-    for (int i = 0; i < MAX_HUFFMAN_TABLES; i++) {
-        decoder->dc_tables[i].is_set = false;
-        decoder->ac_tables[i].is_set = false;
+    if (tables) {
+        memcpy(decoder->quant_tables, tables->quant_tables, sizeof(decoder->quant_tables));
+        memcpy(decoder->dc_tables, tables->dc_tables, sizeof(decoder->dc_tables));
+        memcpy(decoder->ac_tables, tables->ac_tables, sizeof(decoder->ac_tables));
+    } else {
+        /* Initialize tables as not set */
+        for (int i = 0; i < MAX_QUANT_TABLES; i++) {
+            decoder->quant_tables[i].is_set = false;
+        }
+        for (int i = 0; i < MAX_HUFFMAN_TABLES; i++) {
+            decoder->dc_tables[i].is_set = false;
+            decoder->ac_tables[i].is_set = false;
+        }
     }
 
     /* Parse all markers and segments */
@@ -34,6 +41,50 @@ jpeg_decoder_t* jpeg_parser_init(const char *filename) {
     return decoder;
 }
 
+/* Initialize decoder and load file */
+jpeg_decoder_t* jpeg_parser_init(const char *filename) {
+    /* Load file into memory */
+    size_t data_size;
+    uint8_t *data = load_file(filename, &data_size);
+    if (!data) {
+        return NULL;
+    }
+
+    return parser_init_data(data, data_size, NULL);
+}
+
+/* Initialize decoder on a copy of an in-memory JPEG stream */
+jpeg_decoder_t* jpeg_parser_init_memory(const uint8_t *data, size_t data_size) {
+    if (data_size < 2) {
+        JPEG_ERROR_NULL("JPEG stream too short");
+    }
+
+    uint8_t *copy = (uint8_t*)jpeg_malloc(data_size);
+    memcpy(copy, data, data_size);
+    return parser_init_data(copy, data_size, NULL);
+}
+
+/* Parse one frame of a stream on top of the tables of the frames before it */
+jpeg_decoder_t* jpeg_parser_init_frame(uint8_t *data, size_t data_size, jpeg_tables_t *tables) {
+    jpeg_decoder_t *decoder = parser_init_data(data, data_size, tables);
+    if (decoder && tables) {
+        memcpy(tables->quant_tables, decoder->quant_tables, sizeof(tables->quant_tables));
+        memcpy(tables->dc_tables, decoder->dc_tables, sizeof(tables->dc_tables));
+        memcpy(tables->ac_tables, decoder->ac_tables, sizeof(tables->ac_tables));
+    }
+    return decoder;
+}
+
+/* Parse the JPEG embedded in the file's EXIF data, if there is one */
+jpeg_decoder_t* jpeg_parser_init_exif_thumbnail(const jpeg_decoder_t *decoder) {
+    if (decoder->exif_thumbnail_size == 0 || !decoder->data) {
+        return NULL;
+    }
+
+    return jpeg_parser_init_memory(decoder->data + decoder->exif_thumbnail_offset,
+                                   decoder->exif_thumbnail_size);
+}
+
 /* Find next marker in the stream */
 uint16_t find_next_marker(jpeg_decoder_t *decoder) {
     while (decoder->current_pos < decoder->data_size - 1) {
@@ -63,6 +114,105 @@ uint16_t find_next_marker(jpeg_decoder_t *decoder) {
     return 0;  /* No marker found */
 }
 
+/* Name of a marker segment in traces */
+static const char* segment_name(uint16_t marker) {
+    switch (marker) {
+        case MARKER_APP0: return "APP0";
+        case MARKER_APP1: return "APP1";
+        case MARKER_DQT:  return "DQT";
+        case MARKER_DHT:  return "DHT";
+        case MARKER_SOS:  return "SOS";
+        case MARKER_DRI:  return "DRI";
+        case MARKER_COM:  return "COM";
+        case MARKER_SOF0: case MARKER_SOF1: case MARKER_SOF2: case MARKER_SOF3:
+            return "SOF";
+        default:          return "segment";
+    }
+}
+
+/* Parse the segment of one marker: 0 to go on, 1 at the end of the
+ * headers (SOS or EOI), -1 on error */
+static int parse_segment(jpeg_decoder_t *decoder, uint16_t marker) {
+    switch (marker) {
+        case MARKER_SOI:
+            fprintf(stderr, "Unexpected SOI marker\n");
+            return -1;
+
+        case MARKER_EOI:
+            JPEG_LOG("Found EOI marker\n");
+            return 1;  /* End of image */
+
+        case MARKER_APP0:
+            JPEG_LOG("Parsing APP0 (JFIF) marker\n");
+            if (parse_app0(decoder) != 0) return -1;
+            break;
+
+        case MARKER_APP1:
+            JPEG_LOG("Parsing APP1 marker\n");
+            if (parse_app1(decoder) != 0) return -1;
+            break;
+
+        case MARKER_DQT:
+            JPEG_LOG("Parsing DQT (quantization table) marker\n");
+            if (parse_dqt(decoder) != 0) return -1;
+            break;
+
+        case MARKER_DHT:
+            JPEG_LOG("Parsing DHT (Huffman table) marker\n");
+            if (parse_dht(decoder) != 0) return -1;
+            break;
+
+        case MARKER_SOF0:
+            JPEG_LOG("Parsing SOF0 (baseline DCT) marker\n");
+            if (parse_sof0(decoder) != 0) return -1;
+            break;
+
+        case MARKER_SOF1:
+            JPEG_LOG("Parsing SOF1 (extended sequential DCT) marker\n");
+            if (parse_sof0(decoder) != 0) return -1;
+            break;
+
+        case MARKER_SOF2:
+            JPEG_LOG("Parsing SOF2 (progressive DCT) marker\n");
+            if (parse_sof0(decoder) != 0) return -1;
+            break;
+
+        case MARKER_SOF3:
+            JPEG_LOG("Parsing SOF3 (lossless) marker\n");
+            if (parse_sof0(decoder) != 0) return -1;
+            break;
+
+        case MARKER_SOS:
+            JPEG_LOG("Parsing SOS (start of scan) marker\n");
+            if (parse_sos(decoder) != 0) return -1;
+            /* SOS is followed by scan data, stop parsing markers */
+            return 1;
+
+        case MARKER_DRI:
+            JPEG_LOG("Parsing DRI (restart interval) marker\n");
+            if (parse_dri(decoder) != 0) return -1;
+            break;
+
+        case MARKER_COM:
+            JPEG_LOG("Skipping COM (comment) marker\n");
+            if (skip_marker_segment(decoder) != 0) return -1;
+            break;
+
+        default:
+            /* Skip unknown markers */
+            if (marker >= 0xFFE0 && marker <= 0xFFEF) {
+                JPEG_LOG("Skipping APP%d marker\n", marker & 0x0F);
+                if (skip_marker_segment(decoder) != 0) return -1;
+            } else {
+                JPEG_LOG("Skipping unknown marker: 0x%04X\n", marker);
+                if (skip_marker_segment(decoder) != 0) return -1;
+            }
+            break;
+    }
+
+    return 0;
+}
+
 /* Parse all JPEG markers */
 int parse_jpeg_markers(jpeg_decoder_t *decoder) {
     /* First marker must be SOI */
@@ -72,7 +222,7 @@ int parse_jpeg_markers(jpeg_decoder_t *decoder) {
         return -1;
     }
 
-    printf("Found SOI marker\n");
+    JPEG_LOG("Found SOI marker\n");
 
     /* Parse markers until EOI */
     while (decoder->current_pos < decoder->data_size) {
@@ -83,76 +233,11 @@ int parse_jpeg_markers(jpeg_decoder_t *decoder) {
             return -1;
         }
 
-        switch (marker) {
-            case MARKER_SOI:
-                fprintf(stderr, "Unexpected SOI marker\n");
-                return -1;
-
-            case MARKER_EOI:
-                printf("Found EOI marker\n");
-                return 0;  /* End of image */
-
-            case MARKER_APP0:
-                printf("Parsing APP0 (JFIF) marker\n");
-                if (parse_app0(decoder) != 0) return -1;
-                break;
-
-            case MARKER_DQT:
-                printf("Parsing DQT (quantization table) marker\n");
-                if (parse_dqt(decoder) != 0) return -1;
-                break;
-
-            case MARKER_DHT:
-                printf("Parsing DHT (Huffman table) marker\n");
-                if (parse_dht(decoder) != 0) return -1;
-                break;
-
-            case MARKER_SOF0:
-                printf("Parsing SOF0 (baseline DCT) marker\n");
-                if (parse_sof0(decoder) != 0) return -1;
-                break;
-
-            case MARKER_SOF1:
-                printf("Parsing SOF1 (extended sequential DCT) marker\n");
-                if (parse_sof0(decoder) != 0) return -1;
-                break;
-
-            case MARKER_SOF2:
-                printf("Parsing SOF2 (progressive DCT) marker\n");
-                if (parse_sof0(decoder) != 0) return -1;
-                break;
-
-            case MARKER_SOF3:
-                printf("Parsing SOF3 (lossless) marker\n");
-                if (parse_sof0(decoder) != 0) return -1;
-                break;
-
-            case MARKER_SOS:
-                printf("Parsing SOS (start of scan) marker\n");
-                if (parse_sos(decoder) != 0) return -1;
-                /* SOS is followed by scan data, stop parsing markers */
-                return 0;
-
-            case MARKER_DRI:
-                printf("Parsing DRI (restart interval) marker\n");
-                if (parse_dri(decoder) != 0) return -1;
-                break;
-
-            case MARKER_COM:
-                printf("Skipping COM (comment) marker\n");
-                if (skip_marker_segment(decoder) != 0) return -1;
-                break;
-
-            default:
-                /* Skip unknown markers */
-                if (marker >= 0xFFE0 && marker <= 0xFFEF) {
-                    printf("Skipping APP%d marker\n", marker & 0x0F);
-                    if (skip_marker_segment(decoder) != 0) return -1;
-                } else {
-                    printf("Skipping unknown marker: 0x%04X\n", marker);
-                    if (skip_marker_segment(decoder) != 0) return -1;
-                }
-                break;
+        trace_begin_arg(segment_name(marker), "offset", (long)decoder->current_pos);
+        int result = parse_segment(decoder, marker);
+        trace_end();
+        if (result != 0) {
+            return result < 0 ? -1 : 0;
         }
     }
 
@@ -179,6 +264,33 @@ int parse_app0(jpeg_decoder_t *decoder) {
     return 0;
 }
 
+/* Parse APP1 segment: record the EXIF thumbnail location, skip anything else */
+int parse_app1(jpeg_decoder_t *decoder) {
+    if (decoder->current_pos + 2 > decoder->data_size) {
+        JPEG_ERROR("Truncated APP1 segment");
+    }
+
+    uint16_t length = read_uint16_be(&decoder->data[decoder->current_pos]);
+    decoder->current_pos += 2;
+
+    if (length < 2 || decoder->current_pos + length - 2 > decoder->data_size) {
+        JPEG_ERROR("Truncated APP1 data");
+    }
+
+    /* Only the first EXIF segment counts (XMP also uses APP1) */
+    size_t offset, size;
+    if (decoder->exif_thumbnail_size == 0 &&
+        exif_find_thumbnail(&decoder->data[decoder->current_pos], length - 2,
+                            &offset, &size) == 0) {
+        decoder->exif_thumbnail_offset = decoder->current_pos + offset;
+        decoder->exif_thumbnail_size = size;
+        JPEG_LOG("  EXIF thumbnail: %zu bytes at offset %zu\n", size, decoder->exif_thumbnail_offset);
+    }
+
+    decoder->current_pos += length - 2;
+    return 0;
+}
+
 /* Parse DQT (Define Quantization Table) */
 int parse_dqt(jpeg_decoder_t *decoder) {
     if (decoder->current_pos + 2 > decoder->data_size) {
@@ -217,13 +329,22 @@ int parse_dqt(jpeg_decoder_t *decoder) {
         }
 
         /* De-zigzag: file is in zigzag order, we need natural order for IDCT */
-        extern const int jpeg_natural_order[64];
+        uint8_t natural[64];
         for (int i = 0; i < 64; i++) {
-            decoder->quant_tables[table_id].table[jpeg_natural_order[i]] = temp[i];
+            natural[jpeg_natural_order[i]] = temp[i];
+        }
+
+        /* A table repeated from the previous frame keeps its multipliers */
+        quantization_table_t *table = &decoder->quant_tables[table_id];
+        if (table->is_set && memcmp(table->table, natural, sizeof(natural)) == 0) {
+            JPEG_LOG("  Quantization table %d unchanged\n", table_id);
+            continue;
         }
+        memcpy(table->table, natural, sizeof(natural));
+        idct_prepare_quant_table(table);
 
-        decoder->quant_tables[table_id].is_set = true;
-        printf("  Loaded quantization table %d\n", table_id);
+        table->is_set = true;
+        JPEG_LOG("  Loaded quantization table %d\n", table_id);
     }
 
     return 0;
@@ -261,14 +382,16 @@ int parse_dht(jpeg_decoder_t *decoder) {
         }
 
         /* Read BITS array (16 values) */
-        table->bits[0] = 0;  /* Not used */
+        uint8_t bits[17];
+        uint8_t huffval[256];
+        bits[0] = 0;  /* Not used */
         int total_symbols = 0;
         for (int i = 1; i <= 16; i++) {
             if (decoder->current_pos >= decoder->data_size) {
                 JPEG_ERROR("Truncated Huffman BITS");
             }
-            table->bits[i] = decoder->data[decoder->current_pos++];
-            total_symbols += table->bits[i];
+            bits[i] = decoder->data[decoder->current_pos++];
+            total_symbols += bits[i];
         }
 
         if (total_symbols > 256) {
@@ -280,11 +403,29 @@ int parse_dht(jpeg_decoder_t *decoder) {
             if (decoder->current_pos >= decoder->data_size) {
                 JPEG_ERROR("Truncated Huffman HUFFVAL");
             }
-            table->huffval[i] = decoder->data[decoder->current_pos++];
+            huffval[i] = decoder->data[decoder->current_pos++];
+        }
+
+        /* Streams often repeat the same tables in every frame: keep the
+         * codes and lookup table built for an identical one */
+        if (table->is_set && table->codes_generated &&
+            memcmp(table->bits, bits, sizeof(bits)) == 0 &&
+            memcmp(table->huffval, huffval, total_symbols) == 0) {
+            decoder->stats.huffman_tables_reused++;
+            JPEG_LOG("  Huffman table (class=%d, id=%d) unchanged\n", table_class, table_id);
+            continue;
         }
 
+        memcpy(table->bits, bits, sizeof(bits));
+        memcpy(table->huffval, huffval, total_symbols);
         table->is_set = true;
-        printf("  Loaded Huffman table (class=%d, id=%d)\n", table_class, table_id);
+        if (load_standard_build(table)) {
+            decoder->stats.huffman_tables_reused++;
+        } else {
+            generate_huffman_codes(table);
+            decoder->stats.huffman_tables_built++;
+        }
+        JPEG_LOG("  Loaded Huffman table (class=%d, id=%d)\n", table_class, table_id);
     }
 
     return 0;
@@ -311,9 +452,9 @@ int parse_sof0(jpeg_decoder_t *decoder) {
     decoder->current_pos += 2;
     decoder->frame.num_components = decoder->data[decoder->current_pos++];
 
-    printf("  Image: %dx%d, %d components, %d-bit precision\n",
-           decoder->frame.width, decoder->frame.height,
-           decoder->frame.num_components, decoder->frame.precision);
+    JPEG_LOG("  Image: %dx%d, %d components, %d-bit precision\n",
+             decoder->frame.width, decoder->frame.height,
+             decoder->frame.num_components, decoder->frame.precision);
 
     if (decoder->frame.num_components > MAX_COMPONENTS) {
         JPEG_ERROR("Too many components");
@@ -335,10 +476,10 @@ int parse_sof0(jpeg_decoder_t *decoder) {
         decoder->frame.components[i].v_sampling = sampling & 0x0F;
         decoder->frame.components[i].quant_table_id = decoder->data[decoder->current_pos++];
 
-        printf("  Component %d: H=%d, V=%d, Q=%d\n",
-               i, decoder->frame.components[i].h_sampling,
-               decoder->frame.components[i].v_sampling,
-               decoder->frame.components[i].quant_table_id);
+        JPEG_LOG("  Component %d: H=%d, V=%d, Q=%d\n",
+                 i, decoder->frame.components[i].h_sampling,
+                 decoder->frame.components[i].v_sampling,
+                 decoder->frame.components[i].quant_table_id);
     }
 
     /* Calculate MCU dimensions */
@@ -358,10 +499,38 @@ int parse_sof0(jpeg_decoder_t *decoder) {
     decoder->mcu_width = (decoder->frame.width + decoder->mcu_size_x - 1) / decoder->mcu_size_x;
     decoder->mcu_height = (decoder->frame.height + decoder->mcu_size_y - 1) / decoder->mcu_size_y;
 
-    printf("  MCU: %dx%d pixels, %dx%d MCUs in image\n",
-           decoder->mcu_size_x, decoder->mcu_size_y,
-           decoder->mcu_width, decoder->mcu_height);
+    JPEG_LOG("  MCU: %dx%d pixels, %dx%d MCUs in image\n",
+             decoder->mcu_size_x, decoder->mcu_size_y,
+             decoder->mcu_width, decoder->mcu_height);
+
+    return 0;
+}
+
+/* Motion-JPEG frames (AVI1) usually leave out DHT and rely on the typical
+ * tables of Annex K.3: load those for selected tables nothing defined */
+static int load_default_huffman_tables(jpeg_decoder_t *decoder, const component_info_t *comp) {
+    if (comp->dc_table_id >= MAX_HUFFMAN_TABLES || comp->ac_table_id >= MAX_HUFFMAN_TABLES) {
+        JPEG_ERROR("Invalid Huffman table selector");
+    }
 
+    huffman_table_t *dc = &decoder->dc_tables[comp->dc_table_id];
+    huffman_table_t *ac = &decoder->ac_tables[comp->ac_table_id];
+    if (!dc->is_set) {
+        if (comp->dc_table_id > 1) {
+            JPEG_ERROR("Scan uses an undefined DC Huffman table");
+        }
+        load_standard_huffman_table(dc, 0, comp->dc_table_id);
+        decoder->stats.huffman_tables_reused++;
+        JPEG_LOG("  Using the standard DC Huffman table %d\n", comp->dc_table_id);
+    }
+    if (!ac->is_set) {
+        if (comp->ac_table_id > 1) {
+            JPEG_ERROR("Scan uses an undefined AC Huffman table");
+        }
+        load_standard_huffman_table(ac, 1, comp->ac_table_id);
+        decoder->stats.huffman_tables_reused++;
+        JPEG_LOG("  Using the standard AC Huffman table %d\n", comp->ac_table_id);
+    }
     return 0;
 }
 
@@ -380,7 +549,7 @@ int parse_sos(jpeg_decoder_t *decoder) {
     }
 
     uint8_t num_components = decoder->data[decoder->current_pos++];
-    printf("  Scan has %d components\n", num_components);
+    JPEG_LOG("  Scan has %d components\n", num_components);
 
     /* Read component selectors and table selectors */
     for (int i = 0; i < num_components; i++) {
@@ -396,9 +565,12 @@ int parse_sos(jpeg_decoder_t *decoder) {
             if (decoder->frame.components[j].id == component_id) {
                 decoder->frame.components[j].dc_table_id = (table_selector >> 4) & 0x0F;
                 decoder->frame.components[j].ac_table_id = table_selector & 0x0F;
-                printf("  Component %d: DC table %d, AC table %d\n",
-                       j, decoder->frame.components[j].dc_table_id,
-                       decoder->frame.components[j].ac_table_id);
+                if (load_default_huffman_tables(decoder, &decoder->frame.components[j]) != 0) {
+                    return -1;
+                }
+                JPEG_LOG("  Component %d: DC table %d, AC table %d\n",
+                         j, decoder->frame.components[j].dc_table_id,
+                         decoder->frame.components[j].ac_table_id);
                 break;
             }
         }
@@ -411,7 +583,7 @@ int parse_sos(jpeg_decoder_t *decoder) {
     decoder->scan_data = &decoder->data[decoder->current_pos];
     decoder->scan_data_size = decoder->data_size - decoder->current_pos;
 
-    printf("  Scan data starts at offset %zu\n", decoder->current_pos);
+    JPEG_LOG("  Scan data starts at offset %zu\n", decoder->current_pos);
 
     return 0;
 }
@@ -433,7 +605,7 @@ int parse_dri(jpeg_decoder_t *decoder) {
     decoder->restart_interval = read_uint16_be(&decoder->data[decoder->current_pos]);
     decoder->current_pos += 2;
 
-    printf("  Restart interval: %d MCUs\n", decoder->restart_interval);
+    JPEG_LOG("  Restart interval: %d MCUs\n", decoder->restart_interval);
 
     return 0;
 }
@@ -6,12 +6,34 @@
 /* Initialize decoder and parse JPEG file */
 jpeg_decoder_t* jpeg_parser_init(const char *filename);
 
+/* Initialize decoder on an in-memory JPEG stream (the data is copied) */
+jpeg_decoder_t* jpeg_parser_init_memory(const uint8_t *data, size_t data_size);
+
+/* Tables carried from one frame of a Motion-JPEG stream to the next */
+typedef struct {
+    quantization_table_t quant_tables[MAX_QUANT_TABLES];
+    huffman_table_t dc_tables[MAX_HUFFMAN_TABLES];
+    huffman_table_t ac_tables[MAX_HUFFMAN_TABLES];
+} jpeg_tables_t;
+
+/* Parse one frame of a stream, taking ownership of data (allocated with
+ * jpeg_malloc; freed on failure too). The decoder starts out with tables
+ * (NULL = none), so frames may leave out DQT and DHT; afterwards tables
+ * holds the ones the frame defined or kept. Identical tables are not
+ * rebuilt. */
+jpeg_decoder_t* jpeg_parser_init_frame(uint8_t *data, size_t data_size, jpeg_tables_t *tables);
+
+/* Parse the thumbnail embedded in a parsed file's EXIF data. Returns NULL if
+ * the file has none or it cannot be parsed. */
+jpeg_decoder_t* jpeg_parser_init_exif_thumbnail(const jpeg_decoder_t *decoder);
+
 /* Parse JPEG markers and segments */
 int parse_jpeg_markers(jpeg_decoder_t *decoder);
 
 /* Individual marker parsers */
 int parse_soi(jpeg_decoder_t *decoder);
 int parse_app0(jpeg_decoder_t *decoder);
+int parse_app1(jpeg_decoder_t *decoder);
 int parse_dqt(jpeg_decoder_t *decoder);
 int parse_dht(jpeg_decoder_t *decoder);
 int parse_sof0(jpeg_decoder_t *decoder);
@@ -0,0 +1,404 @@
+#include "jpeg_writer.h"
+#include "huffman.h"
+#include "trace.h"
+#include "utils.h"
+#include <limits.h>
+
+/* Grow the output buffer to hold at least extra more bytes */
+static void ensure_capacity(jpeg_writer_t *writer, size_t extra) {
+    if (writer->size + extra <= writer->capacity) {
+        return;
+    }
+
+    size_t capacity = writer->capacity ? writer->capacity : 4096;
+    while (capacity < writer->size + extra) {
+        capacity *= 2;
+    }
+
+    uint8_t *grown = (uint8_t*)jpeg_malloc(capacity);
+    if (writer->data) {
+        memcpy(grown, writer->data, writer->size);
+        jpeg_free(writer->data);
+    }
+    writer->data = grown;
+    writer->capacity = capacity;
+}
+
+static void emit_byte(jpeg_writer_t *writer, uint8_t byte) {
+    ensure_capacity(writer, 1);
+    writer->data[writer->size++] = byte;
+}
+
+static void emit_uint16(jpeg_writer_t *writer, uint16_t value) {
+    emit_byte(writer, (uint8_t)(value >> 8));
+    emit_byte(writer, (uint8_t)(value & 0xFF));
+}
+
+static void emit_marker(jpeg_writer_t *writer, uint16_t marker) {
+    emit_uint16(writer, marker);
+}
+
+/* Append up to 16 bits, stuffing a zero byte after every 0xFF */
+static void emit_bits(jpeg_writer_t *writer, uint32_t code, int length) {
+    writer->bit_buffer = (writer->bit_buffer << length) | (code & ((1u << length) - 1));
+    writer->bit_count += length;
+
+    while (writer->bit_count >= 8) {
+        uint8_t byte = (uint8_t)(writer->bit_buffer >> (writer->bit_count - 8));
+        ensure_capacity(writer, 2);
+        writer->data[writer->size++] = byte;
+        if (byte == 0xFF) {
+            writer->data[writer->size++] = 0x00;
+        }
+        writer->bit_count -= 8;
+    }
+}
+
+/* Number of bits needed for the magnitude of a coefficient (category) */
+static int magnitude_bits(int value) {
+    if (value < 0) value = -value;
+    int bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+void jpeg_writer_init(jpeg_writer_t *writer, size_t initial_capacity) {
+    memset(writer, 0, sizeof(jpeg_writer_t));
+    if (initial_capacity > 0) {
+        ensure_capacity(writer, initial_capacity);
+    }
+}
+
+void jpeg_writer_free(jpeg_writer_t *writer) {
+    if (writer->data) {
+        jpeg_free(writer->data);
+    }
+    memset(writer, 0, sizeof(jpeg_writer_t));
+}
+
+static void write_app0(jpeg_writer_t *writer) {
+    static const uint8_t jfif[14] = {
+        'J', 'F', 'I', 'F', 0,  /* Identifier */
+        1, 1,                   /* Version 1.01 */
+        0,                      /* No density units */
+        0, 1, 0, 1,             /* 1:1 pixel aspect */
+        0, 0                    /* No thumbnail */
+    };
+
+    emit_marker(writer, MARKER_APP0);
+    emit_uint16(writer, 2 + sizeof(jfif));
+    for (size_t i = 0; i < sizeof(jfif); i++) {
+        emit_byte(writer, jfif[i]);
+    }
+}
+
+static void write_dqt(jpeg_writer_t *writer, int table_id, const quantization_table_t *table) {
+    emit_marker(writer, MARKER_DQT);
+    emit_uint16(writer, 2 + 1 + BLOCK_SIZE);
+    emit_byte(writer, (uint8_t)table_id);  /* 8-bit precision */
+
+    /* Tables are kept in natural order; the file stores zigzag order */
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        emit_byte(writer, table->table[jpeg_natural_order[i]]);
+    }
+}
+
+static void write_sof0(jpeg_writer_t *writer, const frame_header_t *frame) {
+    emit_marker(writer, MARKER_SOF0);
+    emit_uint16(writer, 8 + 3 * frame->num_components);
+    emit_byte(writer, 8);
+    emit_uint16(writer, frame->height);
+    emit_uint16(writer, frame->width);
+    emit_byte(writer, frame->num_components);
+
+    for (int i = 0; i < frame->num_components; i++) {
+        const component_info_t *comp = &frame->components[i];
+        emit_byte(writer, comp->id);
+        emit_byte(writer, (uint8_t)((comp->h_sampling << 4) | comp->v_sampling));
+        emit_byte(writer, comp->quant_table_id);
+    }
+}
+
+static void write_dht(jpeg_writer_t *writer, int table_class, int table_id,
+                      const huffman_table_t *table) {
+    int total_symbols = 0;
+    for (int i = 1; i <= 16; i++) {
+        total_symbols += table->bits[i];
+    }
+
+    emit_marker(writer, MARKER_DHT);
+    emit_uint16(writer, 2 + 1 + 16 + total_symbols);
+    emit_byte(writer, (uint8_t)((table_class << 4) | table_id));
+    for (int i = 1; i <= 16; i++) {
+        emit_byte(writer, table->bits[i]);
+    }
+    for (int i = 0; i < total_symbols; i++) {
+        emit_byte(writer, table->huffval[i]);
+    }
+}
+
+static void write_sos(jpeg_writer_t *writer, const frame_header_t *frame) {
+    emit_marker(writer, MARKER_SOS);
+    emit_uint16(writer, 6 + 2 * frame->num_components);
+    emit_byte(writer, frame->num_components);
+
+    for (int i = 0; i < frame->num_components; i++) {
+        const component_info_t *comp = &frame->components[i];
+        emit_byte(writer, comp->id);
+        emit_byte(writer, (uint8_t)((comp->dc_table_id << 4) | comp->ac_table_id));
+    }
+
+    emit_byte(writer, 0);   /* Spectral selection start */
+    emit_byte(writer, 63);  /* Spectral selection end */
+    emit_byte(writer, 0);   /* Successive approximation */
+}
+
+/* Write all headers up to and including SOS */
+void jpeg_write_headers(jpeg_writer_t *writer, const frame_header_t *frame,
+                        const quantization_table_t *quant_tables,
+                        const huffman_table_t *dc_tables,
+                        const huffman_table_t *ac_tables) {
+    bool quant_used[MAX_QUANT_TABLES] = { false };
+    bool dc_used[MAX_HUFFMAN_TABLES] = { false };
+    bool ac_used[MAX_HUFFMAN_TABLES] = { false };
+
+    for (int i = 0; i < frame->num_components; i++) {
+        quant_used[frame->components[i].quant_table_id] = true;
+        dc_used[frame->components[i].dc_table_id] = true;
+        ac_used[frame->components[i].ac_table_id] = true;
+    }
+
+    emit_marker(writer, MARKER_SOI);
+    write_app0(writer);
+
+    for (int i = 0; i < MAX_QUANT_TABLES; i++) {
+        if (quant_used[i]) {
+            write_dqt(writer, i, &quant_tables[i]);
+        }
+    }
+
+    write_sof0(writer, frame);
+
+    for (int i = 0; i < MAX_HUFFMAN_TABLES; i++) {
+        if (dc_used[i]) {
+            write_dht(writer, 0, i, &dc_tables[i]);
+        }
+        if (ac_used[i]) {
+            write_dht(writer, 1, i, &ac_tables[i]);
+        }
+    }
+
+    write_sos(writer, frame);
+    writer->bit_buffer = 0;
+    writer->bit_count = 0;
+}
+
+/* Entropy-code one 8x8 block (F.1.2.1 and F.1.2.2) */
+void jpeg_encode_block(jpeg_writer_t *writer, const int16_t *block, int16_t *dc_predictor,
+                       const huffman_table_t *dc_table, const huffman_table_t *ac_table) {
+    /* DC difference */
+    int diff = block[0] - *dc_predictor;
+    *dc_predictor = block[0];
+
+    int nbits = magnitude_bits(diff);
+    emit_bits(writer, dc_table->codes[nbits], dc_table->code_lengths[nbits]);
+    if (nbits) {
+        /* Negative values are sent as diff - 1 in nbits bits */
+        emit_bits(writer, (uint32_t)(diff < 0 ? diff - 1 : diff), nbits);
+    }
+
+    /* AC coefficients in zigzag order */
+    int run = 0;
+    for (int k = 1; k < BLOCK_SIZE; k++) {
+        int value = block[jpeg_natural_order[k]];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+
+        while (run > 15) {
+            emit_bits(writer, ac_table->codes[0xF0], ac_table->code_lengths[0xF0]);  /* ZRL */
+            run -= 16;
+        }
+
+        nbits = magnitude_bits(value);
+        int symbol = (run << 4) | nbits;
+        emit_bits(writer, ac_table->codes[symbol], ac_table->code_lengths[symbol]);
+        emit_bits(writer, (uint32_t)(value < 0 ? value - 1 : value), nbits);
+        run = 0;
+    }
+
+    if (run > 0) {
+        emit_bits(writer, ac_table->codes[0x00], ac_table->code_lengths[0x00]);  /* EOB */
+    }
+}
+
+/* Gather symbol statistics for one block, mirroring jpeg_encode_block */
+void jpeg_count_block(const int16_t *block, int16_t *dc_predictor,
+                      uint32_t *dc_freq, uint32_t *ac_freq) {
+    int diff = block[0] - *dc_predictor;
+    *dc_predictor = block[0];
+    dc_freq[magnitude_bits(diff)]++;
+
+    int run = 0;
+    for (int k = 1; k < BLOCK_SIZE; k++) {
+        int value = block[jpeg_natural_order[k]];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+
+        while (run > 15) {
+            ac_freq[0xF0]++;
+            run -= 16;
+        }
+        ac_freq[(run << 4) | magnitude_bits(value)]++;
+        run = 0;
+    }
+
+    if (run > 0) {
+        ac_freq[0x00]++;
+    }
+}
+
+/* Optimal Huffman table generation per Annex K.2, limited to 16-bit codes */
+void jpeg_build_optimal_table(const uint32_t *freq_in, huffman_table_t *table) {
+    long freq[257];
+    int codesize[257];
+    int others[257];
+    int bits[33];
+
+    for (int i = 0; i < 256; i++) {
+        freq[i] = freq_in[i];
+    }
+    /* Reserve one code point so no real code is all ones */
+    freq[256] = 1;
+
+    for (int i = 0; i < 257; i++) {
+        codesize[i] = 0;
+        others[i] = -1;
+    }
+    memset(bits, 0, sizeof(bits));
+
+    /* Huffman's procedure: repeatedly merge the two least frequent trees */
+    for (;;) {
+        int c1 = -1;
+        int c2 = -1;
+        long v = LONG_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (freq[i] && freq[i] <= v) {
+                v = freq[i];
+                c1 = i;
+            }
+        }
+
+        v = LONG_MAX;
+        for (int i = 0; i <= 256; i++) {
+            if (freq[i] && freq[i] <= v && i != c1) {
+                v = freq[i];
+                c2 = i;
+            }
+        }
+
+        if (c2 < 0) {
+            break;
+        }
+
+        freq[c1] += freq[c2];
+        freq[c2] = 0;
+
+        codesize[c1]++;
+        while (others[c1] >= 0) {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = c2;
+
+        codesize[c2]++;
+        while (others[c2] >= 0) {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
+    }
+
+    for (int i = 0; i <= 256; i++) {
+        if (codesize[i]) {
+            bits[codesize[i]]++;
+        }
+    }
+
+    /* Adjust code lengths so none exceeds 16 bits (K.3) */
+    for (int i = 32; i > 16; i--) {
+        while (bits[i] > 0) {
+            int j = i - 2;
+            while (bits[j] == 0) {
+                j--;
+            }
+            bits[i] -= 2;
+            bits[i - 1]++;
+            bits[j + 1] += 2;
+            bits[j]--;
+        }
+    }
+
+    /* Remove the reserved code point from the longest length */
+    int longest = 16;
+    while (bits[longest] == 0) {
+        longest--;
+    }
+    bits[longest]--;
+
+    memset(table->bits, 0, sizeof(table->bits));
+    for (int i = 1; i <= 16; i++) {
+        table->bits[i] = (uint8_t)bits[i];
+    }
+
+    /* Symbols sorted by code length */
+    int p = 0;
+    for (int len = 1; len <= 32; len++) {
+        for (int sym = 0; sym < 256; sym++) {
+            if (codesize[sym] == len) {
+                table->huffval[p++] = (uint8_t)sym;
+            }
+        }
+    }
+
+    table->is_set = true;
+    generate_huffman_codes(table);
+}
+
+/* Finish the scan and the image */
+void jpeg_write_trailer(jpeg_writer_t *writer) {
+    if (writer->bit_count > 0) {
+        emit_bits(writer, 0x7F, 8 - writer->bit_count);
+    }
+    writer->bit_buffer = 0;
+    writer->bit_count = 0;
+    emit_marker(writer, MARKER_EOI);
+}
+
+int jpeg_writer_save(const jpeg_writer_t *writer, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open output file: %s\n", filename);
+        return -1;
+    }
+
+    trace_begin_arg("write file", "bytes", (long)writer->size);
+    size_t written = fwrite(writer->data, 1, writer->size, file);
+    trace_end();
+    if (written != writer->size) {
+        fprintf(stderr, "Failed to write output file: %s\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to write output file: %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include "../include/jpeg_types.h"
+
+/* In-memory baseline JPEG bitstream writer */
+typedef struct {
+    uint8_t *data;              /* Output bytes */
+    size_t size;                /* Bytes written */
+    size_t capacity;            /* Allocated size of data */
+    uint32_t bit_buffer;        /* Pending entropy-coded bits (MSB first) */
+    int bit_count;              /* Number of valid bits in bit_buffer */
+} jpeg_writer_t;
+
+/* Symbol statistics gathered in a counting pass (for optimized tables) */
+typedef struct {
+    uint32_t dc[256];
+    uint32_t ac[256];
+} huffman_freq_t;
+
+void jpeg_writer_init(jpeg_writer_t *writer, size_t initial_capacity);
+void jpeg_writer_free(jpeg_writer_t *writer);
+
+/* Write SOI, JFIF APP0, DQT, SOF0, DHT and SOS for a baseline frame. Quant
+ * tables are in natural order; components reference them through their
+ * quant/dc/ac table ids. */
+void jpeg_write_headers(jpeg_writer_t *writer, const frame_header_t *frame,
+                        const quantization_table_t *quant_tables,
+                        const huffman_table_t *dc_tables,
+                        const huffman_table_t *ac_tables);
+
+/* Entropy-code one block of quantized coefficients (natural order) */
+void jpeg_encode_block(jpeg_writer_t *writer, const int16_t *block, int16_t *dc_predictor,
+                       const huffman_table_t *dc_table, const huffman_table_t *ac_table);
+
+/* Count the symbols jpeg_encode_block would emit for one block */
+void jpeg_count_block(const int16_t *block, int16_t *dc_predictor,
+                      uint32_t *dc_freq, uint32_t *ac_freq);
+
+/* Build an optimal length-limited Huffman table from symbol counts (Annex K.2) */
+void jpeg_build_optimal_table(const uint32_t *freq, huffman_table_t *table);
+
+/* Pad the entropy-coded segment with 1 bits and write EOI */
+void jpeg_write_trailer(jpeg_writer_t *writer);
+
+/* Write the finished stream to a file */
+int jpeg_writer_save(const jpeg_writer_t *writer, const char *filename);
+
+#endif /* JPEG_WRITER_H */
@@ -0,0 +1,81 @@
+#include "libjpeg_ref.h"
+#include "utils.h"
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} libjpeg_error_t;
+
+/* Return to libjpeg_decode instead of exiting */
+static void libjpeg_error_exit(j_common_ptr cinfo) {
+    longjmp(((libjpeg_error_t*)cinfo->err)->jump, 1);
+}
+
+static void libjpeg_silent(j_common_ptr cinfo) {
+    (void)cinfo;
+}
+
+bool libjpeg_available(void) {
+    return true;
+}
+
+int libjpeg_decode(const uint8_t *data, size_t size, uint8_t **pixels,
+                   int *width, int *height, int *channels) {
+    struct jpeg_decompress_struct cinfo;
+    libjpeg_error_t error;
+    *pixels = NULL;
+
+    cinfo.err = jpeg_std_error(&error.pub);
+    error.pub.error_exit = libjpeg_error_exit;
+    error.pub.output_message = libjpeg_silent;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        jpeg_free(*pixels);
+        *pixels = NULL;
+        return -1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)data, (unsigned long)size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    *pixels = (uint8_t*)jpeg_malloc(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = *pixels + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+
+    *width = (int)cinfo.output_width;
+    *height = (int)cinfo.output_height;
+    *channels = cinfo.output_components;
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
+#else
+
+bool libjpeg_available(void) {
+    return false;
+}
+
+int libjpeg_decode(const uint8_t *data, size_t size, uint8_t **pixels,
+                   int *width, int *height, int *channels) {
+    (void)data;
+    (void)size;
+    (void)width;
+    (void)height;
+    (void)channels;
+    *pixels = NULL;
+    return -1;
+}
+
+#endif /* HAVE_LIBJPEG */
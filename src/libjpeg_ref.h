@@ -0,0 +1,19 @@
+#ifndef LIBJPEG_REF_H
+#define LIBJPEG_REF_H
+
+#include "../include/jpeg_types.h"
+
+/* The system libjpeg as a reference decoder (built with HAVE_LIBJPEG). Kept
+ * in its own file: jpeglib.h declares names this decoder also uses. */
+
+/* Whether this build links the system libjpeg */
+bool libjpeg_available(void);
+
+/* Decode with the accurate integer IDCT and fancy upsampling into RGB (or
+ * grayscale for one component), like djpeg -dct int. *pixels is allocated
+ * with jpeg_malloc. Returns -1 if libjpeg is unavailable or rejects the
+ * data. */
+int libjpeg_decode(const uint8_t *data, size_t size, uint8_t **pixels,
+                   int *width, int *height, int *channels);
+
+#endif /* LIBJPEG_REF_H */
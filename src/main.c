@@ -7,7 +7,47 @@
 #include "color.h"
 #include "display.h"
 #include "output.h"
+#include "browser.h"
+#include "transform.h"
+#include "encoder.h"
+#include "thumbnail.h"
+#include "probe.h"
+#include "preview.h"
+#include "dct.h"
+#include "metrics.h"
+#include "mjpeg.h"
+#include "verify.h"
+#include "coef_store.h"
+#include "perf.h"
+#include "trace.h"
 #include "utils.h"
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Defaults for multi-image browsing */
+#define DEFAULT_CACHE_MB 512
+#define DEFAULT_PREFETCH_THREADS 2
+#define DEFAULT_PREFETCH_RADIUS 2
+
+/* Default PNG compression (0 = stored, 1 = fast) */
+#define DEFAULT_PNG_LEVEL 1
+
+/* Default JPEG encoder quality */
+#define DEFAULT_QUALITY 85
+
+/* Most sizes --scales renders from one entropy decode (1/1, 1/2, 1/4, 1/8) */
+#define MAX_SCALES 4
+
+/* --verify: images checked without inputs, and their reference hashes */
+#define DEFAULT_VERIFY_DIR "test"
+#define DEFAULT_HASH_FILE "test/reference_hashes.txt"
+
+/* Case-insensitive check for a .jpg/.jpeg output name */
+static int is_jpeg_filename(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    return dot && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
 
 /* Get current time in microseconds */
 static double get_time_us(void) {
@@ -18,14 +58,369 @@ static double get_time_us(void) {
 
 void print_usage(const char *program_name) {
     printf("JPEG Viewer - Custom JPEG Decoder\n");
-    printf("Usage: %s <jpeg_file> [--save-ppm output.ppm]\n", program_name);
+    printf("Usage: %s <jpeg_file> [--save-ppm output.ppm] [output options]\n", program_name);
+    printf("       %s <jpeg_file|directory>... [browse options]\n", program_name);
+    printf("\n");
+    printf("Output options (single file):\n");
+    printf("  --output FILE         Stream rows to FILE while decoding (.ppm .pgm .yuv .png)\n");
+    printf("  --png-level N         PNG compression: 0 = stored, 1 = fast (default %d)\n",
+           DEFAULT_PNG_LEVEL);
+    printf("  --no-display          Do not open a window (batch conversion)\n");
+    printf("  --no-preview          Do not show the EXIF thumbnail while decoding\n");
+    printf("  --fast-upsample       Replicate chroma samples instead of triangle filtering\n");
+    printf("  --idct-upsample       Upsample 4:2:2/4:2:0 chroma inside 16x8/16x16 scaled IDCTs\n");
+    printf("  --gray                Decode only the luma of color images (grayscale output)\n");
+    printf("  --idct METHOD         8x8 IDCT: islow (accurate, default), ifast or float\n");
+    printf("  --threads N           Decode and convert on N threads (default 1, 0 = one per CPU)\n");
+    printf("  --perf                Hardware counters (IPC, cache and branch misses) per stage\n");
+    printf("  --trace FILE          Write a Chrome trace (chrome://tracing, Perfetto) of all threads\n");
+    printf("  --stats-json FILE     Write decode metrics as JSON (- = stdout, implies --quiet)\n");
+    printf("  --quiet               No progress or timing output from the decode\n");
+    printf("\n");
+    printf("JPEG encoding (--output FILE.jpg re-encodes the decoded image):\n");
+    printf("  --thumbnail N         Shrink so neither side exceeds N pixels and encode\n");
+    printf("  --quality N           Encoder quality 1-100 (default %d)\n", DEFAULT_QUALITY);
+    printf("  --subsampling S       Chroma sampling: 444, 422 or 420 (default 420)\n");
+    printf("  --optimize-huffman    Two-pass encode with optimal Huffman tables\n");
+    printf("\n");
+    printf("Lossless transform (writes a JPEG given by --output, no decode):\n");
+    printf("  --transform OP        rot90, rot180, rot270, flip-h, flip-v, transpose, transverse\n");
+    printf("  --crop WxH+X+Y        MCU-aligned crop of the (transformed) image\n");
+    printf("\n");
+    printf("Scaled output (no window, entropy-decoded once for all sizes):\n");
+    printf("  --scales LIST         Render at 1/N for each N in LIST (1, 2, 4, 8, e.g. 1,2,8)\n");
+    printf("                        from stored coefficients; --output img_%%d.png writes each\n");
+    printf("\n");
+    printf("Motion-JPEG (concatenated frames from a file or - for standard input):\n");
+    printf("  --mjpeg               Decode every frame and report the sustained frame rate\n");
+    printf("                        (no window; --output frame%%05d.png writes each frame)\n");
+    printf("  --skip-unchanged      Re-decode only restart intervals whose bytes changed\n");
+    printf("\n");
+    printf("Decoder regression check (default: the %s directory):\n", DEFAULT_VERIFY_DIR);
+    printf("  --verify              Decode through every IDCT/upsampling/threading variant and\n");
+    printf("                        compare with the reference decode and stored hashes\n");
+    printf("  --update-hashes       With --verify: rewrite %s\n", DEFAULT_HASH_FILE);
+    printf("\n");
+    printf("Header probe (no decode, several files or directories allowed):\n");
+    printf("  --identify            Print dimensions, sampling, restart interval, orientation\n");
+    printf("\n");
+    printf("Browse options (several files or a directory):\n");
+    printf("  --cache-mb N          Decoded image cache budget (default %d)\n", DEFAULT_CACHE_MB);
+    printf("  --prefetch N          Neighbors to decode ahead (default %d, 0 = off)\n",
+           DEFAULT_PREFETCH_RADIUS);
+    printf("  --prefetch-threads N  Background decode threads (default %d)\n",
+           DEFAULT_PREFETCH_THREADS);
     printf("\n");
     printf("Example:\n");
     printf("  %s image.jpg\n", program_name);
     printf("  %s image.jpg --save-ppm output.ppm\n", program_name);
+    printf("  %s image.jpg --output image.png --no-display\n", program_name);
+    printf("  %s image.jpg --transform rot90 --output rotated.jpg\n", program_name);
+    printf("  %s image.jpg --thumbnail 256 --output thumb.jpg\n", program_name);
+    printf("  %s image.jpg --scales 2,4,8 --output image_%%d.png\n", program_name);
+    printf("  %s photos/ --identify\n", program_name);
+    printf("  %s --verify\n", program_name);
+    printf("  camera-capture | %s - --mjpeg\n", program_name);
+    printf("  %s photos/ --cache-mb 1024\n", program_name);
     printf("\n");
     printf("Controls:\n");
     printf("  ESC - Close window and exit\n");
+    printf("  Left/Right, Page Up/Down, Home/End - Previous/next/first/last image\n");
+}
+
+/* Browse several images (or a directory) with prefetch and caching */
+static int run_browser(char **inputs, int num_inputs, const browse_options_t *options) {
+    char **paths = NULL;
+    int count = collect_image_paths(inputs, num_inputs, &paths);
+    if (count == 0) {
+        fprintf(stderr, "No JPEG files found\n");
+        jpeg_free(paths);
+        return 1;
+    }
+
+    int result = browse_images(paths, count, options);
+    free_image_paths(paths, count);
+    return result == 0 ? 0 : 1;
+}
+
+/* Output of each frame of a Motion-JPEG stream */
+typedef struct {
+    const char *pattern;        /* printf pattern with one %d (NULL = no output) */
+    output_format_t format;
+    int png_level;
+    int failures;
+} mjpeg_output_t;
+
+/* A frame file pattern has exactly one %d conversion (a zero-padded width
+ * is allowed) and no other '%' than "%%" */
+static int valid_frame_pattern(const char *pattern) {
+    int conversions = 0;
+    for (const char *p = pattern; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (*p != 'd') {
+            return 0;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/* Write one decoded frame to the file named by the pattern */
+static int write_mjpeg_frame(jpeg_decoder_t *frame, unsigned long index, void *user_data) {
+    mjpeg_output_t *output = (mjpeg_output_t*)user_data;
+    if (!output->pattern) {
+        return 0;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), output->pattern, (int)index);
+    image_writer_t *writer = image_writer_open(path, output->format, frame->width,
+                                               frame->height, frame->channels,
+                                               output->png_level);
+    if (!writer ||
+        image_writer_write_rows(writer, frame->image_data,
+                                (size_t)frame->width * frame->channels, frame->height) != 0 ||
+        image_writer_close(writer) != 0) {
+        output->failures++;
+        return 1;
+    }
+    return 0;
+}
+
+/* Decode a Motion-JPEG file or pipe frame by frame and report the rate */
+static int run_mjpeg(const char *path, const char *output_pattern, int png_level,
+                     const mjpeg_options_t *options) {
+    mjpeg_output_t output;
+    memset(&output, 0, sizeof(output));
+    output.pattern = output_pattern;
+    output.png_level = png_level;
+    if (output_pattern) {
+        if (!valid_frame_pattern(output_pattern)) {
+            fprintf(stderr, "--mjpeg --output needs a pattern with one %%d, e.g. frame%%05d.png\n");
+            return 1;
+        }
+        if (output_format_from_filename(output_pattern, &output.format) != 0 ||
+            output.format == OUTPUT_YUV) {
+            fprintf(stderr, "Unsupported frame output format: %s\n", output_pattern);
+            return 1;
+        }
+    }
+
+    /* Per-frame progress output would dominate at video rates */
+    jpeg_verbose = false;
+
+    mjpeg_stats_t stats;
+    if (mjpeg_decode_stream(path, options, write_mjpeg_frame, &output, &stats) != 0) {
+        return 1;
+    }
+
+    double seconds = stats.elapsed_ms / 1000.0;
+    printf("MJPEG: %lu frames (%lu skipped), %.1f MB in %.2f s: %.1f fps, %.1f MB/s\n",
+           stats.frames, stats.skipped, stats.bytes / 1e6, seconds,
+           seconds > 0.0 ? stats.frames / seconds : 0.0,
+           seconds > 0.0 ? stats.bytes / 1e6 / seconds : 0.0);
+    if (stats.frames > 0) {
+        printf("  Per frame: parse %.2f ms, decode %.2f ms, color %.2f ms (stages overlap)\n",
+               stats.parse_ms / stats.frames, stats.decode_ms / stats.frames,
+               stats.color_ms / stats.frames);
+    }
+    if (options->skip_unchanged && stats.segments_total > 0) {
+        printf("  Restart intervals re-decoded: %lu of %lu (%.1f%%)\n",
+               stats.segments_decoded, stats.segments_total,
+               100.0 * stats.segments_decoded / stats.segments_total);
+    }
+    return output.failures == 0 ? 0 : 1;
+}
+
+/* Parse a comma-separated list of scale denominators (1, 2, 4, 8) */
+static int parse_scales(const char *text, int *scales, int *count) {
+    *count = 0;
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long scale = strtol(p, &end, 10);
+        if (end == p || (scale != 1 && scale != 2 && scale != 4 && scale != 8) ||
+            *count == MAX_SCALES || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        scales[(*count)++] = (int)scale;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return *count > 0 ? 0 : -1;
+}
+
+/* Entropy-decode once into a coefficient store, then reconstruct the image
+ * at each scale (writing it when an output pattern is given) */
+static int run_scales(const char *filename, const char *output_pattern, const int *scales,
+                      int num_scales, int png_level, idct_method_t idct_method,
+                      bool fast_upsampling) {
+    output_format_t format = OUTPUT_PPM;
+    if (output_pattern) {
+        if (strchr(output_pattern, '%') ? !valid_frame_pattern(output_pattern) : num_scales > 1) {
+            fprintf(stderr, "--scales --output needs a pattern with one %%d, e.g. image_%%d.png\n");
+            return 1;
+        }
+        if (output_format_from_filename(output_pattern, &format) != 0 || format == OUTPUT_YUV) {
+            fprintf(stderr, "Unsupported scaled output format: %s\n", output_pattern);
+            return 1;
+        }
+    }
+
+    jpeg_verbose = false;
+    jpeg_decoder_t *decoder = jpeg_parser_init(filename);
+    if (!decoder) {
+        fprintf(stderr, "Failed to parse JPEG file\n");
+        return 1;
+    }
+
+    double t_start = get_time_us();
+    coef_store_t *store = coef_store_read(decoder);
+    double read_ms = (get_time_us() - t_start) / 1000.0;
+    jpeg_parser_destroy(decoder);
+    if (!store) {
+        fprintf(stderr, "Failed to decode JPEG data\n");
+        return 1;
+    }
+
+    size_t blocks = coef_store_blocks(store);
+    printf("Entropy decode: %.2f ms, %zu blocks stored in %.1f KB (%.1f bytes/block, dense %.1f KB)\n",
+           read_ms, blocks, coef_store_bytes(store) / 1024.0,
+           blocks > 0 ? (double)coef_store_bytes(store) / blocks : 0.0,
+           blocks * BLOCK_SIZE * sizeof(int16_t) / 1024.0);
+
+    int failures = 0;
+    for (int i = 0; i < num_scales; i++) {
+        decoded_image_t image;
+        t_start = get_time_us();
+        if (coef_store_render(store, scales[i], idct_method, fast_upsampling, &image) != 0) {
+            fprintf(stderr, "Failed to render 1/%d scale\n", scales[i]);
+            failures++;
+            continue;
+        }
+        double render_ms = (get_time_us() - t_start) / 1000.0;
+        printf("  1/%d: %dx%d in %.2f ms", scales[i], image.width, image.height, render_ms);
+
+        if (output_pattern) {
+            char path[4096];
+            snprintf(path, sizeof(path), output_pattern, scales[i]);
+            image_writer_t *writer = image_writer_open(path, format, image.width, image.height,
+                                                       image.channels, png_level);
+            if (!writer ||
+                image_writer_write_rows(writer, image.pixels,
+                                        (size_t)image.width * image.channels, image.height) != 0 ||
+                image_writer_close(writer) != 0) {
+                failures++;
+            } else {
+                printf(" -> %s", path);
+            }
+        }
+        printf("\n");
+        jpeg_free(image.pixels);
+    }
+
+    coef_store_destroy(store);
+    return failures == 0 ? 0 : 1;
+}
+
+/* Probe each file's headers and print one summary line per image */
+static int run_identify(char **inputs, int num_inputs) {
+    char **paths = NULL;
+    int count = collect_image_paths(inputs, num_inputs, &paths);
+    if (count == 0) {
+        fprintf(stderr, "No JPEG files found\n");
+        jpeg_free(paths);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        jpeg_probe_info_t info;
+        if (jpeg_probe_file(paths[i], &info) < 0) {
+            fprintf(stderr, "%s: probe failed\n", paths[i]);
+            failures++;
+            continue;
+        }
+
+        printf("%s: %dx%d, %d-bit, %d component%s, %s (", paths[i], info.width, info.height,
+               info.precision, info.num_components, info.num_components == 1 ? "" : "s",
+               probe_subsampling_name(&info));
+        for (int c = 0; c < info.num_components && c < MAX_COMPONENTS; c++) {
+            printf("%s%dx%d", c > 0 ? "," : "", info.h_sampling[c], info.v_sampling[c]);
+        }
+        printf("), %s SOF%d, restart %d, orientation %d, %zu bytes read\n",
+               info.progressive ? "progressive" : "sequential", info.sof_type,
+               info.restart_interval, info.orientation, info.bytes_read);
+    }
+
+    free_image_paths(paths, count);
+    return failures == 0 ? 0 : 1;
+}
+
+/* Print and release the counter profile of a decode */
+static void finish_perf_profile(jpeg_decoder_t *decoder) {
+    if (decoder->perf) {
+        perf_profile_report(decoder->perf, decoder->frame.width, decoder->frame.height);
+        perf_profile_close(decoder->perf);
+        decoder->perf = NULL;
+    }
+}
+
+/* Write the --stats-json report of a finished decode */
+static int write_stats_json(const char *path, const char *filename,
+                            const jpeg_decoder_t *decoder, double parse_time, double total_time) {
+    decode_timing_t timing;
+    timing.parse_ms = parse_time;
+    timing.total_ms = total_time;
+    return metrics_write_json(path, filename, decoder, &timing);
+}
+
+/* Decode and convert straight into the window's locked texture: no
+ * image_data allocation and no upload copy */
+static int view_in_texture(jpeg_decoder_t *decoder, const char *filename, double parse_time,
+                           const char *stats_json) {
+    uint8_t *pixels;
+    int pitch;
+    display_t *display = display_create_locked(decoder->frame.width, decoder->frame.height,
+                                               &pixels, &pitch);
+    if (!display) {
+        return -1;
+    }
+    display_set_perf(display, decoder->perf);
+
+    double t_start = get_time_us();
+    trace_begin("decode into texture");
+    int result = jpeg_decode_into(decoder, pixels, (size_t)pitch, JPEG_PIXEL_BGRX32);
+    trace_end();
+    double decode_time = (get_time_us() - t_start) / 1000.0;
+    display_unlock_texture(display);
+
+    if (result != 0) {
+        fprintf(stderr, "Failed to decode JPEG data\n");
+        display_destroy(display);
+        return -1;
+    }
+
+    JPEG_LOG("\nDecoded into the display texture: %dx%d\n", decoder->width, decoder->height);
+    JPEG_LOG("  Parsing:         %8.2f ms\n", parse_time);
+    JPEG_LOG("  Decode + convert:%8.2f ms\n", decode_time);
+    JPEG_LOG("\n");
+    if (stats_json) {
+        write_stats_json(stats_json, filename, decoder, parse_time, parse_time + decode_time);
+    }
+
+    result = display_run(display);
+    display_destroy(display);
+    finish_perf_profile(decoder);
+    return result;
 }
 
 int main(int argc, char *argv[]) {
@@ -35,50 +430,381 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    const char *filename = argv[1];
     const char *output_ppm = NULL;
+    const char *output_file = NULL;
+    int png_level = DEFAULT_PNG_LEVEL;
+    int no_display = 0;
+    int lossless_transform = 0;
+    int thumbnail_size = 0;
+    int identify = 0;
+    int show_preview = 1;
+    int fast_upsample = 0;
+    int idct_upsample = 0;
+    int gray = 0;
+    int decode_threads = 1;
+    int perf_counters = 0;
+    int mjpeg = 0;
+    int skip_unchanged = 0;
+    int verify = 0;
+    int update_hashes = 0;
+    int scales[MAX_SCALES];
+    int num_scales = 0;
+    const char *trace_file = NULL;
+    const char *stats_json = NULL;
+    idct_method_t idct_method = IDCT_ISLOW;
+    encoder_options_t encoder_options;
+    encoder_default_options(&encoder_options);
+    encoder_options.quality = DEFAULT_QUALITY;
+    transform_options_t transform_options;
+    memset(&transform_options, 0, sizeof(transform_options));
+    browse_options_t browse_options;
+    browse_options.cache_budget_bytes = (size_t)DEFAULT_CACHE_MB << 20;
+    browse_options.prefetch_threads = DEFAULT_PREFETCH_THREADS;
+    browse_options.prefetch_radius = DEFAULT_PREFETCH_RADIUS;
+
+    /* Collect input files and options */
+    char **inputs = (char**)jpeg_malloc(argc * sizeof(char*));
+    int num_inputs = 0;
 
-    /* Parse optional --save-ppm argument */
-    for (int i = 2; i < argc; i++) {
+    for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--save-ppm") == 0 && i + 1 < argc) {
-            output_ppm = argv[i + 1];
+            output_ppm = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (strcmp(argv[i], "--png-level") == 0 && i + 1 < argc) {
+            png_level = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--identify") == 0) {
+            identify = 1;
+        } else if (strcmp(argv[i], "--no-display") == 0) {
+            no_display = 1;
+        } else if (strcmp(argv[i], "--no-preview") == 0) {
+            show_preview = 0;
+        } else if (strcmp(argv[i], "--fast-upsample") == 0) {
+            fast_upsample = 1;
+        } else if (strcmp(argv[i], "--idct-upsample") == 0) {
+            idct_upsample = 1;
+        } else if (strcmp(argv[i], "--gray") == 0) {
+            gray = 1;
+        } else if (strcmp(argv[i], "--idct") == 0 && i + 1 < argc) {
             i++;
+            if (strcmp(argv[i], idct_method_name(IDCT_ISLOW)) == 0) {
+                idct_method = IDCT_ISLOW;
+            } else if (strcmp(argv[i], idct_method_name(IDCT_IFAST)) == 0) {
+                idct_method = IDCT_IFAST;
+            } else if (strcmp(argv[i], idct_method_name(IDCT_FLOAT)) == 0) {
+                idct_method = IDCT_FLOAT;
+            } else {
+                fprintf(stderr, "Unknown IDCT method: %s (expected islow, ifast or float)\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--mjpeg") == 0) {
+            mjpeg = 1;
+        } else if (strcmp(argv[i], "--skip-unchanged") == 0) {
+            skip_unchanged = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        } else if (strcmp(argv[i], "--update-hashes") == 0) {
+            update_hashes = 1;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            jpeg_verbose = false;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats_json = argv[++i];
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf_counters = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            i++;
+            decode_threads = strcmp(argv[i], "0") == 0 ? (int)sysconf(_SC_NPROCESSORS_ONLN)
+                                                       : atoi(argv[i]);
+            if (decode_threads > MAX_DECODE_THREADS) {
+                decode_threads = MAX_DECODE_THREADS;
+            }
+            if (decode_threads <= 0) {
+                fprintf(stderr, "Invalid thread count: %s\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--transform") == 0 && i + 1 < argc) {
+            if (transform_from_name(argv[++i], &transform_options.op) != 0) {
+                fprintf(stderr, "Unknown transform: %s\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+            lossless_transform = 1;
+        } else if (strcmp(argv[i], "--crop") == 0 && i + 1 < argc) {
+            if (parse_crop_geometry(argv[++i], &transform_options) != 0) {
+                fprintf(stderr, "Invalid crop geometry: %s (expected WxH+X+Y)\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+            lossless_transform = 1;
+        } else if (strcmp(argv[i], "--thumbnail") == 0 && i + 1 < argc) {
+            thumbnail_size = atoi(argv[++i]);
+            if (thumbnail_size <= 0) {
+                fprintf(stderr, "Invalid thumbnail size: %s\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--scales") == 0 && i + 1 < argc) {
+            if (parse_scales(argv[++i], scales, &num_scales) != 0) {
+                fprintf(stderr, "Invalid scales: %s (expected a list of 1, 2, 4, 8)\n", argv[i]);
+                jpeg_free(inputs);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            encoder_options.quality = clamp(atoi(argv[++i]), 1, 100);
+        } else if (strcmp(argv[i], "--subsampling") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "444") == 0) {
+                encoder_options.subsampling = CHROMA_444;
+            } else if (strcmp(mode, "422") == 0) {
+                encoder_options.subsampling = CHROMA_422;
+            } else if (strcmp(mode, "420") == 0) {
+                encoder_options.subsampling = CHROMA_420;
+            } else {
+                fprintf(stderr, "Unknown subsampling: %s\n", mode);
+                jpeg_free(inputs);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--optimize-huffman") == 0) {
+            encoder_options.optimize_huffman = true;
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            browse_options.cache_budget_bytes = (size_t)atol(argv[++i]) << 20;
+        } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            browse_options.prefetch_radius = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prefetch-threads") == 0 && i + 1 < argc) {
+            browse_options.prefetch_threads = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            jpeg_free(inputs);
+            return 1;
+        } else {
+            inputs[num_inputs++] = argv[i];
         }
     }
 
-    printf("========================================\n");
-    printf("JPEG Viewer - Custom JPEG Decoder\n");
-    printf("========================================\n");
-    printf("File: %s\n\n", filename);
+    /* Regression check of the decoder: test files by default */
+    if (verify) {
+        static char default_dir[] = DEFAULT_VERIFY_DIR;
+        if (num_inputs == 0) {
+            inputs[num_inputs++] = default_dir;
+        }
+        int result = verify_run(inputs, num_inputs, DEFAULT_HASH_FILE, update_hashes);
+        jpeg_free(inputs);
+        return result;
+    }
+
+    if (num_inputs == 0) {
+        print_usage(argv[0]);
+        jpeg_free(inputs);
+        return 1;
+    }
+
+    /* Trace any mode; the file is written when the program exits */
+    if (trace_file) {
+        if (trace_open(trace_file) != 0) {
+            jpeg_free(inputs);
+            return 1;
+        }
+        atexit(trace_close);
+        trace_thread_name("main");
+    }
+
+    /* Header probe only: no decode, any number of inputs */
+    if (identify) {
+        int result = run_identify(inputs, num_inputs);
+        jpeg_free(inputs);
+        return result;
+    }
+
+    /* Motion-JPEG stream: one file or "-" */
+    if (mjpeg) {
+        mjpeg_options_t mjpeg_options;
+        mjpeg_options.decode_threads = decode_threads;
+        mjpeg_options.idct_method = idct_method;
+        mjpeg_options.fast_upsampling = fast_upsample;
+        mjpeg_options.luma_only = gray;
+        mjpeg_options.skip_unchanged = skip_unchanged;
+        int result = run_mjpeg(inputs[0], output_file, png_level, &mjpeg_options);
+        jpeg_free(inputs);
+        return result;
+    }
+
+    /* Several files or a directory: browse mode */
+    struct stat st;
+    if (num_inputs > 1 || (stat(inputs[0], &st) == 0 && S_ISDIR(st.st_mode))) {
+        int result = run_browser(inputs, num_inputs, &browse_options);
+        jpeg_free(inputs);
+        return result;
+    }
+
+    const char *filename = inputs[0];
+    jpeg_free(inputs);
+
+    /* Lossless transform: coefficients only, no pixels */
+    if (lossless_transform) {
+        if (!output_file) {
+            fprintf(stderr, "--transform and --crop need --output FILE.jpg\n");
+            return 1;
+        }
+        return jpeg_transform_file(filename, output_file, &transform_options) == 0 ? 0 : 1;
+    }
+
+    /* Thumbnail: decode, resize and encode the planes */
+    if (thumbnail_size > 0) {
+        if (!output_file || !is_jpeg_filename(output_file)) {
+            fprintf(stderr, "--thumbnail needs --output FILE.jpg\n");
+            return 1;
+        }
+        return make_thumbnail(filename, output_file, thumbnail_size, &encoder_options) == 0 ? 0 : 1;
+    }
+
+    /* Several sizes from one entropy decode */
+    if (num_scales > 0) {
+        return run_scales(filename, output_file, scales, num_scales, png_level, idct_method,
+                          fast_upsample);
+    }
+
+    /* A .jpg output re-encodes the decoded image instead of streaming rows */
+    const char *output_jpeg = NULL;
+    if (output_file && is_jpeg_filename(output_file)) {
+        output_jpeg = output_file;
+        output_file = NULL;
+    }
+
+    /* JSON on stdout must not be interleaved with progress output; the
+     * metrics describe one decode on the calling thread, not the preview's */
+    if (stats_json) {
+        if (strcmp(stats_json, "-") == 0) {
+            jpeg_verbose = false;
+        }
+        show_preview = 0;
+    }
+
+    JPEG_LOG("========================================\n");
+    JPEG_LOG("JPEG Viewer - Custom JPEG Decoder\n");
+    JPEG_LOG("========================================\n");
+    JPEG_LOG("File: %s\n\n", filename);
 
     double t_start, t_end;
     double parse_time, decode_time, color_time, total_time;
 
+    /* Counters follow this thread only: decode on it, without the preview's
+     * background decode */
+    perf_profile_t *perf = perf_counters ? perf_profile_open() : NULL;
+    if (perf && (decode_threads > 1 || show_preview)) {
+        JPEG_LOG("Counter profiling: single-threaded decode, no preview\n");
+        decode_threads = 1;
+        show_preview = 0;
+    }
+
     /* Parse JPEG file */
-    printf("Parsing JPEG file...\n");
+    JPEG_LOG("Parsing JPEG file...\n");
     t_start = get_time_us();
+    perf_profile_enter(perf, PERF_STAGE_PARSE);
+    trace_begin("parse");
     jpeg_decoder_t *decoder = jpeg_parser_init(filename);
+    trace_end();
+    perf_profile_enter(perf, PERF_STAGE_NONE);
     t_end = get_time_us();
     parse_time = (t_end - t_start) / 1000.0;  /* Convert to ms */
 
     if (!decoder) {
         fprintf(stderr, "Failed to parse JPEG file\n");
+        perf_profile_close(perf);
         return 1;
     }
+    decoder->perf = perf;
+    decoder->fast_upsampling = fast_upsample;
+    decoder->idct_upsampling = idct_upsample;
+    decoder->luma_only = gray;
+    decoder->idct_method = idct_method;
+    decoder->decode_threads = decode_threads;
+
+    /* Plain viewing: show the embedded EXIF thumbnail while the full image decodes */
+    if (show_preview && !no_display && !output_file && !output_ppm && !output_jpeg) {
+        decoded_image_t preview;
+        if (jpeg_decode_exif_preview(decoder, &preview) == 0) {
+            int result = view_with_preview(decoder, &preview);
+            jpeg_free(preview.pixels);
+            jpeg_parser_destroy(decoder);
+            return result == 0 ? 0 : 1;
+        }
+    }
+
+    /* Plain viewing without a preview: decode into the window's texture */
+    if (!no_display && !output_file && !output_ppm && !output_jpeg) {
+        int result = view_in_texture(decoder, filename, parse_time, stats_json);
+        jpeg_parser_destroy(decoder);
+        return result == 0 ? 0 : 1;
+    }
+
+    /* Stream rows to the output file as they are decoded */
+    image_writer_t *writer = NULL;
+    if (output_file) {
+        output_format_t format;
+        if (output_format_from_filename(output_file, &format) != 0) {
+            fprintf(stderr, "Unknown output format: %s\n", output_file);
+            jpeg_parser_destroy(decoder);
+            return 1;
+        }
+
+        /* Nothing but the PGM needs chroma: skip decoding it */
+        if (format == OUTPUT_PGM && no_display && !output_ppm && !output_jpeg) {
+            decoder->luma_only = true;
+        }
+
+        writer = image_writer_open_decoder(output_file, format, decoder, png_level);
+        if (!writer) {
+            jpeg_parser_destroy(decoder);
+            return 1;
+        }
+    }
 
     /* Decode JPEG data */
     t_start = get_time_us();
-    if (jpeg_decode(decoder) != 0) {
+    trace_begin("decode");
+    int decode_result = jpeg_decode(decoder);
+    trace_end();
+    if (decode_result != 0) {
         fprintf(stderr, "Failed to decode JPEG data\n");
+        if (writer) {
+            image_writer_close(writer);
+        }
         jpeg_parser_destroy(decoder);
         return 1;
     }
     t_end = get_time_us();
     decode_time = (t_end - t_start) / 1000.0;  /* Convert to ms */
 
+    if (writer) {
+        if (image_writer_close(writer) != 0) {
+            jpeg_parser_destroy(decoder);
+            return 1;
+        }
+        JPEG_LOG("Streamed output to: %s\n", output_file);
+    }
+
+    /* Batch conversion: the full RGB image is never needed */
+    if (no_display && !output_ppm && !output_jpeg) {
+        JPEG_LOG("Parse: %.2f ms, decode: %.2f ms\n", parse_time, decode_time);
+        if (stats_json) {
+            write_stats_json(stats_json, filename, decoder, parse_time, parse_time + decode_time);
+        }
+        finish_perf_profile(decoder);
+        jpeg_parser_destroy(decoder);
+        return 0;
+    }
+
     /* Convert to RGB */
     t_start = get_time_us();
-    if (ycbcr_to_rgb(decoder) != 0) {
+    trace_begin("color convert");
+    int convert_result = ycbcr_to_rgb(decoder);
+    trace_end();
+    if (convert_result != 0) {
         fprintf(stderr, "Failed to convert color space\n");
         jpeg_parser_destroy(decoder);
         return 1;
@@ -103,20 +829,23 @@ int main(int argc, char *argv[]) {
     }
 
     /* Display image */
-    printf("\n========================================\n");
-    printf("Decoded successfully!\n");
-    printf("Image: %dx%d, %d channel(s)\n",
-           decoder->width, decoder->height, decoder->channels);
-    printf("Memory optimized for display\n");
-    printf("========================================\n");
-    printf("\n");
-    printf("Performance Profile:\n");
-    printf("  Parsing:         %8.2f ms (%5.1f%%)\n", parse_time, 100.0 * parse_time / total_time);
-    printf("  Decoding:        %8.2f ms (%5.1f%%)\n", decode_time, 100.0 * decode_time / total_time);
-    printf("  Color Convert:   %8.2f ms (%5.1f%%)\n", color_time, 100.0 * color_time / total_time);
-    printf("  --------------------------------\n");
-    printf("  Total:           %8.2f ms\n", total_time);
-    printf("\n");
+    JPEG_LOG("\n========================================\n");
+    JPEG_LOG("Decoded successfully!\n");
+    JPEG_LOG("Image: %dx%d, %d channel(s)\n",
+             decoder->width, decoder->height, decoder->channels);
+    JPEG_LOG("Memory optimized for display\n");
+    JPEG_LOG("========================================\n");
+    JPEG_LOG("\n");
+    JPEG_LOG("Performance Profile:\n");
+    JPEG_LOG("  Parsing:         %8.2f ms (%5.1f%%)\n", parse_time, 100.0 * parse_time / total_time);
+    JPEG_LOG("  Decoding:        %8.2f ms (%5.1f%%)\n", decode_time, 100.0 * decode_time / total_time);
+    JPEG_LOG("  Color Convert:   %8.2f ms (%5.1f%%)\n", color_time, 100.0 * color_time / total_time);
+    JPEG_LOG("  --------------------------------\n");
+    JPEG_LOG("  Total:           %8.2f ms\n", total_time);
+    JPEG_LOG("\n");
+    if (stats_json) {
+        write_stats_json(stats_json, filename, decoder, parse_time, total_time);
+    }
 
     /* Save PPM if requested */
     if (output_ppm) {
@@ -126,8 +855,39 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (display_image(decoder->image_data, decoder->width,
-                     decoder->height, decoder->channels) != 0) {
+    /* Re-encode if requested */
+    if (output_jpeg) {
+        jpeg_writer_t writer;
+        jpeg_writer_init(&writer, (size_t)decoder->width * decoder->height / 4);
+        if (jpeg_encode_pixels(&writer, decoder->image_data, decoder->width, decoder->height,
+                               decoder->channels, (size_t)decoder->width * decoder->channels,
+                               &encoder_options) != 0 ||
+            jpeg_writer_save(&writer, output_jpeg) != 0) {
+            fprintf(stderr, "Failed to save JPEG file\n");
+        } else {
+            JPEG_LOG("Saved output to: %s\n", output_jpeg);
+        }
+        jpeg_writer_free(&writer);
+    }
+
+    if (no_display) {
+        finish_perf_profile(decoder);
+        jpeg_parser_destroy(decoder);
+        return 0;
+    }
+
+    display_t *display = display_create(decoder->image_data, decoder->width,
+                                        decoder->height, decoder->channels);
+    if (!display) {
+        fprintf(stderr, "Failed to display image\n");
+        jpeg_parser_destroy(decoder);
+        return 1;
+    }
+    display_set_perf(display, decoder->perf);
+    int result = display_run(display);
+    display_destroy(display);
+    finish_perf_profile(decoder);
+    if (result != 0) {
         fprintf(stderr, "Failed to display image\n");
         jpeg_parser_destroy(decoder);
         return 1;
@@ -136,6 +896,6 @@ int main(int argc, char *argv[]) {
     /* Cleanup */
     jpeg_parser_destroy(decoder);
 
-    printf("\nProgram exited successfully\n");
+    JPEG_LOG("\nProgram exited successfully\n");
     return 0;
 }
@@ -0,0 +1,98 @@
+#include "metrics.h"
+#include "dct.h"
+#include "utils.h"
+#include <sys/resource.h>
+
+/* JSON string with quotes, backslashes and control characters escaped */
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') {
+            fprintf(out, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(out, "\\u%04x", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* "name": {"ms": ..., "mpix_per_s": ...}; throughput is 0 for stages that
+ * did not run */
+static void write_stage(FILE *out, const char *name, double ms, double megapixels, bool last) {
+    fprintf(out, "    \"%s\": {\"ms\": %.3f, \"mpix_per_s\": %.2f}%s\n", name, ms,
+            ms > 0.0 ? megapixels / (ms / 1000.0) : 0.0, last ? "" : ",");
+}
+
+/* Peak resident set size in KiB (ru_maxrss is KiB on Linux, bytes on macOS) */
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+int metrics_write_json(const char *path, const char *filename,
+                       const jpeg_decoder_t *decoder, const decode_timing_t *timing) {
+    const frame_header_t *frame = &decoder->frame;
+    const jpeg_decode_stats_t *stats = &decoder->stats;
+    double megapixels = (double)frame->width * frame->height / 1e6;
+    bool to_stdout = strcmp(path, "-") == 0;
+
+    FILE *out = to_stdout ? stdout : fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot open stats file %s\n", path);
+        return -1;
+    }
+
+    fprintf(out, "{\n  \"file\": ");
+    write_json_string(out, filename);
+    fprintf(out, ",\n  \"width\": %d,\n  \"height\": %d,\n  \"components\": %d,\n",
+            frame->width, frame->height, frame->num_components);
+    fprintf(out, "  \"sampling\": \"");
+    for (int c = 0; c < frame->num_components; c++) {
+        fprintf(out, "%s%dx%d", c > 0 ? "," : "",
+                frame->components[c].h_sampling, frame->components[c].v_sampling);
+    }
+    fprintf(out, "\",\n  \"restart_interval\": %d,\n", decoder->restart_interval);
+    fprintf(out, "  \"scan_bytes\": %zu,\n", decoder->scan_data_size);
+    fprintf(out, "  \"blocks\": %lu,\n  \"dc_only_blocks\": %lu,\n  \"dc_only_ratio\": %.4f,\n",
+            stats->blocks, stats->dc_only_blocks,
+            stats->blocks > 0 ? (double)stats->dc_only_blocks / stats->blocks : 0.0);
+    fprintf(out, "  \"idct\": \"%s\",\n  \"threads\": %d,\n",
+            idct_method_name(decoder->idct_method),
+            decoder->decode_threads > 1 ? decoder->decode_threads : 1);
+
+    /* Threaded stage times are summed over threads, so their throughput is
+     * per thread */
+    fprintf(out, "  \"stages\": {\n");
+    write_stage(out, "parse", timing->parse_ms, megapixels, false);
+    write_stage(out, "huffman", stats->huffman_time_us / 1000.0, megapixels, false);
+    write_stage(out, "idct", stats->idct_time_us / 1000.0, megapixels, false);
+    write_stage(out, "upsample", stats->upsample_time_us / 1000.0, megapixels, false);
+    write_stage(out, "color", stats->color_time_us / 1000.0, megapixels, true);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"total_ms\": %.3f,\n  \"mpix_per_s\": %.2f,\n", timing->total_ms,
+            timing->total_ms > 0.0 ? megapixels / (timing->total_ms / 1000.0) : 0.0);
+    fprintf(out, "  \"huffman_tables\": {\"reused\": %lu, \"built\": %lu},\n",
+            stats->huffman_tables_reused, stats->huffman_tables_built);
+    fprintf(out, "  \"peak_rss_kb\": %ld,\n  \"jpeg_malloc_calls\": %lu\n}\n",
+            peak_rss_kb(), jpeg_malloc_calls());
+
+    if (to_stdout) {
+        fflush(out);
+        return 0;
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write stats file %s\n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../include/jpeg_types.h"
+
+/* Wall-clock times measured by the caller around a decode, in milliseconds */
+typedef struct {
+    double parse_ms;            /* Marker parsing */
+    double total_ms;            /* Parse through color conversion */
+} decode_timing_t;
+
+/* Write one JSON object describing the last decode of decoder: frame
+ * geometry and sampling, scan bytes, blocks and DC-only ratio, time and
+ * throughput per stage (from decoder->stats), peak RSS and the number of
+ * jpeg_malloc calls. path "-" writes to stdout. Returns 0 on success, -1 on error. */
+int metrics_write_json(const char *path, const char *filename,
+                       const jpeg_decoder_t *decoder, const decode_timing_t *timing);
+
+#endif /* METRICS_H */
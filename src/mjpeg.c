@@ -0,0 +1,766 @@
+#define _POSIX_C_SOURCE 200809L  /* open, read */
+#include "mjpeg.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "color.h"
+#include "trace.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* Bytes requested per read(); a pipe returns whatever has arrived */
+#define MJPEG_CHUNK_SIZE (64 * 1024)
+
+/* Frames waiting between two pipeline stages */
+#define MJPEG_QUEUE_DEPTH 2
+
+struct mjpeg_reader {
+    int fd;
+    bool close_fd;
+    bool eof;
+
+    /* Unconsumed input; once an SOI has been found it starts the buffer */
+    uint8_t *buffer;
+    size_t size;
+    size_t capacity;
+    bool found_soi;
+
+    /* Where find_frame_end stopped in the current frame */
+    size_t scan_pos;
+    bool in_scan;
+
+    jpeg_tables_t tables;
+    size_t bytes_read;
+    unsigned long skipped;
+};
+
+mjpeg_reader_t* mjpeg_reader_open(const char *path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        return NULL;
+    }
+
+    mjpeg_reader_t *reader = (mjpeg_reader_t*)jpeg_malloc(sizeof(mjpeg_reader_t));
+    memset(reader, 0, sizeof(mjpeg_reader_t));
+    reader->fd = fd;
+    reader->close_fd = fd != STDIN_FILENO;
+    reader->capacity = 2 * MJPEG_CHUNK_SIZE;
+    reader->buffer = (uint8_t*)jpeg_malloc(reader->capacity);
+    return reader;
+}
+
+/* Append one read() worth of input, growing the buffer for large frames */
+static void reader_fill(mjpeg_reader_t *reader) {
+    if (reader->capacity - reader->size < MJPEG_CHUNK_SIZE) {
+        size_t capacity = reader->capacity * 2;
+        uint8_t *buffer = (uint8_t*)jpeg_malloc(capacity);
+        memcpy(buffer, reader->buffer, reader->size);
+        jpeg_free(reader->buffer);
+        reader->buffer = buffer;
+        reader->capacity = capacity;
+    }
+
+    ssize_t n;
+    trace_begin("read chunk");
+    do {
+        n = read(reader->fd, reader->buffer + reader->size, MJPEG_CHUNK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    trace_end();
+
+    if (n < 0) {
+        fprintf(stderr, "Read error in MJPEG stream: %s\n", strerror(errno));
+    }
+    if (n <= 0) {
+        reader->eof = true;
+        return;
+    }
+    reader->size += (size_t)n;
+    reader->bytes_read += (size_t)n;
+}
+
+/* Drop the first count bytes of the buffer */
+static void reader_consume(mjpeg_reader_t *reader, size_t count) {
+    memmove(reader->buffer, reader->buffer + count, reader->size - count);
+    reader->size -= count;
+}
+
+/* Move an SOI marker to the start of the buffer, discarding anything before
+ * it. Returns false if the buffer holds none yet. */
+static bool seek_soi(mjpeg_reader_t *reader) {
+    const uint8_t *data = reader->buffer;
+    for (size_t i = 0; i + 1 < reader->size; i++) {
+        if (data[i] == 0xFF && data[i + 1] == 0xD8) {
+            reader_consume(reader, i);
+            reader->found_soi = true;
+            reader->scan_pos = 2;
+            reader->in_scan = false;
+            return true;
+        }
+    }
+
+    /* Keep a trailing 0xFF: it may be the first half of the next SOI */
+    size_t keep = reader->size > 0 && data[reader->size - 1] == 0xFF ? 1 : 0;
+    reader_consume(reader, reader->size - keep);
+    return false;
+}
+
+/* Walk the frame at the start of the buffer from where the last call
+ * stopped: header segments by their lengths, entropy-coded data up to the
+ * first marker that is not RSTn. Returns 1 with *end set once the frame is
+ * complete (EOI, or the SOI of a next frame when EOI is missing), 0 if more
+ * input is needed and -1 if the headers are corrupt. */
+static int find_frame_end(mjpeg_reader_t *reader, size_t *end) {
+    const uint8_t *data = reader->buffer;
+    size_t size = reader->size;
+    size_t pos = reader->scan_pos;
+    int result = 0;
+
+    for (;;) {
+        if (reader->in_scan) {
+            const uint8_t *ff = pos < size ? memchr(data + pos, 0xFF, size - pos) : NULL;
+            if (!ff) {
+                pos = size;
+                break;
+            }
+            pos = (size_t)(ff - data);
+            if (pos + 1 >= size) {
+                break;
+            }
+            uint8_t next = data[pos + 1];
+            if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+                pos += 2;       /* Stuffed byte or restart marker */
+            } else if (next == 0xFF) {
+                pos++;          /* Fill byte */
+            } else {
+                reader->in_scan = false;
+            }
+            continue;
+        }
+
+        if (pos + 2 > size) {
+            break;
+        }
+        if (data[pos] != 0xFF) {
+            result = -1;
+            break;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker == 0xD9) {
+            *end = pos + 2;
+            result = 1;
+            break;
+        }
+        if (marker == 0xD8) {
+            *end = pos;
+            result = 1;
+            break;
+        }
+        if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+            pos += 2;           /* Markers without a segment */
+            continue;
+        }
+
+        if (pos + 4 > size) {
+            break;
+        }
+        size_t length = read_uint16_be(data + pos + 2);
+        if (length < 2) {
+            result = -1;
+            break;
+        }
+        if (pos + 2 + length > size) {
+            break;
+        }
+        if (marker == 0xDA) {
+            reader->in_scan = true;
+        }
+        pos += 2 + length;
+    }
+
+    reader->scan_pos = pos;
+    return result;
+}
+
+jpeg_decoder_t* mjpeg_reader_next(mjpeg_reader_t *reader) {
+    for (;;) {
+        if (!reader->found_soi && !seek_soi(reader)) {
+            if (reader->eof) {
+                return NULL;
+            }
+            reader_fill(reader);
+            continue;
+        }
+
+        size_t end = 0;
+        int result = find_frame_end(reader, &end);
+        if (result < 0) {
+            /* Resynchronize on the next SOI */
+            reader->skipped++;
+            reader->found_soi = false;
+            reader_consume(reader, 2);
+            continue;
+        }
+        if (result == 0) {
+            if (!reader->eof) {
+                reader_fill(reader);
+                continue;
+            }
+            /* Stream ends inside a frame: decode what there is of its scan */
+            if (!reader->in_scan) {
+                reader->skipped++;
+                reader->found_soi = false;
+                reader->size = 0;
+                return NULL;
+            }
+            end = reader->size;
+        }
+
+        /* The parser takes ownership of a copy of exactly the frame */
+        uint8_t *frame = (uint8_t*)jpeg_malloc(end);
+        memcpy(frame, reader->buffer, end);
+        reader_consume(reader, end);
+        reader->found_soi = false;
+
+        trace_begin("parse frame");
+        jpeg_decoder_t *decoder = jpeg_parser_init_frame(frame, end, &reader->tables);
+        trace_end();
+        if (decoder) {
+            return decoder;
+        }
+        reader->skipped++;
+    }
+}
+
+size_t mjpeg_reader_bytes(const mjpeg_reader_t *reader) {
+    return reader->bytes_read;
+}
+
+unsigned long mjpeg_reader_skipped(const mjpeg_reader_t *reader) {
+    return reader->skipped;
+}
+
+void mjpeg_reader_close(mjpeg_reader_t *reader) {
+    if (reader) {
+        if (reader->close_fd) {
+            close(reader->fd);
+        }
+        jpeg_free(reader->buffer);
+        jpeg_free(reader);
+    }
+}
+
+/* Bounded FIFO of frames between two stages. close() marks the end of the
+ * producer's frames; cancel() makes both ends give up at once. */
+typedef struct {
+    jpeg_decoder_t *frames[MJPEG_QUEUE_DEPTH];
+    int head;
+    int count;
+    bool closed;
+    bool cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} frame_queue_t;
+
+static void queue_init(frame_queue_t *queue) {
+    memset(queue, 0, sizeof(frame_queue_t));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+}
+
+/* Destroy frames left behind by a cancelled stream */
+static void queue_destroy(frame_queue_t *queue) {
+    for (int i = 0; i < queue->count; i++) {
+        jpeg_parser_destroy(queue->frames[(queue->head + i) % MJPEG_QUEUE_DEPTH]);
+    }
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+/* Block while the queue is full; -1 if it was cancelled */
+static int queue_push(frame_queue_t *queue, jpeg_decoder_t *frame) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == MJPEG_QUEUE_DEPTH && !queue->cancelled) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    if (queue->cancelled) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->frames[(queue->head + queue->count) % MJPEG_QUEUE_DEPTH] = frame;
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+/* Block while the queue is empty; NULL once it is closed and drained, or
+ * cancelled */
+static jpeg_decoder_t* queue_pop(frame_queue_t *queue) {
+    jpeg_decoder_t *frame = NULL;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed && !queue->cancelled) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    if (queue->count > 0 && !queue->cancelled) {
+        frame = queue->frames[queue->head];
+        queue->head = (queue->head + 1) % MJPEG_QUEUE_DEPTH;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return frame;
+}
+
+static void queue_close(frame_queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void queue_cancel(frame_queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->cancelled = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* The previous frame of a --skip-unchanged stream: its component planes and
+ * RGB output stay around, with a hash of each restart interval's entropy
+ * bytes, so intervals whose bytes did not change need neither decoding nor
+ * color conversion. Owned by the decode thread. */
+typedef struct {
+    bool valid;
+    frame_header_t frame;
+    uint16_t restart_interval;
+    bool luma_only;
+    bool idct_upsampling;
+    jpeg_tables_t tables;
+
+    uint8_t *planes[MAX_COMPONENTS];
+    int plane_width[MAX_COMPONENTS];
+    int plane_height[MAX_COMPONENTS];
+    uint8_t *pixels;
+    int channels;
+
+    int num_segments;
+    size_t *offsets;            /* Of this frame, while it is being decoded */
+    uint64_t *hashes;           /* Of the previous frame, then this one */
+    uint64_t *new_hashes;
+    bool *changed;
+    bool *dirty_rows;           /* Per MCU row */
+} delta_state_t;
+
+/* Split a scan at its RSTn markers: where each interval starts and a hash of
+ * its bytes (markers excluded). Returns the number of intervals, or -1 if
+ * there are not exactly expected of them. */
+static int index_restart_segments(const uint8_t *scan, size_t size, int expected,
+                                  size_t *offsets, uint64_t *hashes) {
+    static const uint8_t stuffed_ff = 0xFF;
+    uint64_t hash = JPEG_HASH_INIT;
+    int count = 0;
+    size_t pos = 0;
+    offsets[0] = 0;
+
+    while (pos < size) {
+        const uint8_t *ff = memchr(scan + pos, 0xFF, size - pos);
+        size_t span_end = ff ? (size_t)(ff - scan) : size;
+        hash = jpeg_hash_bytes(hash, scan + pos, span_end - pos);
+        if (!ff || span_end + 1 >= size) {
+            break;
+        }
+
+        uint8_t next = scan[span_end + 1];
+        if (next >= 0xD0 && next <= 0xD7) {
+            if (count + 1 >= expected) {
+                return -1;
+            }
+            hashes[count++] = hash;
+            offsets[count] = span_end + 2;
+            hash = JPEG_HASH_INIT;
+            pos = span_end + 2;
+        } else if (next == 0x00) {
+            hash = jpeg_hash_bytes(hash, &stuffed_ff, 1);
+            pos = span_end + 2;
+        } else if (next == 0xFF) {
+            pos = span_end + 1;
+        } else {
+            break;              /* EOI ends the scan */
+        }
+    }
+
+    hashes[count++] = hash;
+    return count == expected ? count : -1;
+}
+
+/* Frames can share decoded intervals only with identical geometry,
+ * sampling, table selectors, table contents and restart interval */
+static bool delta_compatible(const delta_state_t *state, const jpeg_decoder_t *frame) {
+    const frame_header_t *a = &state->frame;
+    const frame_header_t *b = &frame->frame;
+    if (!state->valid || a->width != b->width || a->height != b->height ||
+        a->num_components != b->num_components ||
+        state->restart_interval != frame->restart_interval ||
+        state->luma_only != frame->luma_only || state->idct_upsampling != frame->idct_upsampling) {
+        return false;
+    }
+
+    for (int c = 0; c < b->num_components; c++) {
+        const component_info_t *ca = &a->components[c];
+        const component_info_t *cb = &b->components[c];
+        if (ca->h_sampling != cb->h_sampling || ca->v_sampling != cb->v_sampling ||
+            ca->quant_table_id != cb->quant_table_id ||
+            ca->dc_table_id != cb->dc_table_id || ca->ac_table_id != cb->ac_table_id) {
+            return false;
+        }
+
+        const huffman_table_t *dc = &frame->dc_tables[cb->dc_table_id];
+        const huffman_table_t *ac = &frame->ac_tables[cb->ac_table_id];
+        const huffman_table_t *old_dc = &state->tables.dc_tables[cb->dc_table_id];
+        const huffman_table_t *old_ac = &state->tables.ac_tables[cb->ac_table_id];
+        if (memcmp(state->tables.quant_tables[cb->quant_table_id].table,
+                   frame->quant_tables[cb->quant_table_id].table, BLOCK_SIZE) != 0 ||
+            memcmp(old_dc->bits, dc->bits, sizeof(dc->bits)) != 0 ||
+            memcmp(old_dc->huffval, dc->huffval, sizeof(dc->huffval)) != 0 ||
+            memcmp(old_ac->bits, ac->bits, sizeof(ac->bits)) != 0 ||
+            memcmp(old_ac->huffval, ac->huffval, sizeof(ac->huffval)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void delta_reset(delta_state_t *state) {
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        jpeg_free(state->planes[c]);
+        state->planes[c] = NULL;
+    }
+    jpeg_free(state->pixels);
+    jpeg_free(state->offsets);
+    jpeg_free(state->hashes);
+    jpeg_free(state->new_hashes);
+    jpeg_free(state->changed);
+    jpeg_free(state->dirty_rows);
+    memset(state, 0, sizeof(delta_state_t));
+}
+
+/* Full decode and conversion of a frame that starts a new reference: its
+ * planes and a copy of its pixels are kept if it has restart intervals */
+static int delta_decode_full(delta_state_t *state, jpeg_decoder_t *frame) {
+    /* The options the frame asked for: jpeg_decode clears those that do not
+     * apply to it, while the next, undecoded frame still carries them */
+    bool luma_only = frame->luma_only;
+    bool idct_upsampling = frame->idct_upsampling;
+
+    delta_reset(state);
+    if (jpeg_decode(frame) != 0 || ycbcr_to_rgb(frame) != 0) {
+        return -1;
+    }
+
+    int total_mcus = frame->mcu_width * frame->mcu_height;
+    int interval = frame->restart_interval;
+    if (interval == 0) {
+        return 0;
+    }
+
+    int num_segments = (total_mcus + interval - 1) / interval;
+    state->offsets = (size_t*)jpeg_malloc(num_segments * sizeof(size_t));
+    state->hashes = (uint64_t*)jpeg_malloc(num_segments * sizeof(uint64_t));
+    if (index_restart_segments(frame->scan_data, frame->scan_data_size, num_segments,
+                               state->offsets, state->hashes) < 0) {
+        delta_reset(state);
+        return 0;
+    }
+    state->num_segments = num_segments;
+    state->new_hashes = (uint64_t*)jpeg_malloc(num_segments * sizeof(uint64_t));
+    state->changed = (bool*)jpeg_malloc(num_segments * sizeof(bool));
+    state->dirty_rows = (bool*)jpeg_malloc(frame->mcu_height * sizeof(bool));
+
+    state->frame = frame->frame;
+    state->restart_interval = frame->restart_interval;
+    state->luma_only = luma_only;
+    state->idct_upsampling = idct_upsampling;
+    memcpy(state->tables.quant_tables, frame->quant_tables, sizeof(frame->quant_tables));
+    memcpy(state->tables.dc_tables, frame->dc_tables, sizeof(frame->dc_tables));
+    memcpy(state->tables.ac_tables, frame->ac_tables, sizeof(frame->ac_tables));
+
+    /* Take the planes; the frame keeps its pixels for the caller */
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        state->planes[c] = frame->component_buffers[c];
+        state->plane_width[c] = frame->component_width[c];
+        state->plane_height[c] = frame->component_height[c];
+        frame->component_buffers[c] = NULL;
+    }
+    size_t pixel_bytes = (size_t)frame->width * frame->height * frame->channels;
+    state->channels = frame->channels;
+    state->pixels = (uint8_t*)jpeg_malloc(pixel_bytes);
+    memcpy(state->pixels, frame->image_data, pixel_bytes);
+    state->valid = true;
+    return 0;
+}
+
+/* Decode and convert a frame, re-decoding only the restart intervals whose
+ * bytes differ from the previous frame's. *decoded and *total count
+ * intervals. */
+static int delta_decode_frame(delta_state_t *state, jpeg_decoder_t *frame,
+                              unsigned long *decoded, unsigned long *total) {
+    trace_begin("delta decode");
+    if (!delta_compatible(state, frame) ||
+        index_restart_segments(frame->scan_data, frame->scan_data_size, state->num_segments,
+                               state->offsets, state->new_hashes) < 0) {
+        int result = delta_decode_full(state, frame);
+        if (result == 0 && state->valid) {
+            *decoded += state->num_segments;
+            *total += state->num_segments;
+        }
+        trace_end();
+        return result;
+    }
+
+    int interval = frame->restart_interval;
+    int num_changed = 0;
+    memset(state->dirty_rows, 0, frame->mcu_height * sizeof(bool));
+    for (int s = 0; s < state->num_segments; s++) {
+        state->changed[s] = state->new_hashes[s] != state->hashes[s];
+        if (state->changed[s]) {
+            num_changed++;
+            int first = s * interval;
+            int last = first + interval - 1;
+            for (int row = first / frame->mcu_width;
+                 row <= last / frame->mcu_width && row < frame->mcu_height; row++) {
+                state->dirty_rows[row] = true;
+            }
+        }
+    }
+    *decoded += num_changed;
+    *total += state->num_segments;
+
+    /* Decode into the previous planes; the frame only borrows them */
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        frame->component_buffers[c] = state->planes[c];
+        frame->component_width[c] = state->plane_width[c];
+        frame->component_height[c] = state->plane_height[c];
+    }
+    frame->width = frame->frame.width;
+    frame->height = frame->frame.height;
+    frame->channels = state->channels;
+
+    int result = jpeg_decode_restart_segments(frame, state->offsets, state->changed,
+                                              state->num_segments);
+
+    /* Convert the changed MCU rows plus one on each side (upsampling
+     * context) into the kept pixels, then hand the frame a copy */
+    size_t stride = (size_t)frame->width * frame->channels;
+    for (int row = 0; result == 0 && row < frame->mcu_height; row++) {
+        if (!state->dirty_rows[row]) {
+            continue;
+        }
+        int end_row = row;
+        while (end_row + 1 < frame->mcu_height && state->dirty_rows[end_row + 1]) {
+            end_row++;
+        }
+        int y_start = (row > 0 ? row - 1 : 0) * frame->mcu_size_y;
+        int y_end = (end_row + 2) * frame->mcu_size_y;
+        if (y_end > frame->height) {
+            y_end = frame->height;
+        }
+        result = ycbcr_to_rgb_rows(frame, y_start, y_end,
+                                   state->pixels + (size_t)y_start * stride, stride);
+        row = end_row;
+    }
+
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        frame->component_buffers[c] = NULL;
+    }
+    if (result != 0) {
+        /* The kept planes may be half updated */
+        delta_reset(state);
+        trace_end();
+        return -1;
+    }
+
+    frame->image_data = (uint8_t*)jpeg_malloc(stride * frame->height);
+    memcpy(frame->image_data, state->pixels, stride * frame->height);
+
+    uint64_t *hashes = state->hashes;
+    state->hashes = state->new_hashes;
+    state->new_hashes = hashes;
+    trace_end();
+    return 0;
+}
+
+/* Parse -> decode -> color conversion -> caller. Each stage owns its
+ * timing and failure counters; they are read after the threads joined. */
+typedef struct {
+    mjpeg_reader_t *reader;
+    const mjpeg_options_t *options;
+    frame_queue_t parsed;
+    frame_queue_t decoded;
+    frame_queue_t converted;
+    double parse_us;
+    double decode_us;
+    double color_us;
+    unsigned long decode_failures;
+    unsigned long color_failures;
+    delta_state_t delta;        /* options->skip_unchanged */
+    unsigned long segments_decoded;
+    unsigned long segments_total;
+} mjpeg_pipeline_t;
+
+static void* parse_thread(void *arg) {
+    mjpeg_pipeline_t *pipe = (mjpeg_pipeline_t*)arg;
+    const mjpeg_options_t *options = pipe->options;
+    trace_thread_name("mjpeg parse");
+
+    for (;;) {
+        double t_start = jpeg_time_us();
+        jpeg_decoder_t *frame = mjpeg_reader_next(pipe->reader);
+        pipe->parse_us += jpeg_time_us() - t_start;
+        if (!frame) {
+            break;
+        }
+
+        frame->decode_threads = options->decode_threads;
+        frame->idct_method = options->idct_method;
+        frame->fast_upsampling = options->fast_upsampling;
+        frame->luma_only = options->luma_only;
+        if (queue_push(&pipe->parsed, frame) != 0) {
+            jpeg_parser_destroy(frame);
+            break;
+        }
+    }
+    queue_close(&pipe->parsed);
+    return NULL;
+}
+
+static void* decode_thread(void *arg) {
+    mjpeg_pipeline_t *pipe = (mjpeg_pipeline_t*)arg;
+    jpeg_decoder_t *frame;
+    trace_thread_name("mjpeg decode");
+
+    while ((frame = queue_pop(&pipe->parsed)) != NULL) {
+        double t_start = jpeg_time_us();
+        int result;
+        if (pipe->options->skip_unchanged) {
+            result = delta_decode_frame(&pipe->delta, frame, &pipe->segments_decoded,
+                                        &pipe->segments_total);
+        } else {
+            trace_begin("decode frame");
+            result = jpeg_decode(frame);
+            trace_end();
+        }
+        pipe->decode_us += jpeg_time_us() - t_start;
+
+        if (result != 0) {
+            pipe->decode_failures++;
+            jpeg_parser_destroy(frame);
+            continue;
+        }
+        if (queue_push(&pipe->decoded, frame) != 0) {
+            jpeg_parser_destroy(frame);
+            break;
+        }
+    }
+    queue_close(&pipe->decoded);
+    return NULL;
+}
+
+static void* color_thread(void *arg) {
+    mjpeg_pipeline_t *pipe = (mjpeg_pipeline_t*)arg;
+    jpeg_decoder_t *frame;
+    trace_thread_name("mjpeg color");
+
+    while ((frame = queue_pop(&pipe->decoded)) != NULL) {
+        /* Frames of the delta decoder arrive converted */
+        double t_start = jpeg_time_us();
+        trace_begin("convert frame");
+        int result = frame->image_data ? 0 : ycbcr_to_rgb(frame);
+        trace_end();
+        pipe->color_us += jpeg_time_us() - t_start;
+
+        if (result != 0) {
+            pipe->color_failures++;
+            jpeg_parser_destroy(frame);
+            continue;
+        }
+        if (queue_push(&pipe->converted, frame) != 0) {
+            jpeg_parser_destroy(frame);
+            break;
+        }
+    }
+    queue_close(&pipe->converted);
+    return NULL;
+}
+
+int mjpeg_decode_stream(const char *path, const mjpeg_options_t *options,
+                        mjpeg_frame_fn frame_fn, void *user_data, mjpeg_stats_t *stats) {
+    memset(stats, 0, sizeof(mjpeg_stats_t));
+    double t_start = jpeg_time_us();
+
+    mjpeg_pipeline_t pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.reader = mjpeg_reader_open(path);
+    if (!pipe.reader) {
+        return -1;
+    }
+    pipe.options = options;
+    queue_init(&pipe.parsed);
+    queue_init(&pipe.decoded);
+    queue_init(&pipe.converted);
+
+    void* (*stage_fns[3])(void*) = { parse_thread, decode_thread, color_thread };
+    pthread_t threads[3];
+    int num_started = 0;
+    int result = 0;
+    for (int i = 0; i < 3; i++) {
+        if (pthread_create(&threads[i], NULL, stage_fns[i], &pipe) != 0) {
+            fprintf(stderr, "Failed to start MJPEG pipeline thread\n");
+            result = -1;
+            break;
+        }
+        num_started++;
+    }
+
+    if (result == 0) {
+        jpeg_decoder_t *frame;
+        while ((frame = queue_pop(&pipe.converted)) != NULL) {
+            int stop = frame_fn(frame, stats->frames, user_data);
+            jpeg_parser_destroy(frame);
+            stats->frames++;
+            if (stop) {
+                break;
+            }
+        }
+    }
+
+    /* Unblock stages still running after an early stop or a failed start */
+    queue_cancel(&pipe.parsed);
+    queue_cancel(&pipe.decoded);
+    queue_cancel(&pipe.converted);
+    for (int i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    queue_destroy(&pipe.parsed);
+    queue_destroy(&pipe.decoded);
+    queue_destroy(&pipe.converted);
+
+    stats->skipped = mjpeg_reader_skipped(pipe.reader) + pipe.decode_failures +
+                     pipe.color_failures;
+    stats->bytes = mjpeg_reader_bytes(pipe.reader);
+    stats->elapsed_ms = (jpeg_time_us() - t_start) / 1000.0;
+    stats->parse_ms = pipe.parse_us / 1000.0;
+    stats->decode_ms = pipe.decode_us / 1000.0;
+    stats->color_ms = pipe.color_us / 1000.0;
+    stats->segments_decoded = pipe.segments_decoded;
+    stats->segments_total = pipe.segments_total;
+    delta_reset(&pipe.delta);
+    mjpeg_reader_close(pipe.reader);
+    return result;
+}
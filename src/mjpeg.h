@@ -0,0 +1,66 @@
+#ifndef MJPEG_H
+#define MJPEG_H
+
+#include "../include/jpeg_types.h"
+
+/* Opaque splitter of a Motion-JPEG stream (concatenated JPEG frames, as
+ * sent by cameras) read from a file or pipe */
+typedef struct mjpeg_reader mjpeg_reader_t;
+
+/* Open path for reading ("-" = standard input) */
+mjpeg_reader_t* mjpeg_reader_open(const char *path);
+
+/* Read up to the end of the next frame and parse it. Huffman and
+ * quantization tables carry over from earlier frames, and scans that select
+ * tables no frame defined use the standard Annex K tables. Garbage between
+ * frames is skipped; frames that fail to parse are skipped and counted.
+ * Returns NULL at the end of the stream. */
+jpeg_decoder_t* mjpeg_reader_next(mjpeg_reader_t *reader);
+
+/* Bytes read and frames skipped so far */
+size_t mjpeg_reader_bytes(const mjpeg_reader_t *reader);
+unsigned long mjpeg_reader_skipped(const mjpeg_reader_t *reader);
+
+/* Close the input and free the reader */
+void mjpeg_reader_close(mjpeg_reader_t *reader);
+
+/* Decode settings applied to every frame */
+typedef struct {
+    int decode_threads;         /* Per frame, see jpeg_decoder_t */
+    idct_method_t idct_method;
+    bool fast_upsampling;
+    bool luma_only;
+
+    /* Keep the previous frame's planes and pixels and re-decode only the
+     * restart intervals whose entropy-coded bytes changed (frames without
+     * restart markers, or with new tables or geometry, decode in full).
+     * Decoding and conversion then both run on the decode thread. */
+    bool skip_unchanged;
+} mjpeg_options_t;
+
+/* Totals of mjpeg_decode_stream */
+typedef struct {
+    unsigned long frames;       /* Frames delivered to the callback */
+    unsigned long skipped;      /* Frames that failed to parse or decode */
+    size_t bytes;               /* Stream bytes read */
+    double elapsed_ms;          /* Wall time of the whole stream */
+    double parse_ms;            /* Busy time of each pipeline stage */
+    double decode_ms;
+    double color_ms;
+    unsigned long segments_decoded;  /* skip_unchanged: restart intervals decoded */
+    unsigned long segments_total;    /* ... out of this many */
+} mjpeg_stats_t;
+
+/* Called on the calling thread with each converted frame (image_data
+ * filled), in stream order. The frame is destroyed when it returns; a
+ * non-zero return stops the stream. */
+typedef int (*mjpeg_frame_fn)(jpeg_decoder_t *frame, unsigned long index, void *user_data);
+
+/* Decode every frame of path with parsing, decoding and color conversion of
+ * consecutive frames overlapped on three threads. Returns 0 when the stream
+ * was read to the end (or frame_fn stopped it), -1 if it could not be
+ * opened or a thread could not be started. */
+int mjpeg_decode_stream(const char *path, const mjpeg_options_t *options,
+                        mjpeg_frame_fn frame_fn, void *user_data, mjpeg_stats_t *stats);
+
+#endif /* MJPEG_H */
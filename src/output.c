@@ -1,33 +1,941 @@
+#define _DEFAULT_SOURCE  /* posix_memalign, pwritev */
 #include "output.h"
-#include <stdio.h>
+#include "color.h"
+#include "trace.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Large aligned output buffer; writes at least this big bypass it via writev */
+#define OUT_BUFFER_SIZE  (1 << 20)
+#define OUT_BUFFER_ALIGN 4096
+
+/* PNG / deflate parameters */
+#define PNG_IDAT_SIZE    (256 * 1024)   /* Compressed bytes per IDAT chunk */
+#define STORED_BLOCK_MAX 65535          /* Max payload of a stored deflate block */
+#define LZ_WINDOW        32768          /* Deflate distance limit */
+#define LZ_BUFFER        (2 * LZ_WINDOW)
+#define LZ_MIN_MATCH     3
+#define LZ_MAX_MATCH     258
+#define LZ_HASH_BITS     15
+#define LZ_HASH_SIZE     (1 << LZ_HASH_BITS)
+
+/* Maximum rows one MCU row can span in a component (v_sampling 4 x 8) */
+#define MAX_MCU_ROWS 32
+
+struct image_writer {
+    int fd;
+    output_format_t format;
+    int width;
+    int height;
+    int channels;               /* Samples per pixel of rows passed in */
+    int rows_written;
+    int failed;
+
+    /* Buffered sequential output */
+    uint8_t *buffer;
+    size_t used;
+
+    /* Row scratch (PNG filter byte + filtered row) */
+    uint8_t *scratch;
+    uint8_t *prev_row;
+
+    /* PNG state */
+    int png_level;
+    int png_channels;
+    uint32_t crc_table[256];
+    uint32_t adler_a;
+    uint32_t adler_b;
+    uint8_t *idat;              /* Compressed bytes waiting for the next IDAT chunk */
+    size_t idat_used;
+    uint8_t *stored;            /* Level 0: raw bytes of the current stored block */
+    size_t stored_used;
+    uint64_t bit_buffer;        /* Level 1: LSB-first deflate bit writer */
+    int bit_count;
+    uint8_t *window;            /* Level 1: LZ77 history + lookahead */
+    size_t window_pos;          /* Next byte to encode */
+    size_t window_end;          /* End of valid data */
+    int32_t *hash_head;         /* Most recent window position for each hash */
+    uint16_t lit_code[288];     /* Bit-reversed fixed Huffman codes */
+    uint8_t lit_bits[288];
+    uint16_t dist_code_rev[30];
+    uint8_t length_symbol[LZ_MAX_MATCH + 1];
+    uint8_t dist_symbol[512];
+
+    /* YUV planes */
+    int num_planes;
+    int plane_width[MAX_COMPONENTS];
+    int plane_height[MAX_COMPONENTS];
+    off_t plane_offset[MAX_COMPONENTS];
+
+    /* Streaming from the decoder */
+    jpeg_decoder_t *decoder;
+    int converted_rows;         /* Output rows already color converted */
+    uint8_t *band;              /* RGB rows converted per callback */
+    int band_rows;
+};
+
+/* Deflate length and distance code tables (RFC 1951, 3.2.5) */
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* ---- Low-level I/O ---- */
+
+/* Write an iovec array completely, retrying on partial writes */
+static int write_all_v(int fd, struct iovec *iov, int iovcnt) {
+    trace_begin("write");
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            trace_end();
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    trace_end();
+    return 0;
+}
+
+static int flush_buffer(image_writer_t *writer) {
+    if (writer->used == 0) {
+        return 0;
+    }
+    struct iovec iov = { writer->buffer, writer->used };
+    writer->used = 0;
+    if (write_all_v(writer->fd, &iov, 1) != 0) {
+        writer->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Append bytes to the output; large spans go straight to writev uncopied */
+static int out_write(image_writer_t *writer, const void *data, size_t len) {
+    if (writer->used + len <= OUT_BUFFER_SIZE) {
+        memcpy(writer->buffer + writer->used, data, len);
+        writer->used += len;
+        return 0;
+    }
+
+    if (len >= OUT_BUFFER_SIZE / 2) {
+        struct iovec iov[2] = {
+            { writer->buffer, writer->used },
+            { (void*)data, len }
+        };
+        writer->used = 0;
+        if (write_all_v(writer->fd, iov, 2) != 0) {
+            writer->failed = 1;
+            return -1;
+        }
+        return 0;
+    }
+
+    if (flush_buffer(writer) != 0) {
+        return -1;
+    }
+    memcpy(writer->buffer, data, len);
+    writer->used = len;
+    return 0;
+}
+
+/* Reserve len bytes at the end of the output buffer to fill in place */
+static uint8_t* out_reserve(image_writer_t *writer, size_t len) {
+    if (writer->used + len > OUT_BUFFER_SIZE && flush_buffer(writer) != 0) {
+        return NULL;
+    }
+    uint8_t *ptr = writer->buffer + writer->used;
+    writer->used += len;
+    return ptr;
+}
+
+static void put_uint32_be(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* ---- PNG container ---- */
+
+static void init_crc_table(uint32_t *table) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+}
+
+static uint32_t update_crc(const uint32_t *table, uint32_t crc, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/* Emit one PNG chunk: length, type, data, CRC */
+static int write_png_chunk(image_writer_t *writer, const char *type,
+                           const uint8_t *data, size_t len) {
+    uint8_t header[8];
+    put_uint32_be(header, (uint32_t)len);
+    memcpy(header + 4, type, 4);
+
+    uint32_t crc = update_crc(writer->crc_table, 0xFFFFFFFFu, header + 4, 4);
+    crc = update_crc(writer->crc_table, crc, data, len) ^ 0xFFFFFFFFu;
+    uint8_t trailer[4];
+    put_uint32_be(trailer, crc);
+
+    if (out_write(writer, header, 8) != 0) return -1;
+    if (len > 0 && out_write(writer, data, len) != 0) return -1;
+    return out_write(writer, trailer, 4);
+}
+
+/* Queue compressed bytes, emitting IDAT chunks as they fill */
+static int idat_write(image_writer_t *writer, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = PNG_IDAT_SIZE - writer->idat_used;
+        if (n > len) n = len;
+        memcpy(writer->idat + writer->idat_used, data, n);
+        writer->idat_used += n;
+        data += n;
+        len -= n;
+
+        if (writer->idat_used == PNG_IDAT_SIZE) {
+            if (write_png_chunk(writer, "IDAT", writer->idat, writer->idat_used) != 0) {
+                return -1;
+            }
+            writer->idat_used = 0;
+        }
+    }
+    return 0;
+}
+
+static void update_adler(image_writer_t *writer, const uint8_t *data, size_t len) {
+    uint32_t a = writer->adler_a;
+    uint32_t b = writer->adler_b;
+    while (len > 0) {
+        /* 5552 is the largest run that cannot overflow before the modulo */
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    writer->adler_a = a;
+    writer->adler_b = b;
+}
+
+/* ---- Deflate level 0: stored blocks ---- */
+
+static int emit_stored_block(image_writer_t *writer, int final) {
+    uint16_t len = (uint16_t)writer->stored_used;
+    uint8_t header[5] = {
+        (uint8_t)(final ? 1 : 0),
+        (uint8_t)(len & 0xFF), (uint8_t)(len >> 8),
+        (uint8_t)(~len & 0xFF), (uint8_t)((uint16_t)~len >> 8)
+    };
+    if (idat_write(writer, header, 5) != 0) return -1;
+    if (idat_write(writer, writer->stored, writer->stored_used) != 0) return -1;
+    writer->stored_used = 0;
+    return 0;
+}
+
+static int stored_feed(image_writer_t *writer, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = STORED_BLOCK_MAX - writer->stored_used;
+        if (n > len) n = len;
+        memcpy(writer->stored + writer->stored_used, data, n);
+        writer->stored_used += n;
+        data += n;
+        len -= n;
+
+        if (writer->stored_used == STORED_BLOCK_MAX && emit_stored_block(writer, 0) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ---- Deflate level 1: greedy LZ77 with the fixed Huffman code ---- */
+
+static unsigned reverse_bits(unsigned code, int len) {
+    unsigned result = 0;
+    for (int i = 0; i < len; i++) {
+        result = (result << 1) | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+static void init_fixed_codes(image_writer_t *writer) {
+    for (int sym = 0; sym < 288; sym++) {
+        unsigned code;
+        int len;
+        if (sym < 144)      { code = 0x30 + sym;          len = 8; }
+        else if (sym < 256) { code = 0x190 + (sym - 144); len = 9; }
+        else if (sym < 280) { code = sym - 256;           len = 7; }
+        else                { code = 0xC0 + (sym - 280);  len = 8; }
+        writer->lit_code[sym] = (uint16_t)reverse_bits(code, len);
+        writer->lit_bits[sym] = (uint8_t)len;
+    }
+    for (int d = 0; d < 30; d++) {
+        writer->dist_code_rev[d] = (uint16_t)reverse_bits(d, 5);
+    }
+
+    /* Match length -> length code index */
+    for (int code = 0; code < 29; code++) {
+        int count = 1 << length_extra[code];
+        for (int i = 0; i < count && length_base[code] + i <= LZ_MAX_MATCH; i++) {
+            writer->length_symbol[length_base[code] + i] = (uint8_t)code;
+        }
+    }
+    /* 258 has its own code, not the top of the 227+31 range */
+    writer->length_symbol[LZ_MAX_MATCH] = 28;
+
+    /* Distance-1 -> distance code, zlib style: direct below 256, then by 128s */
+    for (int code = 0; code < 30; code++) {
+        int count = 1 << dist_extra[code];
+        for (int i = 0; i < count; i++) {
+            int d = dist_base[code] + i - 1;
+            if (d < 256) {
+                writer->dist_symbol[d] = (uint8_t)code;
+            } else {
+                writer->dist_symbol[256 + (d >> 7)] = (uint8_t)code;
+            }
+        }
+    }
+}
+
+static int put_bits(image_writer_t *writer, uint32_t bits, int count) {
+    writer->bit_buffer |= (uint64_t)bits << writer->bit_count;
+    writer->bit_count += count;
+
+    if (writer->bit_count >= 32) {
+        uint8_t bytes[4] = {
+            (uint8_t)writer->bit_buffer, (uint8_t)(writer->bit_buffer >> 8),
+            (uint8_t)(writer->bit_buffer >> 16), (uint8_t)(writer->bit_buffer >> 24)
+        };
+        writer->bit_buffer >>= 32;
+        writer->bit_count -= 32;
+        return idat_write(writer, bytes, 4);
+    }
+    return 0;
+}
+
+static int flush_bits(image_writer_t *writer) {
+    while (writer->bit_count > 0) {
+        uint8_t byte = (uint8_t)writer->bit_buffer;
+        writer->bit_buffer >>= 8;
+        writer->bit_count = writer->bit_count > 8 ? writer->bit_count - 8 : 0;
+        if (idat_write(writer, &byte, 1) != 0) return -1;
+    }
+    writer->bit_buffer = 0;
+    return 0;
+}
+
+static int put_literal(image_writer_t *writer, int sym) {
+    return put_bits(writer, writer->lit_code[sym], writer->lit_bits[sym]);
+}
+
+static int put_match(image_writer_t *writer, int length, int distance) {
+    int lcode = writer->length_symbol[length];
+    int sym = 257 + lcode;
+    if (put_bits(writer, writer->lit_code[sym], writer->lit_bits[sym]) != 0) return -1;
+    if (length_extra[lcode] &&
+        put_bits(writer, length - length_base[lcode], length_extra[lcode]) != 0) return -1;
+
+    int d = distance - 1;
+    int dcode = d < 256 ? writer->dist_symbol[d] : writer->dist_symbol[256 + (d >> 7)];
+    if (put_bits(writer, writer->dist_code_rev[dcode], 5) != 0) return -1;
+    if (dist_extra[dcode] &&
+        put_bits(writer, distance - dist_base[dcode], dist_extra[dcode]) != 0) return -1;
+    return 0;
+}
+
+static unsigned lz_hash(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Encode window data up to limit (keeping lookahead unless final) */
+static int lz_compress(image_writer_t *writer, size_t limit) {
+    uint8_t *win = writer->window;
+    size_t pos = writer->window_pos;
+    size_t end = writer->window_end;
+
+    while (pos < limit) {
+        int best_len = 0;
+        size_t best_dist = 0;
+
+        if (pos + LZ_MIN_MATCH <= end) {
+            unsigned h = lz_hash(win + pos);
+            int32_t candidate = writer->hash_head[h];
+            writer->hash_head[h] = (int32_t)pos;
+
+            if (candidate >= 0 && pos - (size_t)candidate <= LZ_WINDOW) {
+                size_t max_len = end - pos;
+                if (max_len > LZ_MAX_MATCH) max_len = LZ_MAX_MATCH;
+                const uint8_t *a = win + candidate;
+                const uint8_t *b = win + pos;
+                size_t len = 0;
+                while (len < max_len && a[len] == b[len]) {
+                    len++;
+                }
+                if (len >= LZ_MIN_MATCH) {
+                    best_len = (int)len;
+                    best_dist = pos - (size_t)candidate;
+                }
+            }
+        }
+
+        if (best_len > 0) {
+            if (put_match(writer, best_len, (int)best_dist) != 0) return -1;
+            pos += best_len;
+        } else {
+            if (put_literal(writer, win[pos]) != 0) return -1;
+            pos++;
+        }
+    }
+
+    writer->window_pos = pos;
+    return 0;
+}
+
+static int lz_feed(image_writer_t *writer, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        /* Slide the window once it is full, keeping LZ_WINDOW of history */
+        if (writer->window_end == LZ_BUFFER) {
+            memmove(writer->window, writer->window + LZ_WINDOW, LZ_WINDOW);
+            writer->window_pos -= LZ_WINDOW;
+            writer->window_end -= LZ_WINDOW;
+            for (int i = 0; i < LZ_HASH_SIZE; i++) {
+                int32_t p = writer->hash_head[i];
+                writer->hash_head[i] = p >= LZ_WINDOW ? p - LZ_WINDOW : -1;
+            }
+        }
+
+        size_t n = LZ_BUFFER - writer->window_end;
+        if (n > len) n = len;
+        memcpy(writer->window + writer->window_end, data, n);
+        writer->window_end += n;
+        data += n;
+        len -= n;
+
+        /* Leave a full match of lookahead for the next feed */
+        if (writer->window_end > LZ_MAX_MATCH &&
+            lz_compress(writer, writer->window_end - LZ_MAX_MATCH) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Feed filtered scanline bytes into the zlib stream */
+static int deflate_feed(image_writer_t *writer, const uint8_t *data, size_t len) {
+    update_adler(writer, data, len);
+    return writer->png_level == 0 ? stored_feed(writer, data, len)
+                                  : lz_feed(writer, data, len);
+}
+
+static int deflate_finish(image_writer_t *writer) {
+    if (writer->png_level == 0) {
+        if (emit_stored_block(writer, 1) != 0) return -1;
+    } else {
+        if (lz_compress(writer, writer->window_end) != 0) return -1;
+        /* End this block, then an empty final fixed block */
+        if (put_literal(writer, 256) != 0) return -1;
+        if (put_bits(writer, 1 | (1 << 1), 3) != 0) return -1;  /* BFINAL=1, BTYPE=01 */
+        if (put_literal(writer, 256) != 0) return -1;
+        if (flush_bits(writer) != 0) return -1;
+    }
+
+    uint8_t adler[4];
+    put_uint32_be(adler, (writer->adler_b << 16) | writer->adler_a);
+    if (idat_write(writer, adler, 4) != 0) return -1;
+
+    if (writer->idat_used > 0 &&
+        write_png_chunk(writer, "IDAT", writer->idat, writer->idat_used) != 0) {
+        return -1;
+    }
+    writer->idat_used = 0;
+    return write_png_chunk(writer, "IEND", NULL, 0);
+}
+
+static int png_begin(image_writer_t *writer) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    writer->png_channels = writer->channels;
+    writer->scratch = (uint8_t*)jpeg_malloc((size_t)writer->width * writer->png_channels + 1);
+    writer->prev_row = (uint8_t*)jpeg_malloc((size_t)writer->width * writer->png_channels);
+    memset(writer->prev_row, 0, (size_t)writer->width * writer->png_channels);
+    writer->idat = (uint8_t*)jpeg_malloc(PNG_IDAT_SIZE);
+    writer->adler_a = 1;
+    writer->adler_b = 0;
+    init_crc_table(writer->crc_table);
+
+    if (writer->png_level == 0) {
+        writer->stored = (uint8_t*)jpeg_malloc(STORED_BLOCK_MAX);
+    } else {
+        writer->window = (uint8_t*)jpeg_malloc(LZ_BUFFER);
+        writer->hash_head = (int32_t*)jpeg_malloc(LZ_HASH_SIZE * sizeof(int32_t));
+        for (int i = 0; i < LZ_HASH_SIZE; i++) {
+            writer->hash_head[i] = -1;
+        }
+        init_fixed_codes(writer);
+    }
+
+    uint8_t ihdr[13];
+    put_uint32_be(ihdr, (uint32_t)writer->width);
+    put_uint32_be(ihdr + 4, (uint32_t)writer->height);
+    ihdr[8] = 8;                                    /* Bit depth */
+    ihdr[9] = writer->png_channels == 3 ? 2 : 0;    /* Truecolor or grayscale */
+    ihdr[10] = 0;                                   /* Deflate */
+    ihdr[11] = 0;                                   /* Adaptive filtering */
+    ihdr[12] = 0;                                   /* No interlace */
+
+    uint8_t zlib_header[2] = { 0x78, 0x01 };        /* 32K window, fastest */
+
+    if (out_write(writer, signature, 8) != 0) return -1;
+    if (write_png_chunk(writer, "IHDR", ihdr, 13) != 0) return -1;
+    if (idat_write(writer, zlib_header, 2) != 0) return -1;
+
+    /* Level 1 emits one long fixed-Huffman block: BFINAL=0, BTYPE=01 */
+    return writer->png_level == 0 ? 0 : put_bits(writer, 1 << 1, 3);
+}
+
+/* Filter and compress one scanline: none for stored, Up for level 1 */
+static int png_write_row(image_writer_t *writer, const uint8_t *row) {
+    size_t row_bytes = (size_t)writer->width * writer->png_channels;
+
+    if (writer->png_level == 0) {
+        uint8_t filter = 0;
+        if (deflate_feed(writer, &filter, 1) != 0) return -1;
+        return deflate_feed(writer, row, row_bytes);
+    }
+
+    uint8_t *out = writer->scratch;
+    out[0] = 2;  /* Up */
+    for (size_t i = 0; i < row_bytes; i++) {
+        out[i + 1] = (uint8_t)(row[i] - writer->prev_row[i]);
+    }
+    memcpy(writer->prev_row, row, row_bytes);
+    return deflate_feed(writer, out, row_bytes + 1);
+}
+
+/* ---- YUV planes ---- */
+
+/* Write rows [first, first + count) of one plane at its file offset */
+static int yuv_write_plane_rows(image_writer_t *writer, int plane, int first,
+                                const uint8_t *src, size_t stride, int count) {
+    struct iovec iov[MAX_MCU_ROWS];
+    while (count > 0) {
+        int n = count < MAX_MCU_ROWS ? count : MAX_MCU_ROWS;
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = (void*)(src + (size_t)i * stride);
+            iov[i].iov_len = writer->plane_width[plane];
+        }
+
+        off_t offset = writer->plane_offset[plane] + (off_t)first * writer->plane_width[plane];
+        size_t expected = (size_t)n * writer->plane_width[plane];
+        ssize_t written = pwritev(writer->fd, iov, n, offset);
+        if (written < 0 || (size_t)written != expected) {
+            writer->failed = 1;
+            return -1;
+        }
+
+        src += (size_t)n * stride;
+        first += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* ---- Writer API ---- */
+
+int output_format_from_filename(const char *filename, output_format_t *format) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot) return -1;
+
+    if (strcasecmp(dot, ".ppm") == 0) { *format = OUTPUT_PPM; return 0; }
+    if (strcasecmp(dot, ".pgm") == 0) { *format = OUTPUT_PGM; return 0; }
+    if (strcasecmp(dot, ".yuv") == 0) { *format = OUTPUT_YUV; return 0; }
+    if (strcasecmp(dot, ".png") == 0) { *format = OUTPUT_PNG; return 0; }
+    return -1;
+}
+
+static image_writer_t* writer_create(const char *filename, output_format_t format,
+                                     int width, int height, int channels, int png_level) {
+    if (channels != 1 && channels != 3) {
+        fprintf(stderr, "Unsupported number of channels: %d\n", channels);
+        return NULL;
+    }
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open output file: %s\n", filename);
+        return NULL;
+    }
+
+    image_writer_t *writer = (image_writer_t*)jpeg_malloc(sizeof(image_writer_t));
+    memset(writer, 0, sizeof(image_writer_t));
+    writer->fd = fd;
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->channels = channels;
+    writer->png_level = png_level > 0 ? 1 : 0;
+
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, OUT_BUFFER_ALIGN, OUT_BUFFER_SIZE) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close(fd);
+        jpeg_free(writer);
+        return NULL;
+    }
+    writer->buffer = (uint8_t*)buffer;
+
+    return writer;
+}
+
+/* Write the file header for sequential formats */
+static int writer_begin(image_writer_t *writer) {
+    char header[64];
+    int len;
+
+    switch (writer->format) {
+        case OUTPUT_PPM:
+            len = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", writer->width, writer->height);
+            return out_write(writer, header, len);
+        case OUTPUT_PGM:
+            len = snprintf(header, sizeof(header), "P5\n%d %d\n255\n", writer->width, writer->height);
+            return out_write(writer, header, len);
+        case OUTPUT_PNG:
+            return png_begin(writer);
+        case OUTPUT_YUV:
+            return 0;
+    }
+    return -1;
+}
+
+static void writer_free(image_writer_t *writer) {
+    free(writer->buffer);  /* From posix_memalign */
+    jpeg_free(writer->scratch);
+    jpeg_free(writer->prev_row);
+    jpeg_free(writer->idat);
+    jpeg_free(writer->stored);
+    jpeg_free(writer->window);
+    jpeg_free(writer->hash_head);
+    jpeg_free(writer->band);
+    jpeg_free(writer);
+}
+
+image_writer_t* image_writer_open(const char *filename, output_format_t format,
+                                  int width, int height, int channels, int png_level) {
+    if (format == OUTPUT_YUV && channels != 1) {
+        fprintf(stderr, "YUV output needs decoder planes (use image_writer_open_decoder)\n");
+        return NULL;
+    }
+
+    image_writer_t *writer = writer_create(filename, format, width, height, channels, png_level);
+    if (!writer) {
+        return NULL;
+    }
+
+    if (format == OUTPUT_YUV) {
+        /* Grayscale: a single Y plane */
+        writer->num_planes = 1;
+        writer->plane_width[0] = width;
+        writer->plane_height[0] = height;
+    }
+
+    if (writer_begin(writer) != 0) {
+        fprintf(stderr, "Failed to write header: %s\n", filename);
+        close(writer->fd);
+        writer_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+/* Append rows */
+int image_writer_write_rows(image_writer_t *writer, const uint8_t *rows,
+                            size_t stride, int num_rows) {
+    if (writer->failed) {
+        return -1;
+    }
+    if (writer->rows_written + num_rows > writer->height) {
+        fprintf(stderr, "Too many rows written to image\n");
+        writer->failed = 1;
+        return -1;
+    }
+
+    int width = writer->width;
+    size_t row_bytes = (size_t)width * writer->channels;
+    int result = 0;
+
+    switch (writer->format) {
+        case OUTPUT_PPM:
+            if (writer->channels == 3) {
+                if (stride == row_bytes) {
+                    /* Contiguous: one write for the whole band */
+                    result = out_write(writer, rows, row_bytes * num_rows);
+                } else {
+                    for (int y = 0; y < num_rows && result == 0; y++) {
+                        result = out_write(writer, rows + y * stride, row_bytes);
+                    }
+                }
+            } else {
+                /* Grayscale - expand to RGB directly in the output buffer */
+                for (int y = 0; y < num_rows && result == 0; y++) {
+                    const uint8_t *src = rows + y * stride;
+                    uint8_t *dst = out_reserve(writer, (size_t)width * 3);
+                    if (!dst) {
+                        result = -1;
+                        break;
+                    }
+                    for (int x = 0; x < width; x++) {
+                        dst[x * 3 + 0] = src[x];
+                        dst[x * 3 + 1] = src[x];
+                        dst[x * 3 + 2] = src[x];
+                    }
+                }
+            }
+            break;
+
+        case OUTPUT_PGM:
+            if (writer->channels == 1) {
+                if (stride == row_bytes) {
+                    result = out_write(writer, rows, row_bytes * num_rows);
+                } else {
+                    for (int y = 0; y < num_rows && result == 0; y++) {
+                        result = out_write(writer, rows + y * stride, row_bytes);
+                    }
+                }
+            } else {
+                /* RGB input - write BT.601 luma */
+                for (int y = 0; y < num_rows && result == 0; y++) {
+                    const uint8_t *src = rows + y * stride;
+                    uint8_t *dst = out_reserve(writer, width);
+                    if (!dst) {
+                        result = -1;
+                        break;
+                    }
+                    for (int x = 0; x < width; x++) {
+                        dst[x] = (uint8_t)((19595 * src[x * 3] + 38470 * src[x * 3 + 1] +
+                                            7471 * src[x * 3 + 2] + 32768) >> 16);
+                    }
+                }
+            }
+            break;
+
+        case OUTPUT_PNG:
+            for (int y = 0; y < num_rows && result == 0; y++) {
+                result = png_write_row(writer, rows + y * stride);
+            }
+            break;
+
+        case OUTPUT_YUV:
+            result = yuv_write_plane_rows(writer, 0, writer->rows_written, rows, stride, num_rows);
+            break;
+    }
+
+    if (result != 0) {
+        writer->failed = 1;
+        return -1;
+    }
+
+    writer->rows_written += num_rows;
+    return 0;
+}
+
+/* Decoder row callback: write everything that became final */
+static int on_decoded_rows(jpeg_decoder_t *decoder, int first_row, int num_rows, void *user_data) {
+    image_writer_t *writer = (image_writer_t*)user_data;
+    int last_row = first_row + num_rows;
+    int is_last = (last_row >= decoder->frame.height);
+
+    if (writer->format == OUTPUT_YUV) {
+        int mcu_row = first_row / decoder->mcu_size_y;
+        for (int c = 0; c < writer->num_planes; c++) {
+            int rows_per_mcu = decoder->frame.components[c].v_sampling * 8;
+            int start = mcu_row * rows_per_mcu;
+            int end = start + rows_per_mcu;
+            if (end > writer->plane_height[c]) end = writer->plane_height[c];
+            if (start >= end) continue;
+
+            const uint8_t *src = decoder->component_buffers[c] +
+                                 (size_t)start * decoder->component_width[c];
+            if (yuv_write_plane_rows(writer, c, start, src,
+                                     decoder->component_width[c], end - start) != 0) {
+                return -1;
+            }
+        }
+        writer->rows_written = last_row;
+        return 0;
+    }
+
+    /* Luma or grayscale rows need no conversion: write them straight away */
+    if (writer->channels == 1) {
+        return image_writer_write_rows(writer,
+                                       decoder->component_buffers[0] +
+                                       (size_t)first_row * decoder->component_width[0],
+                                       decoder->component_width[0], num_rows);
+    }
+
+    /* Color: upsampling needs the next MCU row's chroma, so lag one MCU row */
+    int ready = is_last ? decoder->frame.height : first_row;
+    while (writer->converted_rows < ready) {
+        int n = ready - writer->converted_rows;
+        if (n > writer->band_rows) n = writer->band_rows;
+
+        size_t stride = (size_t)writer->width * 3;
+        if (ycbcr_to_rgb_rows(decoder, writer->converted_rows,
+                              writer->converted_rows + n, writer->band, stride) != 0 ||
+            image_writer_write_rows(writer, writer->band, stride, n) != 0) {
+            return -1;
+        }
+        writer->converted_rows += n;
+    }
+    return 0;
+}
+
+image_writer_t* image_writer_open_decoder(const char *filename, output_format_t format,
+                                          jpeg_decoder_t *decoder, int png_level) {
+    int width = decoder->frame.width;
+    int height = decoder->frame.height;
+    int components = decoder->frame.num_components;
+
+    if (components != 1 && components != 3) {
+        fprintf(stderr, "Unsupported number of components: %d\n", components);
+        return NULL;
+    }
+
+    /* PGM (and luma-only decoding) writes the luma plane as-is; no color
+     * conversion at all */
+    int channels = (format == OUTPUT_PGM || decoder->luma_only) ? 1 : components;
+
+    image_writer_t *writer = writer_create(filename, format, width, height, channels, png_level);
+    if (!writer) {
+        return NULL;
+    }
+
+    writer->decoder = decoder;
+
+    if (format == OUTPUT_YUV) {
+        /* Planes are written at their native sampling */
+        decoder->idct_upsampling = false;
+
+        off_t offset = 0;
+        writer->num_planes = decoder->luma_only ? 1 : components;
+        for (int c = 0; c < writer->num_planes; c++) {
+            component_info_t *comp = &decoder->frame.components[c];
+            writer->plane_width[c] = (width * comp->h_sampling + decoder->max_h_sampling - 1) /
+                                     decoder->max_h_sampling;
+            writer->plane_height[c] = (height * comp->v_sampling + decoder->max_v_sampling - 1) /
+                                      decoder->max_v_sampling;
+            writer->plane_offset[c] = offset;
+            offset += (off_t)writer->plane_width[c] * writer->plane_height[c];
+            JPEG_LOG("  YUV plane %d: %dx%d at offset %lld\n", c, writer->plane_width[c],
+                     writer->plane_height[c], (long long)writer->plane_offset[c]);
+        }
+    } else if (channels == 3) {
+        writer->band_rows = 2 * decoder->mcu_size_y;
+        writer->band = (uint8_t*)jpeg_malloc((size_t)width * 3 * writer->band_rows);
+    }
+
+    if (writer_begin(writer) != 0) {
+        fprintf(stderr, "Failed to write header: %s\n", filename);
+        close(writer->fd);
+        writer_free(writer);
+        return NULL;
+    }
+
+    decoder->row_callback = on_decoded_rows;
+    decoder->row_callback_data = writer;
+    return writer;
+}
+
+/* Finish and close the file */
+int image_writer_close(image_writer_t *writer) {
+    int result = writer->failed ? -1 : 0;
+
+    if (result == 0 && writer->rows_written != writer->height) {
+        fprintf(stderr, "Incomplete image: %d of %d rows written\n",
+                writer->rows_written, writer->height);
+        result = -1;
+    }
+
+    if (result == 0 && writer->format == OUTPUT_PNG && deflate_finish(writer) != 0) {
+        result = -1;
+    }
+    if (flush_buffer(writer) != 0) {
+        result = -1;
+    }
+    if (close(writer->fd) != 0) {
+        result = -1;
+    }
+
+    if (writer->decoder && writer->decoder->row_callback_data == writer) {
+        writer->decoder->row_callback = NULL;
+        writer->decoder->row_callback_data = NULL;
+    }
+
+    if (result != 0) {
+        fprintf(stderr, "Failed to write output file\n");
+    }
+
+    writer_free(writer);
+    return result;
+}
 
 /* Save image as PPM file for comparison */
 int save_ppm(const char *filename, const uint8_t *image_data,
              int width, int height, int channels) {
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        fprintf(stderr, "Failed to open output file: %s\n", filename);
+    image_writer_t *writer = image_writer_open(filename, OUTPUT_PPM, width, height, channels, 0);
+    if (!writer) {
         return -1;
     }
 
-    /* Write PPM header */
-    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    if (image_writer_write_rows(writer, image_data, (size_t)width * channels, height) != 0) {
+        image_writer_close(writer);
+        return -1;
+    }
 
-    /* Write pixel data */
-    if (channels == 3) {
-        /* RGB - write directly */
-        fwrite(image_data, 1, width * height * 3, f);
-    } else if (channels == 1) {
-        /* Grayscale - convert to RGB by duplicating */
-        for (int i = 0; i < width * height; i++) {
-            uint8_t gray = image_data[i];
-            fwrite(&gray, 1, 1, f);
-            fwrite(&gray, 1, 1, f);
-            fwrite(&gray, 1, 1, f);
-        }
+    if (image_writer_close(writer) != 0) {
+        return -1;
     }
 
-    fclose(f);
-    printf("Saved output to: %s\n", filename);
+    JPEG_LOG("Saved output to: %s\n", filename);
     return 0;
 }
@@ -1,7 +1,39 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
-#include <stdint.h>
+#include "../include/jpeg_types.h"
+
+/* Output file formats */
+typedef enum {
+    OUTPUT_PPM,         /* Binary RGB (P6); grayscale is expanded */
+    OUTPUT_PGM,         /* Binary grayscale (P5); color images write luma */
+    OUTPUT_YUV,         /* Raw planar Y, Cb, Cr at native sampling */
+    OUTPUT_PNG          /* PNG, stored (level 0) or fast fixed-Huffman (level 1) */
+} output_format_t;
+
+/* Opaque row-oriented buffered image writer */
+typedef struct image_writer image_writer_t;
+
+/* Pick a format from the file extension (.ppm, .pgm, .yuv, .png) */
+int output_format_from_filename(const char *filename, output_format_t *format);
+
+/* Open a writer for width x height rows of 1 (gray) or 3 (RGB) channels.
+ * png_level selects stored (0) or fast (1) deflate for PNG output. */
+image_writer_t* image_writer_open(const char *filename, output_format_t format,
+                                  int width, int height, int channels, int png_level);
+
+/* Open a writer fed directly by jpeg_decode: installs a row callback on the
+ * decoder so each MCU row is converted and written as soon as it is final.
+ * Call after parsing and before jpeg_decode. */
+image_writer_t* image_writer_open_decoder(const char *filename, output_format_t format,
+                                          jpeg_decoder_t *decoder, int png_level);
+
+/* Append num_rows rows (stride bytes apart) to the image */
+int image_writer_write_rows(image_writer_t *writer, const uint8_t *rows,
+                            size_t stride, int num_rows);
+
+/* Finish the file; fails if not all rows were written or I/O failed */
+int image_writer_close(image_writer_t *writer);
 
 /* Save image as PPM file for comparison */
 int save_ppm(const char *filename, const uint8_t *image_data,
@@ -0,0 +1,210 @@
+#define _DEFAULT_SOURCE  /* syscall() */
+#include "perf.h"
+#include "utils.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} perf_counter_t;
+
+static const char *stage_names[PERF_STAGE_COUNT] = {
+    "parse", "huffman", "idct", "store", "upsample", "color", "upload"
+};
+
+struct perf_profile {
+    int fds[PERF_COUNTER_COUNT];        /* -1 where the counter is unavailable */
+    int slots[PERF_COUNTER_COUNT];      /* Position in a group read, -1 if not open */
+    int num_open;
+    perf_stage_t current;
+    double last[PERF_COUNTER_COUNT];    /* Scaled totals at the previous enter */
+    double counts[PERF_STAGE_COUNT][PERF_COUNTER_COUNT];
+    unsigned long entries[PERF_STAGE_COUNT];
+};
+
+#ifdef __linux__
+
+typedef struct {
+    uint32_t type;
+    uint64_t config;
+} perf_counter_def_t;
+
+static const perf_counter_def_t counter_defs[PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+static int open_counter(const perf_counter_def_t *def, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = def->type;
+    attr.config = def->config;
+    attr.disabled = group_fd == -1;     /* The leader starts the whole group */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* This thread, any CPU */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* Read the group, scaled up if the kernel had to multiplex it */
+static int read_counters(const perf_profile_t *profile, double values[PERF_COUNTER_COUNT]) {
+    uint64_t buffer[3 + PERF_COUNTER_COUNT];
+    ssize_t size = read(profile->fds[PERF_CYCLES], buffer, sizeof(buffer));
+    if (size < (ssize_t)(3 * sizeof(uint64_t))) {
+        return -1;
+    }
+
+    uint64_t enabled = buffer[1];
+    uint64_t running = buffer[2];
+    double scale = running > 0 ? (double)enabled / (double)running : 0.0;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        int slot = profile->slots[c];
+        values[c] = slot >= 0 && (uint64_t)slot < buffer[0] ? buffer[3 + slot] * scale : 0.0;
+    }
+    return 0;
+}
+
+perf_profile_t* perf_profile_open(void) {
+    perf_profile_t *profile = (perf_profile_t*)jpeg_malloc(sizeof(perf_profile_t));
+    memset(profile, 0, sizeof(perf_profile_t));
+    profile->current = PERF_STAGE_NONE;
+
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        int group_fd = c == PERF_CYCLES ? -1 : profile->fds[PERF_CYCLES];
+        profile->fds[c] = open_counter(&counter_defs[c], group_fd);
+        profile->slots[c] = profile->fds[c] >= 0 ? profile->num_open++ : -1;
+
+        if (profile->fds[c] < 0 && c == PERF_CYCLES) {
+            if (errno == ENOENT || errno == EOPNOTSUPP) {
+                fprintf(stderr, "No hardware performance counters (virtual machine without a PMU?)\n");
+            } else {
+                fprintf(stderr, "perf_event_open failed: %s (see /proc/sys/kernel/perf_event_paranoid)\n",
+                        strerror(errno));
+            }
+            jpeg_free(profile);
+            return NULL;
+        }
+    }
+
+    JPEG_LOG("Hardware counters: %d of %d available\n", profile->num_open, PERF_COUNTER_COUNT);
+    ioctl(profile->fds[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(profile->fds[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return profile;
+}
+
+void perf_profile_enter(perf_profile_t *profile, perf_stage_t stage) {
+    if (!profile) {
+        return;
+    }
+
+    double now[PERF_COUNTER_COUNT];
+    if (read_counters(profile, now) != 0) {
+        return;
+    }
+    if (profile->current != PERF_STAGE_NONE) {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            profile->counts[profile->current][c] += now[c] - profile->last[c];
+        }
+    }
+    memcpy(profile->last, now, sizeof(now));
+
+    if (stage != PERF_STAGE_NONE && stage != profile->current) {
+        profile->entries[stage]++;
+    }
+    profile->current = stage;
+}
+
+void perf_profile_close(perf_profile_t *profile) {
+    if (!profile) {
+        return;
+    }
+    for (int c = PERF_COUNTER_COUNT - 1; c >= 0; c--) {
+        if (profile->fds[c] >= 0) {
+            close(profile->fds[c]);
+        }
+    }
+    jpeg_free(profile);
+}
+
+#else
+
+perf_profile_t* perf_profile_open(void) {
+    fprintf(stderr, "Hardware counter profiling needs Linux perf_event_open\n");
+    return NULL;
+}
+
+void perf_profile_enter(perf_profile_t *profile, perf_stage_t stage) {
+    (void)profile;
+    (void)stage;
+}
+
+void perf_profile_close(perf_profile_t *profile) {
+    (void)profile;
+}
+
+#endif /* __linux__ */
+
+/* A per-megapixel column, or "-" for a counter that is not open */
+static void print_per_mp(const perf_profile_t *profile, perf_stage_t stage,
+                         perf_counter_t counter, double megapixels) {
+    if (profile->slots[counter] < 0) {
+        printf(" %12s", "-");
+    } else {
+        printf(" %12.0f", profile->counts[stage][counter] / megapixels);
+    }
+}
+
+void perf_profile_report(const perf_profile_t *profile, int width, int height) {
+    if (!profile) {
+        return;
+    }
+    double megapixels = (double)width * height / 1e6;
+    if (megapixels <= 0.0) {
+        return;
+    }
+
+    printf("\nHardware counters (user space, decoding thread; per MP of %dx%d):\n",
+           width, height);
+    printf("  %-9s %10s %10s %6s %12s %12s %12s\n", "stage", "Mcycles", "Minstr", "IPC",
+           "L1D miss/MP", "LLC miss/MP", "br miss/MP");
+
+    for (int s = 0; s < PERF_STAGE_COUNT; s++) {
+        const double *counts = profile->counts[s];
+        if (profile->entries[s] == 0) {
+            continue;
+        }
+        double ipc = counts[PERF_CYCLES] > 0.0
+            ? counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES] : 0.0;
+
+        printf("  %-9s %10.2f", stage_names[s], counts[PERF_CYCLES] / 1e6);
+        if (profile->slots[PERF_INSTRUCTIONS] < 0) {
+            printf(" %10s %6s", "-", "-");
+        } else {
+            printf(" %10.2f %6.2f", counts[PERF_INSTRUCTIONS] / 1e6, ipc);
+        }
+        print_per_mp(profile, (perf_stage_t)s, PERF_L1D_MISSES, megapixels);
+        print_per_mp(profile, (perf_stage_t)s, PERF_LLC_MISSES, megapixels);
+        print_per_mp(profile, (perf_stage_t)s, PERF_BRANCH_MISSES, megapixels);
+        printf("\n");
+    }
+}
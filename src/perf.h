@@ -0,0 +1,36 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "../include/jpeg_types.h"
+
+/* Decode stages that hardware counters are attributed to */
+typedef enum {
+    PERF_STAGE_NONE = -1,       /* Not attributed (I/O, bookkeeping) */
+    PERF_STAGE_PARSE,           /* Marker parsing */
+    PERF_STAGE_HUFFMAN,         /* Entropy decoding */
+    PERF_STAGE_IDCT,            /* Dequantization and IDCT */
+    PERF_STAGE_STORE,           /* Block stores into the component planes */
+    PERF_STAGE_UPSAMPLE,        /* Chroma upsampling */
+    PERF_STAGE_COLOR,           /* YCbCr to RGB (or gray copy) */
+    PERF_STAGE_UPLOAD,          /* Display texture upload */
+    PERF_STAGE_COUNT
+} perf_stage_t;
+
+/* Open cycle, instruction, L1D miss, LLC miss and branch miss counters for
+ * the calling thread (user space only, via perf_event_open). Counters the
+ * CPU or kernel does not offer are left out; returns NULL, with a message,
+ * if none can be opened or the platform is not Linux. */
+perf_profile_t* perf_profile_open(void);
+
+/* Charge the counts since the previous call to the stage then active and
+ * make stage the active one. One read() per call, so call it around whole
+ * rows or passes, not per block. NULL profile: no-op. Not thread-safe: only
+ * the thread that opened the profile may call it. */
+void perf_profile_enter(perf_profile_t *profile, perf_stage_t stage);
+
+/* Print per-stage counts, IPC and misses per megapixel of a width x height image */
+void perf_profile_report(const perf_profile_t *profile, int width, int height);
+
+void perf_profile_close(perf_profile_t *profile);
+
+#endif /* PERF_H */
@@ -0,0 +1,88 @@
+#include "preview.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "color.h"
+#include "display.h"
+#include "trace.h"
+#include "utils.h"
+#include <pthread.h>
+
+/* State shared between the render thread and the full decode */
+typedef struct {
+    jpeg_decoder_t *decoder;
+    display_t *display;
+    int result;
+} full_decode_t;
+
+int jpeg_decode_exif_preview(const jpeg_decoder_t *decoder, decoded_image_t *preview) {
+    jpeg_decoder_t *thumbnail = jpeg_parser_init_exif_thumbnail(decoder);
+    if (!thumbnail) {
+        return -1;
+    }
+    int result = decode_parsed_image(thumbnail, preview);
+    jpeg_parser_destroy(thumbnail);
+    return result;
+}
+
+static void* full_decode_thread(void *arg) {
+    full_decode_t *job = (full_decode_t*)arg;
+    jpeg_decoder_t *decoder = job->decoder;
+
+    trace_thread_name("full decode");
+
+    job->result = jpeg_decode(decoder);
+    if (job->result == 0 && ycbcr_to_rgb(decoder) != 0) {
+        job->result = -1;
+    }
+    if (job->result != 0) {
+        return NULL;
+    }
+
+    char title[256];
+    snprintf(title, sizeof(title), "JPEG Viewer - %dx%d", decoder->width, decoder->height);
+    display_post_image(job->display, decoder->image_data, decoder->width, decoder->height,
+                       decoder->channels, title);
+    job->result = 0;
+    return NULL;
+}
+
+int view_with_preview(jpeg_decoder_t *decoder, const decoded_image_t *preview) {
+    display_t *display = display_create_preview(preview->pixels, preview->width,
+                                                preview->height, preview->channels,
+                                                decoder->frame.width, decoder->frame.height);
+    if (!display) {
+        return -1;
+    }
+
+    char title[256];
+    snprintf(title, sizeof(title), "JPEG Viewer - %dx%d (preview)",
+             decoder->frame.width, decoder->frame.height);
+    display_set_image(display, preview->pixels, preview->width, preview->height,
+                      preview->channels, title);
+
+    full_decode_t job;
+    job.decoder = decoder;
+    job.display = display;
+    job.result = 0;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, full_decode_thread, &job) != 0) {
+        fprintf(stderr, "Failed to start decode thread\n");
+        display_destroy(display);
+        return -1;
+    }
+
+    JPEG_LOG("Showing %dx%d EXIF preview while decoding\n", preview->width, preview->height);
+    int result = display_run(display);
+
+    /* Closing the window early stops the decode at the next MCU row */
+    jpeg_decode_cancel(decoder);
+    pthread_join(thread, NULL);
+
+    display_destroy(display);
+
+    if (job.result != 0 && job.result != JPEG_DECODE_CANCELLED) {
+        fprintf(stderr, "Full decode did not complete\n");
+    }
+    return result;
+}
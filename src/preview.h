@@ -0,0 +1,17 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "../include/jpeg_types.h"
+#include "image_cache.h"
+
+/* Decode the thumbnail embedded in a parsed file's EXIF data to RGB (or
+ * grayscale) pixels, freed with jpeg_free. Returns -1 if there is none or
+ * it cannot be decoded. Does not touch the full image's decode state. */
+int jpeg_decode_exif_preview(const jpeg_decoder_t *decoder, decoded_image_t *preview);
+
+/* Open a window showing the preview at once, decode the full image on a
+ * background thread and swap it in when it is ready. Closing the window
+ * early cancels the decode. */
+int view_with_preview(jpeg_decoder_t *decoder, const decoded_image_t *preview);
+
+#endif /* PREVIEW_H */
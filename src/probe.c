@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200809L  /* open, read, lseek */
+#include "probe.h"
+#include "exif.h"
+#include "trace.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Bytes requested per read(); headers of typical files fit in one or two */
+#define PROBE_CHUNK_SIZE 4096
+
+/* Incremental reader over a file descriptor */
+typedef struct {
+    int fd;
+    uint8_t buffer[PROBE_CHUNK_SIZE];
+    size_t pos;
+    size_t len;
+    size_t bytes_read;
+} probe_reader_t;
+
+static int probe_fill(probe_reader_t *reader) {
+    ssize_t n;
+    trace_begin("read chunk");
+    do {
+        n = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+    } while (n < 0 && errno == EINTR);
+    trace_end();
+
+    if (n <= 0) {
+        return -1;
+    }
+    reader->pos = 0;
+    reader->len = (size_t)n;
+    reader->bytes_read += (size_t)n;
+    return 0;
+}
+
+static int probe_byte(probe_reader_t *reader) {
+    if (reader->pos >= reader->len && probe_fill(reader) < 0) {
+        return -1;
+    }
+    return reader->buffer[reader->pos++];
+}
+
+static int probe_bytes(probe_reader_t *reader, uint8_t *dest, size_t count) {
+    while (count > 0) {
+        if (reader->pos >= reader->len && probe_fill(reader) < 0) {
+            return -1;
+        }
+        size_t avail = reader->len - reader->pos;
+        size_t n = count < avail ? count : avail;
+        memcpy(dest, reader->buffer + reader->pos, n);
+        reader->pos += n;
+        dest += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* Skip from the buffer first; anything beyond it is a seek, not a read */
+static int probe_skip(probe_reader_t *reader, size_t count) {
+    size_t avail = reader->len - reader->pos;
+    if (count <= avail) {
+        reader->pos += count;
+        return 0;
+    }
+
+    count -= avail;
+    reader->pos = reader->len;
+    if (lseek(reader->fd, (off_t)count, SEEK_CUR) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int probe_u16(probe_reader_t *reader) {
+    int hi = probe_byte(reader);
+    int lo = probe_byte(reader);
+    if (hi < 0 || lo < 0) {
+        return -1;
+    }
+    return (hi << 8) | lo;
+}
+
+/* Frame header: precision, dimensions and per-component sampling */
+static int probe_sof(probe_reader_t *reader, int length, int sof_type, jpeg_probe_info_t *info) {
+    uint8_t data[6 + 3 * 255];
+    if (length < 6 || length > (int)sizeof(data) || probe_bytes(reader, data, length) < 0) {
+        return -1;
+    }
+
+    info->sof_type = sof_type;
+    info->progressive = (sof_type & 3) == 2;
+    info->precision = data[0];
+    info->height = (data[1] << 8) | data[2];
+    info->width = (data[3] << 8) | data[4];
+    info->num_components = data[5];
+
+    if (info->num_components < 1 || length < 6 + 3 * info->num_components) {
+        return -1;
+    }
+    for (int i = 0; i < info->num_components && i < MAX_COMPONENTS; i++) {
+        info->h_sampling[i] = data[7 + i * 3] >> 4;
+        info->v_sampling[i] = data[7 + i * 3] & 0x0F;
+    }
+    return 0;
+}
+
+/* APP1: EXIF orientation. The IFD0 entries are normally within the first
+ * few hundred bytes, so try a small prefix before reading the whole segment. */
+static int probe_exif(probe_reader_t *reader, int length, jpeg_probe_info_t *info) {
+    uint8_t prefix[512];
+    size_t n = (size_t)length < sizeof(prefix) ? (size_t)length : sizeof(prefix);
+    if (probe_bytes(reader, prefix, n) < 0) {
+        return -1;
+    }
+
+    int result = exif_read_orientation(prefix, n, &info->orientation);
+    if (result != 1 || n == (size_t)length) {
+        return probe_skip(reader, length - n);
+    }
+
+    uint8_t *segment = jpeg_malloc(length);
+    memcpy(segment, prefix, n);
+    if (probe_bytes(reader, segment + n, length - n) < 0) {
+        jpeg_free(segment);
+        return -1;
+    }
+    exif_read_orientation(segment, length, &info->orientation);
+    jpeg_free(segment);
+    return 0;
+}
+
+/* Walk the marker segments. DRI and EXIF may follow the frame header, so the
+ * walk ends at the first SOS (or EOI) rather than at SOF itself. */
+static int probe_segments(probe_reader_t *reader, jpeg_probe_info_t *info) {
+    if (probe_u16(reader) != MARKER_SOI) {
+        fprintf(stderr, "Not a JPEG file (missing SOI marker)\n");
+        return -1;
+    }
+
+    bool have_frame = false;
+
+    while (1) {
+        /* Markers may be preceded by any number of 0xFF fill bytes */
+        int byte = probe_byte(reader);
+        if (byte != 0xFF) {
+            break;
+        }
+        do {
+            byte = probe_byte(reader);
+        } while (byte == 0xFF);
+        if (byte < 0) {
+            break;
+        }
+
+        int marker = 0xFF00 | byte;
+        if (marker == MARKER_SOS || marker == MARKER_EOI) {
+            break;
+        }
+        if ((marker >= MARKER_RST0 && marker <= MARKER_RST7) || marker == 0xFF01) {
+            continue;   /* Standalone markers carry no length */
+        }
+
+        int length = probe_u16(reader);
+        if (length < 2) {
+            fprintf(stderr, "Invalid segment length for marker 0x%04X\n", marker);
+            return -1;
+        }
+        length -= 2;
+
+        int result;
+        if (marker >= MARKER_SOF0 && marker <= 0xFFCF &&
+            marker != MARKER_DHT && marker != 0xFFC8 && marker != 0xFFCC) {
+            result = probe_sof(reader, length, marker - MARKER_SOF0, info);
+            have_frame = result == 0;
+        } else if (marker == MARKER_DRI && length >= 2) {
+            info->restart_interval = probe_u16(reader);
+            result = info->restart_interval < 0 ? -1 : probe_skip(reader, length - 2);
+        } else if (marker == MARKER_APP1) {
+            result = probe_exif(reader, length, info);
+        } else {
+            result = probe_skip(reader, length);
+        }
+
+        if (result < 0) {
+            fprintf(stderr, "Truncated or invalid segment 0x%04X\n", marker);
+            return -1;
+        }
+    }
+
+    if (!have_frame) {
+        fprintf(stderr, "No frame header found\n");
+        return -1;
+    }
+    return 0;
+}
+
+int jpeg_probe_file(const char *filename, jpeg_probe_info_t *info) {
+    memset(info, 0, sizeof(jpeg_probe_info_t));
+    info->orientation = EXIF_ORIENTATION_NORMAL;
+
+    probe_reader_t reader;
+    reader.fd = open(filename, O_RDONLY);
+    if (reader.fd < 0) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        return -1;
+    }
+    reader.pos = 0;
+    reader.len = 0;
+    reader.bytes_read = 0;
+
+    int result = probe_segments(&reader, info);
+    info->bytes_read = reader.bytes_read;
+
+    close(reader.fd);
+    return result;
+}
+
+const char* probe_subsampling_name(const jpeg_probe_info_t *info) {
+    if (info->num_components == 1) {
+        return "gray";
+    }
+    if (info->num_components != 3 ||
+        info->h_sampling[1] != info->h_sampling[2] ||
+        info->v_sampling[1] != info->v_sampling[2] ||
+        info->h_sampling[1] == 0 || info->v_sampling[1] == 0) {
+        return "other";
+    }
+
+    int h = info->h_sampling[0] / info->h_sampling[1];
+    int v = info->v_sampling[0] / info->v_sampling[1];
+    if (h == 1 && v == 1) return "4:4:4";
+    if (h == 2 && v == 1) return "4:2:2";
+    if (h == 2 && v == 2) return "4:2:0";
+    if (h == 1 && v == 2) return "4:4:0";
+    if (h == 4 && v == 1) return "4:1:1";
+    return "other";
+}
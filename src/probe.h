@@ -0,0 +1,29 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "../include/jpeg_types.h"
+
+/* Header summary gathered without touching entropy-coded data */
+typedef struct {
+    int width;
+    int height;
+    int precision;                      /* Sample precision in bits */
+    int num_components;
+    int h_sampling[MAX_COMPONENTS];
+    int v_sampling[MAX_COMPONENTS];
+    bool progressive;                   /* SOF2, SOF6, SOF10 or SOF14 */
+    int sof_type;                       /* n in SOFn */
+    int restart_interval;               /* 0 if no DRI before the first scan */
+    int orientation;                    /* EXIF orientation 1-8, 1 if absent */
+    size_t bytes_read;                  /* File I/O performed by the probe */
+} jpeg_probe_info_t;
+
+/* Read the marker segments of a JPEG file up to its first scan, in small
+ * chunks, seeking over segments that carry nothing of interest. Returns 0
+ * once a frame header has been found, -1 otherwise. */
+int jpeg_probe_file(const char *filename, jpeg_probe_info_t *info);
+
+/* Chroma subsampling label ("4:2:0", "gray", ...) for a probed frame */
+const char* probe_subsampling_name(const jpeg_probe_info_t *info);
+
+#endif /* PROBE_H */
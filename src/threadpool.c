@@ -0,0 +1,173 @@
+#define _DEFAULT_SOURCE  /* syscall() */
+#include "threadpool.h"
+#include "trace.h"
+#include "utils.h"
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct threadpool_job {
+    threadpool_fn fn;
+    void *arg;
+    struct threadpool_job *next;
+} threadpool_job_t;
+
+struct threadpool {
+    pthread_t *threads;
+    int num_threads;
+    int nice_level;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_available;   /* Signalled when a job is queued or on shutdown */
+    pthread_cond_t idle;            /* Signalled when the pool runs out of work */
+
+    threadpool_job_t *head;
+    threadpool_job_t *tail;
+    int active;                     /* Workers currently running a job */
+    int shutdown;
+};
+
+/* Lower the priority of the calling thread */
+static void lower_thread_priority(int nice_level) {
+#ifdef __linux__
+    /* On Linux, nice values are per-thread when addressed by TID */
+    if (nice_level > 0) {
+        pid_t tid = (pid_t)syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, nice_level) != 0) {
+            fprintf(stderr, "Warning: could not lower worker priority\n");
+        }
+    }
+#else
+    (void)nice_level;
+#endif
+}
+
+static void* worker_main(void *arg) {
+    threadpool_t *pool = (threadpool_t*)arg;
+
+    lower_thread_priority(pool->nice_level);
+    trace_thread_name(pool->nice_level > 0 ? "background worker" : "worker");
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->shutdown) {
+            pthread_cond_wait(&pool->job_available, &pool->lock);
+        }
+        if (!pool->head && pool->shutdown) {
+            break;
+        }
+
+        /* Pop next job */
+        threadpool_job_t *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->fn(job->arg);
+        jpeg_free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (!pool->head && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* Create worker pool */
+threadpool_t* threadpool_create(int num_threads, int nice_level) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    threadpool_t *pool = (threadpool_t*)jpeg_malloc(sizeof(threadpool_t));
+    memset(pool, 0, sizeof(threadpool_t));
+    pool->nice_level = nice_level;
+    pool->threads = (pthread_t*)jpeg_malloc(num_threads * sizeof(pthread_t));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            break;
+        }
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+/* Queue a job at the back of the queue */
+int threadpool_submit(threadpool_t *pool, threadpool_fn fn, void *arg) {
+    threadpool_job_t *job = (threadpool_job_t*)jpeg_malloc(sizeof(threadpool_job_t));
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->lock);
+        jpeg_free(job);
+        return -1;
+    }
+
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+
+    pthread_cond_signal(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/* Wait for all queued and running jobs to finish */
+void threadpool_wait(threadpool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head || pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Drain queue and join workers */
+void threadpool_destroy(threadpool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_cond_destroy(&pool->idle);
+    jpeg_free(pool->threads);
+    jpeg_free(pool);
+}
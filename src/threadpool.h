@@ -0,0 +1,23 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/* Job function run on a worker thread */
+typedef void (*threadpool_fn)(void *arg);
+
+/* Opaque fixed-size pool of worker threads with a FIFO job queue */
+typedef struct threadpool threadpool_t;
+
+/* Create a pool of num_threads workers. A positive nice_level lowers the
+ * scheduling priority of the workers (Linux only; ignored elsewhere). */
+threadpool_t* threadpool_create(int num_threads, int nice_level);
+
+/* Queue a job; returns 0 on success */
+int threadpool_submit(threadpool_t *pool, threadpool_fn fn, void *arg);
+
+/* Block until the queue is empty and all workers are idle */
+void threadpool_wait(threadpool_t *pool);
+
+/* Run remaining queued jobs, then stop and join all workers */
+void threadpool_destroy(threadpool_t *pool);
+
+#endif /* THREADPOOL_H */
@@ -0,0 +1,137 @@
+#include "thumbnail.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "utils.h"
+
+/* Area-average resize of one plane. Each output sample averages the source
+ * rectangle it covers (at least one sample, so this also handles the odd
+ * chroma plane that must grow slightly). */
+static void resize_plane(const uint8_t *src, int src_width, int src_height, size_t src_stride,
+                         uint8_t *dst, int dst_width, int dst_height) {
+    uint32_t *column_sums = (uint32_t*)jpeg_malloc(src_width * sizeof(uint32_t));
+
+    for (int y = 0; y < dst_height; y++) {
+        int y0 = (int)((int64_t)y * src_height / dst_height);
+        int y1 = (int)((int64_t)(y + 1) * src_height / dst_height);
+        if (y1 <= y0) y1 = y0 + 1;
+
+        /* Sum the covered source rows once, then average across columns */
+        memset(column_sums, 0, src_width * sizeof(uint32_t));
+        for (int sy = y0; sy < y1; sy++) {
+            const uint8_t *row = src + (size_t)sy * src_stride;
+            for (int x = 0; x < src_width; x++) {
+                column_sums[x] += row[x];
+            }
+        }
+
+        uint8_t *out = dst + (size_t)y * dst_width;
+        for (int x = 0; x < dst_width; x++) {
+            int x0 = (int)((int64_t)x * src_width / dst_width);
+            int x1 = (int)((int64_t)(x + 1) * src_width / dst_width);
+            if (x1 <= x0) x1 = x0 + 1;
+
+            uint32_t sum = 0;
+            for (int sx = x0; sx < x1; sx++) {
+                sum += column_sums[sx];
+            }
+            uint32_t count = (uint32_t)(x1 - x0) * (y1 - y0);
+            out[x] = (uint8_t)((sum + count / 2) / count);
+        }
+    }
+
+    jpeg_free(column_sums);
+}
+
+/* Decode -> resize planes -> encode */
+int make_thumbnail(const char *input, const char *output, int max_size,
+                   const encoder_options_t *options) {
+    double t_start = jpeg_time_us();
+
+    jpeg_decoder_t *decoder = jpeg_parser_init(input);
+    if (!decoder) {
+        fprintf(stderr, "Failed to parse JPEG file\n");
+        return -1;
+    }
+
+    int num_components = decoder->frame.num_components;
+    if (num_components != 1 && num_components != 3) {
+        fprintf(stderr, "Unsupported number of components: %d\n", num_components);
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+
+    /* Component planes only; the color conversion step is skipped */
+    if (jpeg_decode(decoder) != 0) {
+        fprintf(stderr, "Failed to decode JPEG data\n");
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+    double t_decoded = jpeg_time_us();
+
+    int width = decoder->frame.width;
+    int height = decoder->frame.height;
+    int thumb_width = width;
+    int thumb_height = height;
+    if (width > max_size || height > max_size) {
+        if (width >= height) {
+            thumb_width = max_size;
+            thumb_height = (int)(((int64_t)height * max_size + width / 2) / width);
+        } else {
+            thumb_height = max_size;
+            thumb_width = (int)(((int64_t)width * max_size + height / 2) / height);
+        }
+        if (thumb_width < 1) thumb_width = 1;
+        if (thumb_height < 1) thumb_height = 1;
+    }
+
+    /* Resize each plane straight to its size in the output sampling */
+    uint8_t *planes[MAX_COMPONENTS] = { NULL };
+    size_t strides[MAX_COMPONENTS];
+    for (int c = 0; c < num_components; c++) {
+        component_info_t *comp = &decoder->frame.components[c];
+        int src_width = (width * comp->h_sampling + decoder->max_h_sampling - 1) /
+                        decoder->max_h_sampling;
+        int src_height = (height * comp->v_sampling + decoder->max_v_sampling - 1) /
+                         decoder->max_v_sampling;
+
+        int dst_width = thumb_width;
+        int dst_height = thumb_height;
+        if (c > 0 && options->subsampling != CHROMA_444) {
+            dst_width = (thumb_width + 1) / 2;
+        }
+        if (c > 0 && options->subsampling == CHROMA_420) {
+            dst_height = (thumb_height + 1) / 2;
+        }
+
+        planes[c] = (uint8_t*)jpeg_malloc((size_t)dst_width * dst_height);
+        strides[c] = dst_width;
+        resize_plane(decoder->component_buffers[c], src_width, src_height,
+                     decoder->component_width[c], planes[c], dst_width, dst_height);
+    }
+    double t_resized = jpeg_time_us();
+
+    jpeg_writer_t writer;
+    jpeg_writer_init(&writer, (size_t)thumb_width * thumb_height);
+    int result = jpeg_encode_planes(&writer, (const uint8_t *const *)planes, strides,
+                                    thumb_width, thumb_height, num_components, options);
+    if (result == 0) {
+        result = jpeg_writer_save(&writer, output);
+    }
+    double t_end = jpeg_time_us();
+
+    if (result == 0) {
+        JPEG_LOG("Thumbnail %dx%d -> %dx%d (%zu bytes)\n",
+                 width, height, thumb_width, thumb_height, writer.size);
+        JPEG_LOG("  Decode: %8.2f ms\n", (t_decoded - t_start) / 1000.0);
+        JPEG_LOG("  Resize: %8.2f ms\n", (t_resized - t_decoded) / 1000.0);
+        JPEG_LOG("  Encode: %8.2f ms\n", (t_end - t_resized) / 1000.0);
+        JPEG_LOG("Saved output to: %s\n", output);
+    }
+
+    for (int c = 0; c < num_components; c++) {
+        jpeg_free(planes[c]);
+    }
+    jpeg_writer_free(&writer);
+    jpeg_parser_destroy(decoder);
+    return result;
+}
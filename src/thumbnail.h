@@ -0,0 +1,12 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include "encoder.h"
+
+/* Decode a JPEG, shrink it so neither side exceeds max_size and encode the
+ * result. Works on the decoder's Y/Cb/Cr planes throughout: no RGB image is
+ * ever produced. Images already within max_size are re-encoded as-is. */
+int make_thumbnail(const char *input, const char *output, int max_size,
+                   const encoder_options_t *options);
+
+#endif /* THUMBNAIL_H */
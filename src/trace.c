@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 199309L  /* clock_gettime */
+#include "trace.h"
+#include "utils.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct {
+    const char *name;           /* NULL for an end event */
+    const char *arg_name;       /* NULL: no argument */
+    long arg;
+    double ts;                  /* Microseconds since trace_open */
+} trace_event_t;
+
+/* Events are appended to fixed-size chunks, so recording never moves them */
+typedef struct trace_chunk {
+    trace_event_t events[TRACE_CHUNK_EVENTS];
+    int count;
+    struct trace_chunk *next;
+} trace_chunk_t;
+
+/* One thread's buffer; only that thread appends to it */
+typedef struct trace_thread {
+    int tid;
+    const char *name;
+    trace_chunk_t *head;
+    trace_chunk_t *tail;
+    struct trace_thread *next;
+} trace_thread_t;
+
+/* Set before and cleared after any traced thread runs */
+static bool trace_active;
+static FILE *trace_file;
+static struct timespec trace_start;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+/* Registry of every thread's buffer, taken once per thread */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_thread_t *threads;
+static int next_tid = 1;
+
+static void create_key(void) {
+    pthread_key_create(&thread_key, NULL);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - trace_start.tv_sec) * 1000000.0 +
+           (ts.tv_nsec - trace_start.tv_nsec) / 1000.0;
+}
+
+/* The calling thread's buffer, registered on first use */
+static trace_thread_t* current_thread(void) {
+    pthread_once(&key_once, create_key);
+    trace_thread_t *thread = (trace_thread_t*)pthread_getspecific(thread_key);
+    if (thread) {
+        return thread;
+    }
+
+    thread = (trace_thread_t*)jpeg_malloc(sizeof(trace_thread_t));
+    memset(thread, 0, sizeof(trace_thread_t));
+
+    pthread_mutex_lock(&registry_lock);
+    thread->tid = next_tid++;
+    thread->next = threads;
+    threads = thread;
+    pthread_mutex_unlock(&registry_lock);
+
+    pthread_setspecific(thread_key, thread);
+    return thread;
+}
+
+static void record(const char *name, const char *arg_name, long arg) {
+    if (!trace_active) {
+        return;
+    }
+
+    double ts = now_us();
+    trace_thread_t *thread = current_thread();
+    trace_chunk_t *chunk = thread->tail;
+    if (!chunk || chunk->count == TRACE_CHUNK_EVENTS) {
+        chunk = (trace_chunk_t*)jpeg_malloc(sizeof(trace_chunk_t));
+        chunk->count = 0;
+        chunk->next = NULL;
+        if (thread->tail) {
+            thread->tail->next = chunk;
+        } else {
+            thread->head = chunk;
+        }
+        thread->tail = chunk;
+    }
+
+    trace_event_t *event = &chunk->events[chunk->count++];
+    event->name = name;
+    event->arg_name = arg_name;
+    event->arg = arg;
+    event->ts = ts;
+}
+
+int trace_open(const char *path) {
+    /* Fail now rather than after the work being traced */
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        fprintf(stderr, "Cannot create trace file: %s\n", path);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    trace_active = true;
+    return 0;
+}
+
+bool trace_enabled(void) {
+    return trace_active;
+}
+
+void trace_thread_name(const char *name) {
+    if (trace_active) {
+        current_thread()->name = name;
+    }
+}
+
+void trace_begin(const char *name) {
+    record(name, NULL, 0);
+}
+
+void trace_begin_arg(const char *name, const char *arg_name, long arg) {
+    record(name, arg_name, arg);
+}
+
+void trace_end(void) {
+    record(NULL, NULL, 0);
+}
+
+/* Write every thread's events as Chrome Trace Event JSON */
+static int write_trace(FILE *file) {
+    int pid = (int)getpid();
+    size_t num_events = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (trace_thread_t *thread = threads; thread; thread = thread->next) {
+        if (thread->name) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, thread->tid,
+                    thread->name);
+            first = false;
+        }
+        for (trace_chunk_t *chunk = thread->head; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; i++) {
+                const trace_event_t *event = &chunk->events[i];
+                fprintf(file, "%s{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                        first ? "" : ",\n", event->name ? 'B' : 'E', event->ts, pid, thread->tid);
+                if (event->name) {
+                    fprintf(file, ",\"name\":\"%s\"", event->name);
+                }
+                if (event->arg_name) {
+                    fprintf(file, ",\"args\":{\"%s\":%ld}", event->arg_name, event->arg);
+                }
+                fputc('}', file);
+                first = false;
+                num_events++;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to write trace file\n");
+        return -1;
+    }
+    JPEG_LOG("Wrote %zu trace events\n", num_events);
+    return 0;
+}
+
+void trace_close(void) {
+    if (!trace_active) {
+        return;
+    }
+    trace_active = false;
+
+    write_trace(trace_file);
+    trace_file = NULL;
+
+    while (threads) {
+        trace_thread_t *thread = threads;
+        threads = thread->next;
+        while (thread->head) {
+            trace_chunk_t *chunk = thread->head;
+            thread->head = chunk->next;
+            jpeg_free(chunk);
+        }
+        jpeg_free(thread);
+    }
+    pthread_once(&key_once, create_key);
+    pthread_setspecific(thread_key, NULL);
+}
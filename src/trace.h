@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+/*
+ * Timeline of begin/end events for chrome://tracing and Perfetto. Every
+ * thread appends to its own buffer without locking; the buffers are merged
+ * into Chrome Trace Event JSON by trace_close. Names and argument names
+ * must be string literals (they are stored, not copied). All calls are
+ * no-ops unless tracing was started with trace_open.
+ */
+
+/* Start recording; the trace is written to path by trace_close */
+int trace_open(const char *path);
+
+/* Write the trace and stop recording. Call once every traced thread has
+ * finished (e.g. with atexit). */
+void trace_close(void);
+
+bool trace_enabled(void);
+
+/* Name the calling thread in the viewer */
+void trace_thread_name(const char *name);
+
+/* Open and close a slice on the calling thread; slices nest */
+void trace_begin(const char *name);
+void trace_begin_arg(const char *name, const char *arg_name, long arg);
+void trace_end(void);
+
+#endif /* TRACE_H */
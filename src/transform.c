@@ -0,0 +1,333 @@
+#include "transform.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "jpeg_writer.h"
+#include "utils.h"
+
+/* Quantized coefficient plane: blocks_w x blocks_h blocks of 64 coefficients */
+typedef struct {
+    int16_t *blocks;
+    int blocks_w;
+    int blocks_h;
+} coef_plane_t;
+
+static const struct {
+    const char *name;
+    transform_op_t op;
+} transform_names[] = {
+    { "none",       TRANSFORM_NONE },
+    { "flip-h",     TRANSFORM_FLIP_H },
+    { "flip-v",     TRANSFORM_FLIP_V },
+    { "transpose",  TRANSFORM_TRANSPOSE },
+    { "transverse", TRANSFORM_TRANSVERSE },
+    { "rot90",      TRANSFORM_ROT90 },
+    { "rot180",     TRANSFORM_ROT180 },
+    { "rot270",     TRANSFORM_ROT270 }
+};
+
+int transform_from_name(const char *name, transform_op_t *op) {
+    for (size_t i = 0; i < sizeof(transform_names) / sizeof(transform_names[0]); i++) {
+        if (strcmp(name, transform_names[i].name) == 0) {
+            *op = transform_names[i].op;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int parse_crop_geometry(const char *text, transform_options_t *options) {
+    int w, h, x = 0, y = 0;
+    int n = sscanf(text, "%dx%d+%d+%d", &w, &h, &x, &y);
+    if ((n != 2 && n != 4) || w <= 0 || h <= 0 || x < 0 || y < 0) {
+        return -1;
+    }
+
+    options->crop_width = w;
+    options->crop_height = h;
+    options->crop_x = x;
+    options->crop_y = y;
+    return 0;
+}
+
+/* Every transform is an optional transpose followed by mirroring the
+ * output horizontally and/or vertically */
+static void op_geometry(transform_op_t op, int *transpose, int *mirror_x, int *mirror_y) {
+    *transpose = 0;
+    *mirror_x = 0;
+    *mirror_y = 0;
+
+    switch (op) {
+        case TRANSFORM_NONE:                                          break;
+        case TRANSFORM_FLIP_H:     *mirror_x = 1;                     break;
+        case TRANSFORM_FLIP_V:     *mirror_y = 1;                     break;
+        case TRANSFORM_ROT180:     *mirror_x = 1; *mirror_y = 1;      break;
+        case TRANSFORM_TRANSPOSE:  *transpose = 1;                    break;
+        case TRANSFORM_ROT90:      *transpose = 1; *mirror_x = 1;     break;
+        case TRANSFORM_ROT270:     *transpose = 1; *mirror_y = 1;     break;
+        case TRANSFORM_TRANSVERSE: *transpose = 1; *mirror_x = 1; *mirror_y = 1; break;
+    }
+}
+
+/* In the DCT domain, transposing a block transposes its coefficients and
+ * mirroring negates the odd horizontal (or vertical) frequencies. */
+static void build_block_map(int transpose, int mirror_x, int mirror_y,
+                            int src_index[BLOCK_SIZE], int sign[BLOCK_SIZE]) {
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            int k = v * 8 + u;
+            src_index[k] = transpose ? u * 8 + v : k;
+            sign[k] = 1;
+            if (mirror_x && (u & 1)) sign[k] = -sign[k];
+            if (mirror_y && (v & 1)) sign[k] = -sign[k];
+        }
+    }
+}
+
+/* Visit the blocks of the output in interleaved MCU order, either counting
+ * symbols (writer == NULL) or entropy coding them */
+static void code_planes(const coef_plane_t *planes, const frame_header_t *frame,
+                        int mcu_w, int mcu_h, jpeg_writer_t *writer,
+                        const huffman_table_t *dc_tables, const huffman_table_t *ac_tables,
+                        huffman_freq_t *freqs) {
+    int16_t predictors[MAX_COMPONENTS] = { 0 };
+
+    for (int mcu_row = 0; mcu_row < mcu_h; mcu_row++) {
+        for (int mcu_col = 0; mcu_col < mcu_w; mcu_col++) {
+            for (int c = 0; c < frame->num_components; c++) {
+                const component_info_t *comp = &frame->components[c];
+                const coef_plane_t *plane = &planes[c];
+
+                for (int v = 0; v < comp->v_sampling; v++) {
+                    for (int h = 0; h < comp->h_sampling; h++) {
+                        int bx = mcu_col * comp->h_sampling + h;
+                        int by = mcu_row * comp->v_sampling + v;
+                        const int16_t *block = plane->blocks +
+                                               ((size_t)by * plane->blocks_w + bx) * BLOCK_SIZE;
+
+                        if (writer) {
+                            jpeg_encode_block(writer, block, &predictors[c],
+                                              &dc_tables[comp->dc_table_id],
+                                              &ac_tables[comp->ac_table_id]);
+                        } else {
+                            jpeg_count_block(block, &predictors[c],
+                                             freqs[comp->dc_table_id].dc,
+                                             freqs[comp->ac_table_id].ac);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Lossless transform of a baseline JPEG */
+int jpeg_transform_file(const char *input, const char *output,
+                        const transform_options_t *options) {
+    double t_start = jpeg_time_us();
+
+    jpeg_decoder_t *decoder = jpeg_parser_init(input);
+    if (!decoder) {
+        fprintf(stderr, "Failed to parse JPEG file\n");
+        return -1;
+    }
+
+    frame_header_t *src_frame = &decoder->frame;
+    if (src_frame->num_components != 1 && src_frame->num_components != 3) {
+        fprintf(stderr, "Unsupported number of components: %d\n", src_frame->num_components);
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+
+    int16_t *src_coefs[MAX_COMPONENTS];
+    if (jpeg_read_coefficients(decoder, src_coefs) != 0) {
+        fprintf(stderr, "Failed to read DCT coefficients\n");
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+    double t_read = jpeg_time_us();
+
+    int transpose, mirror_x, mirror_y;
+    op_geometry(options->op, &transpose, &mirror_x, &mirror_y);
+
+    /* A partial MCU can only stay on the right/bottom edge: trim it from any
+     * source axis that gets mirrored */
+    int trim_x = transpose ? mirror_y : mirror_x;
+    int trim_y = transpose ? mirror_x : mirror_y;
+    int src_w = trim_x ? src_frame->width / decoder->mcu_size_x * decoder->mcu_size_x
+                       : src_frame->width;
+    int src_h = trim_y ? src_frame->height / decoder->mcu_size_y * decoder->mcu_size_y
+                       : src_frame->height;
+
+    if (src_w == 0 || src_h == 0) {
+        fprintf(stderr, "Image is smaller than one MCU; cannot transform losslessly\n");
+        for (int c = 0; c < src_frame->num_components; c++) jpeg_free(src_coefs[c]);
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+    if (src_w != src_frame->width || src_h != src_frame->height) {
+        JPEG_LOG("Trimmed partial MCUs: %dx%d -> %dx%d\n",
+                 src_frame->width, src_frame->height, src_w, src_h);
+    }
+
+    /* Output frame: swap sampling factors when transposing */
+    frame_header_t frame = *src_frame;
+    int full_w = transpose ? src_h : src_w;
+    int full_h = transpose ? src_w : src_h;
+    int max_h = 1, max_v = 1;
+
+    for (int c = 0; c < frame.num_components; c++) {
+        component_info_t *comp = &frame.components[c];
+        const component_info_t *src_comp = &src_frame->components[c];
+
+        if (frame.num_components == 1) {
+            comp->h_sampling = 1;
+            comp->v_sampling = 1;
+        } else {
+            comp->h_sampling = transpose ? src_comp->v_sampling : src_comp->h_sampling;
+            comp->v_sampling = transpose ? src_comp->h_sampling : src_comp->v_sampling;
+        }
+        comp->dc_table_id = (c == 0) ? 0 : 1;
+        comp->ac_table_id = (c == 0) ? 0 : 1;
+
+        if (comp->h_sampling > max_h) max_h = comp->h_sampling;
+        if (comp->v_sampling > max_v) max_v = comp->v_sampling;
+    }
+
+    /* Crop in output coordinates, offset snapped down to an MCU boundary */
+    int mcu_px = max_h * 8;
+    int mcu_py = max_v * 8;
+    int x0 = 0, y0 = 0;
+    int out_w = full_w, out_h = full_h;
+
+    if (options->crop_width > 0) {
+        x0 = options->crop_x / mcu_px * mcu_px;
+        y0 = options->crop_y / mcu_py * mcu_py;
+        if (x0 >= full_w || y0 >= full_h) {
+            fprintf(stderr, "Crop offset %d,%d is outside the %dx%d image\n",
+                    options->crop_x, options->crop_y, full_w, full_h);
+            for (int c = 0; c < src_frame->num_components; c++) jpeg_free(src_coefs[c]);
+            jpeg_parser_destroy(decoder);
+            return -1;
+        }
+
+        out_w = options->crop_width + (options->crop_x - x0);
+        out_h = options->crop_height + (options->crop_y - y0);
+        if (out_w > full_w - x0) out_w = full_w - x0;
+        if (out_h > full_h - y0) out_h = full_h - y0;
+        JPEG_LOG("Crop: %dx%d at %d,%d (MCU aligned)\n", out_w, out_h, x0, y0);
+    }
+
+    frame.width = (uint16_t)out_w;
+    frame.height = (uint16_t)out_h;
+
+    int out_mcu_w = (out_w + mcu_px - 1) / mcu_px;
+    int out_mcu_h = (out_h + mcu_py - 1) / mcu_py;
+
+    /* Move and transform every block */
+    int src_index[BLOCK_SIZE], sign[BLOCK_SIZE];
+    build_block_map(transpose, mirror_x, mirror_y, src_index, sign);
+
+    coef_plane_t planes[MAX_COMPONENTS];
+    for (int c = 0; c < frame.num_components; c++) {
+        const component_info_t *comp = &frame.components[c];
+        const component_info_t *src_comp = &src_frame->components[c];
+        coef_plane_t *plane = &planes[c];
+
+        plane->blocks_w = out_mcu_w * comp->h_sampling;
+        plane->blocks_h = out_mcu_h * comp->v_sampling;
+        size_t count = (size_t)plane->blocks_w * plane->blocks_h * BLOCK_SIZE;
+        plane->blocks = (int16_t*)jpeg_malloc(count * sizeof(int16_t));
+        memset(plane->blocks, 0, count * sizeof(int16_t));
+
+        /* Source grid, and its extent after trimming */
+        int src_bw = decoder->mcu_width * src_comp->h_sampling;
+        int src_bh = decoder->mcu_height * src_comp->v_sampling;
+        int trim_bw = trim_x ? src_w / decoder->mcu_size_x * src_comp->h_sampling : src_bw;
+        int trim_bh = trim_y ? src_h / decoder->mcu_size_y * src_comp->v_sampling : src_bh;
+        int full_bw = transpose ? trim_bh : trim_bw;
+        int full_bh = transpose ? trim_bw : trim_bh;
+        int crop_bx = x0 / mcu_px * comp->h_sampling;
+        int crop_by = y0 / mcu_py * comp->v_sampling;
+
+        for (int oy = 0; oy < plane->blocks_h; oy++) {
+            for (int ox = 0; ox < plane->blocks_w; ox++) {
+                int px = ox + crop_bx;
+                int py = oy + crop_by;
+                if (mirror_x) px = full_bw - 1 - px;
+                if (mirror_y) py = full_bh - 1 - py;
+
+                int sx = transpose ? py : px;
+                int sy = transpose ? px : py;
+                if (sx < 0 || sy < 0 || sx >= src_bw || sy >= src_bh) {
+                    continue;  /* Padding beyond the source: leave zero */
+                }
+
+                const int16_t *src = src_coefs[c] + ((size_t)sy * src_bw + sx) * BLOCK_SIZE;
+                int16_t *dst = plane->blocks + ((size_t)oy * plane->blocks_w + ox) * BLOCK_SIZE;
+                for (int k = 0; k < BLOCK_SIZE; k++) {
+                    dst[k] = (int16_t)(src[src_index[k]] * sign[k]);
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < src_frame->num_components; c++) {
+        jpeg_free(src_coefs[c]);
+    }
+
+    /* Quantization tables follow the coefficients through a transpose */
+    quantization_table_t quant_tables[MAX_QUANT_TABLES];
+    for (int i = 0; i < MAX_QUANT_TABLES; i++) {
+        quant_tables[i] = decoder->quant_tables[i];
+        if (transpose) {
+            for (int v = 0; v < 8; v++) {
+                for (int u = 0; u < 8; u++) {
+                    quant_tables[i].table[v * 8 + u] = decoder->quant_tables[i].table[u * 8 + v];
+                }
+            }
+        }
+    }
+    double t_transform = jpeg_time_us();
+
+    /* Two passes: gather statistics, then code with optimized tables */
+    huffman_freq_t freqs[MAX_HUFFMAN_TABLES];
+    memset(freqs, 0, sizeof(freqs));
+    code_planes(planes, &frame, out_mcu_w, out_mcu_h, NULL, NULL, NULL, freqs);
+
+    huffman_table_t dc_tables[MAX_HUFFMAN_TABLES];
+    huffman_table_t ac_tables[MAX_HUFFMAN_TABLES];
+    memset(dc_tables, 0, sizeof(dc_tables));
+    memset(ac_tables, 0, sizeof(ac_tables));
+    int num_tables = frame.num_components > 1 ? 2 : 1;
+    for (int i = 0; i < num_tables; i++) {
+        jpeg_build_optimal_table(freqs[i].dc, &dc_tables[i]);
+        jpeg_build_optimal_table(freqs[i].ac, &ac_tables[i]);
+    }
+
+    jpeg_writer_t writer;
+    jpeg_writer_init(&writer, decoder->data_size + 1024);
+    jpeg_write_headers(&writer, &frame, quant_tables, dc_tables, ac_tables);
+    code_planes(planes, &frame, out_mcu_w, out_mcu_h, &writer, dc_tables, ac_tables, NULL);
+    jpeg_write_trailer(&writer);
+
+    for (int c = 0; c < frame.num_components; c++) {
+        jpeg_free(planes[c].blocks);
+    }
+
+    int result = jpeg_writer_save(&writer, output);
+    double t_end = jpeg_time_us();
+
+    if (result == 0) {
+        JPEG_LOG("Transformed %dx%d -> %dx%d (%zu -> %zu bytes)\n",
+                 src_frame->width, src_frame->height, out_w, out_h,
+                 decoder->data_size, writer.size);
+        JPEG_LOG("  Coefficient decode: %8.2f ms\n", (t_read - t_start) / 1000.0);
+        JPEG_LOG("  Block transform:    %8.2f ms\n", (t_transform - t_read) / 1000.0);
+        JPEG_LOG("  Entropy encode:     %8.2f ms\n", (t_end - t_transform) / 1000.0);
+        JPEG_LOG("Saved output to: %s\n", output);
+    }
+
+    jpeg_writer_free(&writer);
+    jpeg_parser_destroy(decoder);
+    return result;
+}
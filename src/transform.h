@@ -0,0 +1,40 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "../include/jpeg_types.h"
+
+/* Lossless transforms, performed on quantized DCT coefficients */
+typedef enum {
+    TRANSFORM_NONE,
+    TRANSFORM_FLIP_H,       /* Mirror left-right */
+    TRANSFORM_FLIP_V,       /* Mirror top-bottom */
+    TRANSFORM_TRANSPOSE,    /* Mirror across the main diagonal */
+    TRANSFORM_TRANSVERSE,   /* Mirror across the anti-diagonal */
+    TRANSFORM_ROT90,        /* Rotate 90 degrees clockwise */
+    TRANSFORM_ROT180,
+    TRANSFORM_ROT270
+} transform_op_t;
+
+typedef struct {
+    transform_op_t op;
+    /* Crop of the transformed image; crop_width == 0 keeps the whole image.
+     * The offset is rounded down to an MCU boundary. */
+    int crop_x;
+    int crop_y;
+    int crop_width;
+    int crop_height;
+} transform_options_t;
+
+/* Parse a transform name (rot90, rot180, rot270, flip-h, flip-v,
+ * transpose, transverse, none) */
+int transform_from_name(const char *name, transform_op_t *op);
+
+/* Parse a crop geometry of the form WxH+X+Y (offset optional) */
+int parse_crop_geometry(const char *text, transform_options_t *options);
+
+/* Transform a baseline JPEG without decoding it to pixels. Partial MCUs on
+ * an edge that would have to move to the opposite side are trimmed. */
+int jpeg_transform_file(const char *input, const char *output,
+                        const transform_options_t *options);
+
+#endif /* TRANSFORM_H */
@@ -0,0 +1,320 @@
+#include "upsample.h"
+#include "utils.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Source row, clamped to the valid rows (edge rows are replicated) */
+static const uint8_t* src_row(const upsampler_t *u, int row) {
+    if (row < 0) {
+        row = 0;
+    } else if (row >= u->src_height) {
+        row = u->src_height - 1;
+    }
+    return u->src + (size_t)row * u->src_stride;
+}
+
+/* ---- Fast (replicating) kernels ---- */
+
+/* Same resolution, or vertical replication only: no copy needed */
+static const uint8_t* fast_h1(upsampler_t *u, int y) {
+    return src_row(u, y * u->v_den / u->v_num);
+}
+
+static const uint8_t* fast_h2(upsampler_t *u, int y) {
+    const uint8_t *in = src_row(u, y * u->v_den / u->v_num);
+    uint8_t *out = u->row;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        for (; x + 16 <= u->src_width; x += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(in + x));
+            _mm_storeu_si128((__m128i*)(out + 2 * x), _mm_unpacklo_epi8(v, v));
+            _mm_storeu_si128((__m128i*)(out + 2 * x + 16), _mm_unpackhi_epi8(v, v));
+        }
+    }
+#endif
+
+    for (; x < u->src_width; x++) {
+        out[2 * x] = out[2 * x + 1] = in[x];
+    }
+    return out;
+}
+
+static const uint8_t* fast_h4(upsampler_t *u, int y) {
+    const uint8_t *in = src_row(u, y * u->v_den / u->v_num);
+    uint8_t *out = u->row;
+
+    for (int x = 0; x < u->src_width; x++) {
+        uint8_t v = in[x];
+        out[4 * x] = out[4 * x + 1] = out[4 * x + 2] = out[4 * x + 3] = v;
+    }
+    return out;
+}
+
+/* Any other ratio (including non-integer ones): nearest sample */
+static const uint8_t* fast_generic(upsampler_t *u, int y) {
+    const uint8_t *in = src_row(u, y * u->v_den / u->v_num);
+    uint8_t *out = u->row;
+    int out_width = u->src_width * u->h_num / u->h_den;
+
+    for (int x = 0; x < out_width; x++) {
+        out[x] = in[x * u->h_den / u->h_num];
+    }
+    return out;
+}
+
+/* ---- Fancy (triangle filter) kernels ----
+ * Each output sample sits a quarter (h2/v2) or an eighth (h4) of an input
+ * sample from its nearest input; the first and last columns only have one
+ * neighbor and are handled outside the inner loops. */
+
+/* libjpeg h2v1_fancy_upsample: 3/4 nearer + 1/4 further sample */
+static const uint8_t* fancy_h2v1(upsampler_t *u, int y) {
+    const uint8_t *in = src_row(u, y);
+    uint8_t *out = u->row;
+    int last = u->src_width - 1;
+
+    if (last == 0) {
+        out[0] = out[1] = in[0];
+        return out;
+    }
+
+    out[0] = in[0];
+    out[1] = (uint8_t)((in[0] * 3 + in[1] + 2) >> 2);
+
+    int x = 1;
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i two = _mm_set1_epi16(2);
+
+        for (; x + 9 <= u->src_width; x += 8) {
+            __m128i prev = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in + x - 1)), zero);
+            __m128i cur = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in + x)), zero);
+            __m128i next = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in + x + 1)), zero);
+            __m128i cur3 = _mm_add_epi16(cur, _mm_add_epi16(cur, cur));
+
+            __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, prev), one), 2);
+            __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, next), two), 2);
+            even = _mm_packus_epi16(even, even);
+            odd = _mm_packus_epi16(odd, odd);
+            _mm_storeu_si128((__m128i*)(out + 2 * x), _mm_unpacklo_epi8(even, odd));
+        }
+    }
+#endif
+
+    for (; x < last; x++) {
+        int cur = in[x] * 3;
+        out[2 * x] = (uint8_t)((cur + in[x - 1] + 1) >> 2);
+        out[2 * x + 1] = (uint8_t)((cur + in[x + 1] + 2) >> 2);
+    }
+
+    out[2 * last] = (uint8_t)((in[last] * 3 + in[last - 1] + 1) >> 2);
+    out[2 * last + 1] = in[last];
+    return out;
+}
+
+/* libjpeg h1v2_fancy_upsample: rows only, biased 1 above and 2 below */
+static const uint8_t* fancy_h1v2(upsampler_t *u, int y) {
+    int row = y >> 1;
+    int lower = y & 1;
+    const uint8_t *near = src_row(u, row);
+    const uint8_t *far = src_row(u, lower ? row + 1 : row - 1);
+    uint8_t *out = u->row;
+    int bias = lower ? 2 : 1;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias_v = _mm_set1_epi16((short)bias);
+
+        for (; x + 16 <= u->src_width; x += 16) {
+            __m128i n = _mm_loadu_si128((const __m128i*)(near + x));
+            __m128i f = _mm_loadu_si128((const __m128i*)(far + x));
+            __m128i n_lo = _mm_unpacklo_epi8(n, zero);
+            __m128i n_hi = _mm_unpackhi_epi8(n, zero);
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(n_lo, _mm_add_epi16(n_lo, n_lo)),
+                                       _mm_add_epi16(_mm_unpacklo_epi8(f, zero), bias_v));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(n_hi, _mm_add_epi16(n_hi, n_hi)),
+                                       _mm_add_epi16(_mm_unpackhi_epi8(f, zero), bias_v));
+            _mm_storeu_si128((__m128i*)(out + x),
+                             _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+        }
+    }
+#endif
+
+    for (; x < u->src_width; x++) {
+        out[x] = (uint8_t)((near[x] * 3 + far[x] + bias) >> 2);
+    }
+    return out;
+}
+
+/* libjpeg h2v2_fancy_upsample: vertical 3:1 column sums, then horizontal
+ * 3:1 on the sums (9:3:3:1 overall) */
+static const uint8_t* fancy_h2v2(upsampler_t *u, int y) {
+    int row = y >> 1;
+    const uint8_t *near = src_row(u, row);
+    const uint8_t *far = src_row(u, (y & 1) ? row + 1 : row - 1);
+    int16_t *colsum = u->colsum;
+    uint8_t *out = u->row;
+    int width = u->src_width;
+    int last = width - 1;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; x + 8 <= width; x += 8) {
+            __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(near + x)), zero);
+            __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(far + x)), zero);
+            _mm_storeu_si128((__m128i*)(colsum + x),
+                             _mm_add_epi16(_mm_add_epi16(n, _mm_add_epi16(n, n)), f));
+        }
+    }
+#endif
+
+    for (; x < width; x++) {
+        colsum[x] = (int16_t)(near[x] * 3 + far[x]);
+    }
+
+    if (last == 0) {
+        out[0] = (uint8_t)((colsum[0] * 4 + 8) >> 4);
+        out[1] = (uint8_t)((colsum[0] * 4 + 7) >> 4);
+        return out;
+    }
+
+    out[0] = (uint8_t)((colsum[0] * 4 + 8) >> 4);
+    out[1] = (uint8_t)((colsum[0] * 3 + colsum[1] + 7) >> 4);
+
+    x = 1;
+#ifdef __SSE2__
+    if (jpeg_simd_limit >= JPEG_SIMD_SSE2) {
+        const __m128i eight = _mm_set1_epi16(8);
+        const __m128i seven = _mm_set1_epi16(7);
+
+        for (; x + 9 <= width; x += 8) {
+            __m128i prev = _mm_loadu_si128((const __m128i*)(colsum + x - 1));
+            __m128i cur = _mm_loadu_si128((const __m128i*)(colsum + x));
+            __m128i next = _mm_loadu_si128((const __m128i*)(colsum + x + 1));
+            __m128i cur3 = _mm_add_epi16(cur, _mm_add_epi16(cur, cur));
+
+            __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, prev), eight), 4);
+            __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, next), seven), 4);
+            even = _mm_packus_epi16(even, even);
+            odd = _mm_packus_epi16(odd, odd);
+            _mm_storeu_si128((__m128i*)(out + 2 * x), _mm_unpacklo_epi8(even, odd));
+        }
+    }
+#endif
+
+    for (; x < last; x++) {
+        int cur = colsum[x] * 3;
+        out[2 * x] = (uint8_t)((cur + colsum[x - 1] + 8) >> 4);
+        out[2 * x + 1] = (uint8_t)((cur + colsum[x + 1] + 7) >> 4);
+    }
+
+    out[2 * last] = (uint8_t)((colsum[last] * 3 + colsum[last - 1] + 8) >> 4);
+    out[2 * last + 1] = (uint8_t)((colsum[last] * 4 + 7) >> 4);
+    return out;
+}
+
+/* h4v1 (4:1:1): outputs at -3/8, -1/8, +1/8, +3/8 of an input sample */
+static const uint8_t* fancy_h4v1(upsampler_t *u, int y) {
+    const uint8_t *in = src_row(u, y);
+    uint8_t *out = u->row;
+    int last = u->src_width - 1;
+
+    if (last == 0) {
+        memset(out, in[0], 4);
+        return out;
+    }
+
+    out[0] = out[1] = in[0];
+    out[2] = (uint8_t)((in[0] * 7 + in[1] + 4) >> 3);
+    out[3] = (uint8_t)((in[0] * 5 + in[1] * 3 + 4) >> 3);
+
+    for (int x = 1; x < last; x++) {
+        int cur = in[x];
+        int prev = in[x - 1];
+        int next = in[x + 1];
+        uint8_t *o = out + 4 * x;
+        o[0] = (uint8_t)((cur * 5 + prev * 3 + 4) >> 3);
+        o[1] = (uint8_t)((cur * 7 + prev + 4) >> 3);
+        o[2] = (uint8_t)((cur * 7 + next + 4) >> 3);
+        o[3] = (uint8_t)((cur * 5 + next * 3 + 4) >> 3);
+    }
+
+    uint8_t *o = out + 4 * last;
+    o[0] = (uint8_t)((in[last] * 5 + in[last - 1] * 3 + 4) >> 3);
+    o[1] = (uint8_t)((in[last] * 7 + in[last - 1] + 4) >> 3);
+    o[2] = o[3] = in[last];
+    return out;
+}
+
+void upsampler_init(upsampler_t *u, const jpeg_decoder_t *decoder, int comp, bool fast) {
+    const component_info_t *info = &decoder->frame.components[comp];
+
+    memset(u, 0, sizeof(upsampler_t));
+    u->src = decoder->component_buffers[comp];
+    u->src_stride = decoder->component_width[comp];
+    u->h_num = decoder->max_h_sampling;
+    u->h_den = info->h_sampling;
+    u->v_num = decoder->max_v_sampling;
+    u->v_den = info->v_sampling;
+
+    /* Chroma already brought to full resolution by the scaled IDCTs */
+    if (comp > 0 && decoder->idct_upsampling) {
+        u->h_den = u->h_num;
+        u->v_den = u->v_num;
+    }
+
+    /* Same rounding as the encoder's downsampled size */
+    u->src_width = (decoder->frame.width * u->h_den + u->h_num - 1) / u->h_num;
+    u->src_height = (decoder->frame.height * u->v_den + u->v_num - 1) / u->v_num;
+
+    int h_factor = (u->h_num % u->h_den == 0) ? u->h_num / u->h_den : 0;
+    int v_factor = (u->v_num % u->v_den == 0) ? u->v_num / u->v_den : 0;
+
+    if (!fast && v_factor == 1 && h_factor == 2) {
+        u->kernel = fancy_h2v1;
+    } else if (!fast && v_factor == 2 && h_factor == 1) {
+        u->kernel = fancy_h1v2;
+    } else if (!fast && v_factor == 2 && h_factor == 2) {
+        u->kernel = fancy_h2v2;
+        u->colsum = (int16_t*)jpeg_malloc(u->src_width * sizeof(int16_t));
+    } else if (!fast && v_factor == 1 && h_factor == 4) {
+        u->kernel = fancy_h4v1;
+    } else if (h_factor == 1 && v_factor != 0) {
+        u->kernel = fast_h1;
+    } else if (h_factor == 2 && v_factor != 0) {
+        u->kernel = fast_h2;
+    } else if (h_factor == 4 && v_factor != 0) {
+        u->kernel = fast_h4;
+    } else {
+        u->kernel = fast_generic;
+    }
+
+    /* Kernels write whole upsampled input rows, which may exceed frame.width */
+    if (u->kernel != fast_h1) {
+        size_t row_size = (size_t)u->src_width * u->h_num / u->h_den + u->h_num;
+        u->row = (uint8_t*)jpeg_malloc(row_size);
+    }
+}
+
+const uint8_t* upsampler_row(upsampler_t *u, int y) {
+    return u->kernel(u, y);
+}
+
+void upsampler_free(upsampler_t *u) {
+    jpeg_free(u->row);
+    jpeg_free(u->colsum);
+    u->row = NULL;
+    u->colsum = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef UPSAMPLE_H
+#define UPSAMPLE_H
+
+#include "../include/jpeg_types.h"
+
+/* Chroma upsampling for one component, one output row at a time.
+ * Fancy mode uses libjpeg's triangle filter for h2v1, h1v2 and h2v2 (and a
+ * 3:5 / 1:7 triangle for h4v1); fast mode replicates samples. Other ratios
+ * always replicate. h2v1, h1v2 and h2v2 have SSE2 kernels. */
+typedef struct upsampler upsampler_t;
+
+typedef const uint8_t* (*upsample_row_fn)(upsampler_t *upsampler, int y);
+
+struct upsampler {
+    const uint8_t *src;         /* Component plane */
+    size_t src_stride;
+    int src_width;              /* Valid (non-padding) samples per row */
+    int src_height;             /* Valid rows */
+    int h_num, h_den;           /* Output / input ratio horizontally */
+    int v_num, v_den;           /* Output / input ratio vertically */
+    upsample_row_fn kernel;
+    uint8_t *row;               /* Output row buffer (unused for 1:1 widths) */
+    int16_t *colsum;            /* Vertical filter scratch for h2v2 */
+};
+
+/* Set up upsampling of component index comp of a decoded frame */
+void upsampler_init(upsampler_t *upsampler, const jpeg_decoder_t *decoder, int comp,
+                    bool fast);
+
+/* Output row y at full resolution: frame.width samples, possibly pointing
+ * straight into the component plane. Valid until the next call. Needs
+ * source rows up to (y / v_factor) + 1 in fancy mode. */
+const uint8_t* upsampler_row(upsampler_t *upsampler, int y);
+
+void upsampler_free(upsampler_t *upsampler);
+
+#endif /* UPSAMPLE_H */
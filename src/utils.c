@@ -1,7 +1,43 @@
 #include "utils.h"
+#include "trace.h"
+#include <sys/time.h>
+
+/* Zigzag scan order - maps zigzag position to natural (row-major) position */
+const int jpeg_natural_order[BLOCK_SIZE] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* Inverse zigzag - maps natural position to zigzag position */
+const int jpeg_zigzag_order[BLOCK_SIZE] = {
+     0,  1,  5,  6, 14, 15, 27, 28,
+     2,  4,  7, 13, 16, 26, 29, 42,
+     3,  8, 12, 17, 25, 30, 41, 43,
+     9, 11, 18, 24, 31, 40, 44, 53,
+    10, 19, 23, 32, 39, 45, 52, 54,
+    20, 22, 33, 38, 46, 51, 55, 60,
+    21, 34, 37, 47, 50, 56, 59, 61,
+    35, 36, 48, 49, 57, 58, 62, 63
+};
+
+bool jpeg_verbose = true;
+
+jpeg_simd_t jpeg_simd_limit = JPEG_SIMD_AVX2;
+
+/* Relaxed: only the total matters, and allocating threads must not
+ * contend on it */
+static unsigned long malloc_calls;
 
 /* Memory allocation helpers */
 void* jpeg_malloc(size_t size) {
+    __atomic_fetch_add(&malloc_calls, 1, __ATOMIC_RELAXED);
+
     void *ptr = malloc(size);
     if (!ptr) {
         fprintf(stderr, "Memory allocation failed\n");
@@ -16,6 +52,17 @@ void jpeg_free(void *ptr) {
     }
 }
 
+unsigned long jpeg_malloc_calls(void) {
+    return __atomic_load_n(&malloc_calls, __ATOMIC_RELAXED);
+}
+
+uint64_t jpeg_hash_bytes(uint64_t hash, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 /* Initialize bit reader */
 void bit_reader_init(bit_reader_t *reader, const uint8_t *data, size_t data_size) {
     reader->data = data;
@@ -89,28 +136,33 @@ void skip_bits(bit_reader_t *reader, int n) {
     }
 }
 
-/* Read byte from scan data with byte stuffing handling */
+/* Read byte from scan data with byte stuffing handling. A marker (RSTn,
+ * EOI) or the end of the data is not consumed: zeros are returned instead,
+ * so the look-ahead of fill_bit_buffer never runs past a restart marker and
+ * a truncated scan decodes to the end instead of stalling. */
 uint8_t read_byte_from_scan(bit_reader_t *reader) {
     if (reader->byte_pos >= reader->data_size) {
         return 0;
     }
 
-    uint8_t byte = reader->data[reader->byte_pos++];
+    uint8_t byte = reader->data[reader->byte_pos];
 
     /* Handle byte stuffing: 0xFF 0x00 -> 0xFF */
-    if (byte == 0xFF && reader->byte_pos < reader->data_size) {
-        uint8_t next_byte = reader->data[reader->byte_pos];
-        if (next_byte == 0x00) {
-            reader->byte_pos++;  /* Skip the stuffed 0x00 */
+    if (byte == 0xFF) {
+        if (reader->byte_pos + 1 >= reader->data_size ||
+            reader->data[reader->byte_pos + 1] != 0x00) {
+            return 0;  /* Marker: leave it for process_restart or the caller */
         }
+        reader->byte_pos++;  /* Skip the stuffed 0x00 */
     }
+    reader->byte_pos++;
 
     return byte;
 }
 
 /* Fill bit buffer with at least min_bits */
 void fill_bit_buffer(bit_reader_t *reader, int min_bits) {
-    while (reader->bits_in_buffer < min_bits && reader->byte_pos < reader->data_size) {
+    while (reader->bits_in_buffer < min_bits) {
         uint8_t byte = read_byte_from_scan(reader);
         reader->bit_buffer = (reader->bit_buffer << 8) | byte;
         reader->bits_in_buffer += 8;
@@ -161,8 +213,10 @@ uint8_t* load_file(const char *filename, size_t *size) {
     uint8_t *buffer = (uint8_t*)jpeg_malloc(*size);
 
     /* Read file */
+    trace_begin_arg("read file", "bytes", (long)*size);
     size_t read_size = fread(buffer, 1, *size, file);
     fclose(file);
+    trace_end();
 
     if (read_size != *size) {
         fprintf(stderr, "Failed to read complete file\n");
@@ -184,3 +238,9 @@ int clamp(int value, int min, int max) {
     if (value > max) return max;
     return value;
 }
+
+double jpeg_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
@@ -10,10 +10,38 @@
 #define JPEG_ERROR(msg) do { fprintf(stderr, "JPEG Error: %s\n", msg); return -1; } while(0)
 #define JPEG_ERROR_NULL(msg) do { fprintf(stderr, "JPEG Error: %s\n", msg); return NULL; } while(0)
 
+/* Progress and timing output; --quiet clears jpeg_verbose so batch runs
+ * and benchmarks print nothing from the decode path. Set it only at
+ * startup, before any decode, prefetch or pipeline thread is created:
+ * those threads read it without synchronization. */
+extern bool jpeg_verbose;
+#define JPEG_LOG(...) do { if (jpeg_verbose) printf(__VA_ARGS__); } while(0)
+
+/* Widest vector instruction set the decode kernels may use: each kernel
+ * takes the best the CPU supports up to this. --verify lowers it to check
+ * the SIMD kernels against the scalar code. Change it only while no decode
+ * is running, for the same reason as jpeg_verbose. */
+typedef enum {
+    JPEG_SIMD_NONE,
+    JPEG_SIMD_SSE2,
+    JPEG_SIMD_AVX2
+} jpeg_simd_t;
+
+extern jpeg_simd_t jpeg_simd_limit;
+
 /* Memory allocation helpers */
 void* jpeg_malloc(size_t size);
 void jpeg_free(void *ptr);
 
+/* Number of jpeg_malloc calls so far (all threads; plain malloc calls,
+ * e.g. in SDL or libc, are not counted) */
+unsigned long jpeg_malloc_calls(void);
+
+/* FNV-1a (64-bit) of size bytes, continuing from hash; start from
+ * JPEG_HASH_INIT */
+#define JPEG_HASH_INIT 0xcbf29ce484222325ULL
+uint64_t jpeg_hash_bytes(uint64_t hash, const uint8_t *data, size_t size);
+
 /* Bit reader functions */
 void bit_reader_init(bit_reader_t *reader, const uint8_t *data, size_t data_size);
 int read_bit(bit_reader_t *reader);
@@ -33,6 +61,9 @@ uint8_t* load_file(const char *filename, size_t *size);
 
 /* Utility functions */
 uint16_t read_uint16_be(const uint8_t *data);
+
+/* Wall-clock time in microseconds, for stage timings */
+double jpeg_time_us(void);
 int clamp(int value, int min, int max);
 
 #endif /* UTILS_H */
@@ -0,0 +1,857 @@
+#include "verify.h"
+#include "jpeg_parser.h"
+#include "decoder.h"
+#include "color.h"
+#include "encoder.h"
+#include "browser.h"
+#include "libjpeg_ref.h"
+#include "coef_store.h"
+#include "huffman.h"
+#include "utils.h"
+#include <math.h>
+
+/* Decodes of each file whose times are compared; the fastest counts */
+#define VERIFY_TIMING_RUNS 3
+
+#define MAX_HASH_ENTRIES 256
+
+/* One way of decoding a file. min_psnr == 0 means bit-exact with the
+ * reference (the first entry); float_reference variants are compared with
+ * reference_decode at their scale and with their upsampling instead,
+ * luma_only ones with the reference decode's Y plane, and those with a
+ * baseline with that earlier variant's output. */
+typedef struct {
+    const char *name;
+    int threads;
+    idct_method_t idct_method;
+    bool fast_upsampling;
+    bool idct_upsampling;
+    bool decode_into;           /* jpeg_decode_into a caller buffer */
+    bool luma_only;             /* ... as JPEG_PIXEL_GRAY8 */
+    jpeg_simd_t simd;           /* jpeg_simd_limit for the decode */
+    double min_psnr;
+    int max_error;
+    int store_scale;            /* Render from a coef_store at 1/store_scale (0 = decode) */
+    bool float_reference;
+    const char *baseline;
+} verify_variant_t;
+
+/* The first entry is the reference. The simd rows repeat a decode with the
+ * AVX2 kernels (batched islow IDCT, float IDCT), then also the SSE2 ones
+ * (upsampling, float IDCT), replaced by scalar code; the float kernels
+ * differ by a rounding now and then, as FMA rounds once per multiply-add.
+ * The bounds leave 2-3 dB and a few levels of margin over the worst of the
+ * test corpus: ifast degrades most at quality 100. Against the floating-point reference, which clamps its
+ * planes to 0-255 before upsampling as the decoder does, the integer paths
+ * measure 43-54 dB with errors of at most 4, saturated colors included. */
+static const verify_variant_t variants[] = {
+    { "reference",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 0.0,  0,  0, false, NULL },
+    { "threads",        4, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 0.0,  0,  0, false, NULL },
+    { "decode-into",    4, IDCT_ISLOW, false, false, true,  false, JPEG_SIMD_AVX2, 0.0,  0,  0, false, NULL },
+    { "luma-only",      4, IDCT_ISLOW, false, false, true,  true,  JPEG_SIMD_AVX2, 0.0,  0,  0, false, NULL },
+    { "simd-sse2",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_SSE2, 0.0,  0,  0, false, NULL },
+    { "simd-none",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_NONE, 0.0,  0,  0, false, NULL },
+    { "idct-ifast",     1, IDCT_IFAST, false, false, false, false, JPEG_SIMD_AVX2, 30.0, 32, 0, false, NULL },
+    { "idct-float",     1, IDCT_FLOAT, false, false, false, false, JPEG_SIMD_AVX2, 40.0, 6,  0, false, NULL },
+    { "float-sse2",     1, IDCT_FLOAT, false, false, false, false, JPEG_SIMD_SSE2, 50.0, 3,  0, false, "idct-float" },
+    { "float-none",     1, IDCT_FLOAT, false, false, false, false, JPEG_SIMD_NONE, 50.0, 3,  0, false, "idct-float" },
+    { "fast-upsample",  1, IDCT_ISLOW, true,  false, false, false, JPEG_SIMD_AVX2, 41.0, 6,  0, true,  NULL },
+    { "fast-simd-none", 1, IDCT_ISLOW, true,  false, false, false, JPEG_SIMD_NONE, 0.0,  0,  0, false, "fast-upsample" },
+    { "idct-upsample",  1, IDCT_ISLOW, false, true,  false, false, JPEG_SIMD_AVX2, 41.0, 6,  0, true,  NULL },
+    { "store-1/1",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 0.0,  0,  1, false, NULL },
+    { "store-1/2",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 47.0, 6,  2, true,  NULL },
+    { "store-1/4",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 47.0, 6,  4, true,  NULL },
+    { "store-1/8",      1, IDCT_ISLOW, false, false, false, false, JPEG_SIMD_AVX2, 47.0, 6,  8, true,  NULL },
+};
+
+#define NUM_VARIANTS ((int)(sizeof(variants) / sizeof(variants[0])))
+
+/* Versus the system libjpeg (accurate IDCT, fancy upsampling) */
+#define LIBJPEG_MIN_PSNR 40.0
+#define LIBJPEG_MAX_ERROR 6
+
+/* Images encoded on the fly, for what test files rarely cover */
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    int channels;
+    chroma_subsampling_t subsampling;
+    int quality;
+    bool optimize_huffman;
+    bool saturated;             /* Blocks of fully saturated colors */
+} verify_generated_t;
+
+static const verify_generated_t generated[] = {
+    { "generated/444-q95-64x48",      64,  48,  3, CHROMA_444, 95,  false, false },
+    { "generated/422-q75-37x23",      37,  23,  3, CHROMA_422, 75,  false, false },
+    { "generated/420-q50-101x67",     101, 67,  3, CHROMA_420, 50,  false, false },
+    { "generated/420-q90-opt-160x120", 160, 120, 3, CHROMA_420, 90,  true,  false },
+    { "generated/420-q100-17x9",      17,  9,   3, CHROMA_420, 100, false, false },
+    { "generated/420-q85-1x1",        1,   1,   3, CHROMA_420, 85,  false, false },
+    { "generated/gray-q85-33x17",     33,  17,  1, CHROMA_444, 85,  false, false },
+    { "generated/422-q75-sat-203x131", 203, 131, 3, CHROMA_422, 75,  false, true },
+};
+
+#define NUM_GENERATED ((int)(sizeof(generated) / sizeof(generated[0])))
+
+typedef struct {
+    uint8_t *pixels;
+    int width;
+    int height;
+    int channels;
+    double ms;
+} verify_image_t;
+
+typedef struct {
+    char name[256];
+    uint64_t hash;
+} hash_entry_t;
+
+typedef struct {
+    hash_entry_t entries[MAX_HASH_ENTRIES];
+    int count;
+} hash_list_t;
+
+typedef struct {
+    int checks;
+    int failures;
+    double ours_ms;             /* Reference decodes of files libjpeg also decoded */
+    double libjpeg_ms;
+    int timed_files;
+} verify_totals_t;
+
+/* Gradients, hard edges and noise: smooth areas for the IDCT rounding,
+ * edges for ringing and upsampling, noise for long AC runs */
+static void generate_pattern(uint8_t *pixels, int width, int height, int channels) {
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (int)((seed >> 16) & 63) - 32;
+            bool edge = ((x / 5) + (y / 3)) & 1;
+            for (int c = 0; c < channels; c++) {
+                int value;
+                if (x < width / 3) {
+                    value = (x * 255 / (width > 1 ? width - 1 : 1) + c * 80) & 255;
+                } else if (x < 2 * width / 3) {
+                    value = edge ? 230 - c * 60 : 20 + c * 50;
+                } else {
+                    value = 128 + noise + (c - 1) * 40;
+                }
+                pixels[((size_t)y * width + x) * channels + c] = (uint8_t)clamp(value, 0, 255);
+            }
+        }
+    }
+}
+
+/* Primaries, secondaries, black and white in irregular patches: the
+ * chroma overshoots 0-255 at their edges, and clamping matters */
+static void generate_saturated_pattern(uint8_t *pixels, int width, int height, int channels) {
+    static const uint8_t colors[8][3] = {
+        { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0 },
+        { 0, 255, 255 }, { 255, 0, 255 }, { 0, 0, 0 }, { 255, 255, 255 },
+    };
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int index = ((x / 7) + (y / 5) * 3 + (x * y / 97)) & 7;
+            for (int c = 0; c < channels; c++) {
+                pixels[((size_t)y * width + x) * channels + c] = colors[index][c];
+            }
+        }
+    }
+}
+
+static uint8_t* encode_generated(const verify_generated_t *gen, size_t *size) {
+    uint8_t *pixels = (uint8_t*)jpeg_malloc((size_t)gen->width * gen->height * gen->channels);
+    if (gen->saturated) {
+        generate_saturated_pattern(pixels, gen->width, gen->height, gen->channels);
+    } else {
+        generate_pattern(pixels, gen->width, gen->height, gen->channels);
+    }
+
+    encoder_options_t options;
+    encoder_default_options(&options);
+    options.quality = gen->quality;
+    options.subsampling = gen->subsampling;
+    options.optimize_huffman = gen->optimize_huffman;
+
+    jpeg_writer_t writer;
+    jpeg_writer_init(&writer, 4096);
+    int result = jpeg_encode_pixels(&writer, pixels, gen->width, gen->height, gen->channels,
+                                    (size_t)gen->width * gen->channels, &options);
+    jpeg_free(pixels);
+    if (result != 0) {
+        jpeg_writer_free(&writer);
+        return NULL;
+    }
+
+    uint8_t *data = (uint8_t*)jpeg_malloc(writer.size);
+    memcpy(data, writer.data, writer.size);
+    *size = writer.size;
+    jpeg_writer_free(&writer);
+    return data;
+}
+
+static int decode_variant(const uint8_t *data, size_t size, const verify_variant_t *variant,
+                          verify_image_t *image) {
+    memset(image, 0, sizeof(verify_image_t));
+    jpeg_decoder_t *decoder = jpeg_parser_init_memory(data, size);
+    if (!decoder) {
+        return -1;
+    }
+    decoder->decode_threads = variant->threads;
+    decoder->idct_method = variant->idct_method;
+    decoder->fast_upsampling = variant->fast_upsampling;
+    decoder->idct_upsampling = variant->idct_upsampling;
+    jpeg_simd_t simd_limit = jpeg_simd_limit;
+    jpeg_simd_limit = variant->simd;
+
+    int width = decoder->frame.width;
+    int height = decoder->frame.height;
+    int channels = decoder->frame.num_components == 1 || variant->luma_only ? 1 : 3;
+    size_t stride = (size_t)width * channels;
+    image->pixels = (uint8_t*)jpeg_malloc(stride * height);
+
+    double t_start = jpeg_time_us();
+    int result;
+    if (variant->store_scale > 0) {
+        coef_store_t *store = coef_store_read(decoder);
+        decoded_image_t scaled;
+        result = store ? coef_store_render(store, variant->store_scale, variant->idct_method,
+                                           variant->fast_upsampling, &scaled) : -1;
+        coef_store_destroy(store);
+        if (result == 0) {
+            width = scaled.width;
+            height = scaled.height;
+            jpeg_free(image->pixels);
+            image->pixels = scaled.pixels;
+        }
+    } else if (variant->decode_into) {
+        result = jpeg_decode_into(decoder, image->pixels, stride,
+                                  channels == 1 ? JPEG_PIXEL_GRAY8 : JPEG_PIXEL_RGB24);
+    } else {
+        result = jpeg_decode(decoder);
+        if (result == 0) {
+            result = ycbcr_to_rgb(decoder);
+        }
+        if (result == 0) {
+            memcpy(image->pixels, decoder->image_data, stride * height);
+        }
+    }
+    image->ms = (jpeg_time_us() - t_start) / 1000.0;
+    jpeg_parser_destroy(decoder);
+    jpeg_simd_limit = simd_limit;
+
+    if (result != 0) {
+        jpeg_free(image->pixels);
+        image->pixels = NULL;
+        return -1;
+    }
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    return 0;
+}
+
+/* The Y plane of the reference decode (the image itself for grayscale) */
+static int decode_luma_plane(const uint8_t *data, size_t size, verify_image_t *image) {
+    memset(image, 0, sizeof(verify_image_t));
+    jpeg_decoder_t *decoder = jpeg_parser_init_memory(data, size);
+    if (!decoder) {
+        return -1;
+    }
+    decoder->decode_threads = variants[0].threads;
+    decoder->idct_method = variants[0].idct_method;
+    if (jpeg_decode(decoder) != 0) {
+        jpeg_parser_destroy(decoder);
+        return -1;
+    }
+
+    int width = decoder->frame.width;
+    int height = decoder->frame.height;
+    image->pixels = (uint8_t*)jpeg_malloc((size_t)width * height);
+    for (int y = 0; y < height; y++) {
+        memcpy(image->pixels + (size_t)y * width,
+               decoder->component_buffers[0] + (size_t)y * decoder->component_width[0], width);
+    }
+    jpeg_parser_destroy(decoder);
+    image->width = width;
+    image->height = height;
+    image->channels = 1;
+    return 0;
+}
+
+/* Index of the variant called name, or -1 */
+static int find_variant(const char *name) {
+    for (int v = 0; v < NUM_VARIANTS; v++) {
+        if (strcmp(variants[v].name, name) == 0) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+/* Whether a later variant is compared with variant v's output */
+static bool is_baseline(int v) {
+    for (int later = v + 1; later < NUM_VARIANTS; later++) {
+        if (variants[later].baseline && find_variant(variants[later].baseline) == v) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Decode with the system libjpeg, timed */
+static int decode_libjpeg(const uint8_t *data, size_t size, verify_image_t *image) {
+    memset(image, 0, sizeof(verify_image_t));
+    double t_start = jpeg_time_us();
+    int result = libjpeg_decode(data, size, &image->pixels, &image->width, &image->height,
+                                &image->channels);
+    image->ms = (jpeg_time_us() - t_start) / 1000.0;
+    return result;
+}
+
+static uint64_t image_hash(const verify_image_t *image) {
+    uint8_t header[9] = {
+        (uint8_t)(image->width >> 24), (uint8_t)(image->width >> 16),
+        (uint8_t)(image->width >> 8), (uint8_t)image->width,
+        (uint8_t)(image->height >> 24), (uint8_t)(image->height >> 16),
+        (uint8_t)(image->height >> 8), (uint8_t)image->height,
+        (uint8_t)image->channels
+    };
+    uint64_t hash = jpeg_hash_bytes(JPEG_HASH_INIT, header, sizeof(header));
+    return jpeg_hash_bytes(hash, image->pixels,
+                           (size_t)image->width * image->height * image->channels);
+}
+
+/* ---- Floating-point reference decoder ----
+ * Checks the variants the accurate decode cannot: everything after entropy
+ * decoding is computed in double, and rounding happens once, on the final
+ * pixels. The reduced IDCTs and the scaled-IDCT upsampling are all the
+ * 8x8 inverse DCT evaluated on another grid (the coefficients above the
+ * output's Nyquist limit dropped), so one IDCT serves every block size.
+ * Chroma is interpolated linearly between sample centers where the decoder
+ * has a triangle filter for the ratio, and replicated otherwise. */
+
+#define REFERENCE_PI 3.14159265358979323846
+
+typedef enum {
+    REFERENCE_TRIANGLE,         /* Fancy upsampling */
+    REFERENCE_REPLICATE,        /* --fast-upsample */
+    REFERENCE_IDCT              /* --idct-upsample: chroma blocks cover the MCU */
+} reference_upsampling_t;
+
+typedef struct {
+    jpeg_decoder_t *decoder;    /* Parsed, for the frame and quantization tables */
+    int16_t *coefficients[MAX_COMPONENTS];
+} reference_source_t;
+
+typedef struct {
+    double *samples;
+    int stride;
+    int width;                  /* Valid samples, as the decoder's upsampler sees them */
+    int height;
+    int h_num;                  /* Output samples per h_den plane samples */
+    int h_den;
+    int v_num;
+    int v_den;
+    bool triangle;
+} reference_plane_t;
+
+/* cos((2x + 1) u pi / 2n) with the DCT normalization of u folded in */
+static void reference_basis(int n, double basis[16][8]) {
+    for (int x = 0; x < n; x++) {
+        for (int u = 0; u < 8; u++) {
+            double scale = u == 0 ? sqrt(0.5) : 1.0;
+            basis[x][u] = u < n ? scale * cos((2 * x + 1) * u * REFERENCE_PI / (2.0 * n)) : 0.0;
+        }
+    }
+}
+
+/* One block's samples at width x height (1 to 16 each), clamped to 0-255 */
+static void reference_idct(const int16_t *block, const uint8_t *quant, int width, int height,
+                           double *out, int out_stride) {
+    double h_basis[16][8];
+    double v_basis[16][8];
+    double rows[8][16];
+    reference_basis(width, h_basis);
+    reference_basis(height, v_basis);
+
+    for (int v = 0; v < 8; v++) {
+        for (int x = 0; x < width; x++) {
+            double sum = 0.0;
+            for (int u = 0; u < 8; u++) {
+                sum += h_basis[x][u] * block[v * 8 + u] * quant[v * 8 + u];
+            }
+            rows[v][x] = sum;
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            double sum = 0.0;
+            for (int v = 0; v < 8; v++) {
+                sum += v_basis[y][v] * rows[v][x];
+            }
+            /* Saturated like the decoder's planes, which hold 0-255
+             * samples before they are upsampled and converted */
+            double sample = sum / 4.0 + 128.0;
+            out[(size_t)y * out_stride + x] = sample < 0.0 ? 0.0 : (sample > 255.0 ? 255.0 : sample);
+        }
+    }
+}
+
+static double reference_sample(const reference_plane_t *plane, int x, int y) {
+    x = x < 0 ? 0 : (x >= plane->width ? plane->width - 1 : x);
+    y = y < 0 ? 0 : (y >= plane->height ? plane->height - 1 : y);
+    return plane->samples[(size_t)y * plane->stride + x];
+}
+
+/* The plane's value at output pixel (x, y) */
+static double reference_upsample(const reference_plane_t *plane, int x, int y) {
+    if (!plane->triangle) {
+        return reference_sample(plane, x * plane->h_den / plane->h_num,
+                                y * plane->v_den / plane->v_num);
+    }
+
+    double px = (x + 0.5) * plane->h_den / plane->h_num - 0.5;
+    double py = (y + 0.5) * plane->v_den / plane->v_num - 0.5;
+    int x0 = (int)floor(px);
+    int y0 = (int)floor(py);
+    double fx = px - x0;
+    double fy = py - y0;
+    return (reference_sample(plane, x0, y0) * (1.0 - fx) +
+            reference_sample(plane, x0 + 1, y0) * fx) * (1.0 - fy) +
+           (reference_sample(plane, x0, y0 + 1) * (1.0 - fx) +
+            reference_sample(plane, x0 + 1, y0 + 1) * fx) * fy;
+}
+
+static uint8_t reference_pixel(double value) {
+    return (uint8_t)clamp((int)floor(value + 0.5), 0, 255);
+}
+
+/* Decode at 1/scale (as coef_store_render) with the given upsampling */
+static int reference_decode(const reference_source_t *source, int scale,
+                            reference_upsampling_t upsampling, verify_image_t *image) {
+    const jpeg_decoder_t *decoder = source->decoder;
+    const frame_header_t *frame = &decoder->frame;
+    int num_components = frame->num_components;
+
+    memset(image, 0, sizeof(verify_image_t));
+    if (num_components != 1 && num_components != 3) {
+        return -1;
+    }
+    /* As resolve_decode_options: only 4:2:2 and 4:2:0 have scaled-IDCT chroma */
+    const component_info_t *luma = &frame->components[0];
+    if (upsampling == REFERENCE_IDCT &&
+        (num_components != 3 || luma->h_sampling != 2 || luma->v_sampling > 2 ||
+         frame->components[1].h_sampling != 1 || frame->components[1].v_sampling != 1 ||
+         frame->components[2].h_sampling != 1 || frame->components[2].v_sampling != 1)) {
+        upsampling = REFERENCE_TRIANGLE;
+    }
+    image->width = (frame->width + scale - 1) / scale;
+    image->height = (frame->height + scale - 1) / scale;
+    image->channels = num_components;
+
+    reference_plane_t planes[3];
+    for (int c = 0; c < num_components; c++) {
+        const component_info_t *info = &frame->components[c];
+        const uint8_t *quant = decoder->quant_tables[info->quant_table_id].table;
+        reference_plane_t *plane = &planes[c];
+        bool full_size = c > 0 && upsampling == REFERENCE_IDCT;
+        int block_width = full_size ? 8 * decoder->max_h_sampling / info->h_sampling : 8 / scale;
+        int block_height = full_size ? 8 * decoder->max_v_sampling / info->v_sampling : 8 / scale;
+        int blocks_w = decoder->mcu_width * info->h_sampling;
+        int blocks_h = decoder->mcu_height * info->v_sampling;
+
+        plane->stride = blocks_w * block_width;
+        plane->samples = (double*)jpeg_malloc((size_t)plane->stride * blocks_h * block_height *
+                                              sizeof(double));
+        plane->h_num = full_size ? 1 : decoder->max_h_sampling;
+        plane->h_den = full_size ? 1 : info->h_sampling;
+        plane->v_num = full_size ? 1 : decoder->max_v_sampling;
+        plane->v_den = full_size ? 1 : info->v_sampling;
+        plane->width = (image->width * plane->h_den + plane->h_num - 1) / plane->h_num;
+        plane->height = (image->height * plane->v_den + plane->v_num - 1) / plane->v_num;
+
+        /* The ratios upsampler_init has triangle filters for */
+        int h_factor = plane->h_num % plane->h_den == 0 ? plane->h_num / plane->h_den : 0;
+        int v_factor = plane->v_num % plane->v_den == 0 ? plane->v_num / plane->v_den : 0;
+        plane->triangle = upsampling == REFERENCE_TRIANGLE &&
+            ((h_factor == 2 && (v_factor == 1 || v_factor == 2)) ||
+             (h_factor == 1 && v_factor == 2) || (h_factor == 4 && v_factor == 1));
+
+        for (int by = 0; by < blocks_h; by++) {
+            for (int bx = 0; bx < blocks_w; bx++) {
+                reference_idct(source->coefficients[c] + ((size_t)by * blocks_w + bx) * BLOCK_SIZE,
+                               quant, block_width, block_height,
+                               plane->samples + (size_t)by * block_height * plane->stride +
+                               bx * block_width, plane->stride);
+            }
+        }
+    }
+
+    image->pixels = (uint8_t*)jpeg_malloc((size_t)image->width * image->height * image->channels);
+    uint8_t *out = image->pixels;
+    for (int y = 0; y < image->height; y++) {
+        for (int x = 0; x < image->width; x++) {
+            double luma = reference_upsample(&planes[0], x, y);
+            if (num_components == 1) {
+                *out++ = reference_pixel(luma);
+                continue;
+            }
+            double cb = reference_upsample(&planes[1], x, y) - 128.0;
+            double cr = reference_upsample(&planes[2], x, y) - 128.0;
+            *out++ = reference_pixel(luma + 1.402 * cr);
+            *out++ = reference_pixel(luma - 0.344136 * cb - 0.714136 * cr);
+            *out++ = reference_pixel(luma + 1.772 * cb);
+        }
+    }
+
+    for (int c = 0; c < num_components; c++) {
+        jpeg_free(planes[c].samples);
+    }
+    return 0;
+}
+
+/* Parse and entropy-decode once for every reference decode of a file */
+static int reference_open(const uint8_t *data, size_t size, reference_source_t *source) {
+    source->decoder = jpeg_parser_init_memory(data, size);
+    if (!source->decoder) {
+        return -1;
+    }
+    if (jpeg_read_coefficients(source->decoder, source->coefficients) != 0) {
+        jpeg_parser_destroy(source->decoder);
+        source->decoder = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void reference_close(reference_source_t *source) {
+    if (!source->decoder) {
+        return;
+    }
+    for (int c = 0; c < MAX_COMPONENTS; c++) {
+        jpeg_free(source->coefficients[c]);
+    }
+    jpeg_parser_destroy(source->decoder);
+    source->decoder = NULL;
+}
+
+/* Compare against the reference; returns false if the sizes differ */
+static bool compare_images(const verify_image_t *a, const verify_image_t *b,
+                           double *psnr, int *max_error) {
+    if (a->width != b->width || a->height != b->height || a->channels != b->channels) {
+        return false;
+    }
+
+    size_t count = (size_t)a->width * a->height * a->channels;
+    double sum_squares = 0.0;
+    int worst = 0;
+    for (size_t i = 0; i < count; i++) {
+        int diff = abs((int)a->pixels[i] - (int)b->pixels[i]);
+        sum_squares += (double)diff * diff;
+        if (diff > worst) {
+            worst = diff;
+        }
+    }
+    *max_error = worst;
+    *psnr = sum_squares > 0.0 ? 10.0 * log10(255.0 * 255.0 * count / sum_squares) : INFINITY;
+    return true;
+}
+
+/* "hex name" per line; # starts a comment */
+static void load_hashes(const char *path, hash_list_t *list) {
+    list->count = 0;
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), file) && list->count < MAX_HASH_ENTRIES) {
+        hash_entry_t *entry = &list->entries[list->count];
+        unsigned long long hash;
+        if (line[0] == '#' || sscanf(line, "%16llx %255s", &hash, entry->name) != 2) {
+            continue;
+        }
+        entry->hash = (uint64_t)hash;
+        list->count++;
+    }
+    fclose(file);
+}
+
+static const hash_entry_t* find_hash(const hash_list_t *list, const char *name) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->entries[i].name, name) == 0) {
+            return &list->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int save_hashes(const char *path, const hash_list_t *list) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write hash file: %s\n", path);
+        return -1;
+    }
+    fprintf(file, "# Reference decodes (accurate IDCT, one thread, triangle upsampling):\n");
+    fprintf(file, "# FNV-1a of width, height, channels and pixels. Regenerate with\n");
+    fprintf(file, "# jpeg_viewer --verify --update-hashes test\n");
+    for (int i = 0; i < list->count; i++) {
+        fprintf(file, "%016llx %s\n", (unsigned long long)list->entries[i].hash,
+                list->entries[i].name);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/* Hashes of files are keyed by file name so the check does not depend on
+ * the directory it runs from */
+static const char* hash_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void check(verify_totals_t *totals, bool passed) {
+    totals->checks++;
+    if (!passed) {
+        totals->failures++;
+    }
+}
+
+/* Run every variant of one image; key names its hash */
+static void verify_image(const char *name, const char *key, const uint8_t *data, size_t size,
+                         const hash_list_t *stored, hash_list_t *computed,
+                         bool update_hashes, verify_totals_t *totals) {
+    printf("%s (%zu bytes)\n", name, size);
+
+    verify_image_t reference;
+    if (decode_variant(data, size, &variants[0], &reference) != 0) {
+        printf("  %-14s FAILED to decode\n", variants[0].name);
+        check(totals, false);
+        return;
+    }
+    for (int run = 1; run < VERIFY_TIMING_RUNS; run++) {
+        verify_image_t again;
+        if (decode_variant(data, size, &variants[0], &again) == 0) {
+            reference.ms = again.ms < reference.ms ? again.ms : reference.ms;
+            jpeg_free(again.pixels);
+        }
+    }
+
+    uint64_t hash = image_hash(&reference);
+    const hash_entry_t *expected = find_hash(stored, key);
+    printf("  %-14s %dx%dx%d, %.2f ms, hash %016llx", variants[0].name, reference.width,
+           reference.height, reference.channels, reference.ms, (unsigned long long)hash);
+    if (update_hashes || !expected) {
+        printf(update_hashes ? " (stored)\n" : " (no stored hash)\n");
+    } else {
+        printf(expected->hash == hash ? " ok\n" : " MISMATCH (stored %016llx)\n",
+               (unsigned long long)expected->hash);
+        check(totals, expected->hash == hash);
+    }
+    if (computed->count < MAX_HASH_ENTRIES) {
+        hash_entry_t *entry = &computed->entries[computed->count++];
+        snprintf(entry->name, sizeof(entry->name), "%s", key);
+        entry->hash = hash;
+    }
+
+    reference_source_t source;
+    memset(&source, 0, sizeof(source));
+    verify_image_t outputs[NUM_VARIANTS];
+    memset(outputs, 0, sizeof(outputs));
+    for (int v = 1; v < NUM_VARIANTS; v++) {
+        const verify_variant_t *variant = &variants[v];
+        verify_image_t image;
+        double psnr;
+        int max_error;
+        if (decode_variant(data, size, variant, &image) != 0) {
+            printf("  %-14s FAILED to decode\n", variant->name);
+            check(totals, false);
+            continue;
+        }
+
+        verify_image_t expected_image = reference;
+        const char *expected_name = "the reference";
+        if (variant->baseline) {
+            int baseline = find_variant(variant->baseline);
+            if (baseline < 0 || !outputs[baseline].pixels) {
+                printf("  %-14s FAILED: no %s output\n", variant->name, variant->baseline);
+                check(totals, false);
+                jpeg_free(image.pixels);
+                continue;
+            }
+            expected_image = outputs[baseline];
+            expected_name = variant->baseline;
+        } else if (variant->luma_only) {
+            if (decode_luma_plane(data, size, &expected_image) != 0) {
+                printf("  %-14s FAILED: no reference Y plane\n", variant->name);
+                check(totals, false);
+                jpeg_free(image.pixels);
+                continue;
+            }
+            expected_name = "the reference Y plane";
+        } else if (variant->float_reference) {
+            reference_upsampling_t upsampling = variant->idct_upsampling ? REFERENCE_IDCT
+                : (variant->fast_upsampling ? REFERENCE_REPLICATE : REFERENCE_TRIANGLE);
+            int scale = variant->store_scale > 0 ? variant->store_scale : 1;
+            if ((!source.decoder && reference_open(data, size, &source) != 0) ||
+                reference_decode(&source, scale, upsampling, &expected_image) != 0) {
+                printf("  %-14s FAILED: no floating-point reference\n", variant->name);
+                check(totals, false);
+                jpeg_free(image.pixels);
+                continue;
+            }
+        }
+        bool passed = compare_images(&expected_image, &image, &psnr, &max_error);
+        if (variant->luma_only || variant->float_reference) {
+            jpeg_free(expected_image.pixels);
+        }
+        if (!passed) {
+            printf("  %-14s FAILED: %dx%dx%d output\n", variant->name,
+                   image.width, image.height, image.channels);
+        } else if (variant->min_psnr == 0.0) {
+            passed = max_error == 0;
+            if (passed) {
+                printf("  %-14s bit-exact\n", variant->name);
+            } else {
+                printf("  %-14s DIFFERS from %s\n", variant->name, expected_name);
+            }
+        } else {
+            passed = psnr >= variant->min_psnr && max_error <= variant->max_error;
+            printf("  %-14s PSNR %.2f dB, max error %d%s\n", variant->name, psnr, max_error,
+                   passed ? "" : "  OUT OF BOUNDS");
+        }
+        check(totals, passed);
+        if (is_baseline(v)) {
+            outputs[v] = image;
+        } else {
+            jpeg_free(image.pixels);
+        }
+    }
+    reference_close(&source);
+    for (int v = 0; v < NUM_VARIANTS; v++) {
+        jpeg_free(outputs[v].pixels);
+    }
+
+    verify_image_t system;
+    if (!libjpeg_available()) {
+        /* Reported once in the summary */
+    } else if (decode_libjpeg(data, size, &system) != 0) {
+        printf("  %-14s could not decode (skipped)\n", "libjpeg");
+    } else {
+        for (int run = 1; run < VERIFY_TIMING_RUNS; run++) {
+            verify_image_t again;
+            if (decode_libjpeg(data, size, &again) == 0) {
+                system.ms = again.ms < system.ms ? again.ms : system.ms;
+                jpeg_free(again.pixels);
+            }
+        }
+
+        double psnr;
+        int max_error;
+        bool passed = compare_images(&reference, &system, &psnr, &max_error) &&
+                      psnr >= LIBJPEG_MIN_PSNR && max_error <= LIBJPEG_MAX_ERROR;
+        printf("  %-14s PSNR %.2f dB, max error %d, %.2f ms (ours %.2fx)%s\n", "libjpeg",
+               psnr, max_error, system.ms, system.ms > 0.0 ? reference.ms / system.ms : 0.0,
+               passed ? "" : "  OUT OF BOUNDS");
+        check(totals, passed);
+        totals->ours_ms += reference.ms;
+        totals->libjpeg_ms += system.ms;
+        totals->timed_files++;
+        jpeg_free(system.pixels);
+    }
+
+    jpeg_free(reference.pixels);
+}
+
+/* The compiled-in Annex K tables must be what the table builder makes */
+static void verify_standard_huffman_tables(verify_totals_t *totals) {
+    bool passed = true;
+    for (int table_class = 0; table_class < 2; table_class++) {
+        for (int id = 0; id < 2; id++) {
+            huffman_table_t loaded;
+            huffman_table_t built;
+            load_standard_huffman_table(&loaded, table_class, id);
+            huffman_standard_contents(&built, table_class, id);
+            generate_huffman_codes(&built);
+            passed = passed && loaded.is_set && loaded.codes_generated &&
+                memcmp(loaded.bits, built.bits, sizeof(built.bits)) == 0 &&
+                memcmp(loaded.huffval, built.huffval, sizeof(built.huffval)) == 0 &&
+                memcmp(loaded.codes, built.codes, sizeof(built.codes)) == 0 &&
+                memcmp(loaded.code_lengths, built.code_lengths, sizeof(built.code_lengths)) == 0 &&
+                memcmp(loaded.lookup, built.lookup, sizeof(built.lookup)) == 0;
+        }
+    }
+    printf("Annex K Huffman tables: compiled-in tables %s a runtime build\n\n",
+           passed ? "match" : "DIFFER from");
+    check(totals, passed);
+}
+
+int verify_run(char **inputs, int num_inputs, const char *hash_file, bool update_hashes) {
+    char **paths = NULL;
+    int count = collect_image_paths(inputs, num_inputs, &paths);
+
+    /* Library progress output would bury the report */
+    jpeg_verbose = false;
+
+    hash_list_t *stored = (hash_list_t*)jpeg_malloc(sizeof(hash_list_t));
+    hash_list_t *computed = (hash_list_t*)jpeg_malloc(sizeof(hash_list_t));
+    load_hashes(hash_file, stored);
+    computed->count = 0;
+    if (!update_hashes && stored->count == 0) {
+        printf("No reference hashes in %s\n", hash_file);
+    }
+
+    verify_totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    verify_standard_huffman_tables(&totals);
+
+    for (int i = 0; i < count; i++) {
+        size_t size;
+        uint8_t *data = load_file(paths[i], &size);
+        if (!data) {
+            check(&totals, false);
+            continue;
+        }
+        verify_image(paths[i], hash_name(paths[i]), data, size, stored, computed, update_hashes, &totals);
+        jpeg_free(data);
+    }
+    free_image_paths(paths, count);
+
+    for (int i = 0; i < NUM_GENERATED; i++) {
+        size_t size;
+        uint8_t *data = encode_generated(&generated[i], &size);
+        if (!data) {
+            printf("%s: could not encode\n", generated[i].name);
+            check(&totals, false);
+            continue;
+        }
+        verify_image(generated[i].name, generated[i].name, data, size, stored, computed, update_hashes, &totals);
+        jpeg_free(data);
+    }
+
+    if (!libjpeg_available()) {
+        printf("\nBuilt without libjpeg: no comparison with the system decoder\n");
+    } else if (totals.timed_files > 0) {
+        printf("\nSpeed over %d images: ours %.2f ms, libjpeg %.2f ms (ours %.2fx the time)\n",
+               totals.timed_files, totals.ours_ms, totals.libjpeg_ms,
+               totals.libjpeg_ms > 0.0 ? totals.ours_ms / totals.libjpeg_ms : 0.0);
+    }
+
+    int result = 0;
+    if (update_hashes) {
+        result = save_hashes(hash_file, computed);
+        if (result == 0) {
+            printf("Wrote %d hashes to %s\n", computed->count, hash_file);
+        }
+    }
+    printf("%d of %d checks passed over %d files and %d generated images\n",
+           totals.checks - totals.failures, totals.checks, count, NUM_GENERATED);
+
+    jpeg_free(stored);
+    jpeg_free(computed);
+    return totals.failures == 0 && result == 0 ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "../include/jpeg_types.h"
+
+/* Regression check of the decode kernels. Every JPEG under inputs, plus a
+ * corpus generated with the encoder (sizes that are not MCU multiples,
+ * every sampling, grayscale, optimized tables), is decoded through each
+ * variant: threaded and caller-buffer decodes must match the reference
+ * (accurate IDCT, one thread, triangle upsampling) bit for bit, as must a
+ * full-size render from a coef_store; the approximate IDCTs and upsamplers
+ * and the reduced-scale renders must stay within a PSNR and max-error
+ * bound. Reference outputs are checked against the hashes in hash_file
+ * (when it exists), and, when built with the system libjpeg, against
+ * libjpeg's output and speed. With update_hashes the file is rewritten
+ * instead. Returns 0 if everything passed. */
+int verify_run(char **inputs, int num_inputs, const char *hash_file, bool update_hashes);
+
+#endif /* VERIFY_H */
@@ -0,0 +1,85 @@
+/* Build-time generator of the Annex K Huffman tables: builds the four
+ * tables with the decoder's own generate_huffman_codes and prints them as
+ * static initializers for huffman.c. Usage: gen_huffman_tables > FILE */
+#include "../src/huffman.h"
+#include <stdio.h>
+
+static const char *table_names[2][2] = {
+    { "DC luminance", "DC chrominance" },
+    { "AC luminance", "AC chrominance" }
+};
+
+/* Entries up to the last nonzero one; the rest are zero-initialized */
+static int used_length(const unsigned *values, int count) {
+    while (count > 0 && values[count - 1] == 0) {
+        count--;
+    }
+    return count;
+}
+
+static void print_array(const char *name, const unsigned *values, int count, bool hex) {
+    printf("        .%s = {", name);
+    for (int i = 0; i < used_length(values, count); i++) {
+        printf(i % 12 == 0 ? "\n            " : " ");
+        printf(hex ? "0x%02x," : "%u,", values[i]);
+    }
+    printf("\n        },\n");
+}
+
+static void print_table(const huffman_table_t *table) {
+    unsigned values[256];
+
+    for (int i = 0; i < 17; i++) {
+        values[i] = table->bits[i];
+    }
+    print_array("bits", values, 17, false);
+    for (int i = 0; i < 256; i++) {
+        values[i] = table->huffval[i];
+    }
+    print_array("huffval", values, 256, true);
+    for (int i = 0; i < 256; i++) {
+        values[i] = table->codes[i];
+    }
+    print_array("codes", values, 256, true);
+    for (int i = 0; i < 256; i++) {
+        values[i] = table->code_lengths[i];
+    }
+    print_array("code_lengths", values, 256, false);
+
+    /* Lookup entries as { symbol, bits } pairs */
+    int last = 1 << HUFF_LOOKAHEAD;
+    while (last > 0 && table->lookup[last - 1].bits == 0) {
+        last--;
+    }
+    printf("        .lookup = {");
+    for (int i = 0; i < last; i++) {
+        printf(i % 6 == 0 ? "\n            " : " ");
+        printf("{0x%02x, %u},", table->lookup[i].symbol, table->lookup[i].bits);
+    }
+    printf("\n        },\n");
+    printf("        .is_set = true,\n        .codes_generated = true\n");
+}
+
+int main(void) {
+    printf("/* Generated by tools/gen_huffman_tables.c at build time: the Annex K.3\n");
+    printf(" * Huffman tables with codes and lookup built, [class][id]. */\n\n");
+    printf("static const huffman_table_t std_tables[2][2] = {\n");
+    for (int table_class = 0; table_class < 2; table_class++) {
+        printf("    {\n");
+        for (int id = 0; id < 2; id++) {
+            huffman_table_t table;
+            huffman_standard_contents(&table, table_class, id);
+            generate_huffman_codes(&table);
+            if (!table.codes_generated) {
+                fprintf(stderr, "Failed to build the %s table\n", table_names[table_class][id]);
+                return 1;
+            }
+            printf("    {   /* %s */\n", table_names[table_class][id]);
+            print_table(&table);
+            printf("    },\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n");
+    return 0;
+}